@@ -0,0 +1,194 @@
+// Microbenchmark for Region::updateLiveness.
+//
+// Compares the bitset engine against the std::set dataflow it replaced
+// (reproduced below as `setLiveness`), on a function shaped like a loop
+// after ConstLoopUnroll has copied its body many times:
+//   - an entry block defining `width` values that stay live until the exit;
+//   - a header with `width` phis;
+//   - `copies` body blocks in a chain, each defining `width` new values
+//     from the ones of the previous block, the last one jumping back.
+// Both must agree on every live-in and live-out set.
+//
+// Build the compiler with test.py first, then:
+//   clang++ -std=c++17 -O2 bench/Liveness.cpp build/codegen/codegen.a -o build/bench-liveness
+//   build/bench-liveness [copies] [width] [rounds]
+
+#include "../src/codegen/CodeGen.h"
+#include "../src/codegen/Attrs.h"
+#include "../src/codegen/Ops.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <set>
+#include <vector>
+
+using namespace sys;
+
+namespace {
+
+using LiveMap = std::map<BasicBlock*, std::set<Op*>>;
+
+// The old Region::updateLiveness, writing to `liveIn` and `liveOut` instead of the blocks.
+void setLiveness(Region *region, LiveMap &liveIn, LiveMap &liveOut) {
+  region->updatePreds();
+  liveIn.clear();
+  liveOut.clear();
+
+  std::map<BasicBlock*, std::set<Op*>> phis;
+  std::map<BasicBlock*, std::set<Op*>> upwardExposed;
+  std::map<BasicBlock*, std::set<Op*>> defined;
+
+  for (auto bb : region->getBlocks()) {
+    for (auto op : bb->getOps()) {
+      if (isa<PhiOp>(op)) {
+        phis[bb].insert(op);
+        continue;
+      }
+
+      defined[bb].insert(op);
+      for (auto value : op->getOperands()) {
+        if (!defined[bb].count(value.defining))
+          upwardExposed[bb].insert(value.defining);
+      }
+    }
+  }
+
+  bool changed;
+  do {
+    changed = false;
+    for (auto bb : region->getBlocks()) {
+      auto liveInOld = liveIn[bb];
+
+      std::set<Op*> out;
+      for (auto succ : bb->succs) {
+        std::set_difference(
+          liveIn[succ].begin(), liveIn[succ].end(),
+          phis[succ].begin(), phis[succ].end(),
+          std::inserter(out, out.end())
+        );
+        for (auto phi : phis[succ]) {
+          auto &ops = phi->getOperands();
+          auto &attrs = phi->getAttrs();
+          for (size_t i = 0; i < ops.size(); i++) {
+            if (FROM(attrs[i]) == bb)
+              out.insert(ops[i].defining);
+          }
+        }
+      }
+
+      liveOut[bb] = out;
+
+      auto &in = liveIn[bb];
+      in.clear();
+      std::set_difference(
+        out.begin(), out.end(),
+        defined[bb].begin(), defined[bb].end(),
+        std::inserter(in, in.end())
+      );
+      for (auto x : upwardExposed[bb])
+        in.insert(x);
+      for (auto x : phis[bb])
+        in.insert(x);
+
+      if (liveInOld != in)
+        changed = true;
+    }
+  } while (changed);
+}
+
+FuncOp *buildUnrolled(ModuleOp *module, int copies, int width) {
+  Builder builder;
+  builder.setToRegionStart(module->getRegion());
+  auto func = builder.create<FuncOp>({ new NameAttr("unrolled"), new ArgCountAttr(0) });
+  auto region = func->appendRegion();
+
+  auto entry = region->appendBlock();
+  auto header = region->appendBlock();
+  std::vector<BasicBlock*> body;
+  for (int i = 0; i < copies; i++)
+    body.push_back(region->appendBlock());
+  auto exit = region->appendBlock();
+
+  builder.setToBlockEnd(entry);
+  std::vector<Op*> early;
+  for (int j = 0; j < width; j++)
+    early.push_back(builder.create<IntOp>({ new IntAttr(j) }));
+  builder.create<GotoOp>({ new TargetAttr(header) });
+
+  builder.setToBlockEnd(header);
+  std::vector<Op*> phis;
+  for (int j = 0; j < width; j++)
+    phis.push_back(builder.create<PhiOp>());
+  builder.create<BranchOp>({ Value(phis[0]) }, { new TargetAttr(body[0]), new ElseAttr(exit) });
+
+  std::vector<Op*> prev = phis;
+  for (int i = 0; i < copies; i++) {
+    builder.setToBlockEnd(body[i]);
+    std::vector<Op*> next;
+    for (int j = 0; j < width; j++)
+      next.push_back(builder.create<AddIOp>({ Value(prev[j]), Value(prev[(j + 1) % width]) }));
+    builder.create<GotoOp>({ new TargetAttr(i + 1 < copies ? body[i + 1] : header) });
+    prev = next;
+  }
+
+  for (int j = 0; j < width; j++) {
+    phis[j]->pushOperand(early[j]);
+    phis[j]->add<FromAttr>(entry);
+    phis[j]->pushOperand(prev[j]);
+    phis[j]->add<FromAttr>(body.back());
+  }
+
+  builder.setToBlockEnd(exit);
+  Op *sum = phis[0];
+  for (int j = 0; j < width; j++)
+    sum = builder.create<AddIOp>({ Value(sum), Value(early[j]) });
+  builder.create<ReturnOp>({ Value(sum) });
+  return func;
+}
+
+template<class F>
+double measure(F f) {
+  auto start = std::chrono::steady_clock::now();
+  f();
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+}
+
+int main(int argc, char **argv) {
+  int copies = argc > 1 ? atoi(argv[1]) : 200;
+  int width = argc > 2 ? atoi(argv[2]) : 16;
+  int rounds = argc > 3 ? atoi(argv[3]) : 5;
+
+  auto module = new ModuleOp;
+  module->createFirstBlock();
+  auto func = buildUnrolled(module, copies, width);
+  auto region = func->getRegion();
+
+  LiveMap liveIn, liveOut;
+  double before = measure([&]() {
+    for (int r = 0; r < rounds; r++)
+      setLiveness(region, liveIn, liveOut);
+  });
+  double after = measure([&]() {
+    for (int r = 0; r < rounds; r++)
+      region->updateLiveness();
+  });
+
+  bool same = true;
+  for (auto bb : region->getBlocks()) {
+    if (bb->getLiveIn() != liveIn[bb] || bb->getLiveOut() != liveOut[bb])
+      same = false;
+  }
+
+  std::cout << copies << " copies x " << width << " values, " << rounds << " rounds\n";
+  std::cout << "updateLiveness: std::set " << before << " ms, bitset " << after << " ms ("
+            << before / after << "x)\n";
+  std::cout << (same ? "results match\n" : "RESULTS DIFFER\n");
+
+  delete module;
+  return same ? 0 : 1;
+}
@@ -0,0 +1,165 @@
+// Microbenchmark for use-list maintenance.
+//
+// Compares the intrusive use-chains of Op against the std::set<Op*> bookkeeping
+// they replaced (reproduced below as `SetOp`), on a constant with many users:
+//   - replaceAllUsesWith back and forth between two constants;
+//   - setOperand on every user, flipping between the two constants;
+//   - pushOperand/removeOperand on a phi-like op with users/10 operands.
+//
+// Build the compiler with test.py first, then:
+//   clang++ -std=c++17 -O2 bench/UseList.cpp build/codegen/codegen.a -o build/bench-uselist
+//   build/bench-uselist [users] [rounds]
+
+#include "../src/codegen/CodeGen.h"
+#include "../src/codegen/Attrs.h"
+#include "../src/codegen/Ops.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <set>
+#include <vector>
+
+using namespace sys;
+
+namespace {
+
+// The representation before use-chains, with the same algorithms as the old Op.
+struct SetOp {
+  std::set<SetOp*> uses;
+  std::vector<SetOp*> operands;
+
+  void removeOperandUse(SetOp *def) {
+    for (auto x : operands) {
+      if (x == def)
+        return;
+    }
+    def->uses.erase(this);
+  }
+
+  void pushOperand(SetOp *v) {
+    v->uses.insert(this);
+    operands.push_back(v);
+  }
+
+  void setOperand(int i, SetOp *v) {
+    auto def = operands[i];
+    operands[i] = v;
+    removeOperandUse(def);
+    v->uses.insert(this);
+  }
+
+  void removeOperand(int i) {
+    auto def = operands[i];
+    operands.erase(operands.begin() + i);
+    removeOperandUse(def);
+  }
+
+  void replaceAllUsesWith(SetOp *other) {
+    for (auto use : uses) {
+      for (auto &operand : use->operands) {
+        if (operand != this)
+          continue;
+
+        operand = other;
+        other->uses.insert(use);
+      }
+    }
+    uses.clear();
+  }
+};
+
+template<class F>
+double measure(F f) {
+  auto start = std::chrono::steady_clock::now();
+  f();
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+void report(const char *name, double before, double after) {
+  std::cout << name << ": std::set " << before << " ms, use-chain " << after << " ms ("
+            << before / after << "x)\n";
+}
+
+}
+
+int main(int argc, char **argv) {
+  int users = argc > 1 ? atoi(argv[1]) : 100000;
+  int rounds = argc > 2 ? atoi(argv[2]) : 10;
+  // The old removeOperand is quadratic in the operand count; keep it bearable.
+  int phiOperands = users / 10;
+
+  // --- std::set ---
+  SetOp sa, sb;
+  std::vector<SetOp*> susers;
+  for (int i = 0; i < users; i++) {
+    auto op = new SetOp;
+    op->pushOperand(&sa);
+    op->pushOperand(i % 2 ? &sa : &sb);
+    susers.push_back(op);
+  }
+
+  double setRauw = measure([&]() {
+    for (int r = 0; r < rounds; r++) {
+      sa.replaceAllUsesWith(&sb);
+      sb.replaceAllUsesWith(&sa);
+    }
+  });
+  double setRewrite = measure([&]() {
+    for (int r = 0; r < rounds; r++) {
+      for (auto op : susers)
+        op->setOperand(0, r % 2 ? &sa : &sb);
+    }
+  });
+  SetOp sphi;
+  double setPhi = measure([&]() {
+    for (int r = 0; r < rounds; r++) {
+      for (int i = 0; i < phiOperands; i++)
+        sphi.pushOperand(susers[i]);
+      while (sphi.operands.size())
+        sphi.removeOperand(sphi.operands.size() - 1);
+    }
+  });
+  for (auto op : susers)
+    delete op;
+
+  // --- use-chain ---
+  auto module = new ModuleOp;
+  Builder builder;
+  builder.setToBlockEnd(module->createFirstBlock());
+  auto a = builder.create<IntOp>({ new IntAttr(0) });
+  auto b = builder.create<IntOp>({ new IntAttr(1) });
+  std::vector<Op*> ousers;
+  for (int i = 0; i < users; i++)
+    ousers.push_back(builder.create<AddIOp>({ Value(a), Value(i % 2 ? a : b) }));
+
+  double chainRauw = measure([&]() {
+    for (int r = 0; r < rounds; r++) {
+      a->replaceAllUsesWith(b);
+      b->replaceAllUsesWith(a);
+    }
+  });
+  double chainRewrite = measure([&]() {
+    for (int r = 0; r < rounds; r++) {
+      for (auto op : ousers)
+        op->setOperand(0, r % 2 ? a : b);
+    }
+  });
+  auto phi = builder.create<PhiOp>();
+  double chainPhi = measure([&]() {
+    for (int r = 0; r < rounds; r++) {
+      for (int i = 0; i < phiOperands; i++)
+        phi->pushOperand(ousers[i]);
+      while (phi->getOperandCount())
+        phi->removeOperand(phi->getOperandCount() - 1);
+    }
+  });
+
+  std::cout << users << " users, " << rounds << " rounds\n";
+  report("replaceAllUsesWith", setRauw, chainRauw);
+  report("setOperand", setRewrite, chainRewrite);
+  report("push/removeOperand", setPhi, chainPhi);
+
+  delete module;
+}
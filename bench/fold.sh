@@ -0,0 +1,39 @@
+#!/bin/bash
+
+# Compile-time benchmark for RegularFold.
+#
+# Compiles every program in test/custom twice, once with the worklist driver
+# and once with `--fold-sweep` (the old sweep-until-fixpoint driver),
+# and reports the total wall time, rewrites and rule attempts of each.
+#
+#   bench/fold.sh [sysc] [rounds]
+
+SYSC=${1:-build/sysc}
+ROUNDS=${2:-3}
+OUT=$(mktemp)
+trap 'rm -f $OUT' EXIT
+
+# run <label> [flags...]
+run() {
+  local label=$1
+  shift
+  local folded=0 attempts=0
+  local start=$(date +%s.%N)
+  for round in $(seq $ROUNDS); do
+    for file in test/custom/*.sy; do
+      for target in --rv --arm; do
+        $SYSC $file $target -S -o /dev/null --stats $@ > $OUT 2>&1
+        if [ $round -eq 1 ]; then
+          folded=$((folded + $(awk '/^regular-fold:/ { f = 1; next } /^[^ ]/ { f = 0 } f && /folded-ops/ { s += $3 } END { print s + 0 }' $OUT)))
+          attempts=$((attempts + $(awk '/^regular-fold:/ { f = 1; next } /^[^ ]/ { f = 0 } f && /rule-attempts/ { s += $3 } END { print s + 0 }' $OUT)))
+        fi
+      done
+    done
+  done
+  local end=$(date +%s.%N)
+  printf "%-10s %8.2fs %10d rewrites %12d attempts\n" $label \
+    $(awk "BEGIN { print ($end - $start) / $ROUNDS }") $folded $attempts
+}
+
+run worklist
+run sweep --fold-sweep
@@ -0,0 +1,42 @@
+#!/bin/bash
+
+# Recursion benchmark for the interpreter.
+#
+# Runs every program in bench/recursion under `--compare`, which interprets
+# the module after each pass, and reports the wall time of each.
+# With a second compiler (say, one built from an older commit),
+# runs that one as well, so that the two can be compared side by side.
+# A crash (like a host stack overflow) is reported instead of a time.
+#
+#   bench/interp.sh [sysc] [baseline-sysc]
+
+SYSC=${1:-build/sysc}
+BASELINE=$2
+
+# run <sysc> <program>
+run() {
+  local start=$(date +%s.%N)
+  $1 $2.sy --rv -S -o /dev/null --compare $2.out -i $2.in > /dev/null 2>&1
+  local status=$?
+  local end=$(date +%s.%N)
+  if [ $status -ne 0 ]; then
+    printf "%12s" "exit $status"
+  else
+    printf "%11.2fs" $(awk "BEGIN { print $end - $start }")
+  fi
+}
+
+printf "%-12s %12s" program "sysc"
+[ -n "$BASELINE" ] && printf " %12s" "baseline"
+printf "\n"
+
+for file in bench/recursion/*.sy; do
+  program=${file%.sy}
+  printf "%-12s " $(basename $program)
+  run $SYSC $program
+  if [ -n "$BASELINE" ]; then
+    printf " "
+    run $BASELINE $program
+  fi
+  printf "\n"
+done
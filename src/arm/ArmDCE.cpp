@@ -40,8 +40,6 @@ bool ArmDCE::isImpure(Op *op) {
     IMPURE(SubSpOp)
     IMPURE(PlaceHolderOp)
     IMPURE(CloneOp)
-    IMPURE(JoinOp)
-    IMPURE(WakeOp)
   ;
 }
 
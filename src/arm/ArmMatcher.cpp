@@ -6,117 +6,6 @@
 using namespace sys;
 using namespace sys::arm;
 
-#define MATCH_TERNARY(opcode, Ty) \
-  if (opname == opcode && isa<Ty>(op)) { \
-    return matchExpr(list->elements[1], op->getOperand(0).defining) && \
-           matchExpr(list->elements[2], op->getOperand(1).defining) && \
-           matchExpr(list->elements[3], op->getOperand(2).defining); \
-  }
-
-#define MATCH_BINARY(opcode, Ty) \
-  if (opname == opcode && isa<Ty>(op)) { \
-    return matchExpr(list->elements[1], op->getOperand(0).defining) && \
-           matchExpr(list->elements[2], op->getOperand(1).defining); \
-  }
-
-#define MATCH_UNARY(opcode, Ty) \
-  if (opname == opcode && isa<Ty>(op)) { \
-    return matchExpr(list->elements[1], op->getOperand(0).defining); \
-  }
-
-#define MATCH_TERNARY_IMM(opcode, Ty) \
-  if (opname == opcode && isa<Ty>(op)) { \
-    if (!matchExpr(list->elements[1], op->getOperand(0).defining) || \
-        !matchExpr(list->elements[2], op->getOperand(1).defining) || \
-        !matchExpr(list->elements[3], op->getOperand(2).defining)) \
-      return false;\
-    int imm = V(op); \
-    auto var = cast<Atom>(list->elements[4])->value; \
-    assert(var[0] == '#'); \
-    if (imms.count(var)) \
-      return imms[var] == imm; \
-    imms[var] = imm; \
-    return true; \
-  }
-
-#define MATCH_BINARY_IMM(opcode, Ty) \
-  if (opname == opcode && isa<Ty>(op)) { \
-    if (!matchExpr(list->elements[1], op->getOperand(0).defining) || \
-        !matchExpr(list->elements[2], op->getOperand(1).defining)) \
-      return false;\
-    int imm = V(op); \
-    auto var = cast<Atom>(list->elements[3])->value; \
-    assert(var[0] == '#'); \
-    if (imms.count(var)) \
-      return imms[var] == imm; \
-    imms[var] = imm; \
-    return true; \
-  }
-
-#define MATCH_UNARY_IMM(opcode, Ty) \
-  if (opname == opcode && isa<Ty>(op)) { \
-    if (!matchExpr(list->elements[1], op->getOperand(0).defining)) \
-      return false;\
-    int imm = V(op); \
-    auto var = cast<Atom>(list->elements[2])->value; \
-    assert(var[0] == '#'); \
-    if (imms.count(var)) \
-      return imms[var] == imm; \
-    imms[var] = imm; \
-    return true; \
-  }
-
-#define MATCH_IMM(opcode, Ty) \
-  if (opname == opcode && isa<Ty>(op)) { \
-    int imm = V(op); \
-    auto var = cast<Atom>(list->elements[1])->value; \
-    assert(var[0] == '#'); \
-    if (imms.count(var)) \
-      return imms[var] == imm; \
-    imms[var] = imm; \
-    return true; \
-  }
-
-#define MATCH_BRANCH(opcode, Ty) \
-  if (opname == opcode && isa<Ty>(op)) { \
-    if (!matchExpr(list->elements[1], op->getOperand().defining)) \
-      return false; \
-    auto target = TARGET(op); \
-    auto var = cast<Atom>(list->elements[2])->value; \
-    assert(var[0] == '>'); \
-    if (blockBinding.count(var)) \
-      return blockBinding[var] == target; \
-    blockBinding[var] = target; \
-    auto ifnot = ELSE(op); \
-    var = cast<Atom>(list->elements[3])->value; \
-    assert(var[0] == '>'); \
-    if (blockBinding.count(var)) \
-      return blockBinding[var] == ifnot; \
-    blockBinding[var] = ifnot; \
-    return true; \
-  }
-
-#define MATCH_BRANCH_BINARY(opcode, Ty) \
-  if (opname == opcode && isa<Ty>(op)) { \
-    if (!matchExpr(list->elements[1], op->getOperand(0).defining)) \
-      return false; \
-    if (!matchExpr(list->elements[2], op->getOperand(1).defining)) \
-      return false; \
-    auto target = TARGET(op); \
-    auto var = cast<Atom>(list->elements[3])->value; \
-    assert(var[0] == '>'); \
-    if (blockBinding.count(var)) \
-      return blockBinding[var] == target; \
-    blockBinding[var] = target; \
-    auto ifnot = ELSE(op); \
-    var = cast<Atom>(list->elements[4])->value; \
-    assert(var[0] == '>'); \
-    if (blockBinding.count(var)) \
-      return blockBinding[var] == ifnot; \
-    blockBinding[var] = ifnot; \
-    return true; \
-  }
-
 #define EVAL_BINARY(opcode, op) \
   if (opname == "!" opcode) { \
     int a = evalExpr(list->elements[1]); \
@@ -184,10 +73,8 @@ using namespace sys::arm;
 #define BUILD_BRANCH(opcode, Ty) \
   if (opname == opcode) { \
     Value arg = buildExpr(list->elements[1]); \
-    auto bb1 = cast<Atom>(list->elements[2])->value; \
-    auto bb2 = cast<Atom>(list->elements[3])->value; \
-    BasicBlock *target = blockBinding[bb1]; \
-    BasicBlock *ifnot = blockBinding[bb2]; \
+    BasicBlock *target = bound(list->elements[2]).bb; \
+    BasicBlock *ifnot = bound(list->elements[3]).bb; \
     return builder.create<Ty>({ arg }, { new TargetAttr(target), new ElseAttr(ifnot) }); \
   }
 
@@ -195,23 +82,116 @@ using namespace sys::arm;
   if (opname == opcode) { \
     Value arg1 = buildExpr(list->elements[1]); \
     Value arg2 = buildExpr(list->elements[2]); \
-    auto bb1 = cast<Atom>(list->elements[3])->value; \
-    auto bb2 = cast<Atom>(list->elements[4])->value; \
-    BasicBlock *target = blockBinding[bb1]; \
-    BasicBlock *ifnot = blockBinding[bb2]; \
+    BasicBlock *target = bound(list->elements[3]).bb; \
+    BasicBlock *ifnot = bound(list->elements[4]).bb; \
     return builder.create<Ty>({ arg1, arg2 }, { new TargetAttr(target), new ElseAttr(ifnot) }); \
   }
 
+namespace {
+
+// How an ArmOp appears in a pattern: `(opname operands... #imm >target >else)`.
+struct Shape {
+  int opid;
+  int operands;
+  bool imm;
+  // 1 for a target, 2 for a target and an else.
+  int blocks;
+};
+
+}
+
+static const Shape &shapeOf(std::string_view opname) {
+  static const std::map<std::string_view, Shape> shapes = {
+    { "strwr", { StrWROp::id, 3, true, 0 } },
+    { "strfr", { StrFROp::id, 3, true, 0 } },
+    { "strxr", { StrXROp::id, 3, true, 0 } },
+
+    { "addw", { AddWOp::id, 2, false, 0 } },
+    { "addx", { AddXOp::id, 2, false, 0 } },
+    { "fadd", { FaddOp::id, 2, false, 0 } },
+    { "subw", { SubWOp::id, 2, false, 0 } },
+    { "subx", { SubXOp::id, 2, false, 0 } },
+    { "fsub", { FsubOp::id, 2, false, 0 } },
+    { "mulw", { MulWOp::id, 2, false, 0 } },
+    { "mulx", { MulXOp::id, 2, false, 0 } },
+    { "fmul", { FmulOp::id, 2, false, 0 } },
+    { "sdivw", { SdivWOp::id, 2, false, 0 } },
+    { "sdivx", { SdivXOp::id, 2, false, 0 } },
+    { "and", { AndOp::id, 2, false, 0 } },
+    { "or", { OrOp::id, 2, false, 0 } },
+    { "eor", { EorOp::id, 2, false, 0 } },
+    { "csetne", { CsetNeOp::id, 2, false, 0 } },
+    { "csetlt", { CsetLtOp::id, 2, false, 0 } },
+    { "csetle", { CsetLeOp::id, 2, false, 0 } },
+    { "cseteq", { CsetEqOp::id, 2, false, 0 } },
+
+    { "strw", { StrWOp::id, 2, true, 0 } },
+    { "strf", { StrFOp::id, 2, true, 0 } },
+    { "strx", { StrXOp::id, 2, true, 0 } },
+    { "ldrwr", { LdrWROp::id, 2, true, 0 } },
+    { "ldrfr", { LdrFROp::id, 2, true, 0 } },
+    { "ldrxr", { LdrXROp::id, 2, true, 0 } },
+
+    { "addwi", { AddWIOp::id, 1, true, 0 } },
+    { "addxi", { AddXIOp::id, 1, true, 0 } },
+    { "subwi", { SubWIOp::id, 1, true, 0 } },
+    { "ldrw", { LdrWOp::id, 1, true, 0 } },
+    { "ldrf", { LdrFOp::id, 1, true, 0 } },
+    { "ldrx", { LdrXOp::id, 1, true, 0 } },
+    { "lslwi", { LslWIOp::id, 1, true, 0 } },
+    { "lslxi", { LslXIOp::id, 1, true, 0 } },
+    { "lsrwi", { LsrWIOp::id, 1, true, 0 } },
+    { "lsrxi", { LsrXIOp::id, 1, true, 0 } },
+    { "asrwi", { AsrWIOp::id, 1, true, 0 } },
+    { "asrxi", { AsrXIOp::id, 1, true, 0 } },
+    { "andi", { arm::AndIOp::id, 1, true, 0 } },
+    { "ori", { arm::OrIOp::id, 1, true, 0 } },
+    { "eori", { EorIOp::id, 1, true, 0 } },
+
+    { "mov", { MovIOp::id, 0, true, 0 } },
+
+    { "neg", { NegOp::id, 1, false, 0 } },
+
+    { "cbz", { CbzOp::id, 1, false, 2 } },
+    { "cbnz", { CbnzOp::id, 1, false, 2 } },
+    { "beq", { BeqOp::id, 2, false, 2 } },
+    { "bne", { BneOp::id, 2, false, 2 } },
+    { "blt", { BltOp::id, 2, false, 2 } },
+    { "bgt", { BgtOp::id, 2, false, 2 } },
+    { "ble", { BleOp::id, 2, false, 2 } },
+    { "bge", { BgeOp::id, 2, false, 2 } },
+
+    { "j", { GotoOp::id, 0, false, 1 } },
+  };
+  auto it = shapes.find(opname);
+  if (it == shapes.end()) {
+    std::cerr << "unknown opname in pattern: " << opname << "\n";
+    assert(false);
+  }
+  return it->second;
+}
+
 ArmRule::ArmRule(const char *text): text(text) {
   pattern = parse();
+
+  auto list = cast<List>(pattern);
+  assert(cast<Atom>(list->elements[0])->value == "change");
+
+  regs = 1;
+  compile(list->elements[1], 0);
+  program.push_back({ MatchInst::Accept });
+  resolve(pattern);
+  tree.add(program);
 }
 
 void ArmRule::dump(std::ostream &os) {
   dump(pattern, os);
   os << "\n===== binding starts =====\n";
-  for (auto [k, v] : binding) {
+  for (auto [k, slot] : slotOf) {
+    if (!binding || !(*binding)[slot].bound || k[0] == '#' || k[0] == '>')
+      continue;
     os << k << " = ";
-    v->dump(os);
+    (*binding)[slot].op->dump(os);
   }
   os << "\n===== binding ends =====\n";
 }
@@ -268,101 +248,72 @@ Expr *ArmRule::parse() {
 }
 
 // This is matching against ArmOps.
-bool ArmRule::matchExpr(Expr *expr, Op* op) {
-  if (auto* atom = dyn_cast<Atom>(expr)) {
-    std::string_view var = atom->value;
-
-    // A normal binding.
-    if (binding.count(var))
-      return binding[var] == op;
+void ArmRule::compile(Expr *expr, int reg) {
+  auto slotFor = [&](Atom *atom) {
+    if (!slotOf.count(atom->value)) {
+      int slot = slotOf.size();
+      slotOf[atom->value] = slot;
+    }
+    return atom->slot = slotOf[atom->value];
+  };
 
-    binding[var] = op;
-    return true;
+  // A normal binding.
+  if (auto atom = dyn_cast<Atom>(expr)) {
+    program.push_back({ MatchInst::Bind, reg, slotFor(atom) });
+    return;
   }
 
-  List *list = dyn_cast<List>(expr);
-  if (!list)
-    return false;
-
+  auto list = cast<List>(expr);
   assert(!list->elements.empty());
-  Atom *head = dyn_cast<Atom>(list->elements[0]);
-  if (!head)
-    return false;
+  const Shape &shape = shapeOf(cast<Atom>(list->elements[0])->value);
 
-  std::string_view opname = head->value;
+  MatchInst inst { MatchInst::Opcode, reg, shape.opid };
+  inst.first = regs;
+  inst.count = shape.operands;
+  regs += inst.count;
+  program.push_back(inst);
 
-  MATCH_TERNARY_IMM("strwr", StrWROp);
-  MATCH_TERNARY_IMM("strfr", StrFROp);
-  MATCH_TERNARY_IMM("strxr", StrXROp);
-
-  MATCH_BINARY("addw", AddWOp);
-  MATCH_BINARY("addx", AddXOp);
-  MATCH_BINARY("fadd", FaddOp);
-  MATCH_BINARY("subw", SubWOp);
-  MATCH_BINARY("subx", SubXOp);
-  MATCH_BINARY("fsub", FsubOp);
-  MATCH_BINARY("mulw", MulWOp);
-  MATCH_BINARY("mulx", MulXOp);
-  MATCH_BINARY("fmul", FmulOp);
-  MATCH_BINARY("sdivw", SdivWOp);
-  MATCH_BINARY("sdivx", SdivXOp);
-  MATCH_BINARY("and", AndOp);
-  MATCH_BINARY("or", OrOp);
-  MATCH_BINARY("eor", EorOp);
-  MATCH_BINARY("csetne", CsetNeOp);
-  MATCH_BINARY("csetlt", CsetLtOp);
-  MATCH_BINARY("csetle", CsetLeOp);
-  MATCH_BINARY("cseteq", CsetEqOp);
-
-  MATCH_BINARY_IMM("strw", StrWOp);
-  MATCH_BINARY_IMM("strf", StrFOp);
-  MATCH_BINARY_IMM("strx", StrXOp);
-  MATCH_BINARY_IMM("ldrwr", LdrWROp);
-  MATCH_BINARY_IMM("ldrfr", LdrFROp);
-  MATCH_BINARY_IMM("ldrxr", LdrXROp);
-
-  MATCH_UNARY_IMM("addwi", AddWIOp);
-  MATCH_UNARY_IMM("addxi", AddXIOp);
-  MATCH_UNARY_IMM("subwi", SubWIOp);
-  MATCH_UNARY_IMM("ldrw", LdrWOp);
-  MATCH_UNARY_IMM("ldrf", LdrFOp);
-  MATCH_UNARY_IMM("ldrx", LdrXOp);
-  MATCH_UNARY_IMM("lslwi", LslWIOp);
-  MATCH_UNARY_IMM("lslxi", LslXIOp);
-  MATCH_UNARY_IMM("lsrwi", LsrWIOp);
-  MATCH_UNARY_IMM("lsrxi", LsrXIOp);
-  MATCH_UNARY_IMM("asrwi", AsrWIOp);
-  MATCH_UNARY_IMM("asrxi", AsrXIOp);
-  MATCH_UNARY_IMM("andi", AndIOp);
-  MATCH_UNARY_IMM("ori", OrIOp);
-  MATCH_UNARY_IMM("eori", EorIOp);
-
-  MATCH_IMM("mov", MovIOp);
-
-  MATCH_UNARY("neg", NegOp);
-
-  MATCH_BRANCH("cbz", CbzOp);
-  MATCH_BRANCH("cbnz", CbnzOp);
-  MATCH_BRANCH_BINARY("beq", BeqOp);
-  MATCH_BRANCH_BINARY("bne", BneOp);
-  MATCH_BRANCH_BINARY("blt", BltOp);
-  MATCH_BRANCH_BINARY("bgt", BgtOp);
-  MATCH_BRANCH_BINARY("ble", BleOp);
-  MATCH_BRANCH_BINARY("bge", BgeOp);
-
-  if (opname == "j" && isa<GotoOp>(op)) {
-    auto target = TARGET(op);
-    auto var = cast<Atom>(list->elements[1])->value;
-    assert(var[0] == '>');
-
-    if (blockBinding.count(var))
-      return blockBinding[var] == target;
-
-    blockBinding[var] = target;
-    return true;
+  for (int i = 0; i < shape.operands; i++)
+    compile(list->elements[i + 1], inst.first + i);
+
+  int next = shape.operands + 1;
+  if (shape.imm) {
+    auto atom = cast<Atom>(list->elements[next++]);
+    assert(atom->value[0] == '#');
+    program.push_back({ MatchInst::BindImm, reg, slotFor(atom) });
+  }
+  if (shape.blocks >= 1) {
+    auto atom = cast<Atom>(list->elements[next++]);
+    assert(atom->value[0] == '>');
+    program.push_back({ MatchInst::BindTarget, reg, slotFor(atom) });
   }
+  if (shape.blocks >= 2) {
+    auto atom = cast<Atom>(list->elements[next++]);
+    assert(atom->value[0] == '>');
+    program.push_back({ MatchInst::BindElse, reg, slotFor(atom) });
+  }
+}
 
-  return false;
+// Points variables outside the matcher to their slots.
+void ArmRule::resolve(Expr *expr) {
+  if (auto atom = dyn_cast<Atom>(expr)) {
+    if (atom->slot == -1 && slotOf.count(atom->value))
+      atom->slot = slotOf[atom->value];
+    return;
+  }
+
+  auto list = cast<List>(expr);
+  for (size_t i = 1; i < list->elements.size(); i++)
+    resolve(list->elements[i]);
+}
+
+const MatchSlot &ArmRule::bound(Expr *expr) {
+  auto atom = cast<Atom>(expr);
+  if (atom->slot == -1 || !(*binding)[atom->slot].bound) {
+    std::cerr << "unbound variable: " << atom->value << "\n";
+    assert(false);
+  }
+  return (*binding)[atom->slot];
 }
 
 int ArmRule::evalExpr(Expr *expr) {
@@ -373,14 +324,12 @@ int ArmRule::evalExpr(Expr *expr) {
     }
 
     if (atom->value[0] == '\'') {
-      auto lint = cast<IntOp>(binding[atom->value]);
+      auto lint = cast<IntOp>(bound(atom).op);
       return V(lint);
     }
 
-    if (atom->value[0] == '#') {
-      assert(imms.count(atom->value));
-      return imms[atom->value];
-    }
+    if (atom->value[0] == '#')
+      return bound(atom).imm;
     assert(false);
   }
 
@@ -435,11 +384,7 @@ Op *ArmRule::buildExpr(Expr *expr) {
       return builder.create<IntOp>({ new IntAttr(result) });
     }
 
-    if (!binding.count(atom->value)) {
-      std::cerr << "unbound variable: " << atom->value << "\n";
-      assert(false);
-    }
-    return binding[atom->value];
+    return bound(atom).op;
   }
 
   auto list = cast<List>(expr);
@@ -518,8 +463,7 @@ Op *ArmRule::buildExpr(Expr *expr) {
   BUILD_BRANCH_BINARY("bge", BgeOp);
 
   if (opname == "b") {
-    auto bb = cast<Atom>(list->elements[1])->value;
-    BasicBlock *target = blockBinding[bb];
+    BasicBlock *target = bound(list->elements[1]).bb;
 
     return builder.create<BOp>({ new TargetAttr(target) });
   }
@@ -528,28 +472,35 @@ Op *ArmRule::buildExpr(Expr *expr) {
   assert(false);
 }
 
-// Nearly identical as above, just the "match" condition has changed.
-bool ArmRule::rewrite(Op *op) {
-  loc = 0;
-  failed = false;
-  binding.clear();
-  blockBinding.clear();
-  imms.clear();
-  
-  auto list = cast<List>(pattern);
-  assert(cast<Atom>(list->elements[0])->value == "change");
-  auto matcher = list->elements[1];
-  auto rewriter = list->elements[2];
+int ArmRule::rootOpid() {
+  return program[0].arg;
+}
 
-  if (!matchExpr(matcher, op))
-    return false;
+bool ArmRule::apply(Op *op, const std::vector<MatchSlot> &slots) {
+  failed = false;
+  binding = &slots;
 
   builder.setBeforeOp(op);
-  Op *opnew = buildExpr(rewriter);
-  if (!opnew || failed)
+  // Everything built goes right before `op`.
+  Op *prev = op->prevOp();
+  auto list = cast<List>(pattern);
+  Op *opnew = buildExpr(list->elements[2]);
+  if (!opnew || failed) {
+    // Take back what got built before failing, such as the constants of `!only-if`.
+    // Later ones use earlier ones, so go backwards.
+    while (op->prevOp() != prev)
+      op->prevOp()->erase();
     return false;
+  }
 
   op->replaceAllUsesWith(opnew);
   op->erase();
   return true;
 }
+
+bool ArmRule::rewrite(Op *op) {
+  tree.reset();
+  return tree.match(op, [&](int) {
+    return apply(op, tree.getSlots());
+  });
+}
@@ -7,27 +7,38 @@ namespace sys {
 
 // The difference is that opcode is interpreted differently.
 class ArmRule {
-  std::map<std::string_view, Op*> binding;
-  std::map<std::string_view, BasicBlock*> blockBinding;
-  std::map<std::string_view, int> imms;
+  template<class R>
+  friend class RuleSet;
 
+  // Variable names to slots.
+  std::map<std::string_view, int> slotOf;
   std::string_view text;
   Expr *pattern;
+  std::vector<MatchInst> program;
+  MatchTree tree;
+  // The slots of the current match.
+  const std::vector<MatchSlot> *binding = nullptr;
   Builder builder;
   int loc = 0;
+  int regs = 0;
   bool failed = false;
 
   std::string_view nextToken();
   Expr *parse();
 
-  bool matchExpr(Expr *expr, Op *op);
+  void compile(Expr *expr, int reg);
+  void resolve(Expr *expr);
+  const MatchSlot &bound(Expr *expr);
   int evalExpr(Expr *expr);
   Op *buildExpr(Expr *expr);
+  bool apply(Op *op, const std::vector<MatchSlot> &slots);
 
   void dump(Expr *expr, std::ostream &os);
 public:
   ArmRule(const char *text);
   bool rewrite(Op *op);
+  // The opid of the op the pattern's root matches.
+  int rootOpid();
 
   void dump(std::ostream &os);
 };
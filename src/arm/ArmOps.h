@@ -217,18 +217,35 @@ ARMOPF(FmsubOp);
 ARMOP(St1Op);
 ARMOPV(Ld1Op);
 ARMOPV(AddVOp);
+ARMOPV(SubVOp);
 ARMOPV(MulVOp);
 ARMOPV(MlaVOp);
+ARMOPV(FaddVOp);
+ARMOPV(FsubVOp);
+ARMOPV(FmulVOp);
 ARMOPV(DupOp);
+ARMOPV(DupFOp); // Broadcasts lane 0 of a fp register.
+ARMOPV(CmeqVOp);
+ARMOPV(CmgtVOp);
+ARMOPV(CmgeVOp);
+ARMOPV(FcmeqVOp);
+ARMOPV(FcmgtVOp);
+ARMOPV(FcmgeVOp);
+ARMOPV(AndVOp);
+ARMOPV(BicVOp); // And-not.
+ARMOPV(OrrVOp);
+ARMOPV(MovVOp);
+ARMOPF(AddvOp); // Sum of all lanes, into lane 0.
+ARMOP(UmovOp); // Moves the lane given by an IntAttr to a w-register.
+ARMOPF(DupSOp); // Moves the lane given by an IntAttr to a fp register.
 
 // ====== Pseudo Ops ======
 ARMOPE(ReadRegOp);
 ARMOP(WriteRegOp);
 ARMOP(PlaceHolderOp);
 ARMOP(SubSpOp);
+// Runs a worker on the thread pool, over the range in x0 and x1.
 ARMOP(CloneOp);
-ARMOP(JoinOp);
-ARMOP(WakeOp);
 
 inline bool hasRd(Op *op) {
   return !(
@@ -254,9 +271,7 @@ inline bool hasRd(Op *op) {
     isa<RetOp>(op) ||
     isa<WriteRegOp>(op) ||
     isa<SubSpOp>(op) ||
-    isa<CloneOp>(op) ||
-    isa<JoinOp>(op) ||
-    isa<WakeOp>(op)
+    isa<CloneOp>(op)
   );
 }
 
@@ -2,6 +2,7 @@
 #define ARM_PASSES_H
 
 #include "../opt/Pass.h"
+#include "../opt/ListSchedule.h"
 #include "../codegen/CodeGen.h"
 #include "../codegen/Ops.h"
 #include "../codegen/Attrs.h"
@@ -57,9 +58,33 @@ public:
   void run() override;
 };
 
+// Reorders ops before allocation. Post-increments stay on the same side
+// of every other user of their base.
+class Schedule : public ListSchedule {
+protected:
+  Role classify(Op *op, Access &access) override;
+  int latency(Op *op) override;
+  Op *updates(Op *op) override;
+  bool fpResult(Op *op) override;
+public:
+  Schedule(ModuleOp *module);
+
+  std::string name() override { return "arm-schedule"; };
+};
+
 class RegAlloc : public Pass {
+public:
+  enum Mode {
+    // Colors values one by one in order of priority.
+    Greedy,
+    // Linear scan, for compile time; see LinearScan.
+    Linear,
+  };
+private:
+  Mode mode;
   int spilled = 0;
   int convertedTotal = 0;
+  int rematerialized = 0;
 
   std::map<FuncOp*, std::set<Reg>> usedRegisters;
   std::map<std::string, FuncOp*> fnMap;
@@ -70,11 +95,14 @@ class RegAlloc : public Pass {
   void tidyup(Region *region);
 public:
 
-  RegAlloc(ModuleOp *module): Pass(module) {}
+  RegAlloc(ModuleOp *module, Mode mode = Greedy): Pass(module), mode(mode) {}
 
   std::string name() override { return "arm-regalloc"; };
   std::map<std::string, int> stats() override;
   void run() override;
+  bool isFunctionPass() override { return true; }
+  void runOnFunction(FuncOp *func) override;
+  void finish() override;
 };
 
 class LateLegalize : public Pass {
@@ -54,6 +54,7 @@ using namespace sys::arm;
 #define BINARY_X(Ty, name) BINARY(Ty, name, xreg)
 #define BINARY_F(Ty, name) BINARY(Ty, name, freg)
 #define BINARY_V(Ty, name) BINARY(Ty, name, vreg)
+#define BINARY_B(Ty, name) BINARY(Ty, name, breg)
 #define BINARY_NO_RD_W(Ty, name) BINARY_BASE(Ty, name, wreg,)
 #define BINARY_NO_RD_X(Ty, name) BINARY_BASE(Ty, name, xreg,)
 #define BINARY_NO_RD_F(Ty, name) BINARY_BASE(Ty, name, freg,)
@@ -103,6 +104,16 @@ std::string vreg(Reg reg) {
   return name + ".4s"; // 4 signed integers
 }
 
+// For bitwise ops, which only take bytes.
+std::string breg(Reg reg) {
+  auto name = showReg(reg);
+  return name + ".16b";
+}
+
+std::string lane(Reg reg, int i) {
+  return showReg(reg) + ".s[" + std::to_string(i) + "]";
+}
+
 }
 
 void Dump::dumpOp(Op *op, std::ostream &os) {
@@ -141,8 +152,22 @@ void Dump::dumpOp(Op *op, std::ostream &os) {
   BINARY_X(EorOp, "eor");
 
   BINARY_V(AddVOp, "add");
+  BINARY_V(SubVOp, "sub");
   BINARY_V(MulVOp, "mul");
   BINARY_V(MlaVOp, "mla");
+  BINARY_V(FaddVOp, "fadd");
+  BINARY_V(FsubVOp, "fsub");
+  BINARY_V(FmulVOp, "fmul");
+  BINARY_V(CmeqVOp, "cmeq");
+  BINARY_V(CmgtVOp, "cmgt");
+  BINARY_V(CmgeVOp, "cmge");
+  BINARY_V(FcmeqVOp, "fcmeq");
+  BINARY_V(FcmgtVOp, "fcmgt");
+  BINARY_V(FcmgeVOp, "fcmge");
+
+  BINARY_B(AndVOp, "and");
+  BINARY_B(BicVOp, "bic");
+  BINARY_B(OrrVOp, "orr");
 
   UNARY_I_W(AddWIOp, "add");
   UNARY_I_W(LslWIOp, "lsl");
@@ -374,35 +399,32 @@ void Dump::dumpOp(Op *op, std::ostream &os) {
   case DupOp::id:
     os << "dup " << vreg(RD(op)) << ", " << wreg(RS(op)) << "\n";
     break;
+  case DupFOp::id:
+    os << "dup " << vreg(RD(op)) << ", " << lane(RS(op), 0) << "\n";
+    break;
+  case MovVOp::id:
+    os << "mov " << breg(RD(op)) << ", " << breg(RS(op)) << "\n";
+    break;
+  case AddvOp::id:
+    os << "addv " << freg(RD(op)) << ", " << vreg(RS(op)) << "\n";
+    break;
+  case UmovOp::id:
+    os << "mov " << wreg(RD(op)) << ", " << lane(RS(op), V(op)) << "\n";
+    break;
+  case DupSOp::id:
+    os << "mov " << freg(RD(op)) << ", " << lane(RS(op), V(op)) << "\n";
+    break;
   case St1Op::id:
     os << "st1 {" << vreg(RS(op)) << "}, [" << xreg(RS2(op)) << "]\n";
     break;
   case Ld1Op::id:
     os << "ld1 {" << vreg(RD(op)) << "}, [" << xreg(RS(op)) << "]\n";
     break;
-  case JoinOp::id:
-    os << "adrp x0, _lock" << NAME(op) << "\n  ";
-    os << "add x0, x0, :lo12:_lock" << NAME(op) << "\n  ";
-    os << "bl spinlock_wait\n";
-    break;
   case CloneOp::id:
-    os << "adrp x0, " << NAME(op) << "\n  ";
-    os << "add x0, x0, :lo12:" << NAME(op) << "\n  ";
-    os << "adrp x1, _stack" << NAME(op) << "\n  ";
-    os << "add x1, x1, :lo12:_stack" << NAME(op) << "\n  ";
-    os << "add x1, x1, #8192\n  ";
-    os << "mov x2, #1\n  ";
-    os << "adrp x3, _lock" << NAME(op) << "\n  ";
-    os << "add x3, x3, :lo12:_lock" << NAME(op) << "\n  ";
-    os << "str x2, [x3]\n  ";
-    os << "bl instantiate_worker\n";
-    break;
-  case WakeOp::id:
-    os << "adrp x0, _lock" << NAME(op) << "\n  ";
-    os << "add x0, x0, :lo12:_lock" << NAME(op) << "\n  ";
-    os << "dmb ish\n  ";
-    os << "mov w1, #0\n  ";
-    os << "stlr w1, [x0]\n";
+    // The range is already in x0 and x1.
+    os << "adrp x2, " << NAME(op) << "\n  ";
+    os << "add x2, x2, :lo12:" << NAME(op) << "\n  ";
+    os << "bl pool_run\n";
     break;
   default:
     std::cerr << "unimplemented op: " << op;
@@ -439,10 +461,18 @@ void Dump::dump(std::ostream &os) {
 
   auto clones = module->findAll<CloneOp>();
   if (clones.size()) {
-#include "../rt/arm-clone.s"
-    >> os;
-#include "../rt/arm-join.s"
+#include "../rt/arm-pool.s"
     >> os;
+
+    // Each thread besides the main one gets 1 MiB of stack.
+    int threads = 1;
+    for (auto global : collectGlobals()) {
+      if (NAME(global) == "_pool_threads")
+        threads = global->get<IntArrayAttr>()->vi[0];
+    }
+    os << "\n.section .bss\n.balign 16\n";
+    os << "_pool_stacks:\n  .skip " << std::max(threads - 1, 1) * (1 << 20) << "\n";
+    os << ".text\n\n";
   }
 
   auto globals = collectGlobals();
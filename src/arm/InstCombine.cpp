@@ -71,6 +71,15 @@ static ArmRule rules[] = {
 };
 
 void InstCombine::run() {
+  // Rules indexed by the opid of their root, each merged into one matcher.
+  std::map<int, std::vector<ArmRule*>> rooted;
+  for (auto &rule : rules)
+    rooted[rule.rootOpid()].push_back(&rule);
+
+  std::unordered_map<int, RuleSet<ArmRule>> buckets;
+  for (auto &[opid, list] : rooted)
+    buckets.emplace(opid, list);
+
   auto funcs = collectFuncs();
   int folded;
   do {
@@ -79,15 +88,11 @@ void InstCombine::run() {
       auto region = func->getRegion();
 
       for (auto bb : region->getBlocks()) {
-        auto ops = bb->getOps();
+        std::vector<Op*> ops = bb->getOps();
         for (auto op : ops) {
-          for (auto &rule : rules) {
-            bool success = rule.rewrite(op);
-            if (success) {
-              folded++;
-              break;
-            }
-          }
+          auto it = buckets.find(op->opid);
+          if (it != buckets.end() && it->second.rewrite(op))
+            folded++;
         }
       }
     }
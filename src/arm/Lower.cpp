@@ -96,11 +96,15 @@ void Lower::run() {
   REPLACE(LeFOp, CsetLeFOp);
   REPLACE(SelectOp, CselNeZOp);
   REPLACE(BroadcastOp, DupOp);
+  REPLACE(BroadcastFOp, DupFOp);
   REPLACE(sys::AddVOp, AddVOp);
+  REPLACE(sys::SubVOp, SubVOp);
   REPLACE(sys::MulVOp, MulVOp);
-  REPLACE(sys::CloneOp, CloneOp);
-  REPLACE(sys::JoinOp, JoinOp);
-  REPLACE(sys::WakeOp, WakeOp);
+  REPLACE(AddFVOp, FaddVOp);
+  REPLACE(SubFVOp, FsubVOp);
+  REPLACE(MulFVOp, FmulVOp);
+  REPLACE(EqVOp, CmeqVOp);
+  REPLACE(EqFVOp, FcmeqVOp);
 
   runRewriter([&](FloatOp *op) {
     float value = F(op);
@@ -134,6 +138,55 @@ void Lower::run() {
     return false;
   });
 
+  // NEON only compares for `>` and `>=`.
+  runRewriter([&](LtVOp *op) {
+    builder.replace<CmgtVOp>(op, { op->getOperand(1), op->getOperand(0) });
+    return false;
+  });
+
+  runRewriter([&](LeVOp *op) {
+    builder.replace<CmgeVOp>(op, { op->getOperand(1), op->getOperand(0) });
+    return false;
+  });
+
+  runRewriter([&](LtFVOp *op) {
+    builder.replace<FcmgtVOp>(op, { op->getOperand(1), op->getOperand(0) });
+    return false;
+  });
+
+  runRewriter([&](LeFVOp *op) {
+    builder.replace<FcmgeVOp>(op, { op->getOperand(1), op->getOperand(0) });
+    return false;
+  });
+
+  // (a & mask) | (b & ~mask)
+  runRewriter([&](SelectVOp *op) {
+    auto mask = op->getOperand(0);
+    auto a = op->getOperand(1);
+    auto b = op->getOperand(2);
+
+    builder.setBeforeOp(op);
+    auto x = builder.create<AndVOp>({ a, mask });
+    auto y = builder.create<BicVOp>({ b, mask });
+    builder.replace<OrrVOp>(op, { x, y });
+    return false;
+  });
+
+  runRewriter([&](ReduceAddVOp *op) {
+    builder.setBeforeOp(op);
+    auto addv = builder.create<AddvOp>(op->getOperands());
+    builder.replace<UmovOp>(op, { addv }, { new IntAttr(0) });
+    return false;
+  });
+
+  runRewriter([&](ExtractOp *op) {
+    if (op->getResultType() == Value::f32)
+      builder.replace<DupSOp>(op, op->getOperands(), op->getAttrs());
+    else
+      builder.replace<UmovOp>(op, op->getOperands(), op->getAttrs());
+    return false;
+  });
+
   runRewriter([&](ModIOp *op) {
     auto x = op->getOperand(0);
     auto y = op->getOperand(1);
@@ -167,7 +220,7 @@ void Lower::run() {
       return false;
     }
 
-    if (ty == Value::i128 && SIZE(op) == 16) {
+    if ((ty == Value::i128 || ty == Value::f128) && SIZE(op) == 16) {
       builder.replace<St1Op>(op, op->getOperands());
       return false;
     }
@@ -189,7 +242,7 @@ void Lower::run() {
       return false;
     }
 
-    if (ty == Value::i128 && SIZE(op) == 16) {
+    if ((ty == Value::i128 || ty == Value::f128) && SIZE(op) == 16) {
       builder.replace<Ld1Op>(op, op->getOperands());
       return false;
     }
@@ -208,6 +261,8 @@ void Lower::run() {
     Reg::x4, Reg::x5, Reg::x6, Reg::x7,
   };
 
+  auto fnMap = getFunctionMap();
+
   runRewriter([&](sys::CallOp *op) {
     builder.setBeforeOp(op);
     const auto &args = op->getOperands();
@@ -248,10 +303,16 @@ void Lower::run() {
         builder.create<StrXOp>({ spilled[i], sp }, { new SizeAttr(8), new IntAttr(i * 8) });
     }
 
-    builder.create<BlOp>(argsNew, { 
-      op->get<NameAttr>(),
-      new ArgCountAttr(args.size())
-    });
+    // A worker runs on the thread pool, which passes each thread the bounds of its chunks
+    // in the same registers.
+    const auto &name = NAME(op);
+    if (fnMap.count(name) && fnMap[name]->has<WorkerAttr>())
+      builder.create<CloneOp>(argsNew, { op->get<NameAttr>() });
+    else
+      builder.create<BlOp>(argsNew, { 
+        op->get<NameAttr>(),
+        new ArgCountAttr(args.size())
+      });
 
     // Restore stack pointer.
     if (stackOffset > 0)
@@ -104,7 +104,7 @@ void PostIncr::runImpl(LoopInfo *info) {
 
 void PostIncr::run() {
   LoopAnalysis analysis(module);
-  analysis.run();
+  analysis.runCached();
   auto forests = analysis.getResult();
 
   for (const auto &[_, forest] : forests) {
@@ -1,5 +1,6 @@
 #include "ArmPasses.h"
 #include "Regs.h"
+#include "../utils/LinearScan.h"
 #include <unordered_set>
 
 using namespace sys;
@@ -65,6 +66,7 @@ std::map<std::string, int> RegAlloc::stats() {
   return {
     { "spilled", spilled },
     { "peepholed", convertedTotal },
+    { "rematerialized", rematerialized },
   };
 }
 
@@ -115,6 +117,90 @@ struct Event {
 // Defined in rv/RegAlloc.cpp.
 void dumpInterf(Region *region, const std::unordered_map<Op*, std::set<Op*>> &interf);
 
+// Finds the values that are `sp` plus a constant, i.e. the addresses of locals,
+// along with that constant. Only those outside of the call sequences, where `sp` is moved, count.
+static std::unordered_map<Op*, int> frameAddresses(Region *region) {
+  std::unordered_map<Op*, int> result;
+  for (auto bb : region->getBlocks()) {
+    int delta = 0;
+    for (auto op : bb->getOps()) {
+      if (isa<SubSpOp>(op))
+        delta += V(op);
+      if (delta)
+        continue;
+
+      if (isa<ReadRegOp>(op) && REG(op) == Reg::sp)
+        result[op] = 0;
+      if (isa<AddXIOp>(op) && result.count(op->DEF(0)))
+        result[op] = result[op->DEF(0)] + V(op);
+      if (isa<AddXOp>(op) && result.count(op->DEF(0)) && isa<MovIOp>(op->DEF(1)))
+        result[op] = result[op->DEF(0)] + V(op->DEF(1));
+    }
+  }
+  return result;
+}
+
+// PostIncr leaves a placeholder for the value that a post-increment writes back into a phi.
+// The placeholder is dropped from the phi later on without a move, so it must really share
+// the phi's register; returns that phi, if `op` is such a placeholder.
+static Op *postIncrPhi(Op *op) {
+  if (!isa<PlaceHolderOp>(op) || op->getOperandCount() != 1 || !isa<PhiOp>(op->DEF(0)))
+    return nullptr;
+  return op->DEF(0);
+}
+
+// Allocates every value of the region by linear scan, for --fast-regalloc.
+// Values that didn't get a register end up in `slots`, numbered from 0.
+static int colorLinear(Region *region, std::map<Op*, Reg> &assignment,
+                       const Reg *order, int regcount, const Reg *orderf, int regcountf,
+                       std::unordered_map<Op*, int> &slots) {
+  std::vector<int> ints, fps;
+  for (int i = 0; i < regcount; i++)
+    ints.push_back((int) order[i]);
+  for (int i = 0; i < regcountf; i++)
+    fps.push_back((int) orderf[i]);
+
+  LinearScan scan({ ints, fps });
+  for (auto [op, reg] : assignment)
+    scan.fix(op, (int) reg);
+
+  for (auto bb : region->getBlocks()) {
+    for (auto op : bb->getOps()) {
+      if (assignment.count(op) || !hasRd(op))
+        continue;
+
+      // In the whole function, `sp` and `xzr` are read-only.
+      if (isa<ReadRegOp>(op) && (REG(op) == Reg::sp || REG(op) == Reg::xzr)) {
+        assignment[op] = REG(op);
+        continue;
+      }
+
+      if (auto phi = postIncrPhi(op)) {
+        scan.alias(op, phi);
+        continue;
+      }
+
+      scan.add(op, fpreg(op->getResultType()));
+      if (isa<ReadRegOp>(op))
+        scan.hint(op, (int) REG(op));
+      if (isa<PhiOp>(op)) {
+        for (auto v : op->getOperands())
+          scan.tie(op, v.defining);
+      }
+      for (auto use : op->getUses()) {
+        if (isa<WriteRegOp>(use))
+          scan.hint(op, (int) REG(use));
+      }
+    }
+  }
+
+  scan.run(region);
+  for (auto [op, reg] : scan.assignment)
+    assignment[op] = (Reg) reg;
+  slots = scan.slot;
+  return scan.slotCount;
+}
+
 void RegAlloc::runImpl(Region *region, bool isLeaf) {
   const Reg *order = isLeaf ? leafOrder : normalOrder;
   const Reg *orderf = isLeaf ? leafOrderf : normalOrderf;
@@ -129,14 +215,11 @@ void RegAlloc::runImpl(Region *region, bool isLeaf) {
 
   // First of all, add 35 precolored placeholders before each call.
   // This denotes that a call clobbers those registers.
-  // Note clones and joins will also be emitted as calls.
+  // Note clones will also be emitted as calls.
   std::vector<Op*> clobbering = funcOp->findAll<BlOp>();
   auto clones = funcOp->findAll<CloneOp>();
-  auto joins = funcOp->findAll<JoinOp>();
   for (auto cl : clones)
     clobbering.push_back(cl);
-  for (auto j : joins)
-    clobbering.push_back(j);
 
   for (auto op : clobbering) {
     std::vector<Op*> writes;
@@ -235,6 +318,15 @@ void RegAlloc::runImpl(Region *region, bool isLeaf) {
   std::unordered_map<Op*, Op*> prefer;
   // Maps a phi to its operands.
   std::unordered_map<Op*, std::vector<Op*>> phiOperand;
+  // Maps each placeholder of PostIncr to its phi, whose register it must have.
+  std::unordered_map<Op*, Op*> tied;
+
+  // Constants, global addresses and addresses of locals are recomputed at each use if spilled,
+  // rather than stored and reloaded. The cheapest of them are the first to give up their registers.
+  auto frameAddr = frameAddresses(region);
+  const auto rematerializable = [&](Op *op) {
+    return isa<MovIOp>(op) || isa<AdrOp>(op) || frameAddr.count(op);
+  };
 
   int currentPriority = 2;
   for (auto bb : region->getBlocks()) {
@@ -263,8 +355,11 @@ void RegAlloc::runImpl(Region *region, bool isLeaf) {
       if (isa<ReadRegOp>(op))
         priority[op] = 1;
       
+      // Those that take a single instruction to rematerialize.
       if (isa<MovIOp>(op) && (V(op) <= 32767 && V(op) >= -32768))
         priority[op] = -2;
+      if (isa<AddXIOp>(op) && frameAddr.count(op) && frameAddr[op] < 4096)
+        priority[op] = -2;
       
       if (isa<PhiOp>(op)) {
         priority[op] = currentPriority + 1;
@@ -272,6 +367,8 @@ void RegAlloc::runImpl(Region *region, bool isLeaf) {
           priority[x.defining] = currentPriority;
           prefer[x.defining] = op;
           phiOperand[op].push_back(x.defining);
+          if (postIncrPhi(x.defining) == op)
+            tied[x.defining] = op;
         }
         currentPriority += 2;
       }
@@ -282,6 +379,10 @@ void RegAlloc::runImpl(Region *region, bool isLeaf) {
     for (auto op : bb->getLiveOut())
       lastUsed[op] = ops.size();
 
+    // LinearScan works out intervals of its own, and never needs the graph.
+    if (mode == Linear)
+      continue;
+
     // We use event-driven approach to optimize it into O(n log n + E).
     std::vector<Event> events;
     for (auto [op, v] : lastUsed) {
@@ -333,121 +434,183 @@ void RegAlloc::runImpl(Region *region, bool isLeaf) {
   for (auto [k, v] : priority)
     ops.push_back(k);
 
-  // Sort by **descending** degree.
-  std::sort(ops.begin(), ops.end(), [&](Op *a, Op *b) {
-    auto pa = priority[a];
-    auto pb = priority[b];
-    return pa == pb ? interf[a].size() > interf[b].size() : pa > pb;
-  });
-
   std::unordered_map<Op*, int> spillOffset;
   int currentOffset = STACKOFF(funcOp);
   int highest = 0;
 
-  for (auto op : ops) {
-    // Do not allocate colored instructions.
-    if (assignment.count(op))
-      continue;
+  // Gives `group`, which shares a register, a stack slot instead.
+  auto spill = [&](const std::vector<Op*> &group) {
+    spilled += group.size();
+    // Try to see all spill offsets of conflicting ops.
+    int desired = currentOffset;
+    std::unordered_set<int> conflict;
+    for (auto op : group) {
+      for (auto v : interf[op]) {
+        if (!spillOffset.count(v))
+          continue;
 
-    std::unordered_set<Reg> bad, unpreferred;
+        conflict.insert(spillOffset[v]);
+      }
+      for (auto v : spillInterf[op]) {
+        if (!spillOffset.count(v))
+          continue;
 
-    for (auto v : interf[op]) {
-      // In the whole function, `sp` and `zero` are read-only.
-      if (assignment.count(v) && assignment[v] != Reg::sp && assignment[v] != Reg::xzr)
-        bad.insert(assignment[v]);
+        conflict.insert(spillOffset[v]);
+      }
     }
 
-    if (isa<PhiOp>(op)) {
-      // Dislike everything that might interfere with phi's operands.
-      const auto &operands = phiOperand[op];
-      for (auto x : operands) {
-        for (auto v : interf[x]) {
-          if (assignment.count(v) && assignment[v] != Reg::sp && assignment[v] != Reg::xzr)
-            unpreferred.insert(assignment[v]);
-        }
+    // Try find a space.
+    while (conflict.count(desired))
+      desired += 8;
+
+    for (auto op : group)
+      spillOffset[op] = desired;
+
+    // Update `highest`, which will indicate the size allocated.
+    if (desired > highest)
+      highest = desired;
+  };
+
+  if (mode == Linear) {
+    std::unordered_map<Op*, int> slots;
+    int count = colorLinear(region, assignment, order, regcount, orderf, regcountf, slots);
+    for (auto [op, slot] : slots)
+      spillOffset[op] = currentOffset + slot * 8;
+    if (count)
+      highest = currentOffset + (count - 1) * 8;
+    spilled += slots.size();
+  } else {
+    // With a profile, values that are defined or used more often are more costly to spill,
+    // so they're allocated first. Without one, every cost is zero.
+    std::unordered_map<Op*, long long> cost;
+    for (auto bb : region->getBlocks()) {
+      auto freq = frequency(bb);
+      if (freq <= 0)
+        continue;
+
+      for (auto op : bb->getOps()) {
+        cost[op] += freq;
+        for (auto v : op->getOperands())
+          cost[v.defining] += freq;
       }
     }
 
-    if (prefer.count(op)) {
-      auto ref = prefer[op];
-      // Try to allocate the same register as `ref`.
-      if (assignment.count(ref) && !bad.count(assignment[ref])) {
-        assignment[op] = assignment[ref];
-        continue;
+    // `prefer` is only a hint, so a tied phi takes over the interference of its placeholder instead.
+    // These phis go first, before any other value gets the chance to take their register;
+    // a spilled one would lose the post-increment, as that only updates the reloaded copy.
+    for (auto [holder, phi] : tied) {
+      for (auto v : interf[holder]) {
+        if (v == phi)
+          continue;
+        interf[phi].insert(v);
+        interf[v].insert(phi);
+      }
+      for (auto v : spillInterf[holder]) {
+        spillInterf[phi].insert(v);
+        spillInterf[v].insert(phi);
       }
+      priority[phi] = currentPriority;
     }
 
-    // See if there's any preferred registers.
-    int preferred = -1;
-    for (auto use : op->getUses()) {
-      if (isa<WriteRegOp>(use)) {
-        auto reg = REG(use);
-        if (!bad.count(reg)) {
-          preferred = (int) reg;
-          break;
+    // Sort by **descending** spill cost, then degree.
+    std::sort(ops.begin(), ops.end(), [&](Op *a, Op *b) {
+      auto pa = priority[a];
+      auto pb = priority[b];
+      if (pa != pb)
+        return pa > pb;
+      if (cost[a] != cost[b])
+        return cost[a] > cost[b];
+      return interf[a].size() > interf[b].size();
+    });
+
+    for (auto op : ops) {
+      // Do not allocate colored instructions.
+      // Tied placeholders get their phi's register below.
+      if (assignment.count(op) || tied.count(op))
+        continue;
+
+      std::unordered_set<Reg> bad, unpreferred;
+
+      for (auto v : interf[op]) {
+        // In the whole function, `sp` and `zero` are read-only.
+        if (assignment.count(v) && assignment[v] != Reg::sp && assignment[v] != Reg::xzr)
+          bad.insert(assignment[v]);
+      }
+
+      if (isa<PhiOp>(op)) {
+        // Dislike everything that might interfere with phi's operands.
+        const auto &operands = phiOperand[op];
+        for (auto x : operands) {
+          for (auto v : interf[x]) {
+            if (assignment.count(v) && assignment[v] != Reg::sp && assignment[v] != Reg::xzr)
+              unpreferred.insert(assignment[v]);
+          }
         }
       }
-    }
-    if (isa<ReadRegOp>(op)) {
-      auto reg = REG(op);
-      if (!bad.count(reg))
-        preferred = (int) reg;
-    }
 
-    if (preferred != -1) {
-      assignment[op] = (Reg) preferred;
-      continue;
-    }
+      if (prefer.count(op)) {
+        auto ref = prefer[op];
+        // Try to allocate the same register as `ref`.
+        if (assignment.count(ref) && !bad.count(assignment[ref])) {
+          assignment[op] = assignment[ref];
+          continue;
+        }
+      }
 
-    auto rcnt = !fpreg(op->getResultType()) ? regcount : regcountf;
-    auto rorder = !fpreg(op->getResultType()) ? order : orderf;
+      // See if there's any preferred registers.
+      int preferred = -1;
+      for (auto use : op->getUses()) {
+        if (isa<WriteRegOp>(use)) {
+          auto reg = REG(use);
+          if (!bad.count(reg)) {
+            preferred = (int) reg;
+            break;
+          }
+        }
+      }
+      if (isa<ReadRegOp>(op)) {
+        auto reg = REG(op);
+        if (!bad.count(reg))
+          preferred = (int) reg;
+      }
 
-    for (int i = 0; i < rcnt; i++) {
-      if (!bad.count(rorder[i]) && !unpreferred.count(rorder[i])) {
-        assignment[op] = rorder[i];
-        break;
+      if (preferred != -1) {
+        assignment[op] = (Reg) preferred;
+        continue;
       }
-    }
 
-    // We have excluded too much. Try it again.
-    if (!assignment.count(op) && unpreferred.size()) {
+      auto rcnt = !fpreg(op->getResultType()) ? regcount : regcountf;
+      auto rorder = !fpreg(op->getResultType()) ? order : orderf;
+
       for (int i = 0; i < rcnt; i++) {
-        if (!bad.count(rorder[i])) {
+        if (!bad.count(rorder[i]) && !unpreferred.count(rorder[i])) {
           assignment[op] = rorder[i];
           break;
         }
       }
-    }
 
-    if (assignment.count(op))
-      continue;
+      // We have excluded too much. Try it again.
+      if (!assignment.count(op) && unpreferred.size()) {
+        for (int i = 0; i < rcnt; i++) {
+          if (!bad.count(rorder[i])) {
+            assignment[op] = rorder[i];
+            break;
+          }
+        }
+      }
 
-    spilled++;
-    // Spilled. Try to see all spill offsets of conflicting ops.
-    int desired = currentOffset;
-    std::unordered_set<int> conflict;
-    for (auto v : interf[op]) {
-      if (!spillOffset.count(v))
+      if (assignment.count(op))
         continue;
 
-      conflict.insert(spillOffset[v]);
+      spill({ op });
     }
-    for (auto v : spillInterf[op]) {
-      if (!spillOffset.count(v))
-        continue;
 
-      conflict.insert(spillOffset[v]);
+    for (auto [holder, phi] : tied) {
+      if (assignment.count(phi))
+        assignment[holder] = assignment[phi];
+      else if (spillOffset.count(phi))
+        spillOffset[holder] = spillOffset[phi];
     }
-
-    // Try find a space.
-    while (conflict.count(desired))
-      desired += 8;
-
-    spillOffset[op] = desired;
-
-    // Update `highest`, which will indicate the size allocated.
-    if (desired > highest)
-      highest = desired;
   }
 
   // Only a single register is spilled. Let's use x28.
@@ -498,6 +661,17 @@ void RegAlloc::runImpl(Region *region, bool isLeaf) {
   if (spillOffset.size())
     STACKOFF(funcOp) = highest + 8;
 
+  // A spilled value that's cheap to recompute is never stored, unless its slot is shared,
+  // in which case the others might depend on the store.
+  std::unordered_map<int, int> slotUsers;
+  for (auto [_, offset] : spillOffset)
+    slotUsers[offset]++;
+  std::unordered_set<Op*> remat;
+  for (auto [op, offset] : spillOffset) {
+    if (rematerializable(op) && slotUsers[offset] == 1)
+      remat.insert(op);
+  }
+
   const auto getReg = [&](Op *op) {
     return assignment.count(op) ? assignment[op] :
       fpreg(op->getResultType()) ? orderf[0] : order[0];
@@ -519,6 +693,19 @@ void RegAlloc::runImpl(Region *region, bool isLeaf) {
   LOWER(AddXOp, BINARY);
   LOWER(AddWOp, BINARY);
   LOWER(AddVOp, BINARY);
+  LOWER(SubVOp, BINARY);
+  LOWER(FaddVOp, BINARY);
+  LOWER(FsubVOp, BINARY);
+  LOWER(FmulVOp, BINARY);
+  LOWER(CmeqVOp, BINARY);
+  LOWER(CmgtVOp, BINARY);
+  LOWER(CmgeVOp, BINARY);
+  LOWER(FcmeqVOp, BINARY);
+  LOWER(FcmgtVOp, BINARY);
+  LOWER(FcmgeVOp, BINARY);
+  LOWER(AndVOp, BINARY);
+  LOWER(BicVOp, BINARY);
+  LOWER(OrrVOp, BINARY);
   LOWER(SubWOp, BINARY);
   LOWER(SubXOp, BINARY);
   LOWER(MulWOp, BINARY);
@@ -603,17 +790,23 @@ void RegAlloc::runImpl(Region *region, bool isLeaf) {
   LOWER(CsetEqFcmpZOp, UNARY);
   LOWER(CsetNeFcmpZOp, UNARY);
   LOWER(DupOp, UNARY);
+  LOWER(DupFOp, UNARY);
+  LOWER(AddvOp, UNARY);
+  LOWER(UmovOp, UNARY);
+  LOWER(DupSOp, UNARY);
 
   // Note that some ops are dealt with later.
   // We can't remove all operands here.
   for (auto bb : region->getBlocks()) {
     for (auto op : bb->getOps()) {
-      if (isa<BlOp>(op) || isa<RetOp>(op))
+      if (isa<BlOp>(op) || isa<CloneOp>(op) || isa<RetOp>(op))
         op->removeAllOperands();
 
       if (isa<PlaceHolderOp>(op)) {
         // All users of it are phis.
-        for (auto use : op->getUses()) {
+        // Removing the operands unthreads them from the use-chain, so walk a snapshot.
+        std::vector<Op*> uses = op->getUses();
+        for (auto use : uses) {
           assert(isa<PhiOp>(use));
           for (int i = 0; i < use->getOperandCount(); i++) {
             if (use->DEF(i) == op) {
@@ -677,7 +870,7 @@ void RegAlloc::runImpl(Region *region, bool isLeaf) {
 
   // This contains all phis to be removed.
   std::vector<Op*> allPhis;
-  auto bbs = region->getBlocks();
+  std::vector<BasicBlock*> bbs = region->getBlocks();
 
   // Split critical edges.
   for (auto bb : bbs) {
@@ -747,7 +940,14 @@ void RegAlloc::runImpl(Region *region, bool isLeaf) {
         builder.setBeforeOp(term);
         auto def = ops[i].defining;
         Op *mv;
-        if (fpreg(phi->getResultType())) {
+        auto ty = phi->getResultType();
+        if (ty == Value::i128 || ty == Value::f128) {
+          mv = builder.create<MovVOp>({
+            new ImpureAttr,
+            spillOffset.count(phi) ? (Attr*) new SpilledRdAttr GET_SPILLED_ARGS(phi) : RDC(getReg(phi)),
+            spillOffset.count(def) ? (Attr*) new SpilledRsAttr GET_SPILLED_ARGS(def) : RSC(getReg(def))
+          });
+        } else if (fpreg(ty)) {
           mv = builder.create<FmovOp>({
             new ImpureAttr,
             spillOffset.count(phi) ? (Attr*) new SpilledRdAttr GET_SPILLED_ARGS(phi) : RDC(getReg(phi)),
@@ -856,6 +1056,7 @@ void RegAlloc::runImpl(Region *region, bool isLeaf) {
       Reg headerSrc = moveGraph[header];
       auto mv = revMap[bb][{ header, headerSrc }];
       bool fp = isFP(header);
+      bool vec = isa<MovVOp>(mv);
       Reg tmp = fp ? fspillReg2 : spillReg2;
       RD(mv) = tmp;
       mv->moveBefore(term);
@@ -870,7 +1071,10 @@ void RegAlloc::runImpl(Region *region, bool isLeaf) {
 
       // Move from temp into the header.
       builder.setBeforeOp(term);
-      CREATE_MV(fp, header, tmp);
+      if (vec)
+        builder.create<MovVOp>({ RDC(header), RSC(tmp) });
+      else
+        CREATE_MV(fp, header, tmp);
     }
   }
 
@@ -897,6 +1101,20 @@ void RegAlloc::runImpl(Region *region, bool isLeaf) {
     }
   }
 
+  // Recomputes `ref`, which is in `remat`, into `reg`.
+  const auto rematerialize = [&](Op *ref, Reg reg, int delta) {
+    if (isa<MovIOp>(ref))
+      builder.create<MovIOp>({ RDC(reg), new IntAttr(V(ref)) });
+    else if (isa<AdrOp>(ref))
+      builder.create<AdrOp>({ RDC(reg), new NameAttr(NAME(ref)) });
+    else if (delta + frameAddr[ref] < 4096)
+      builder.create<AddXIOp>({ RDC(reg), RSC(Reg::sp), new IntAttr(delta + frameAddr[ref]) });
+    else {
+      builder.create<MovIOp>({ RDC(reg), new IntAttr(delta + frameAddr[ref]) });
+      builder.create<AddXOp>({ RDC(reg), RSC(Reg::sp), RS2C(reg) });
+    }
+  };
+
   // Deal with spilled variables.
   std::vector<Op*> remove;
   for (auto bb : region->getBlocks()) {
@@ -917,8 +1135,9 @@ void RegAlloc::runImpl(Region *region, bool isLeaf) {
 
       if (auto rd = op->find<SpilledRdAttr>()) {
         // We will rematerialize them later.
-        if (isa<MovIOp>(rd->ref) || isa<AdrOp>(rd->ref)) {
+        if (remat.count(rd->ref)) {
           remove.push_back(op);
+          rematerialized++;
           continue;
         }
 
@@ -944,12 +1163,8 @@ void RegAlloc::runImpl(Region *region, bool isLeaf) {
         auto reg = fp ? fspillReg : spillReg;
 
         builder.setBeforeOp(op);
-        // Rematerialized.
-        auto ref = rs->ref;
-        if (isa<MovIOp>(ref))
-          builder.create<MovIOp>({ RDC(reg), new IntAttr(V(ref)) });
-        else if (isa<AdrOp>(ref))
-          builder.create<AdrOp>({ RDC(reg), new NameAttr(NAME(ref)) });
+        if (remat.count(rs->ref))
+          rematerialize(rs->ref, reg, delta);
         else if (offset < delta)
           builder.create<FmovDOp>({ RDC(reg), RSC(Reg(delta - offset)) });
         else if (offset < 16384) {
@@ -967,11 +1182,8 @@ void RegAlloc::runImpl(Region *region, bool isLeaf) {
         auto reg = fp ? fspillReg2 : spillReg2;
 
         builder.setBeforeOp(op);
-        auto ref = rs2->ref;
-        if (isa<MovIOp>(ref))
-          builder.create<MovIOp>({ RDC(reg), new IntAttr(V(ref)) });
-        else if (isa<AdrOp>(ref))
-          builder.create<AdrOp>({ RDC(reg), new NameAttr(NAME(ref)) });
+        if (remat.count(rs2->ref))
+          rematerialize(rs2->ref, reg, delta);
         else if (offset < delta)
           builder.create<FmovDOp>({ RDC(reg), RSC(Reg(delta - offset)) });
         else if (offset < 16384) {
@@ -989,11 +1201,8 @@ void RegAlloc::runImpl(Region *region, bool isLeaf) {
         auto reg = fp ? fspillReg3 : spillReg3;
 
         builder.setBeforeOp(op);
-        auto ref = rs3->ref;
-        if (isa<MovIOp>(ref))
-          builder.create<MovIOp>({ RDC(reg), new IntAttr(V(ref)) });
-        else if (isa<AdrOp>(ref))
-          builder.create<AdrOp>({ RDC(reg), new NameAttr(NAME(ref)) });
+        if (remat.count(rs3->ref))
+          rematerialize(rs3->ref, reg, delta);
         else if (offset < delta)
           builder.create<FmovDOp>({ RDC(reg), RSC(Reg(delta - offset)) });
         else if (offset < 16384) {
@@ -1011,17 +1220,15 @@ void RegAlloc::runImpl(Region *region, bool isLeaf) {
     op->erase();
 }
 
-void RegAlloc::run() {
+void RegAlloc::runOnFunction(FuncOp *func) {
+  auto calls = func->findAll<BlOp>();
+  auto clones = func->findAll<CloneOp>();
+  runImpl(func->getRegion(), calls.empty() && clones.empty());
+}
+
+void RegAlloc::finish() {
   auto funcs = collectFuncs();
   fnMap = getFunctionMap();
-  std::set<FuncOp*> leaves;
-
-  for (auto func : funcs) {
-    auto calls = func->findAll<BlOp>();
-    if (calls.size() == 0)
-      leaves.insert(func);
-    runImpl(func->getRegion(), calls.size() == 0);
-  }
 
   // Have a look at what registers are used inside each function.
   for (auto func : funcs) {
@@ -1039,7 +1246,16 @@ void RegAlloc::run() {
   }
 
   for (auto func : funcs) {
-    proEpilogue(func, leaves.count(func));
+    // Calls are still there after allocation.
+    bool isLeaf = func->findAll<BlOp>().empty() && func->findAll<CloneOp>().empty();
+    proEpilogue(func, isLeaf);
     tidyup(func->getRegion());
   }
 }
+
+void RegAlloc::run() {
+  auto funcs = collectFuncs();
+  for (auto func : funcs)
+    runOnFunction(func);
+  finish();
+}
@@ -184,6 +184,15 @@ int RegAlloc::latePeephole(Op *funcOp) {
     return false;
   });
 
+  runRewriter(funcOp, [&](MovVOp *op) {
+    if (RD(op) == RS(op)) {
+      converted++;
+      op->erase();
+      return true;
+    }
+    return false;
+  });
+
   return converted;
 }
 
@@ -0,0 +1,207 @@
+#include "ArmPasses.h"
+#include "Regs.h"
+
+using namespace sys;
+using namespace sys::arm;
+
+Schedule::Schedule(ModuleOp *module): ListSchedule(module) {
+  intRegs = normalRegCnt;
+  fpRegs = normalRegCntf;
+}
+
+#define ACCESS(Ty, role, addr, sz, imm) \
+  case Ty::id: \
+    access.base = op->DEF(addr); \
+    access.size = sz; \
+    access.offset = imm ? V(op) : 0; \
+    access.known = true; \
+    return role
+
+// The register-offset forms can be anywhere around the base.
+#define ACCESS_R(Ty, role, addr) \
+  case Ty::id: \
+    access.base = op->DEF(addr); \
+    return role
+
+ListSchedule::Role Schedule::classify(Op *op, Access &access) {
+  switch (op->opid) {
+  ACCESS(LdrWOp, Load, 0, 4, true);
+  ACCESS(LdrXOp, Load, 0, 8, true);
+  ACCESS(LdrFOp, Load, 0, 4, true);
+  ACCESS(LdrDOp, Load, 0, 8, true);
+  ACCESS(StrWOp, Store, 1, 4, true);
+  ACCESS(StrXOp, Store, 1, 8, true);
+  ACCESS(StrFOp, Store, 1, 4, true);
+  ACCESS(StrDOp, Store, 1, 8, true);
+
+  // Post-increments access the base itself, and add the immediate afterwards.
+  ACCESS(LdrWPOp, Load, 0, 4, false);
+  ACCESS(LdrXPOp, Load, 0, 8, false);
+  ACCESS(LdrFPOp, Load, 0, 4, false);
+  ACCESS(StrWPOp, Store, 1, 4, false);
+  ACCESS(StrXPOp, Store, 1, 8, false);
+  ACCESS(StrFPOp, Store, 1, 4, false);
+
+  ACCESS(Ld1Op, Load, 0, 16, false);
+  ACCESS(St1Op, Store, 1, 16, false);
+
+  ACCESS_R(LdrWROp, Load, 0);
+  ACCESS_R(LdrXROp, Load, 0);
+  ACCESS_R(LdrFROp, Load, 0);
+  ACCESS_R(StrWROp, Store, 1);
+  ACCESS_R(StrXROp, Store, 1);
+  ACCESS_R(StrFROp, Store, 1);
+
+  // The sequence around a call must stay as it is, and so must threading.
+  case BlOp::id:
+  case WriteRegOp::id:
+  case SubSpOp::id:
+  case PlaceHolderOp::id:
+  case CloneOp::id:
+  // Sets flags.
+  case SubSWOp::id:
+    return Barrier;
+
+  // Reading `sp` or `xzr` is the only register read that can move.
+  case ReadRegOp::id:
+    return REG(op) == Reg::sp || REG(op) == Reg::xzr ? Plain : Barrier;
+
+  default:
+    return Plain;
+  }
+}
+
+#undef ACCESS
+#undef ACCESS_R
+
+// Roughly a Cortex-A72.
+int Schedule::latency(Op *op) {
+  switch (op->opid) {
+  case MulWOp::id:
+  case MaddWOp::id:
+  case MsubWOp::id:
+  case SmullOp::id:
+    return 3;
+  case MulXOp::id:
+  case MaddXOp::id:
+  case MsubXOp::id:
+    return 5;
+  case SdivWOp::id:
+  case UdivWOp::id:
+    return 12;
+  case SdivXOp::id:
+    return 20;
+
+  case LdrWOp::id:
+  case LdrXOp::id:
+  case LdrFOp::id:
+  case LdrDOp::id:
+  case LdrWROp::id:
+  case LdrXROp::id:
+  case LdrFROp::id:
+  case LdrWPOp::id:
+  case LdrXPOp::id:
+  case LdrFPOp::id:
+    return 4;
+  case Ld1Op::id:
+    return 5;
+
+  case FaddOp::id:
+  case FsubOp::id:
+  case FmulOp::id:
+  case ScvtfOp::id:
+  case FcvtzsOp::id:
+  case AddVOp::id:
+  case SubVOp::id:
+  case MulVOp::id:
+  case MlaVOp::id:
+  case FaddVOp::id:
+  case FsubVOp::id:
+  case FmulVOp::id:
+  case AddvOp::id:
+    return 4;
+  case FmaddOp::id:
+  case FmsubOp::id:
+    return 7;
+  case FdivOp::id:
+    return 11;
+  case FmovWOp::id:
+  case FmovXOp::id:
+  case FmovOp::id:
+  case FnegOp::id:
+  case DupOp::id:
+  case DupFOp::id:
+  case UmovOp::id:
+  case DupSOp::id:
+    return 3;
+  case CmeqVOp::id:
+  case CmgtVOp::id:
+  case CmgeVOp::id:
+  case FcmeqVOp::id:
+  case FcmgtVOp::id:
+  case FcmgeVOp::id:
+  case AndVOp::id:
+  case BicVOp::id:
+  case OrrVOp::id:
+  case MovVOp::id:
+    return 2;
+
+  // A compare, then a conditional op.
+  case CsetNeOp::id:
+  case CsetEqOp::id:
+  case CsetLtOp::id:
+  case CsetLeOp::id:
+  case CsetGtOp::id:
+  case CsetGeOp::id:
+  case CsetNeTstOp::id:
+  case CsetEqTstOp::id:
+  case CnegLtZOp::id:
+  case CselEqZOp::id:
+  case CselNeZOp::id:
+  case CselLtZOp::id:
+  case CselLeZOp::id:
+  case CselGtZOp::id:
+  case CselGeZOp::id:
+    return 2;
+  case CsetNeFOp::id:
+  case CsetEqFOp::id:
+  case CsetLtFOp::id:
+  case CsetLeFOp::id:
+  case CsetGtFOp::id:
+  case CsetGeFOp::id:
+  case CsetNeFcmpZOp::id:
+  case CsetEqFcmpZOp::id:
+    return 4;
+
+  // Shifted operands take another cycle.
+  case AddWLOp::id:
+  case AddWROp::id:
+  case AddWAROp::id:
+  case AddXLOp::id:
+  case AddXROp::id:
+    return 2;
+
+  case ReadRegOp::id:
+  case WriteRegOp::id:
+  case PlaceHolderOp::id:
+  case SubSpOp::id:
+  case PhiOp::id:
+    return 0;
+
+  default:
+    return 1;
+  }
+}
+
+Op *Schedule::updates(Op *op) {
+  if (isa<LdrWPOp>(op) || isa<LdrXPOp>(op) || isa<LdrFPOp>(op))
+    return op->DEF(0);
+  if (isa<StrWPOp>(op) || isa<StrXPOp>(op) || isa<StrFPOp>(op))
+    return op->DEF(1);
+  return nullptr;
+}
+
+bool Schedule::fpResult(Op *op) {
+  auto ty = op->getResultType();
+  return ty == Value::f32 || ty == Value::i128 || ty == Value::f128;
+}
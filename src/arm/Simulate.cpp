@@ -0,0 +1,470 @@
+#include "ArmOps.h"
+#include "ArmAttrs.h"
+#include "Regs.h"
+#include "../codegen/Attrs.h"
+#include "../utils/MachineExec.h"
+
+using namespace sys;
+using namespace sys::exec;
+using namespace sys::arm;
+
+ArmInterpreter::ArmInterpreter(ModuleOp *module, bool allocated): MachineInterpreter(module, allocated) {
+  spReg = (int) Reg::sp;
+  zeroReg = (int) Reg::xzr;
+  linkReg = (int) Reg::x30;
+  for (auto reg : arm::argRegs)
+    argRegs.push_back((int) reg);
+  for (auto reg : arm::fargRegs)
+    fargRegs.push_back((int) reg);
+  for (auto reg : arm::calleeSaved)
+    calleeSaved.push_back((int) reg);
+  for (auto reg : arm::callerSaved)
+    callerSaved.push_back((int) reg);
+  // Writing a w-register clears the upper half.
+  intExt = W32Z;
+  // `sdiv` and `udiv` give zero when dividing by zero.
+  divByZero = 0;
+}
+
+int ArmInterpreter::frameSize(Op *func) {
+  return func->has<arm::StackOffsetAttr>() ? STACKOFF(func) : 0;
+}
+
+// Before allocation, sources are operands; after it, they're `rs`, `rs2` and `rs3`.
+int ArmInterpreter::source(Op *op, int i) {
+  if (!allocated)
+    return slot(op->DEF(i));
+  return reg((int) (i == 0 ? RS(op) : i == 1 ? RS2(op) : RS3(op)));
+}
+
+int ArmInterpreter::dest(Op *op) {
+  if (!allocated)
+    return slot(op);
+  return regDest((int) RD(op));
+}
+
+// Whether `op`, which writes `reg`, brings back a spilled value.
+// The spill registers only hold spilled values around their uses,
+// so that's when the next access to `reg` in the block reads it.
+bool ArmInterpreter::reloads(Op *op, int reg) {
+  if (!allocated)
+    return false;
+  auto r = (Reg) reg;
+  if (r != arm::spillReg && r != arm::spillReg2 && r != arm::spillReg3 &&
+      r != arm::fspillReg && r != arm::fspillReg2 && r != arm::fspillReg3)
+    return false;
+
+  for (auto runner = op->nextOp(); runner; runner = runner->nextOp()) {
+    if ((runner->has<arm::RsAttr>() && RS(runner) == r) ||
+        (runner->has<arm::Rs2Attr>() && RS2(runner) == r) ||
+        (runner->has<arm::Rs3Attr>() && RS3(runner) == r))
+      return true;
+    if (runner->has<arm::RdAttr>() && RD(runner) == r)
+      return false;
+  }
+  return false;
+}
+
+#define TERNARY(Ty, kind, w) \
+  case arm::Ty::id: \
+    inst.code = kind; \
+    inst.width = w; \
+    inst.rd = dest(op); \
+    inst.a = source(op, 0); \
+    inst.b = source(op, 1); \
+    inst.c = source(op, 2); \
+    break
+
+#define BINARY(Ty, kind, w) \
+  case arm::Ty::id: \
+    inst.code = kind; \
+    inst.width = w; \
+    inst.rd = dest(op); \
+    inst.a = source(op, 0); \
+    inst.b = source(op, 1); \
+    break
+
+// The immediate is a shift amount instead.
+#define BINARY_SHIFT(Ty, kind, w) \
+  case arm::Ty::id: \
+    inst.code = kind; \
+    inst.width = w; \
+    inst.rd = dest(op); \
+    inst.a = source(op, 0); \
+    inst.b = source(op, 1); \
+    inst.shift = V(op); \
+    break
+
+#define UNARY_I(Ty, kind, w) \
+  case arm::Ty::id: \
+    inst.code = kind; \
+    inst.width = w; \
+    inst.rd = dest(op); \
+    inst.a = source(op, 0); \
+    inst.imm = V(op); \
+    break
+
+#define UNARY(Ty, kind, w) \
+  case arm::Ty::id: \
+    inst.code = kind; \
+    inst.width = w; \
+    inst.rd = dest(op); \
+    inst.a = source(op, 0); \
+    break
+
+// `cmp` (or `fcmp`, `tst`) and then `cset`.
+#define CSET(Ty, kind, cmp) \
+  case arm::Ty::id: \
+    inst.code = kind; \
+    inst.cond = cmp; \
+    inst.width = W32Z; \
+    inst.rd = dest(op); \
+    inst.a = source(op, 0); \
+    inst.b = source(op, 1); \
+    inst.weight = 2; \
+    break
+
+// `fcmp` against zero and then `cset`.
+#define CSET_Z(Ty, cmp) \
+  case arm::Ty::id: \
+    inst.code = CsetF; \
+    inst.cond = cmp; \
+    inst.rd = dest(op); \
+    inst.a = source(op, 0); \
+    inst.weight = 2; \
+    break
+
+// Compares lane by lane into a mask.
+#define CMPV(Ty, kind, cmp) \
+  case arm::Ty::id: \
+    inst.code = kind; \
+    inst.cond = cmp; \
+    inst.rd = dest(op); \
+    inst.a = source(op, 0); \
+    inst.b = source(op, 1); \
+    break
+
+// `cmp` against zero and then `csel`.
+#define CSEL(Ty, cmp) \
+  case arm::Ty::id: \
+    inst.code = Csel; \
+    inst.cond = cmp; \
+    inst.width = W32Z; \
+    inst.rd = dest(op); \
+    inst.a = source(op, 0); \
+    inst.b = source(op, 1); \
+    inst.c = source(op, 2); \
+    inst.weight = 2; \
+    break
+
+// `cmp` and then a conditional branch.
+#define BRANCH(Ty, cmp) \
+  case arm::Ty::id: \
+    inst.code = Branch; \
+    inst.cond = cmp; \
+    inst.width = W32Z; \
+    inst.a = source(op, 0); \
+    inst.b = source(op, 1); \
+    inst.weight = 2; \
+    break
+
+// Branches on a single register against zero.
+#define BRANCH_Z(Ty, cmp) \
+  case arm::Ty::id: \
+    inst.code = Branch; \
+    inst.cond = cmp; \
+    inst.width = W32Z; \
+    inst.a = source(op, 0); \
+    inst.imm = 0; \
+    break
+
+#define LOAD(Ty, kind, sz, w) \
+  case arm::Ty::id: \
+    inst.code = kind; \
+    inst.width = w; \
+    inst.size = sz; \
+    inst.rd = dest(op); \
+    inst.a = source(op, 0); \
+    if (kind == LoadIdx) \
+      inst.b = source(op, 1), inst.shift = V(op); \
+    else if (sz != 16) \
+      inst.imm = V(op); \
+    inst.reload = allocated && reloads(op, (int) RD(op)); \
+    break
+
+#define STORE(Ty, kind, sz) \
+  case arm::Ty::id: \
+    inst.code = kind; \
+    inst.size = sz; \
+    inst.a = source(op, 0); \
+    inst.b = source(op, 1); \
+    if (kind == StoreIdx) \
+      inst.c = source(op, 2), inst.shift = V(op); \
+    else if (sz != 16) \
+      inst.imm = V(op); \
+    break
+
+void ArmInterpreter::decode(Op *op, Inst &inst) {
+  switch (op->opid) {
+  case arm::MovIOp::id:
+    inst.code = Li;
+    inst.rd = dest(op);
+    inst.imm = (uint32_t) V(op);
+    break;
+  case arm::MovnOp::id:
+    inst.code = Li;
+    inst.rd = dest(op);
+    inst.imm = (uint32_t) ~(uint32_t) V(op);
+    break;
+  case arm::MovkOp::id:
+    inst.code = Movk;
+    inst.width = W32Z;
+    inst.rd = dest(op);
+    inst.imm = V(op);
+    inst.shift = LSL(op);
+    break;
+  case arm::AdrOp::id:
+    inst.code = Li;
+    inst.rd = dest(op);
+    inst.imm = address(NAME(op));
+    // `adrp` + `add`.
+    inst.weight = 2;
+    break;
+
+  UNARY(MovROp, Mov, W64);
+  UNARY(FmovWOp, MovS, W64);
+  UNARY(FmovOp, MovS, W64);
+  UNARY(FmovXOp, Mov64, W64);
+  UNARY(NegOp, Neg, W32Z);
+  UNARY(FnegOp, Fneg, W64);
+  UNARY(ScvtfOp, Scvtf, W64);
+  UNARY(FcvtzsOp, Fcvtzs, W32Z);
+  UNARY(DupOp, Dup, W64);
+  UNARY(DupFOp, Dup, W64);
+  UNARY(MovVOp, Mov, W64);
+  UNARY(AddvOp, AddAcross, W64);
+  UNARY_I(UmovOp, Lane, W64);
+  UNARY_I(DupSOp, Lane, W64);
+
+  case arm::FmovDOp::id:
+    inst.code = Mov64;
+    inst.rd = dest(op);
+    inst.a = source(op, 0);
+    inst.reload = allocated && reloads(op, (int) RD(op));
+    break;
+
+  BINARY(AddWOp, Add, W32Z);
+  BINARY(AddXOp, Add, W64);
+  BINARY(SubWOp, Sub, W32Z);
+  BINARY(SubSWOp, Sub, W32Z);
+  BINARY(SubXOp, Sub, W64);
+  BINARY(MulWOp, Mul, W32Z);
+  BINARY(MulXOp, Mul, W64);
+  BINARY(SdivWOp, Div, W32Z);
+  BINARY(SdivXOp, Div, W64);
+  BINARY(UdivWOp, Udiv, W32Z);
+  BINARY(SmullOp, Smull, W64);
+  BINARY(AndOp, And, W64);
+  BINARY(OrOp, Or, W64);
+  BINARY(EorOp, Xor, W64);
+  BINARY(LslWOp, Sll, W32Z);
+  BINARY(LslXOp, Sll, W64);
+  BINARY(LsrWOp, Srl, W32Z);
+  BINARY(LsrXOp, Srl, W64);
+  BINARY(AsrWOp, Sra, W32Z);
+  BINARY(AsrXOp, Sra, W64);
+  BINARY(FaddOp, Fadd, W64);
+  BINARY(FsubOp, Fsub, W64);
+  BINARY(FmulOp, Fmul, W64);
+  BINARY(FdivOp, Fdiv, W64);
+  BINARY(AddVOp, AddV, W64);
+  BINARY(SubVOp, SubV, W64);
+  BINARY(MulVOp, MulV, W64);
+  BINARY(FaddVOp, FaddV, W64);
+  BINARY(FsubVOp, FsubV, W64);
+  BINARY(FmulVOp, FmulV, W64);
+  BINARY(AndVOp, AndV, W64);
+  BINARY(BicVOp, BicV, W64);
+  BINARY(OrrVOp, OrrV, W64);
+
+  BINARY_SHIFT(AddWLOp, AddLsl, W32Z);
+  BINARY_SHIFT(AddXLOp, AddLsl, W64);
+  BINARY_SHIFT(AddWROp, AddLsr, W32Z);
+  BINARY_SHIFT(AddXROp, AddLsr, W64);
+  BINARY_SHIFT(AddWAROp, AddAsr, W32Z);
+
+  UNARY_I(AddWIOp, Add, W32Z);
+  UNARY_I(AddXIOp, Add, W64);
+  UNARY_I(SubWIOp, Sub, W32Z);
+  UNARY_I(AndIOp, And, W64);
+  UNARY_I(OrIOp, Or, W64);
+  UNARY_I(EorIOp, Xor, W64);
+  UNARY_I(LslWIOp, Sll, W32Z);
+  UNARY_I(LslXIOp, Sll, W64);
+  UNARY_I(LsrWIOp, Srl, W32Z);
+  UNARY_I(LsrXIOp, Srl, W64);
+  UNARY_I(AsrWIOp, Sra, W32Z);
+  UNARY_I(AsrXIOp, Sra, W64);
+
+  TERNARY(MaddWOp, Madd, W32Z);
+  TERNARY(MaddXOp, Madd, W64);
+  TERNARY(MsubWOp, Msub, W32Z);
+  TERNARY(MsubXOp, Msub, W64);
+  TERNARY(FmaddOp, Fmadd, W64);
+  TERNARY(FmsubOp, Fmsub, W64);
+
+  // `mla` accumulates into its destination.
+  case arm::MlaVOp::id:
+    inst.code = MlaV;
+    inst.rd = dest(op);
+    inst.a = source(op, 0);
+    inst.b = source(op, 1);
+    inst.c = reg((int) RD(op));
+    break;
+
+  CMPV(CmeqVOp, CmpV, Eq);
+  CMPV(CmgtVOp, CmpV, Gt);
+  CMPV(CmgeVOp, CmpV, Ge);
+  CMPV(FcmeqVOp, CmpFV, Eq);
+  CMPV(FcmgtVOp, CmpFV, Gt);
+  CMPV(FcmgeVOp, CmpFV, Ge);
+
+  CSET(CsetEqOp, Cset, Eq);
+  CSET(CsetNeOp, Cset, Ne);
+  CSET(CsetLtOp, Cset, Lt);
+  CSET(CsetLeOp, Cset, Le);
+  CSET(CsetGtOp, Cset, Gt);
+  CSET(CsetGeOp, Cset, Ge);
+  CSET(CsetEqFOp, CsetF, Eq);
+  CSET(CsetNeFOp, CsetF, Ne);
+  CSET(CsetLtFOp, CsetF, Lt);
+  CSET(CsetLeFOp, CsetF, Le);
+  CSET(CsetGtFOp, CsetF, Gt);
+  CSET(CsetGeFOp, CsetF, Ge);
+  CSET(CsetEqTstOp, CsetTst, Eq);
+  CSET(CsetNeTstOp, CsetTst, Ne);
+  CSET_Z(CsetEqFcmpZOp, Eq);
+  CSET_Z(CsetNeFcmpZOp, Ne);
+
+  case arm::CnegLtZOp::id:
+    inst.code = Cneg;
+    inst.width = W32Z;
+    inst.rd = dest(op);
+    inst.a = source(op, 0);
+    inst.b = source(op, 1);
+    inst.weight = 2;
+    break;
+
+  CSEL(CselEqZOp, Eq);
+  CSEL(CselNeZOp, Ne);
+  CSEL(CselLtZOp, Lt);
+  CSEL(CselLeZOp, Le);
+  CSEL(CselGtZOp, Gt);
+  CSEL(CselGeZOp, Ge);
+
+  LOAD(LdrWOp, Load, 4, W32Z);
+  LOAD(LdrXOp, Load, 8, W64);
+  LOAD(LdrFOp, Load, 4, W32Z);
+  LOAD(LdrDOp, Load, 8, W64);
+  LOAD(LdrWROp, LoadIdx, 4, W32Z);
+  LOAD(LdrXROp, LoadIdx, 8, W64);
+  LOAD(LdrFROp, LoadIdx, 4, W32Z);
+  LOAD(LdrWPOp, LoadPost, 4, W32Z);
+  LOAD(LdrXPOp, LoadPost, 8, W64);
+  LOAD(LdrFPOp, LoadPost, 4, W32Z);
+  LOAD(Ld1Op, Load, 16, W64);
+
+  STORE(StrWOp, Store, 4);
+  STORE(StrXOp, Store, 8);
+  STORE(StrFOp, Store, 4);
+  STORE(StrDOp, Store, 8);
+  STORE(StrWROp, StoreIdx, 4);
+  STORE(StrXROp, StoreIdx, 8);
+  STORE(StrFROp, StoreIdx, 4);
+  STORE(StrWPOp, StorePost, 4);
+  STORE(StrXPOp, StorePost, 8);
+  STORE(StrFPOp, StorePost, 4);
+  STORE(St1Op, Store, 16);
+
+  // Only in prologues and epilogues, after allocation.
+  case arm::LdpXOp::id:
+  case arm::LdpDOp::id:
+    inst.code = LoadPair;
+    inst.size = 8;
+    inst.rd = regDest((int) RS(op));
+    inst.c = regDest((int) RS2(op));
+    inst.a = reg((int) RS3(op));
+    inst.imm = V(op);
+    break;
+  case arm::StpXOp::id:
+  case arm::StpDOp::id:
+    inst.code = StorePair;
+    inst.size = 8;
+    inst.a = reg((int) RS(op));
+    inst.b = reg((int) RS2(op));
+    inst.c = reg((int) RS3(op));
+    inst.imm = V(op);
+    break;
+
+  BRANCH(BeqOp, Eq);
+  BRANCH(BneOp, Ne);
+  BRANCH(BltOp, Lt);
+  BRANCH(BleOp, Le);
+  BRANCH(BgtOp, Gt);
+  BRANCH(BgeOp, Ge);
+  BRANCH_Z(CbzOp, Eq);
+  BRANCH_Z(CbnzOp, Ne);
+  BRANCH_Z(BmiOp, Lt);
+  BRANCH_Z(BplOp, Ge);
+
+  case arm::BOp::id:
+    inst.code = Jump;
+    break;
+  case arm::BlOp::id:
+    inst.code = Call;
+    break;
+  case arm::RetOp::id:
+    inst.code = Ret;
+    break;
+
+  // Simulation runs the worker over the whole range on the calling thread.
+  // The weight is the instructions Dump emits for it.
+  case arm::CloneOp::id:
+    inst.code = Call;
+    inst.weight = 3;
+    break;
+
+  // Pseudo-ops that only exist before allocation, and don't become instructions.
+  case arm::SubSpOp::id:
+    inst.code = SubSp;
+    inst.imm = V(op);
+    inst.weight = 0;
+    break;
+  case arm::ReadRegOp::id:
+    inst.code = Mov;
+    inst.rd = dest(op);
+    inst.a = reg((int) REG(op));
+    inst.weight = 0;
+    break;
+  case arm::WriteRegOp::id:
+    inst.code = Mov;
+    inst.rd = regDest((int) REG(op));
+    inst.a = source(op, 0);
+    inst.weight = 0;
+    break;
+  case arm::PlaceHolderOp::id:
+    inst.weight = 0;
+    if (!allocated && op->getOperandCount()) {
+      inst.code = Mov;
+      inst.rd = dest(op);
+      inst.a = source(op, 0);
+    } else
+      inst.code = Nop;
+    break;
+
+  default:
+    // Only an error if it's actually reached.
+    inst.code = Unknown;
+    break;
+  }
+}
@@ -24,7 +24,7 @@ void hoistMovi(LoopInfo *loop) {
   auto term = loop->preheader->getLastOp();
 
   for (auto bb : loop->bbs) {
-    auto ops = bb->getOps();
+    std::vector<Op*> ops = bb->getOps();
     for (auto op : ops) {
       if (isa<MovIOp>(op))
         op->moveBefore(term);
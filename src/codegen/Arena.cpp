@@ -0,0 +1,89 @@
+#include "Arena.h"
+
+#include <algorithm>
+
+using namespace sys;
+
+thread_local Arena *Arena::current = nullptr;
+
+Arena::~Arena() {
+  for (auto child : children)
+    delete child;
+  for (auto chunk : chunks)
+    ::operator delete(chunk);
+
+  if (current == this)
+    current = nullptr;
+}
+
+void Arena::refill() {
+  auto chunk = (char*) ::operator new(chunkSize);
+  chunks.push_back(chunk);
+  cur = chunk;
+  end = chunk + chunkSize;
+}
+
+void *Arena::allocate(size_t size) {
+  size = (size + align - 1) & ~(align - 1);
+  live += size;
+  peak = std::max(peak, live);
+
+  if (size > maxSmall)
+    return ::operator new(size);
+
+  auto &head = freeList[size / align];
+  if (head) {
+    auto node = head;
+    head = node->next;
+    reused++;
+    return node;
+  }
+
+  // The tail of the old chunk is simply abandoned.
+  if (cur + size > end)
+    refill();
+
+  auto p = cur;
+  cur += size;
+  return p;
+}
+
+void Arena::deallocate(void *p, size_t size) {
+  size = (size + align - 1) & ~(align - 1);
+  live -= size;
+
+  if (size > maxSmall) {
+    ::operator delete(p);
+    return;
+  }
+
+  auto &head = freeList[size / align];
+  auto node = (FreeNode*) p;
+  node->next = head;
+  head = node;
+}
+
+Arena *Arena::fork() {
+  auto child = new Arena;
+  children.push_back(child);
+  return child;
+}
+
+std::map<std::string, int> Arena::stats() const {
+  // An object can be freed into another arena than the one it came from,
+  // so only the sum of `live` makes sense (and it wraps around correctly).
+  // The peaks of children are summed, which overestimates.
+  size_t totalLive = live, totalPeak = peak, totalChunks = chunks.size(), totalReused = reused;
+  for (auto child : children) {
+    totalLive += child->live;
+    totalPeak += child->peak;
+    totalChunks += child->chunks.size();
+    totalReused += child->reused;
+  }
+  return {
+    { "live-bytes", (int) totalLive },
+    { "peak-bytes", (int) totalPeak },
+    { "chunks", (int) totalChunks },
+    { "reused-objects", (int) totalReused },
+  };
+}
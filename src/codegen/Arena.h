@@ -0,0 +1,75 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <map>
+#include <new>
+#include <string>
+#include <vector>
+
+namespace sys {
+
+// A bump allocator backing every Op, BasicBlock, Region and Attr of a module.
+//
+// Memory is carved out of large chunks. Freed objects go to a free list
+// segregated by (rounded) size; since every IR class has a fixed size,
+// that is effectively one free list per type. Chunks are only returned
+// to the system when the arena itself dies, together with its module.
+//
+// An arena isn't thread-safe. Threads working on the same module each
+// allocate from a child made by fork(); objects may be freed into any of them.
+class Arena {
+  struct FreeNode {
+    FreeNode *next;
+  };
+
+  // All sizes are rounded up to this.
+  constexpr static size_t align = alignof(std::max_align_t);
+  // Objects larger than this bypass the arena (e.g. nothing in practice).
+  constexpr static size_t maxSmall = 1024;
+  constexpr static size_t chunkSize = 256 * 1024;
+
+  std::vector<char*> chunks;
+  std::vector<Arena*> children;
+  char *cur = nullptr;
+  char *end = nullptr;
+  FreeNode *freeList[maxSmall / align + 1] = {};
+
+  size_t live = 0;
+  size_t peak = 0;
+  size_t reused = 0;
+
+  void refill();
+public:
+  // The arena of the module currently being built/transformed, for this thread.
+  // Objects allocated while it's null come from the global heap.
+  static thread_local Arena *current;
+
+  Arena() = default;
+  Arena(const Arena &other) = delete;
+  ~Arena();
+
+  void *allocate(size_t size);
+  void deallocate(void *p, size_t size);
+  // A child arena that lives as long as this one. Its stats are counted here.
+  Arena *fork();
+
+  size_t liveBytes() const { return live; }
+  size_t peakBytes() const { return peak; }
+  std::map<std::string, int> stats() const;
+
+  // Entry points for class-specific operator new/delete.
+  static void *alloc(size_t size) {
+    return current ? current->allocate(size) : ::operator new(size);
+  }
+  static void dealloc(void *p, size_t size) {
+    if (current)
+      current->deallocate(p, size);
+    else
+      ::operator delete(p);
+  }
+};
+
+}
+
+#endif
@@ -266,3 +266,21 @@ std::string DimensionAttr::toString() {
   ss << ">";
   return ss.str();
 }
+
+std::string ProfileAttr::toString() {
+  std::stringstream ss;
+  ss << "<profile = " << count;
+  if (taken)
+    ss << ", taken = " << taken;
+  if (trips >= 0)
+    ss << ", trips = " << trips;
+  ss << ">";
+  return ss.str();
+}
+
+long long sys::frequency(BasicBlock *bb) {
+  if (!bb->getOpCount())
+    return -1;
+  auto attr = bb->getLastOp()->find<ProfileAttr>();
+  return attr ? attr->count : -1;
+}
@@ -49,8 +49,8 @@ public:
 };
 
 // A map for printing purposes.
-extern std::map<BasicBlock*, int> bbmap;
-extern int bbid;
+extern thread_local std::map<BasicBlock*, int> bbmap;
+extern thread_local int bbid;
 
 // The target for GotoOp, and for BranchOp if the condition is true.
 class TargetAttr : public AttrImpl<TargetAttr, __LINE__> {
@@ -124,6 +124,14 @@ public:
   AtMostOnceAttr *clone() override { return new AtMostOnceAttr; }
 };
 
+// A function running chunks of a parallel loop, as `f(lo, hi)`.
+// Calls to it hand the whole range to the thread pool, so it must stay a function of its own.
+class WorkerAttr : public AttrImpl<WorkerAttr, __LINE__> {
+public:
+  std::string toString() override { return "<worker>"; }
+  WorkerAttr *clone() override { return new WorkerAttr; }
+};
+
 class ArgCountAttr : public AttrImpl<ArgCountAttr, __LINE__> {
 public:
   int count;
@@ -258,10 +266,35 @@ public:
   DimensionAttr *clone() override { return new DimensionAttr(dims); }
 };
 
+// Execution counts from an instrumented run of the interpreter (see the Profile pass).
+// On a block's terminator, `count` is how many times the block ran;
+// on a call, how many times the call ran.
+class ProfileAttr : public AttrImpl<ProfileAttr, __LINE__> {
+public:
+  // Counts from this on are considered hot.
+  static constexpr long long hot = 1000;
+
+  long long count;
+  // For a branch, how many times it went to the target rather than the else block.
+  long long taken;
+  // For the terminator of a loop header, the average iterations per entry to the loop.
+  // -1 if it's not a header.
+  long long trips;
+
+  ProfileAttr(long long count = 0, long long taken = 0, long long trips = -1):
+    count(count), taken(taken), trips(trips) {}
+
+  std::string toString() override;
+  ProfileAttr *clone() override { return new ProfileAttr(count, taken, trips); }
+};
+
 bool mustAlias(Op *a, Op *b);
 bool neverAlias(Op *a, Op *b);
 bool mayAlias(Op *a, Op *b);
 
+// How many times `bb` ran in the last profile, or -1 if that's unknown.
+long long frequency(BasicBlock *bb);
+
 }
 
 #define V(op) (op)->get<IntAttr>()->value
@@ -276,5 +309,6 @@ bool mayAlias(Op *a, Op *b);
 #define FROM(attr) cast<FromAttr>(attr)->bb
 #define INCR(op) (op)->get<IncreaseAttr>()
 #define DIM(op) (op)->get<DimensionAttr>()->dims
+#define PROFILE(op) (op)->get<ProfileAttr>()
 
 #endif
@@ -30,7 +30,7 @@ void Builder::setToBlockEnd(BasicBlock *block) {
 
 void Builder::setBeforeOp(Op *op) {
   bb = op->parent;
-  at = op->place;
+  at = op->getIterator();
   init = true;
 }
 
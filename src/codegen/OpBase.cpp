@@ -7,62 +7,46 @@
 
 using namespace sys;
 
-std::map<BasicBlock*, int> sys::bbmap;
-int sys::bbid = 0;
+thread_local std::map<BasicBlock*, int> sys::bbmap;
+thread_local int sys::bbid = 0;
 
 void BasicBlock::insert(iterator at, Op *op) {
   op->parent = this;
-  op->place = ops.insert(at, op);
+  ops.insert(at, op);
 }
 
 void BasicBlock::insertAfter(iterator at, Op *op) {
   op->parent = this;
   if (at == ops.end()) {
     ops.push_back(op);
-    op->place = --end();
     return;
   }
-  op->place = ops.insert(++at, op);
+  ops.insert(++at, op);
 }
 
 void BasicBlock::remove(iterator at) {
-  ops.erase(at);
-}
-
-BasicBlock *BasicBlock::nextBlock() const {
-  auto it = place;
-  return *++it;
-}
-
-Op *Op::prevOp() {
-  auto it = place;
-  if (it == parent->begin())
-    return nullptr;
-  return *--it;
-}
-
-Op *Op::nextOp() {
-  auto it = place;
-  if (++it == parent->end())
-    return nullptr;
-  return *it;
+  ops.remove(*at);
 }
 
 Value::Value(Op *from): defining(from) {}
 
 Op::Op(int id, Value::Type resultTy, const std::vector<Value> &values):
-  resultTy(resultTy), opid(id) {
-  for (auto x : values) {
-    operands.push_back(x);
-    x.defining->uses.insert(this);
+  uses(this), operands(values), resultTy(resultTy), opid(id) {
+  uselinks.reserve(values.size());
+  for (int i = 0; i < values.size(); i++) {
+    uselinks.emplace_back(this);
+    addUse(i);
   }
+  if (OpIndex::current)
+    OpIndex::current->insert(this);
 }
 
 Op::Op(int id, Value::Type resultTy, const std::vector<Value> &values, const std::vector<Attr*> &attrs):
-  resultTy(resultTy), opid(id) {
-  for (auto x : values) {
-    operands.push_back(x);
-    x.defining->uses.insert(this);
+  uses(this), operands(values), resultTy(resultTy), opid(id) {
+  uselinks.reserve(values.size());
+  for (int i = 0; i < values.size(); i++) {
+    uselinks.emplace_back(this);
+    addUse(i);
   }
   for (auto attr : attrs) {
     auto cloned = attr->clone();
@@ -71,6 +55,8 @@ Op::Op(int id, Value::Type resultTy, const std::vector<Value> &values, const std
     if (!attr->refcnt)
       delete attr;
   }
+  if (OpIndex::current)
+    OpIndex::current->insert(this);
 }
 
 void indent(std::ostream &os, int n) {
@@ -85,8 +71,22 @@ Region *Op::appendRegion() {
 }
 
 void Op::pushOperand(Value v) {
-  v.defining->uses.insert(this);
+  // Growing moves every Use; take them out of their chains meanwhile.
+  int n = operands.size();
+  bool grows = uselinks.size() == uselinks.capacity();
+  if (grows) {
+    for (int i = 0; i < n; i++)
+      unlink(i);
+  }
+
   operands.push_back(v);
+  uselinks.emplace_back(this);
+
+  if (grows) {
+    for (int i = 0; i < n; i++)
+      link(i);
+  }
+  addUse(n);
 }
 
 Op *Op::getParentOp() {
@@ -108,38 +108,41 @@ void Op::moveBefore(Op *op) {
   if (op == this)
     return;
 
-  parent->remove(place);
+  parent->ops.remove(this);
   parent = op->parent;
-  parent->insert(op->place, this);
+  parent->insert(op->getIterator(), this);
 }
 
 void Op::moveAfter(Op *op) {
   if (op == this)
     return;
   
-  parent->remove(place);
+  parent->ops.remove(this);
   parent = op->parent;
-  parent->insertAfter(op->place, this);
+  parent->insertAfter(op->getIterator(), this);
 }
 
 void Op::moveToEnd(BasicBlock *block) {
-  parent->remove(place);
+  parent->ops.remove(this);
   parent = block;
   parent->insert(parent->end(), this);
 }
 
 void Op::moveToStart(BasicBlock *block) {
-  parent->remove(place);
+  parent->ops.remove(this);
   parent = block;
   parent->insert(parent->begin(), this);
 }
 
 void Op::removeAllOperands() {
-  for (auto x : operands) {
-    auto op = x.defining;
-    op->uses.erase(this);
+  // Every slot goes away, so there's no need to hand `primary` over.
+  for (int i = 0; i < operands.size(); i++) {
+    unlink(i);
+    if (uselinks[i].primary)
+      operands[i].defining->uses.users--;
   }
   operands.clear();
+  uselinks.clear();
 }
 
 void Op::removeAllAttributes() {
@@ -166,30 +169,104 @@ void Op::removeRegion(Region *region) {
   }
 }
 
-// Remove `def`'s use if we don't refer to it anymore.
-void Op::removeOperandUse(Op *def) {
-  bool hasDef = false;
-  for (auto x : operands) {
-    if (x.defining == def) {
-      hasDef = true;
-      break;
+int UseList::count(Op *user) const {
+  for (auto x : user->operands) {
+    if (x.defining == owner)
+      return 1;
+  }
+  return 0;
+}
+
+void Op::link(int i) {
+  auto &list = operands[i].defining->uses;
+  auto &use = uselinks[i];
+  use.prev = nullptr;
+  use.next = list.head;
+  if (use.next)
+    use.next->prev = &use;
+  list.head = &use;
+  list.slots++;
+}
+
+void Op::unlink(int i) {
+  auto &list = operands[i].defining->uses;
+  auto &use = uselinks[i];
+  if (use.prev)
+    use.prev->next = use.next;
+  else
+    list.head = use.next;
+  if (use.next)
+    use.next->prev = use.prev;
+  list.slots--;
+}
+
+Use *Op::findOtherUse(int i) {
+  auto def = operands[i].defining;
+  auto self = &uselinks[i];
+
+  // Scan whichever is shorter. Phis can have thousands of operands,
+  // and constants thousands of uses, but rarely both.
+  // While constructing, only the slots before `uselinks.size()` are threaded yet.
+  if (uselinks.size() <= def->uses.slots) {
+    for (int j = 0; j < uselinks.size(); j++) {
+      if (j != i && operands[j].defining == def)
+        return &uselinks[j];
     }
+    return nullptr;
+  }
+
+  for (auto use = def->uses.head; use; use = use->next) {
+    if (use->user == this && use != self)
+      return use;
   }
-  if (!hasDef)
-    def->uses.erase(this);
+  return nullptr;
+}
+
+void Op::addUse(int i) {
+  auto &use = uselinks[i];
+
+  // Only the first slot referring to the op counts as a user.
+  use.primary = !findOtherUse(i);
+  if (use.primary)
+    operands[i].defining->uses.users++;
+
+  link(i);
+}
+
+void Op::dropUse(int i) {
+  auto &use = uselinks[i];
+  unlink(i);
+
+  if (!use.primary)
+    return;
+
+  // Hand over to another slot that still refers to the op, if any.
+  use.primary = false;
+  if (auto other = findOtherUse(i))
+    other->primary = true;
+  else
+    operands[i].defining->uses.users--;
 }
 
 void Op::setOperand(int i, Value v) {
-  auto def = operands[i].defining;
+  dropUse(i);
   operands[i] = v;
-  removeOperandUse(def);
-  v.defining->uses.insert(this);
+  addUse(i);
 }
 
 void Op::removeOperand(int i) {
-  auto def = operands[i].defining;
+  dropUse(i);
+
+  // Erasing moves the later slots; take them out of their chains meanwhile.
+  int n = operands.size();
+  for (int j = i + 1; j < n; j++)
+    unlink(j);
+
   operands.erase(operands.begin() + i);
-  removeOperandUse(def);
+  uselinks.erase(uselinks.begin() + i);
+
+  for (int j = i; j < n - 1; j++)
+    link(j);
 }
 
 void Op::removeOperand(Op *v) {
@@ -222,13 +299,15 @@ void Op::setAttribute(int i, Attr *attr) {
 }
 
 void Op::erase() {
-  parent->remove(place);
+  parent->ops.remove(this);
+  if (OpIndex::current)
+    OpIndex::current->remove(this);
   removeAllOperands();
 
   for (auto region : regions)
     region->erase();
 
-  if (uses.size()) {
+  if (!uses.empty()) {
     std::cerr << "removing op in use:\n  ";
     dump(std::cerr);
     std::cerr << "uses:\n";
@@ -242,7 +321,7 @@ void Op::erase() {
   toDelete.push_back(this);
 }
 
-std::vector<Op*> Op::toDelete;
+thread_local std::vector<Op*> Op::toDelete;
 
 void Op::release() {
   for (auto op : toDelete) {
@@ -255,22 +334,84 @@ void Op::release() {
   toDelete.clear();
 }
 
+std::vector<Op*> Op::takeErased() {
+  std::vector<Op*> erased;
+  erased.swap(toDelete);
+  return erased;
+}
+
+void Op::adoptErased(const std::vector<Op*> &erased) {
+  toDelete.insert(toDelete.end(), erased.begin(), erased.end());
+}
+
+ModuleOp::ModuleOp(): OpImpl(Value::i32, {}), arena(new Arena), index(new OpIndex) {
+  setName("ModuleOp");
+  Arena::current = arena;
+  OpIndex::current = index;
+}
+
+// Only runs destructors. The memory itself goes away with the arena.
+void ModuleOp::destroy(Region *region) {
+  for (auto bb : region->getBlocks()) {
+    for (auto op : bb->getOps()) {
+      for (auto r : op->getRegions())
+        destroy(r);
+      for (auto attr : op->getAttrs()) {
+        if (!--attr->refcnt)
+          attr->~Attr();
+      }
+      op->~Op();
+    }
+    bb->~BasicBlock();
+  }
+  region->~Region();
+}
+
+ModuleOp::~ModuleOp() {
+  Op::release();
+
+  for (auto region : regions)
+    destroy(region);
+  regions.clear();
+
+  for (auto attr : attrs) {
+    if (!--attr->refcnt)
+      attr->~Attr();
+  }
+  attrs.clear();
+
+  if (OpIndex::current == index)
+    OpIndex::current = nullptr;
+  delete index;
+  // Frees everything in bulk.
+  if (Arena::current == arena)
+    Arena::current = nullptr;
+  delete arena;
+}
+
 BasicBlock *Op::createFirstBlock() {
   appendRegion();
   return regions[0]->appendBlock();
 }
 
 void Op::replaceAllUsesWith(Op *other) {
-  for (auto use : uses) {
-    for (auto &operand : use->operands) {
-      if (operand.defining != this)
-        continue;
+  if (other == this)
+    return;
 
-      operand.defining = other;
-      other->uses.insert(use);
-    }
+  // Detach the whole chain at once, then move each slot over to `other`.
+  auto use = uses.head;
+  uses.head = nullptr;
+  uses.users = 0;
+  uses.slots = 0;
+
+  while (use) {
+    auto next = use->next;
+    auto user = use->user;
+    int i = use - user->uselinks.data();
+    user->operands[i].defining = other;
+    user->addUse(i);
+    use = next;
   }
-  uses.clear();
 }
 
 Op *Op::getPhiFrom(Op *phi, BasicBlock *bb) {
@@ -295,8 +436,8 @@ BasicBlock *Op::getPhiFrom(Op *phi, Op *op) {
   assert(false);
 }
 
-static std::map<Op*, int> valueName = {};
-static int id = 0;
+static thread_local std::map<Op*, int> valueName = {};
+static thread_local int id = 0;
 
 std::string getValueNumber(Value value) {
   if (!valueName.count(value.defining))
@@ -329,54 +470,40 @@ bool Op::inside(Op *op) {
   return false;
 }
 
+// The splicing functions below relink only the ends of the moved range;
+// the per-op work left is updating `parent`.
+
 void BasicBlock::inlineToEnd(BasicBlock *bb) {
-  for (auto it = begin(); it != end(); ) {
-    auto next = it; ++next;
-    (*it)->moveToEnd(bb);
-    it = next;
-  }
+  bb->ops.splice(bb->end(), ops, begin(), end(), [&](Op *x) { x->parent = bb; });
 }
 
 void BasicBlock::inlineBefore(Op *op) {
-  for (auto it = begin(); it != end(); ) {
-    auto next = it; ++next;
-    (*it)->moveBefore(op);
-    it = next;
-  }
+  auto bb = op->parent;
+  bb->ops.splice(op->getIterator(), ops, begin(), end(), [&](Op *x) { x->parent = bb; });
 }
 
 void BasicBlock::splitOpsAfter(BasicBlock *dest, Op *op) {
-  for (auto it = op->place; it != end(); ) {
-    auto next = it; ++next;
-    // `it` invalidates now.
-    (*it)->moveToEnd(dest);
-    it = next;
-  }
+  dest->ops.splice(dest->end(), ops, op->getIterator(), end(), [&](Op *x) { x->parent = dest; });
 }
 
 void BasicBlock::splitOpsBefore(BasicBlock *dest, Op *op) {
-  for (auto it = begin(); it != op->place; ) {
-    auto next = it; ++next;
-    // `it` invalidates now.
-    (*it)->moveToEnd(dest);
-    it = next;
-  }
+  dest->ops.splice(dest->end(), ops, begin(), op->getIterator(), [&](Op *x) { x->parent = dest; });
 }
 
 void BasicBlock::moveBefore(BasicBlock *bb) {
-  parent->remove(place);
+  parent->remove(this);
   parent = bb->parent;
-  parent->insert(bb->place, this);
+  parent->insert(parent->getBlocks().iter(bb), this);
 }
 
 void BasicBlock::moveAfter(BasicBlock *bb) {
-  parent->remove(place);
+  parent->remove(this);
   parent = bb->parent;
-  parent->insertAfter(bb->place, this);
+  parent->insertAfter(parent->getBlocks().iter(bb), this);
 }
 
 void BasicBlock::moveToEnd(Region *region) {
-  parent->remove(place);
+  parent->remove(this);
   parent = region;
   parent->insert(parent->end(), this);
 }
@@ -394,13 +521,13 @@ void BasicBlock::erase() {
 }
 
 void BasicBlock::forceErase() {
-  auto copy = ops;
+  std::vector<Op*> copy = ops;
   for (auto op : ops)
     op->removeAllOperands();
   for (auto op : copy)
     op->erase();
   
-  parent->remove(place);
+  parent->remove(this);
   delete this;
 }
 
@@ -426,66 +553,53 @@ bool BasicBlock::dominatedBy(const BasicBlock *bb) const {
 BasicBlock *Region::insert(BasicBlock *at) {
   assert(at->parent == this);
 
-  auto it = bbs.insert(at->place, nullptr);
-  *it = new BasicBlock(this, it);
-  return *it;
+  auto bb = new BasicBlock(this);
+  bbs.insert(bbs.iter(at), bb);
+  return bb;
 }
 
 BasicBlock *Region::insertAfter(BasicBlock *at) {
   assert(at->parent == this);
 
-  if (at->place == end())
-    return appendBlock();
-
-  auto place = at->place;
-  ++place;
-  auto it = bbs.insert(place, nullptr);
-  *it = new BasicBlock(this, it);
-  return *it;
+  auto bb = new BasicBlock(this);
+  bbs.insert(++bbs.iter(at), bb);
+  return bb;
 }
 
 void Region::remove(BasicBlock *bb) {
-  bbs.erase(bb->place);
+  bbs.remove(bb);
 }
 
 void Region::remove(iterator at) {
-  bbs.erase(at);
+  bbs.remove(*at);
 }
 
 void Region::insert(iterator at, BasicBlock *bb) {
   bb->parent = this;
-  bb->place = bbs.insert(at, bb);
+  bbs.insert(at, bb);
 }
 
 void Region::insertAfter(iterator at, BasicBlock *bb) {
   bb->parent = this;
   if (at == bbs.end()) {
     bbs.push_back(bb);
-    bb->place = --end();
     return;
   }
-  bb->place = bbs.insert(++at, bb);
+  bbs.insert(++at, bb);
 }
 
 BasicBlock *Region::appendBlock() {
-  bbs.push_back(nullptr);
-  auto place = --bbs.end();
-  *place = new BasicBlock(this, place);
-  return *place;
+  auto bb = new BasicBlock(this);
+  bbs.push_back(bb);
+  return bb;
 }
 
 std::pair<BasicBlock*, BasicBlock*> Region::moveTo(BasicBlock *bb) {
-  BasicBlock *prev = bb;
   // Preserve it beforehand; the region will become empty afterwards
   auto result = std::make_pair(getFirstBlock(), getLastBlock());
 
-  for (auto it = begin(); it != end(); ) {
-    auto next = it; next++;
-    auto current = *it;
-    current->moveAfter(prev);
-    prev = current;
-    it = next;
-  }
+  auto dest = bb->parent;
+  dest->bbs.splice(++dest->bbs.iter(bb), bbs, begin(), end(), [&](BasicBlock *x) { x->parent = dest; });
 
   return result;
 }
@@ -498,7 +612,7 @@ void Region::erase() {
         region->erase();
     }
   }
-  auto copy = bbs;
+  std::vector<BasicBlock*> copy = bbs;
   for (auto bb : copy)
     bb->forceErase();
   parent->removeRegion(this);
@@ -547,23 +661,24 @@ using UnionFind = BBMap;
 // Best ancestor found so far.
 using Best = BBMap;
 
-int num = 0;
-int pnum = 0;
+// Passes might compute dominators of several functions at once.
+thread_local int num = 0;
+thread_local int pnum = 0;
 
 // Dominators.
-DFN dfn;
-SDom sdom;
-Vertex vertex;
-Parent parents;
-UnionFind uf;
-Best best;
+thread_local DFN dfn;
+thread_local SDom sdom;
+thread_local Vertex vertex;
+thread_local Parent parents;
+thread_local UnionFind uf;
+thread_local Best best;
 // Post-dominators. Just a copy-paste.
-DFN pdfn;
-SDom psdom;
-Vertex pvertex;
-Parent pparents;
-UnionFind puf;
-Best pbest;
+thread_local DFN pdfn;
+thread_local SDom psdom;
+thread_local Vertex pvertex;
+thread_local Parent pparents;
+thread_local UnionFind puf;
+thread_local Best pbest;
 
 
 void updateDFN(BasicBlock *current) {
@@ -788,89 +903,163 @@ void Region::updatePDoms() {
 // See the SSA Book:
 //   https://pfalcon.github.io/ssabook/latest/book-full.pdf
 // Page 116.
+namespace {
+
+// A fixed-size set of small integers, stored as 64-bit words.
+// All sets in one liveness problem share the same width.
+struct Bitset {
+  std::vector<uint64_t> words;
+
+  Bitset() {}
+  Bitset(size_t bits): words((bits + 63) / 64) {}
+
+  void set(int x) { words[x >> 6] |= uint64_t(1) << (x & 63); }
+  bool test(int x) const { return words[x >> 6] >> (x & 63) & 1; }
+};
+
+}
+
 void Region::updateLiveness() {
   updatePreds();
 
-  // Clear existing values.
+  // Number every value that can appear in the sets densely.
+  // Sort by address first, so that ascending numbers are ascending `Op*`s,
+  // and the std::sets at the end can be filled in order with a hint.
+  std::vector<Op*> values;
   for (auto bb : bbs) {
-    bb->liveIn.clear();
-    bb->liveOut.clear();
+    for (auto op : bb->getOps()) {
+      values.push_back(op);
+      for (auto value : op->getOperands())
+        values.push_back(value.defining);
+    }
   }
-
-  std::map<BasicBlock*, std::set<Op*>> phis;
-  std::map<BasicBlock*, std::set<Op*>> upwardExposed;
-  std::map<BasicBlock*, std::set<Op*>> defined;
-
-  for (auto bb : bbs) {
+  std::sort(values.begin(), values.end());
+  values.erase(std::unique(values.begin(), values.end()), values.end());
+
+  std::unordered_map<Op*, int> number;
+  number.reserve(values.size());
+  for (size_t i = 0; i < values.size(); i++)
+    number[values[i]] = i;
+
+  size_t n = values.size();
+  size_t words = (n + 63) / 64;
+
+  // Postorder from the entry, so that successors are mostly visited first.
+  // Unreachable blocks follow in their original order.
+  std::vector<BasicBlock*> order;
+  std::unordered_map<BasicBlock*, int> blockid;
+  blockid.reserve(bbs.size());
+  {
+    std::vector<std::pair<BasicBlock*, std::set<BasicBlock*>::iterator>> stack;
+    std::set<BasicBlock*> visited;
+    auto visit = [&](BasicBlock *bb) {
+      visited.insert(bb);
+      stack.push_back({ bb, bb->succs.begin() });
+    };
+    if (!bbs.empty())
+      visit(getFirstBlock());
+    while (!stack.empty()) {
+      auto &[bb, it] = stack.back();
+      if (it == bb->succs.end()) {
+        order.push_back(bb);
+        stack.pop_back();
+        continue;
+      }
+      auto succ = *it++;
+      if (!visited.count(succ))
+        visit(succ);
+    }
+    for (auto bb : bbs) {
+      if (!visited.count(bb))
+        order.push_back(bb);
+    }
+  }
+  for (size_t i = 0; i < order.size(); i++)
+    blockid[order[i]] = i;
+
+  size_t m = order.size();
+  std::vector<Bitset> phis(m, Bitset(n));
+  std::vector<Bitset> upwardExposed(m, Bitset(n));
+  std::vector<Bitset> defined(m, Bitset(n));
+  // phiUses[i] holds the phi operands (of any successor) that come from block i.
+  std::vector<Bitset> phiUses(m, Bitset(n));
+  std::vector<Bitset> liveIn(m, Bitset(n));
+  std::vector<Bitset> liveOut(m, Bitset(n));
+
+  for (size_t i = 0; i < m; i++) {
+    auto bb = order[i];
     for (auto op : bb->getOps()) {
       if (isa<PhiOp>(op)) {
-        phis[bb].insert(op);
+        phis[i].set(number[op]);
+        auto &ops = op->getOperands();
+        auto &attrs = op->getAttrs();
+        for (size_t j = 0; j < ops.size(); j++) {
+          auto from = FROM(attrs[j]);
+          // Skip blocks that are no longer predecessors.
+          if (!from->succs.count(bb) || !blockid.count(from))
+            continue;
+          phiUses[blockid[from]].set(number[ops[j].defining]);
+        }
         continue;
       }
 
-      defined[bb].insert(op);
-
       // A value is upward exposed if it's from some block upwards;
       // i.e. it's used but not defined in this block.
       for (auto value : op->getOperands()) {
-        if (!defined[bb].count(value.defining))
-          upwardExposed[bb].insert(value.defining);
+        int x = number[value.defining];
+        if (!defined[i].test(x))
+          upwardExposed[i].set(x);
       }
+
+      defined[i].set(number[op]);
     }
   }
 
-  std::deque<BasicBlock*> worklist;
-  
-  // Do a dataflow approach. We start with all exit blocks;
-  // i.e. those that have no successors.
-  std::copy_if(bbs.begin(), bbs.end(), std::back_inserter(worklist), [&](BasicBlock *bb) {
-    return bb->succs.size() == 0;
-  });
-
   bool changed;
   do {
     changed = false;
-    for (auto bb : bbs) {
-      auto liveInOld = bb->liveIn;
+    for (size_t i = 0; i < m; i++) {
+      auto bb = order[i];
+      auto &out = liveOut[i].words;
+      auto &in = liveIn[i].words;
 
       // LiveOut(B) = \bigcup_{S\in succ(B)} (LiveIn(S) - PhiDefs(S)) \cup PhiUses(B)
       // Here PhiUses(B) means the set of variables used in Phi nodes of S that come from B.
-      std::set<Op*> liveOut;
+      out = phiUses[i].words;
       for (auto succ : bb->succs) {
-        std::set_difference(
-          succ->liveIn.begin(), succ->liveIn.end(),
-          phis[succ].begin(), phis[succ].end(),
-          std::inserter(liveOut, liveOut.end())
-        );
-        for (auto phi : phis[succ]) {
-          auto &ops = phi->getOperands();
-          auto &attrs = phi->getAttrs();
-          for (size_t i = 0; i < ops.size(); i++) {
-            if (FROM(attrs[i]) == bb)
-              liveOut.insert(ops[i].defining);
-          }
-        }
+        int s = blockid[succ];
+        auto &succIn = liveIn[s].words;
+        auto &succPhis = phis[s].words;
+        for (size_t w = 0; w < words; w++)
+          out[w] |= succIn[w] & ~succPhis[w];
       }
 
-      bb->liveOut = liveOut;
-
       // LiveIn(B) = PhiDefs(B) \cup UpwardExposed(B) \cup (LiveOut(B) - Defs(B))
-      bb->liveIn.clear();
-      std::set_difference(
-        liveOut.begin(), liveOut.end(),
-        defined[bb].begin(), defined[bb].end(),
-        std::inserter(bb->liveIn, bb->liveIn.end())
-      );
-      for (auto x : upwardExposed[bb])
-        bb->liveIn.insert(x);
-      for (auto x : phis[bb])
-        bb->liveIn.insert(x);
-
-      if (liveInOld != bb->liveIn)
-        changed = true;
+      auto &defs = defined[i].words;
+      auto &uses = upwardExposed[i].words;
+      auto &phiDefs = phis[i].words;
+      for (size_t w = 0; w < words; w++) {
+        uint64_t word = (out[w] & ~defs[w]) | uses[w] | phiDefs[w];
+        if (word != in[w]) {
+          in[w] = word;
+          changed = true;
+        }
+      }
     }
   } while (changed);
 
+  for (size_t i = 0; i < m; i++) {
+    auto bb = order[i];
+    bb->liveIn.clear();
+    bb->liveOut.clear();
+    for (size_t w = 0; w < words; w++) {
+      for (uint64_t in = liveIn[i].words[w]; in; in &= in - 1)
+        bb->liveIn.insert(bb->liveIn.end(), values[w * 64 + __builtin_ctzll(in)]);
+      for (uint64_t out = liveOut[i].words[w]; out; out &= out - 1)
+        bb->liveOut.insert(bb->liveOut.end(), values[w * 64 + __builtin_ctzll(out)]);
+    }
+  }
+
   // showLiveIn();
 }
 
@@ -3,13 +3,15 @@
 
 #include <algorithm>
 #include <iterator>
-#include <list>
 #include <iostream>
 #include <set>
 #include <string>
 #include <vector>
 
+#include "Arena.h"
+#include "OpIndex.h"
 #include "../utils/DynamicCast.h"
+#include "../utils/IList.h"
 
 namespace sys {
 
@@ -37,7 +39,7 @@ public:
 };
 
 class Region {
-  std::list<BasicBlock*> bbs;
+  IList<BasicBlock> bbs;
   Op *parent;
 
   // For debug purposes.
@@ -46,8 +48,8 @@ public:
   using iterator = decltype(bbs)::iterator;
 
   auto &getBlocks() { return bbs; }
-  BasicBlock *getFirstBlock() { return *bbs.begin(); }
-  BasicBlock *getLastBlock() { return *--bbs.end(); }
+  BasicBlock *getFirstBlock() { return bbs.front(); }
+  BasicBlock *getLastBlock() { return bbs.back(); }
 
   iterator begin() { return bbs.begin(); }
   iterator end() { return bbs.end(); }
@@ -87,13 +89,90 @@ public:
   void erase();
 
   Region(Op *parent): parent(parent) {}
+
+  static void *operator new(size_t size) { return Arena::alloc(size); }
+  static void operator delete(void *p, size_t size) { Arena::dealloc(p, size); }
+};
+
+// The link of one operand slot into the use-chain of the op it refers to.
+// These live in Op::uselinks, which is parallel to Op::operands.
+class Use {
+  Op *user;
+  Use *prev = nullptr;
+  Use *next = nullptr;
+  // Whether this is the first slot of `user` that refers to the op.
+  // Only these are visited, so that each user is seen once.
+  bool primary = false;
+
+  friend class Op;
+  friend class UseList;
+public:
+  Use(Op *user): user(user) {}
+
+  Op *getUser() const { return user; }
+};
+
+// The users of an op, threaded through the operand slots referring to it.
+// As with the std::set<Op*> it replaced, a user that refers to the op
+// several times (e.g. `mul %1 %1`) only appears once.
+//
+// Like IList, it can't be copied; convert it to a vector to take a snapshot.
+class UseList {
+  Op *owner;
+  Use *head = nullptr;
+  // Number of distinct users.
+  int users = 0;
+  // Number of operand slots in the chain.
+  int slots = 0;
+
+  friend class Op;
+public:
+  class iterator {
+    Use *cur;
+
+    void skip() {
+      while (cur && !cur->primary)
+        cur = cur->next;
+    }
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = Op*;
+    using difference_type = std::ptrdiff_t;
+    using pointer = Op**;
+    using reference = Op*;
+
+    iterator(Use *cur = nullptr): cur(cur) { skip(); }
+
+    Op *operator*() const { return cur->user; }
+
+    iterator &operator++() { cur = cur->next; skip(); return *this; }
+    iterator operator++(int) { auto old = *this; ++*this; return old; }
+
+    bool operator==(const iterator &other) const { return cur == other.cur; }
+    bool operator!=(const iterator &other) const { return cur != other.cur; }
+  };
+
+  UseList(Op *owner): owner(owner) {}
+  UseList(const UseList &other) = delete;
+  UseList &operator=(const UseList &other) = delete;
+
+  iterator begin() const { return iterator(head); }
+  iterator end() const { return iterator(); }
+
+  size_t size() const { return users; }
+  bool empty() const { return !users; }
+
+  // Whether `user` refers to the owner. This scans the operands of `user`.
+  int count(Op *user) const;
+
+  // Takes a snapshot, which stays valid when uses change.
+  operator std::vector<Op*>() const { return std::vector<Op*>(begin(), end()); }
 };
 
 class SimplifyCFG;
-class BasicBlock {
-  std::list<Op*> ops;
+class BasicBlock : public IListNode<BasicBlock> {
+  IList<Op> ops;
   Region *parent;
-  Region::iterator place;
   // Note these are dominatORs, which mean `this` is dominatED by the elements.
   std::set<BasicBlock*> doms;
   // Dominance frontiers. `this` dominatES all blocks which are preds of the elements.
@@ -115,13 +194,12 @@ public:
   std::set<BasicBlock*> succs;
   using iterator = decltype(ops)::iterator;
 
-  BasicBlock(Region *parent, Region::iterator place):
-    parent(parent), place(place) {}
+  BasicBlock(Region *parent): parent(parent) {}
 
   auto &getOps() { return ops; }
   int getOpCount() { return ops.size(); }
-  Op *getFirstOp() const { return *ops.begin(); }
-  Op *getLastOp() const { return *--ops.end(); }
+  Op *getFirstOp() const { return ops.front(); }
+  Op *getLastOp() const { return ops.back(); }
 
   iterator begin() { return ops.begin(); }
   iterator end() { return ops.end(); }
@@ -137,7 +215,8 @@ public:
   
   BasicBlock *getIdom() const { return idom; }
   BasicBlock *getIPdom() const { return ipdom; }
-  BasicBlock *nextBlock() const;
+  BasicBlock *nextBlock() const { return getNextNode(); }
+  BasicBlock *prevBlock() const { return getPrevNode(); }
 
   bool dominatedBy(const BasicBlock *bb) const;
   bool dominates(const BasicBlock *bb) const { return bb->dominatedBy(this); }
@@ -168,12 +247,16 @@ public:
   // Does not check if there's any preds.
   // Used when a lot of blocks are going to get removed.
   void forceErase();
+
+  static void *operator new(size_t size) { return Arena::alloc(size); }
+  static void operator delete(void *p, size_t size) { Arena::dealloc(p, size); }
 };
 
 class Attr {
   int refcnt = 0;
 
   friend class Op;
+  friend class ModuleOp;
   friend class Builder;
 public:
   const int attrid;
@@ -182,35 +265,55 @@ public:
   virtual ~Attr() {}
   virtual std::string toString() = 0;
   virtual Attr *clone() = 0;
+
+  // The destructor is virtual, so `size` is always that of the dynamic type.
+  static void *operator new(size_t size) { return Arena::alloc(size); }
+  static void operator delete(void *p, size_t size) { Arena::dealloc(p, size); }
 };
 
-class Op {
+class Op : public IListNode<Op> {
 protected:
-  std::set<Op*> uses;
+  UseList uses;
   std::vector<Value> operands;
+  // uselinks[i] threads operands[i] into the use-chain of its defining op.
+  std::vector<Use> uselinks;
   std::vector<Region*> regions;
   std::vector<Attr*> attrs;
-  BasicBlock *parent;
-  BasicBlock::iterator place;
+  BasicBlock *parent = nullptr;
   Value::Type resultTy;
 
+  // See OpIndex::collect().
+  unsigned indexMark = 0;
+  bool indexed = false;
+
   friend class Builder;
   friend class BasicBlock;
+  friend class UseList;
+  friend class OpIndex;
 
   std::string opname;
   // This is for ease of writing macro.
   void setName(std::string name);
-  void removeOperandUse(Op *op);
-
-  static std::vector<Op*> toDelete;
+  // Only touch the chain pointers of uselinks[i].
+  void link(int i);
+  void unlink(int i);
+  // Another slot of this op that refers to the same op as slot `i`.
+  Use *findOtherUse(int i);
+  // Also keep `primary` and the user count right.
+  void addUse(int i);
+  void dropUse(int i);
+
+  // Per thread, as passes might run on several functions at once.
+  static thread_local std::vector<Op*> toDelete;
 public:
   const int opid;
 
   const std::string &getName() { return opname; }
   BasicBlock *getParent() { return parent; }
   Op *getParentOp();
-  Op *prevOp();
-  Op *nextOp();
+  Op *prevOp() { return getPrevNode(); }
+  Op *nextOp() { return getNextNode(); }
+  BasicBlock::iterator getIterator() { return parent->getOps().iter(this); }
 
   const auto &getUses() const { return uses; }
   const auto &getRegions() const { return regions; }
@@ -243,6 +346,8 @@ public:
 
   Op(int id, Value::Type resultTy, const std::vector<Value> &values);
   Op(int id, Value::Type resultTy, const std::vector<Value> &values, const std::vector<Attr*> &attrs);
+  // Virtual for ModuleOp, which owns the arena and index of its module.
+  virtual ~Op() {}
 
   Region *appendRegion();
   BasicBlock *createFirstBlock();
@@ -257,16 +362,26 @@ public:
   void moveToStart(BasicBlock *block);
 
   bool inside(Op *op);
-  bool atFront() { return this == parent->getFirstOp(); }
-  bool atBack() { return this == parent->getLastOp(); }
+  // False once erased.
+  bool isIndexed() const { return indexed; }
+  bool atFront() { return !getPrevNode(); }
+  bool atBack() { return !getNextNode(); }
 
   // erase() will delay its deletion.
   // This function must be called to actually call `operator delete`.
   static void release();
+  // Hands the ops erased by this thread over to another one, which releases them.
+  static std::vector<Op*> takeErased();
+  static void adoptErased(const std::vector<Op*> &erased);
 
   static Op *getPhiFrom(Op *phi, BasicBlock *bb);
   static BasicBlock *getPhiFrom(Op *phi, Op *op);
 
+  // Every Op is allocated through here, including those made by Builder and the OP macros.
+  // The destructor is virtual, so `size` is always that of the dynamic type.
+  static void *operator new(size_t size) { return Arena::alloc(size); }
+  static void operator delete(void *p, size_t size) { Arena::dealloc(p, size); }
+
   template<class T>
   bool has() {
     for (auto x : attrs)
@@ -312,17 +427,26 @@ public:
   template<class T>
   std::vector<Op*> findAll() {
     std::vector<Op*> result;
+    findAll<T>(result);
+    return result;
+  }
+
+  // Appends to `result` rather than building a vector per nesting level.
+  // This is a walk rather than an OpIndex lookup because callers rely on
+  // the pre-order (e.g. outer loops before inner ones). The index still
+  // lets it skip the walk when there's no such op at all.
+  template<class T>
+  void findAll(std::vector<Op*> &result) {
+    if (OpIndex::current && !OpIndex::current->count(T::id))
+      return;
+
     if (isa<T>(this))
       result.push_back(this);
 
-    for (auto region : getRegions())
+    for (auto region : regions)
       for (auto bb : region->getBlocks())
-        for (auto x : bb->getOps()) {
-          auto v = x->findAll<T>();
-          std::copy(v.begin(), v.end(), std::back_inserter(result));
-        }
-
-    return result;
+        for (auto x : bb->getOps())
+          x->findAll<T>(result);
   }
 
   template<class T>
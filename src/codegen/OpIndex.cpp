@@ -0,0 +1,77 @@
+#include "OpIndex.h"
+#include "Ops.h"
+
+using namespace sys;
+
+OpIndex *OpIndex::current = nullptr;
+thread_local std::vector<Op*> *OpIndex::created = nullptr;
+std::atomic<unsigned> OpIndex::nextMark = 0;
+
+OpIndex::~OpIndex() {
+  if (current == this)
+    current = nullptr;
+}
+
+std::unique_lock<std::mutex> OpIndex::guard() {
+  if (concurrent)
+    return std::unique_lock<std::mutex>(mutex);
+  return std::unique_lock<std::mutex>();
+}
+
+void OpIndex::insert(Op *op) {
+  auto lock = guard();
+  counts[op->opid]++;
+  op->indexed = true;
+
+  if (created)
+    created->push_back(op);
+}
+
+void OpIndex::remove(Op *op) {
+  if (!op->indexed)
+    return;
+
+  auto lock = guard();
+  counts[op->opid]--;
+  op->indexed = false;
+}
+
+bool OpIndex::marked(Op *op, unsigned mark) {
+  if (op->indexMark == mark)
+    return true;
+
+  auto bb = op->getParent();
+  if (!bb)
+    return false;
+  auto parent = bb->getParent()->getParent();
+  if (!parent || parent->indexMark != mark)
+    return false;
+  op->indexMark = mark;
+  return true;
+}
+
+void OpIndex::collect(int opid, Op *op, unsigned mark, std::vector<Op*> &result) {
+  op->indexMark = mark;
+  if (op->opid == opid)
+    result.push_back(op);
+
+  for (auto region : op->getRegions()) {
+    for (auto bb : region->getBlocks()) {
+      for (auto x : bb->getOps())
+        collect(opid, x, mark, result);
+    }
+  }
+}
+
+std::vector<Op*> OpIndex::collect(int opid, Op *root, unsigned *mark) {
+  // Zero is what every op starts with.
+  unsigned m = ++nextMark;
+  if (mark)
+    *mark = m;
+
+  std::vector<Op*> result;
+  if (!count(opid))
+    return result;
+  collect(opid, root, m, result);
+  return result;
+}
@@ -0,0 +1,72 @@
+#ifndef OPINDEX_H
+#define OPINDEX_H
+
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace sys {
+
+class Op;
+
+// Every op of a module, counted by opid.
+//
+// Ops register themselves on construction and leave on Op::erase(),
+// so this is always up to date without any help from the passes.
+// The counts let lookups skip the walk when there's no such op at all.
+//
+// While `concurrent` is set, several threads may be working on different
+// functions of the module; see PassManager::runParallel().
+class OpIndex {
+  std::unordered_map<int, int> counts;
+  std::mutex mutex;
+  // Newly created ops of this thread are also appended here, if it's set.
+  static thread_local std::vector<Op*> *created;
+  static std::atomic<unsigned> nextMark;
+
+  std::unique_lock<std::mutex> guard();
+  static void collect(int opid, Op *op, unsigned mark, std::vector<Op*> &result);
+public:
+  bool concurrent = false;
+
+  // The index of the module currently being built/transformed.
+  static OpIndex *current;
+
+  OpIndex() = default;
+  OpIndex(const OpIndex &other) = delete;
+  ~OpIndex();
+
+  void insert(Op *op);
+  void remove(Op *op);
+
+  // Number of ops with this opid, including those not yet placed in a block.
+  int count(int opid) {
+    auto lock = guard();
+    auto it = counts.find(opid);
+    return it == counts.end() ? 0 : it->second;
+  }
+
+  // Ops with this opid inside `root` (including itself), in pre-order, like Op::findAll().
+  // Every op visited gets `*mark`, which marked() then checks.
+  // The walk only looks at `root`, so this is fine while concurrent.
+  std::vector<Op*> collect(int opid, Op *root, unsigned *mark = nullptr);
+
+  // Whether `op` got `mark` from collect(), or has since been placed
+  // right inside an op that did. Also marks it in the latter case.
+  static bool marked(Op *op, unsigned mark);
+
+  // Records every op created by this thread while it's alive.
+  class Recorder {
+    std::vector<Op*> *saved;
+  public:
+    std::vector<Op*> ops;
+
+    Recorder(OpIndex*): saved(created) { created = &ops; }
+    ~Recorder() { created = saved; }
+  };
+};
+
+}
+
+#endif
@@ -42,10 +42,28 @@
 #define OPF(Ty) OPBASE(Value::f32, Ty)
 #define OPL(Ty) OPBASE(Value::i64, Ty)
 #define OPV(Ty) OPBASE(Value::i128, Ty)
+#define OPFV(Ty) OPBASE(Value::f128, Ty)
 
 namespace sys {
 
-OP(ModuleOp);
+// The module owns the arena that everything inside it is allocated from.
+// It is the only op that lives outside an arena.
+class ModuleOp : public OpImpl<ModuleOp, __LINE__> {
+  Arena *arena;
+  OpIndex *index;
+
+  void destroy(Region *region);
+public:
+  ModuleOp();
+  ~ModuleOp();
+
+  Arena *getArena() { return arena; }
+  OpIndex *getIndex() { return index; }
+
+  static void *operator new(size_t size) { return ::operator new(size); }
+  static void operator delete(void *p) { ::operator delete(p); }
+};
+
 OP(AddIOp);
 OP(SubIOp);
 OP(MulIOp);
@@ -111,14 +129,24 @@ OP(SelectOp);
 OPV(AddVOp);
 OPV(SubVOp);
 OPV(MulVOp);
+OPFV(AddFVOp);
+OPFV(SubFVOp);
+OPFV(MulFVOp);
 
 OPV(BroadcastOp);
+OPFV(BroadcastFOp);
 
-// ====== Multi-threaded ======
+// Compares give a mask, with all bits set in the lanes where they hold.
+OPV(EqVOp);
+OPV(LtVOp);
+OPV(LeVOp);
+OPV(EqFVOp);
+OPV(LtFVOp);
+OPV(LeFVOp);
+OPE(SelectVOp); // Operand order: mask, lanes where it's set, lanes where it's clear.
 
-OP(CloneOp);
-OP(JoinOp);
-OP(WakeOp);
+OP(ReduceAddVOp); // Sum of all lanes.
+OPE(ExtractOp); // The lane is given by an IntAttr.
 
 // vectorized load/store is detected by size.
 
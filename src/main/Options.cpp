@@ -1,4 +1,6 @@
 #include "Options.h"
+#include <algorithm>
+#include <cstdlib>
 #include <cstring>
 #include <iostream>
 
@@ -22,6 +24,13 @@ Options::Options() {
   verify = false;
   sat = false;
   bv = false;
+  foldSweep = false;
+  timePasses = false;
+  profile = false;
+  costReport = false;
+  rvv = false;
+  fastMath = false;
+  dynamicChunks = false;
 }
 
 Options sys::parseArgs(int argc, char **argv) {
@@ -58,6 +67,42 @@ Options sys::parseArgs(int argc, char **argv) {
       continue;
     }
 
+    if (strcmp(argv[i], "-j") == 0 || strcmp(argv[i], "--jobs") == 0) {
+      opts.jobs = std::max(1, atoi(argv[i + 1]));
+      i++;
+      continue;
+    }
+
+    if (strcmp(argv[i], "--threads") == 0) {
+      opts.threads = atoi(argv[i + 1]);
+      i++;
+      continue;
+    }
+
+    if (strcmp(argv[i], "--rv-core") == 0) {
+      opts.rvCore = argv[i + 1];
+      i++;
+      continue;
+    }
+
+    if (strcmp(argv[i], "--regalloc") == 0) {
+      opts.regalloc = argv[i + 1];
+      i++;
+      continue;
+    }
+
+    if (strcmp(argv[i], "--fast-regalloc") == 0) {
+      opts.regalloc = "linear";
+      continue;
+    }
+
+    if (strcmp(argv[i], "--trace-passes") == 0) {
+      opts.traceFile = argv[i + 1];
+      opts.timePasses = true;
+      i++;
+      continue;
+    }
+
     PARSEOPT("--dump-ast", dumpAST);
     PARSEOPT("--dump-mid-ir", dumpMidIR);
     PARSEOPT("--rv", rv);
@@ -70,6 +115,13 @@ Options sys::parseArgs(int argc, char **argv) {
     PARSEOPT("--verify", verify);
     PARSEOPT("--bv", bv);
     PARSEOPT("--sat", sat);
+    PARSEOPT("--fold-sweep", foldSweep);
+    PARSEOPT("--time-passes", timePasses);
+    PARSEOPT("--profile", profile);
+    PARSEOPT("--cost-report", costReport);
+    PARSEOPT("--rvv", rvv);
+    PARSEOPT("--fast-math", fastMath);
+    PARSEOPT("--dynamic-chunks", dynamicChunks);
 
     if (opts.inputFile != "") {
       std::cerr << "error: multiple inputs\n";
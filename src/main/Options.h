@@ -20,6 +20,16 @@ struct Options {
     option verify : 1;
     option bv : 1;
     option sat : 1;
+    option foldSweep : 1;
+    option timePasses : 1;
+    option profile : 1;
+    option costReport : 1;
+    // Vectorize for the RISC-V vector extension.
+    option rvv : 1;
+    // Allow reassociating floats, as in vectorized reductions.
+    option fastMath : 1;
+    // Parallel loops hand out small chunks as threads ask, rather than one share each.
+    option dynamicChunks : 1;
   };
 
   std::string inputFile;
@@ -28,6 +38,18 @@ struct Options {
   std::string printBefore;
   std::string compareWith;
   std::string simulateInput;
+  // Chrome trace-event JSON written under --time-passes.
+  std::string traceFile;
+  // Core for the rv cost model; see rv::CostModel.
+  std::string rvCore = "nanhu";
+  // Register allocator: "greedy", "irc" for iterated register coalescing (rv only),
+  // or "linear" for linear scan (--fast-regalloc).
+  std::string regalloc = "greedy";
+  // Threads for function passes; see Pass::isFunctionPass().
+  int jobs = 1;
+  // Threads that run parallel loops on arm, including the main one.
+  // Below 2, loops aren't parallelized.
+  int threads = 0;
   
   Options();
 };
@@ -1,5 +1,6 @@
 #include "Options.h"
 #include <fstream>
+#include <memory>
 #include <sstream>
 
 #include "../parse/Parser.h"
@@ -19,6 +20,7 @@
 #include "../arm/ArmLoopPasses.h"
 #include "../rv/RvPasses.h"
 #include "../rv/RvDupPasses.h"
+#include "../rv/CostModel.h"
 #include "../utils/smt/SMT.h"
 
 using namespace smt;
@@ -35,7 +37,8 @@ void initArmPipeline(sys::PassManager &pm) {
   pm.addPass<sys::GVN>();
   pm.addPass<PostIncr>();
   pm.addPass<ArmDCE>();
-  pm.addPass<RegAlloc>();
+  pm.addPass<Schedule>();
+  pm.addPass<RegAlloc>(opts.regalloc == "linear" ? RegAlloc::Linear : RegAlloc::Greedy);
   pm.addPass<LateLegalize>();
   pm.addPass<Dump>(opts.outputFile);
 }
@@ -48,8 +51,18 @@ void initRvPipeline(sys::PassManager &pm) {
   pm.addPass<InstCombine>();
   pm.addPass<RvDCE>();
   pm.addPass<sys::GVN>();
-  pm.addPass<RegAlloc>();
-  pm.addPass<Dump>(opts.outputFile);
+  pm.addPass<Schedule>();
+  auto mode = opts.regalloc == "irc" ? RegAlloc::Coalescing :
+              opts.regalloc == "linear" ? RegAlloc::Linear : RegAlloc::Greedy;
+  pm.addPass<RegAlloc>(mode);
+  pm.addPass<Dump>(opts.outputFile, opts.costReport);
+}
+
+// Profile-guided passes after this point see fresh counts.
+// The program runs on the input given by `-i`.
+void addProfile(sys::PassManager &pm) {
+  if (opts.profile)
+    pm.addPass<sys::Profile>(opts.simulateInput);
 }
 
 void initPipeline(sys::PassManager &pm) {
@@ -67,12 +80,12 @@ void initPipeline(sys::PassManager &pm) {
   pm.addPass<sys::RaiseToFor>();
   pm.addPass<sys::DCE>(/*elimBlocks=*/ false);
   pm.addPass<sys::EarlyInline>();
-  pm.addPass<sys::RegularFold>();
+  pm.addPass<sys::RegularFold>(opts.foldSweep);
   pm.addPass<sys::View>();
   pm.addPass<sys::LoopDCE>();
   pm.addPass<sys::TidyMemory>();
-  // if (opts.arm && (!opts.noLink || opts.o1)) // RV only has a single core.
-  //   pm.addPass<sys::Parallelize>();
+  if (opts.arm && opts.threads > 1) // RV only has a single core.
+    pm.addPass<sys::Parallelize>(opts.threads, opts.dynamicChunks);
   // pm.addPass<sys::Fusion>();
   // pm.addPass<sys::Unswitch>();
   pm.addPass<sys::DCE>(/*elimBlocks=*/ false);
@@ -85,6 +98,7 @@ void initPipeline(sys::PassManager &pm) {
   // ===== Flattened CFG =====
 
   pm.addPass<sys::FlattenCFG>();
+  addProfile(pm);
   pm.addPass<sys::GVN>();
   pm.addPass<sys::DCE>();
   pm.addPass<sys::Inline>(/*inlineThreshold=*/ 200);
@@ -96,7 +110,7 @@ void initPipeline(sys::PassManager &pm) {
 
   pm.addPass<sys::Mem2Reg>();
   pm.addPass<sys::Alias>();
-  pm.addPass<sys::RegularFold>();
+  pm.addPass<sys::RegularFold>(opts.foldSweep);
   pm.addPass<sys::DCE>();
   pm.addPass<sys::DAE>();
   pm.addPass<sys::Alias>();
@@ -110,16 +124,17 @@ void initPipeline(sys::PassManager &pm) {
   pm.addPass<sys::LoopRotate>();
   pm.addPass<sys::CanonicalizeLoop>(/*lcssa=*/ false);
   pm.addPass<sys::LICM>();
+  addProfile(pm);
   pm.addPass<sys::ConstLoopUnroll>();
   pm.addPass<sys::SCEV>();
   pm.addPass<sys::AggressiveDCE>();
-  if (opts.arm) // RV doesn't support SIMD.
-    pm.addPass<sys::Vectorize>();
+  if (opts.arm || opts.rvv) // RV only has SIMD with the V extension.
+    pm.addPass<sys::Vectorize>(/*neon=*/ opts.arm, opts.fastMath);
   pm.addPass<sys::GVN>();
   
   // ===== Misc =====
 
-  pm.addPass<sys::RegularFold>();
+  pm.addPass<sys::RegularFold>(opts.foldSweep);
   pm.addPass<sys::DCE>();
   pm.addPass<sys::GVN>();
   pm.addPass<sys::SimplifyCFG>();
@@ -128,13 +143,14 @@ void initPipeline(sys::PassManager &pm) {
   pm.addPass<sys::DSE>();
   pm.addPass<sys::DLE>();
   pm.addPass<sys::Select>();
-  pm.addPass<sys::RegularFold>();
+  pm.addPass<sys::RegularFold>(opts.foldSweep);
   // pm.addPass<sys::Range>();
   // pm.addPass<sys::RangeAwareFold>();
   // pm.addPass<sys::Splice>();
   pm.addPass<sys::DCE>();
   // pm.addPass<sys::Reassociate>();
   // pm.addPass<sys::Cached>(); // This doesn't work... but why?
+  addProfile(pm);
   pm.addPass<sys::GCM>();
   pm.addPass<sys::GVN>();
   pm.addPass<sys::AggressiveDCE>();
@@ -142,7 +158,7 @@ void initPipeline(sys::PassManager &pm) {
   // ===== Late Inline =====
 
   pm.addPass<sys::LateInline>(/*threshold=*/ 200);
-  pm.addPass<sys::RegularFold>();
+  pm.addPass<sys::RegularFold>(opts.foldSweep);
   pm.addPass<sys::GVN>();
   pm.addPass<sys::Alias>();
   pm.addPass<sys::DSE>();
@@ -150,7 +166,7 @@ void initPipeline(sys::PassManager &pm) {
   pm.addPass<sys::DCE>();
   pm.addPass<sys::InlineStore>();
   pm.addPass<sys::SynthConstArray>();
-  pm.addPass<sys::RegularFold>();
+  pm.addPass<sys::RegularFold>(opts.foldSweep);
   pm.addPass<sys::DCE>();
   pm.addPass<sys::GCM>();
   pm.addPass<sys::GVN>();
@@ -163,7 +179,7 @@ void initPipeline(sys::PassManager &pm) {
     pm.addPass<sys::SCEV>();
     pm.addPass<sys::RemoveEmptyLoop>();
     pm.addPass<sys::GVN>();
-    pm.addPass<sys::RegularFold>();
+    pm.addPass<sys::RegularFold>(opts.foldSweep);
   }
 
   // ===== Final Cleanup =====
@@ -171,6 +187,10 @@ void initPipeline(sys::PassManager &pm) {
   pm.addPass<sys::AggressiveDCE>();
   pm.addPass<sys::SimplifyCFG>();
   pm.addPass<sys::InstSchedule>();
+  if (opts.arm || opts.rvv)
+    pm.addPass<sys::SLP>(/*neon=*/ opts.arm);
+  // Lowering keeps the counts on branches, for the register allocators.
+  addProfile(pm);
 
   if (opts.arm)
     initArmPipeline(pm);
@@ -322,6 +342,17 @@ int main(int argc, char **argv) {
     return 0;
   }
 
+  // The rv backend and InstSchedule consult the cost model.
+  if (!sys::rv::CostModel::select(opts.rvCore)) {
+    std::cerr << "error: unknown core: " << opts.rvCore << "\n";
+    return 1;
+  }
+
+  if (opts.regalloc != "greedy" && opts.regalloc != "irc" && opts.regalloc != "linear") {
+    std::cerr << "error: unknown register allocator: " << opts.regalloc << "\n";
+    return 1;
+  }
+
   // Read input file.
   std::ifstream ifs(opts.inputFile);
   if (!ifs) {
@@ -343,11 +374,12 @@ int main(int argc, char **argv) {
   sys::CodeGen cg(node);
   delete node;
 
-  sys::ModuleOp *module = cg.getModule();
+  // Outlives `pm`, whose passes hold on to it.
+  std::unique_ptr<sys::ModuleOp> module(cg.getModule());
   if (opts.dumpMidIR)
-    std::cerr << module;
+    std::cerr << module.get();
 
-  sys::PassManager pm(module, opts);
+  sys::PassManager pm(module.get(), opts);
   
   initPipeline(pm);
   
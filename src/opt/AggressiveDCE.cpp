@@ -15,10 +15,7 @@ static bool preserved(Op *op) {
     PRESERVED(BranchOp)
     PRESERVED(GotoOp)
     PRESERVED(StoreOp)
-    PRESERVED(ReturnOp)
-    PRESERVED(CloneOp)
-    PRESERVED(JoinOp)
-    PRESERVED(WakeOp);
+    PRESERVED(ReturnOp);
 }
 
 void AggressiveDCE::runImpl(FuncOp *fn) {
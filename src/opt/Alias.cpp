@@ -12,7 +12,7 @@ void Alias::runImpl(Region *region) {
   // Run local analysis over RPO of the dominator tree.
 
   // First calculate RPO.
-  DomTree tree = getDomTree(region);
+  DomTree tree = getDomTreeCached(region);
 
   BasicBlock *entry = region->getFirstBlock();
   std::vector<BasicBlock*> rpo;
@@ -19,6 +19,7 @@ public:
   std::string name() override { return "pureness"; };
   std::map<std::string, int> stats() override { return {}; }
   void run() override;
+  Preserve preserves() override { return Preserve::All; }
 };
 
 // Puts CallerAttr to each function.
@@ -29,6 +30,7 @@ public:
   std::string name() override { return "call-graph"; };
   std::map<std::string, int> stats() override { return {}; }
   void run() override;
+  Preserve preserves() override { return Preserve::All; }
 };
 
 // Gives an AliasAttr to values, if they are addresses.
@@ -41,6 +43,7 @@ public:
   std::string name() override { return "alias"; };
   std::map<std::string, int> stats() override { return {}; }
   void run() override;
+  Preserve preserves() override { return Preserve::All; }
 };
 
 // Integer range analysis.
@@ -63,6 +66,21 @@ public:
   void run() override;
 };
 
+// Runs the module in the interpreter on the program's input,
+// and gives a ProfileAttr to each terminator and call.
+// Block frequencies then drive inlining, unrolling, GCM and register allocation.
+class Profile : public Pass {
+  std::string input;
+  int profiled = 0;
+public:
+  Profile(ModuleOp *module, const std::string &inputFile);
+
+  std::string name() override { return "profile"; };
+  std::map<std::string, int> stats() override;
+  void run() override;
+  Preserve preserves() override { return Preserve::All; }
+};
+
 // Mark functions that are called at most once.
 class AtMostOnce : public Pass {
 public:
@@ -71,6 +89,7 @@ public:
   std::string name() override { return "at-most-once"; };
   std::map<std::string, int> stats() override { return {}; }
   void run() override;
+  Preserve preserves() override { return Preserve::All; }
 };
 
 }
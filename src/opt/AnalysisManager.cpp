@@ -0,0 +1,147 @@
+#include "AnalysisManager.h"
+#include "Analysis.h"
+#include "LoopPasses.h"
+
+#include <unordered_set>
+
+using namespace sys;
+
+AnalysisManager *AnalysisManager::current = nullptr;
+
+AnalysisManager::~AnalysisManager() {
+  for (auto [func, entry] : entries)
+    release(entry.loops);
+
+  if (current == this)
+    current = nullptr;
+}
+
+void AnalysisManager::release(LoopForest *forest) {
+  if (!forest)
+    return;
+
+  for (auto loop : forest->getLoops())
+    delete loop;
+  delete forest;
+}
+
+void AnalysisManager::invalidate(Preserve preserved) {
+  // Forget functions that are gone. They might have been freed already,
+  // so look at what's still in the module rather than at the functions themselves.
+  std::unordered_set<FuncOp*> alive;
+  for (auto op : module->getRegion()->getFirstBlock()->getOps()) {
+    if (auto func = dyn_cast<FuncOp>(op))
+      alive.insert(func);
+  }
+  for (auto it = entries.begin(); it != entries.end();) {
+    if (alive.count(it->first)) {
+      ++it;
+      continue;
+    }
+    release(it->second.loops);
+    it = entries.erase(it);
+  }
+
+  if (preserved == Preserve::All)
+    return;
+
+  calls = false;
+  for (auto &[func, entry] : entries) {
+    entry.inductions = entry.live = false;
+    if (preserved == Preserve::Nothing)
+      entry.doms = entry.shape = entry.front = false;
+  }
+}
+
+AnalysisManager::Entry &AnalysisManager::getEntry(FuncOp *func) {
+  std::lock_guard<std::mutex> lock(mutex);
+  return entries[func];
+}
+
+void AnalysisManager::updateDoms(FuncOp *func) {
+  auto &entry = getEntry(func);
+  if (entry.doms) {
+    domHits++;
+    return;
+  }
+
+  domMisses++;
+  func->getRegion()->updateDoms();
+  entry.doms = true;
+}
+
+void AnalysisManager::updateDomFront(FuncOp *func) {
+  auto &entry = getEntry(func);
+  if (entry.front && entry.doms) {
+    frontHits++;
+    return;
+  }
+
+  frontMisses++;
+  // This updates dominators as well.
+  func->getRegion()->updateDomFront();
+  entry.doms = entry.front = true;
+}
+
+void AnalysisManager::updateLiveness(FuncOp *func) {
+  auto &entry = getEntry(func);
+  if (entry.live) {
+    liveHits++;
+    return;
+  }
+
+  liveMisses++;
+  func->getRegion()->updateLiveness();
+  entry.live = true;
+}
+
+void AnalysisManager::updateCallGraph() {
+  if (calls) {
+    callHits++;
+    return;
+  }
+
+  callMisses++;
+  CallGraph(module).run();
+  calls = true;
+}
+
+const LoopForest &AnalysisManager::getLoops(FuncOp *func) {
+  auto &entry = getEntry(func);
+  if (entry.loops && entry.shape && entry.inductions) {
+    loopHits++;
+    return *entry.loops;
+  }
+
+  LoopAnalysis analysis(module);
+  if (entry.loops && entry.shape) {
+    loopPartialHits++;
+    updateDoms(func);
+    analysis.findInductions(*entry.loops);
+    entry.inductions = true;
+    return *entry.loops;
+  }
+
+  loopMisses++;
+  release(entry.loops);
+  // This updates dominators as well.
+  entry.loops = new LoopForest(analysis.runImpl(func->getRegion()));
+  entry.doms = entry.shape = entry.inductions = true;
+  return *entry.loops;
+}
+
+std::map<std::string, int> AnalysisManager::stats() {
+  return {
+    { "dom-hits", domHits },
+    { "dom-misses", domMisses },
+    { "loop-hits", loopHits },
+    { "loop-partial-hits", loopPartialHits },
+    { "loop-misses", loopMisses },
+    { "front-hits", frontHits },
+    { "front-misses", frontMisses },
+    { "live-hits", liveHits },
+    { "live-misses", liveMisses },
+    { "call-hits", callHits },
+    { "call-misses", callMisses },
+  };
+}
@@ -0,0 +1,101 @@
+#ifndef ANALYSIS_MANAGER_H
+#define ANALYSIS_MANAGER_H
+
+#include "../codegen/Ops.h"
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace sys {
+
+class LoopForest;
+
+// What a pass leaves intact. See Pass::preserves().
+enum class Preserve {
+  // Anything might have changed.
+  Nothing,
+  // No block is added, removed or retargeted, though ops might have changed.
+  // Dominators and the shape of loops still hold; induction variables don't.
+  CFG,
+  // Only attributes have changed.
+  All,
+};
+
+// Caches per-function analyses across passes.
+//
+// After each pass, PassManager calls invalidate() with what the pass preserved.
+// That only marks results as stale; they're recomputed on the next request.
+//
+// Requests are only valid at the start of a pass, before it changes anything,
+// as nothing here can tell whether the pass has changed a function since.
+// See LoopAnalysis::runCached() and Pass::getDomTreeCached().
+//
+// Requests for different functions may come from different threads.
+class AnalysisManager {
+  struct Entry {
+    LoopForest *loops = nullptr;
+    // The preds, succs and idoms of the blocks are up to date.
+    bool doms = false;
+    // `loops` is up to date, except for induction variables.
+    bool shape = false;
+    // The induction variables in `loops` are up to date.
+    bool inductions = false;
+    // The dominance frontiers of the blocks are up to date.
+    bool front = false;
+    // The live-in and live-out sets of the blocks are up to date.
+    bool live = false;
+  };
+
+  ModuleOp *module;
+  std::unordered_map<FuncOp*, Entry> entries;
+  // Guards `entries` itself; each entry is only touched by the thread working on its function.
+  std::mutex mutex;
+  // Every function has an up-to-date CallerAttr.
+  bool calls = false;
+
+  std::atomic<int> domHits = 0;
+  std::atomic<int> domMisses = 0;
+  std::atomic<int> loopHits = 0;
+  // Only induction variables have been recomputed.
+  std::atomic<int> loopPartialHits = 0;
+  std::atomic<int> loopMisses = 0;
+  std::atomic<int> frontHits = 0;
+  std::atomic<int> frontMisses = 0;
+  std::atomic<int> liveHits = 0;
+  std::atomic<int> liveMisses = 0;
+  int callHits = 0;
+  int callMisses = 0;
+
+  Entry &getEntry(FuncOp *func);
+  void release(LoopForest *forest);
+public:
+  // The manager of the pipeline currently running, if any.
+  static AnalysisManager *current;
+
+  AnalysisManager(ModuleOp *module): module(module) {}
+  AnalysisManager(const AnalysisManager &other) = delete;
+  ~AnalysisManager();
+
+  void invalidate(Preserve preserved);
+
+  // Makes sure the dominators of `func` are up to date.
+  void updateDoms(FuncOp *func);
+  // Same for dominance frontiers. They only depend on the CFG.
+  void updateDomFront(FuncOp *func);
+  // Same for liveness, which is lost as soon as any op changes.
+  void updateLiveness(FuncOp *func);
+  // Runs CallGraph, unless nothing has changed since the last time.
+  // Only called from Pass::run(), so there's a single thread here.
+  void updateCallGraph();
+  // The loop forest of `func`. It's owned by the manager.
+  const LoopForest &getLoops(FuncOp *func);
+
+  std::map<std::string, int> stats();
+};
+
+}
+
+#endif
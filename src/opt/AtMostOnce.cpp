@@ -4,7 +4,7 @@ using namespace sys;
 
 // This runs before Flatten CFG.
 void AtMostOnce::run() {
-  CallGraph(module).run();
+  updateCallGraphCached();
   auto funcs = collectFuncs();
   auto fnMap = getFunctionMap();
 
@@ -71,7 +71,7 @@ void CanonicalizeLoop::canonicalize(LoopInfo *loop) {
       }
       
       // Replace uses outside of the loop with phi.
-      auto uses = op->getUses();
+      std::vector<Op*> uses = op->getUses();
       for (auto use : uses) {
         auto parent = use->getParent();
         // Phi should be treated as from the place where that operands comes from.
@@ -120,7 +120,7 @@ void CanonicalizeLoop::runImpl(Region *region, LoopForest forest) {
 void CanonicalizeLoop::run() {
   Builder builder;
   LoopAnalysis loop(module);
-  loop.run();
+  loop.runCached();
   auto info = loop.getResult();
 
   auto funcs = collectFuncs();
@@ -28,6 +28,7 @@ public:
   std::string name() override { return "dce"; };
   std::map<std::string, int> stats() override;
   void run() override;
+  Preserve preserves() override { return elimBB ? Preserve::Nothing : Preserve::CFG; }
 };
 
 // Assume every operation is dead unless proved otherwise.
@@ -54,6 +55,9 @@ public:
   std::string name() override { return "dle"; }
   std::map<std::string, int> stats() override;
   void run() override;
+  Preserve preserves() override { return Preserve::CFG; }
+  bool isFunctionPass() override { return true; }
+  void runOnFunction(FuncOp *func) override { runImpl(func->getRegion()); }
 };
 
 // Dead argument elimination.
@@ -85,6 +89,7 @@ public:
   std::string name() override { return "dse"; };
   std::map<std::string, int> stats() override;
   void run() override;
+  Preserve preserves() override { return Preserve::CFG; }
 };
 
 class SimplifyCFG : public Pass {
@@ -61,6 +61,10 @@ void DAE::run() {
 
   auto funcs = collectFuncs();
   for (auto func : funcs) {
+    // The pool always passes the bounds of a chunk.
+    if (func->has<WorkerAttr>())
+      continue;
+
     std::set<int, std::greater<int>> toRemove;
     std::set<int> visited;
     int &argcnt = func->get<ArgCountAttr>()->count;
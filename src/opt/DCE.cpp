@@ -17,8 +17,7 @@ bool DCE::isImpure(Op *op) {
       isa<BranchOp>(op) || isa<GotoOp>(op) ||
       isa<ProceedOp>(op) || isa<BreakOp>(op) ||
       isa<ContinueOp>(op) || isa<ForOp>(op) ||
-      isa<CloneOp>(op) || isa<JoinOp>(op) ||
-      isa<WakeOp>(op) || isa<IfOp>(op))
+      isa<IfOp>(op))
     return true;
 
   if (isa<CallOp>(op)) {
@@ -82,7 +81,7 @@ void DCE::run() {
   // Remove unused phi's. 
   // They might be cyclically referencing each other, but not used elsewhere.
   std::vector<Op*> unused;
-  runRewriter([&](PhiOp *op) {
+  runRewriterWorklist([&](PhiOp *op) {
     if (!op->getOperandCount())
       return false;
     
@@ -17,7 +17,7 @@ void DLE::runImpl(Region *region) {
 
   for (auto bb : region->getBlocks()) {
     std::vector<Op*> liveStore;
-    auto ops = bb->getOps();
+    std::vector<Op*> ops = bb->getOps();
 
     for (auto op : ops) {
       if (isa<StoreOp>(op)) {
@@ -124,7 +124,7 @@ void DLE::runImpl(Region *region) {
 
     std::set<Op*> live = liveIn[bb];
 
-    auto ops = bb->getOps();
+    std::vector<Op*> ops = bb->getOps();
     for (auto op : ops) {
       if (isa<StoreOp>(op)) {
         // Kill all loads in `live` that might alias with the store.
@@ -119,7 +119,7 @@ static void handleWhile(Op *x) {
       op->moveToEnd(bb);
       for (auto unused : unusedBB->getOps())
         unused->removeAllOperands();
-      auto copy = unusedBB->getOps();
+      std::vector<Op*> copy = unusedBB->getOps();
       for (auto unused : copy) {
         // It is possible that "unused" itself is also in disrupters.
         // In that case we must skip it in the following process.
@@ -236,7 +236,7 @@ void tidy(FuncOp *func) {
   if (body->getFirstBlock()->preds.size() >= 1) {
     auto first = body->getFirstBlock();
     auto entry = body->insert(first);
-    auto ops = first->getOps();
+    std::vector<Op*> ops = first->getOps();
     for (auto op : ops) {
       if (isa<AllocaOp>(op) || isa<GetArgOp>(op))
         op->moveToEnd(entry);
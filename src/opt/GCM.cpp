@@ -13,10 +13,7 @@ static bool pinned(Op *op) {
     PINNED(BranchOp)
     PINNED(GotoOp)
     PINNED(PhiOp)
-    PINNED(AllocaOp)
-    PINNED(CloneOp)
-    PINNED(JoinOp)
-    PINNED(WakeOp);
+    PINNED(AllocaOp);
 }
 
 // Schedule `op` to the first block that is dominated by its inputs.
@@ -81,7 +78,7 @@ void GCM::scheduleLate(Op *op) {
     }
     while (lca != parent) {
       lca = lca->getIdom();
-      if (loopDepth[lca] < loopDepth[result])
+      if (colder(lca, result))
         result = lca;
     }
 
@@ -100,6 +97,16 @@ void GCM::scheduleLate(Op *op) {
   }
 }
 
+// Whether `a` runs less often than `b`.
+// Uses the profile when both have one, and the loop depth otherwise.
+bool GCM::colder(BasicBlock *a, BasicBlock *b) {
+  auto fa = frequency(a);
+  auto fb = frequency(b);
+  if (fa >= 0 && fb >= 0)
+    return fa < fb;
+  return loopDepth[a] < loopDepth[b];
+}
+
 void GCM::updateDepth(BasicBlock *bb, int dep) {
   depth[bb] = dep;
   for (auto child : tree[bb])
@@ -142,7 +149,7 @@ void GCM::runImpl(Region *region, const LoopForest &forest) {
   visited.clear();
   depth.clear();
 
-  tree = getDomTree(region);
+  tree = getDomTreeCached(region);
   auto entry = region->getFirstBlock();
   updateDepth(entry, 0);
 
@@ -180,7 +187,7 @@ void GCM::runImpl(Region *region, const LoopForest &forest) {
 // Global Code Motion, by Cliff Click
 void GCM::run() {
   LoopAnalysis loop(module);
-  loop.run();
+  loop.runCached();
   auto forests = loop.getResult();
   
   auto funcs = collectFuncs();
@@ -188,3 +195,9 @@ void GCM::run() {
   for (auto func : funcs)
     runImpl(func->getRegion(), forests[func]);
 }
+
+void GCM::runOnFunction(FuncOp *func) {
+  LoopAnalysis loop(module);
+  loop.runCached(func);
+  runImpl(func->getRegion(), loop.getResult()[func]);
+}
@@ -48,6 +48,17 @@ bool allowed(Op *op) {
     ALLOW(AddVOp)
     ALLOW(SubVOp)
     ALLOW(MulVOp)
+    ALLOW(AddFVOp)
+    ALLOW(SubFVOp)
+    ALLOW(MulFVOp)
+    ALLOW(EqVOp)
+    ALLOW(LtVOp)
+    ALLOW(LeVOp)
+    ALLOW(EqFVOp)
+    ALLOW(LtFVOp)
+    ALLOW(LeFVOp)
+    ALLOW(SelectVOp)
+    ALLOW(ReduceAddVOp)
     ALLOW(EqOp)
     ALLOW(NeOp)
     ALLOW(LtOp)
@@ -72,6 +83,7 @@ bool allowed(Op *op) {
     ALLOW(SetNotZeroOp)
     ALLOW(GetGlobalOp)
     ALLOW(BroadcastOp)
+    ALLOW(BroadcastFOp)
 
   // RISC-V GVN
     ALLOW(rv::AddOp)
@@ -113,7 +125,7 @@ void GVN::dvnt(BasicBlock *bb, Domtree &domtree) {
     symbols[phi] = num++;
   }
 
-  auto ops = bb->getOps();
+  std::vector<Op*> ops = bb->getOps();
   for (auto op : ops) {
     // Processed beforehand.
     if (isa<PhiOp>(op))
@@ -179,14 +191,8 @@ void GVN::runImpl(Region *region) {
   dvnt(region->getFirstBlock(), domtree);
 }
 
-void GVN::run() {
-  auto funcs = collectFuncs();
-  for (auto func : funcs)
-    runImpl(func->getRegion());
-
-  // Tidy up remaining phis after gvn.
-  runRewriter([&](PhiOp *op) {
-    // Discard trivial phis.
+void GVN::tidyPhis(Op *root) {
+  runRewriterWorklist(root, [&](PhiOp *op) {
     if (op->getOperands().size() == 1) {
       auto def = op->getOperand().defining;
       op->replaceAllUsesWith(def);
@@ -196,3 +202,17 @@ void GVN::run() {
     return false;
   });
 }
+
+void GVN::run() {
+  auto funcs = collectFuncs();
+  for (auto func : funcs)
+    runImpl(func->getRegion());
+
+  // Tidy up remaining phis after gvn.
+  tidyPhis(module);
+}
+
+void GVN::runOnFunction(FuncOp *func) {
+  runImpl(func->getRegion());
+  tidyPhis(func);
+}
@@ -88,7 +88,7 @@ void Globalize::runImpl(Region *region) {
     std::map<int, Op*> unknownOffsets;
 
     for (;;) {
-      auto ops = runner->getOps();
+      std::vector<Op*> ops = runner->getOps();
       for (auto op : ops) {
         if (isa<StoreOp>(op)) {
           auto value = op->getOperand(0).defining;
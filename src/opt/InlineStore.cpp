@@ -60,7 +60,7 @@ void InlineStore::run() {
     bool bad = false;
 
     for (auto runner = entry; runner->succs.size();) {
-      auto ops = runner->getOps();
+      std::vector<Op*> ops = runner->getOps();
       for (auto op : ops) {
         if (isa<LoadOp>(op)) {
           if (!op->DEF()->has<AliasAttr>())
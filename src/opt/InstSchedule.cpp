@@ -1,5 +1,7 @@
 #include "LowerPasses.h"
 #include "Analysis.h"
+#include "../rv/CostModel.h"
+#include <list>
 #include <unordered_set>
 
 using namespace sys;
@@ -13,7 +15,7 @@ void InstSchedule::runImpl(BasicBlock *bb) {
   for (auto op : bb->getOps()) {
     // We can't reschedule if there is any pinned operations.
     // TODO: Perhaps there's some way to mitigate this?
-    if (isa<CallOp>(op) && op->has<ImpureAttr>() || isa<CloneOp>(op) || isa<JoinOp>(op) || isa<WakeOp>(op))
+    if (isa<CallOp>(op) && op->has<ImpureAttr>())
       return;
   }
 
@@ -48,6 +50,9 @@ void InstSchedule::runImpl(BasicBlock *bb) {
 
   // Now do a list scheduling.
 
+  // Cycles before a loaded value can be used; consumers are kept this many instructions away.
+  int loadLatency = rv::CostModel::get().latency(LoadOp::id);
+
   // The amount of ops that this one is waiting for.
   std::unordered_map<Op*, int> degree;
   std::unordered_map<Op*, int> time;
@@ -82,8 +87,8 @@ void InstSchedule::runImpl(BasicBlock *bb) {
       if (isa<StoreOp>(op) && i >= 2)
         break;
       
-      // Wait 2 instructions for load.
-      if (isa<LoadOp>(def) && index - time[def] <= 2) {
+      // Wait for load.
+      if (isa<LoadOp>(def) && index - time[def] < loadLatency) {
         result--;
       }
 
@@ -183,7 +188,7 @@ void InstSchedule::run() {
   auto funcs = collectFuncs();
   for (auto func : funcs) {
     auto region = func->getRegion();
-    region->updateLiveness();
+    updateLivenessCached(func);
 
     for (auto bb : region->getBlocks())
       runImpl(bb);
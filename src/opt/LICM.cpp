@@ -4,7 +4,8 @@ using namespace sys;
 
 std::map<std::string, int> LICM::stats() {
   return {
-    { "hoisted", hoisted }
+    { "hoisted", hoisted },
+    { "versioned", versioned }
   };
 }
 
@@ -92,7 +93,7 @@ void LICM::hoistVariant(LoopInfo *info, BasicBlock *bb, bool hoistable) {
     if (op->has<VariantAttr>())
       continue;
 
-    if (pinned(op) || isa<PhiOp>(op) || (isa<LoadOp>(op) && (!noAlias(op, stores) || impure))
+    if (pinned(op) || isa<PhiOp>(op) || (isa<LoadOp>(op) && ((!noAlias(op, stores) && !checked.count(op)) || impure))
         // When a store only writes a loop-invariant value to loop-invariant address,
         // and it doesn't follow any load, then it's safe to hoist it out.
         || (isa<StoreOp>(op) && (!hoistable || impure || op->DEF(0)->has<VariantAttr>() || op->DEF(1)->has<VariantAttr>())))
@@ -173,6 +174,78 @@ bool LICM::updateStores(LoopInfo *info) {
   return true;
 }
 
+void LICM::version(LoopInfo *info) {
+  if (impure || info->subloops.size())
+    return;
+
+  LoopVersion version(info);
+
+  // Loads at invariant addresses that some store might overwrite.
+  std::vector<Op*> loads, storeOps;
+  for (auto bb : info->getBlocks()) {
+    for (auto op : bb->getOps()) {
+      if (isa<StoreOp>(op))
+        storeOps.push_back(op);
+      if (isa<LoadOp>(op) && !noAlias(op, stores) && version.invariant(op->DEF()))
+        loads.push_back(op);
+    }
+  }
+
+  // A store that can't be placed keeps every load it might overwrite;
+  // so does one to the very same address.
+  std::unordered_set<Op*> blocked;
+  for (auto store : storeOps) {
+    auto addr = store->DEF(1);
+    bool placed = version.known(addr);
+    for (auto load : loads) {
+      if (mayAlias(load->DEF(), addr) && (!placed || load->DEF() == addr))
+        blocked.insert(load);
+    }
+  }
+
+  std::unordered_set<Op*> addrs;
+  std::vector<Op*> candidates;
+  for (auto load : loads) {
+    if (!blocked.count(load))
+      candidates.push_back(load),
+      addrs.insert(load->DEF());
+  }
+  if (candidates.empty())
+    return;
+
+  for (auto load : candidates)
+    version.add(load->DEF(), SIZE(load), false);
+  for (auto store : storeOps) {
+    auto addr = store->DEF(1);
+    for (auto x : addrs) {
+      if (mayAlias(x, addr)) {
+        version.add(addr, SIZE(store), true);
+        break;
+      }
+    }
+  }
+
+  // Only the candidates need telling apart from the stores.
+  auto cond = version.check([&](Op *a, Op *b) {
+    return (!addrs.count(a) && !addrs.count(b)) || !mayAlias(a, b);
+  });
+  if (!cond)
+    return;
+
+  auto copy = version.clone(cond);
+  versioned++;
+  cfgChanged = true;
+  domtree = getDomTree(info->header->getParent());
+
+  // The copy still deserves whatever can be hoisted without the check.
+  if (updateStores(&copy))
+    hoistVariant(&copy, copy.header, /*hoistable=*/true);
+  updateStores(info);
+
+  for (auto load : candidates)
+    checked.insert(load);
+}
+
 void LICM::runImpl(LoopInfo *info) {
   // Hoist internal loops first;
   // otherwise we risk hoisting inner-loop's variants out.
@@ -182,10 +255,17 @@ void LICM::runImpl(LoopInfo *info) {
   if (!updateStores(info))
     return;
 
+  // Alias analysis can't tell array parameters apart, which would keep their loads in the loop.
+  // A copy guarded by a runtime check lets them out.
+  version(info);
+
   // Mark invariants inside the loop, and try hoisting it out.
   // We must traverse through domtree to preserve def-use chain.
   auto header = info->header;
   hoistVariant(info, header, /*hoistable=*/true);
+
+  // Those loads are now in the preheader, which the check doesn't cover for outer loops.
+  checked.clear();
 }
 
 bool LICM::hoistSubloop(LoopInfo *outer) {
@@ -195,7 +275,7 @@ bool LICM::hoistSubloop(LoopInfo *outer) {
   for (auto bb : outer->getBlocks()) {
     // All single-operand phis that refer to things outside this loop can be folded.
     // This won't break LCSSA.
-    auto ops = bb->getOps();
+    std::vector<Op*> ops = bb->getOps();
     for (auto op : ops) {
       if (!isa<PhiOp>(op) || op->getOperandCount() != 1)
         continue;
@@ -302,54 +382,67 @@ bool LICM::hoistSubloop(LoopInfo *outer) {
   return false;
 }
 
-void LICM::run() {
-  LoopAnalysis loop(module);
-  loop.run();
-  auto forests = loop.getResult();
+void LICM::hoistInvariants(FuncOp *func, const LoopForest &forest) {
+  auto region = func->getRegion();
+  domtree = getDomTreeCached(region);
 
-  auto funcs = collectFuncs();
-  
-  for (auto func : funcs) {
-    auto region = func->getRegion();
-    domtree = getDomTree(region);
+  for (auto info : forest.getLoops()) {
+    // Only call for top-level loops.
+    if (!info->getParent())
+      runImpl(info);
+  }
+
+  // Remove VariantAttr's attached.
+  // That's necessary because phi's cannot have attrs other than FromAttr.
+  for (auto bb : region->getBlocks()) {
+    for (auto op : bb->getOps())
+      op->remove<VariantAttr>();
+  }
+}
 
-    const auto &forest = forests[func];
+void LICM::hoistSubloops(FuncOp *func, LoopForest forest) {
+  auto region = func->getRegion();
+  domtree = getDomTree(region);
+
+  LoopAnalysis loop(module);
+  bool changed;
+  do {
+    changed = false;
     for (auto info : forest.getLoops()) {
       // Only call for top-level loops.
-      if (!info->getParent())
-        runImpl(info);
+      if (!info->getParent() && hoistSubloop(info)) {
+        forest = loop.runImpl(region);
+        domtree = getDomTree(region);
+        changed = cfgChanged = true;
+        break;
+      }
     }
 
-    // Remove VariantAttr's attached.
-    // That's necessary because phi's cannot have attrs other than FromAttr.
     for (auto bb : region->getBlocks()) {
       for (auto op : bb->getOps())
         op->remove<VariantAttr>();
     }
-  }
+  } while (changed);
+}
 
-  for (auto func : funcs) {
-    auto region = func->getRegion();
-    domtree = getDomTree(region);
-
-    auto forest = forests[func];
-    bool changed;
-    do {
-      changed = false;
-      for (auto info : forest.getLoops()) {
-        // Only call for top-level loops.
-        if (!info->getParent() && hoistSubloop(info)) {
-          forest = loop.runImpl(region);
-          domtree = getDomTree(region);
-          changed = true;
-          break;
-        }
-      }
+void LICM::run() {
+  LoopAnalysis loop(module);
+  loop.runCached();
+  auto forests = loop.getResult();
 
-      for (auto bb : region->getBlocks()) {
-        for (auto op : bb->getOps())
-          op->remove<VariantAttr>();
-      }
-    } while (changed);
-  }
+  auto funcs = collectFuncs();
+  for (auto func : funcs)
+    hoistInvariants(func, forests[func]);
+
+  for (auto func : funcs)
+    hoistSubloops(func, forests[func]);
+}
+
+void LICM::runOnFunction(FuncOp *func) {
+  LoopAnalysis loop(module);
+  loop.runCached(func);
+  auto forests = loop.getResult();
+
+  hoistInvariants(func, forests[func]);
+  hoistSubloops(func, forests[func]);
 }
@@ -14,7 +14,7 @@ bool isRecursive(Op *op);
 
 // This pass runs after Mem2Reg.
 void LateInline::run() {
-  CallGraph(module).run();
+  updateCallGraphCached();
   
   Builder builder;
 
@@ -31,13 +31,26 @@ void LateInline::run() {
     }
 
     FuncOp *func = fnMap[fname];
+    // Calls to workers are dispatched to the thread pool.
+    if (func->has<WorkerAttr>())
+      return false;
+
+    // With a profile, calls that never ran aren't worth the code size,
+    // and hot ones may be twice as large.
+    int limit = threshold;
+    if (auto profile = call->find<ProfileAttr>()) {
+      if (!profile->count)
+        return false;
+      if (profile->count >= ProfileAttr::hot)
+        limit *= 2;
+    }
 
     // Don't inline overly large functions.
     auto fnRegion = func->getRegion();
     int opcount = 0;
     for (auto bb : fnRegion->getBlocks())
       opcount += bb->getOpCount();
-    if (opcount >= threshold)
+    if (opcount >= limit)
       return false;
 
     // Don't inline recursive functions here.
@@ -0,0 +1,359 @@
+#include "ListSchedule.h"
+#include "../codegen/Attrs.h"
+
+#include <algorithm>
+#include <cassert>
+#include <unordered_map>
+
+using namespace sys;
+
+struct ListSchedule::Node {
+  Op *op;
+  int latency;
+  // Longest latency-weighted path from here to the end of the region.
+  int height = 0;
+  // Predecessors not yet scheduled.
+  int preds = 0;
+  // The earliest cycle at which the operands are all available.
+  int ready = 0;
+  // Each successor, with the cycles it must wait after this one issues.
+  std::vector<std::pair<int, int>> succs;
+  // Register values this op reads; indices into the value table.
+  std::vector<int> reads;
+  // The value this op defines, or -1.
+  int defines = -1;
+};
+
+std::map<std::string, int> ListSchedule::stats() {
+  return {
+    { "reordered-regions", reordered },
+    { "moved-ops", moved },
+  };
+}
+
+namespace {
+
+// Whether the two address ops are known to point into different objects.
+// Backend memory ops add their own immediates, so the offsets in AliasAttr don't say much.
+bool disjointBases(Op *a, Op *b) {
+  auto x = a->find<AliasAttr>();
+  auto y = b->find<AliasAttr>();
+  if (!x || !y || x->unknown || y->unknown)
+    return false;
+
+  for (const auto &[base, _] : x->location) {
+    if (y->location.count(base))
+      return false;
+  }
+  return true;
+}
+
+// A register value read or written in a region.
+struct Live {
+  bool fp;
+  // Defined before the region, so it's live when the region starts.
+  bool external = false;
+  // Some user is outside the region, so it stays live past the end.
+  bool escapes = false;
+  // Users inside the region.
+  int users = 0;
+};
+
+// The peak number of live values of each class, were the region run in `order`.
+std::pair<int, int> peak(const std::vector<int> &order, const std::vector<std::vector<int>> &reads,
+                         const std::vector<int> &defines, const std::vector<Live> &values) {
+  std::vector<int> users(values.size());
+  for (int i = 0; i < values.size(); i++)
+    users[i] = values[i].users;
+
+  int live[2] = { 0, 0 };
+  for (auto &value : values) {
+    if (value.external)
+      live[value.fp]++;
+  }
+  int high[2] = { live[0], live[1] };
+  for (auto i : order) {
+    for (auto v : reads[i]) {
+      if (!--users[v] && !values[v].escapes)
+        live[values[v].fp]--;
+    }
+    if (defines[i] >= 0) {
+      auto &value = values[defines[i]];
+      live[value.fp]++;
+      high[value.fp] = std::max(high[value.fp], live[value.fp]);
+    }
+  }
+  return { high[0], high[1] };
+}
+
+}
+
+bool ListSchedule::schedule(const std::vector<Op*> &region, Op *boundary) {
+  int n = region.size();
+  if (n < 3)
+    return false;
+
+  std::unordered_map<Op*, int> index;
+  for (int i = 0; i < n; i++)
+    index[region[i]] = i;
+
+  std::vector<Node> nodes(n);
+  std::vector<Access> accesses(n);
+  std::vector<Role> roles(n);
+  for (int i = 0; i < n; i++) {
+    nodes[i].op = region[i];
+    nodes[i].latency = latency(region[i]);
+    roles[i] = classify(region[i], accesses[i]);
+  }
+
+  auto edge = [&](int from, int to, int lat) {
+    nodes[from].succs.push_back({ to, lat });
+    nodes[to].preds++;
+  };
+
+  // Register values. Those defined outside the region are live all the way through it
+  // unless every user is in the region.
+  std::vector<Live> values;
+  std::unordered_map<Op*, int> valueId;
+  auto track = [&](Op *def) {
+    if (valueId.count(def))
+      return valueId[def];
+
+    Live value;
+    value.fp = fpResult(def);
+    value.external = !index.count(def);
+    for (auto use : def->getUses()) {
+      if (index.count(use))
+        value.users++;
+      else
+        value.escapes = true;
+    }
+    valueId[def] = values.size();
+    values.push_back(value);
+    return valueId[def];
+  };
+
+  for (int i = 0; i < n; i++) {
+    auto op = region[i];
+    if (!op->getUses().empty())
+      nodes[i].defines = track(op);
+
+    for (auto operand : op->getOperands()) {
+      auto def = operand.defining;
+      int v = track(def);
+      // The same value used twice is still one read.
+      if (std::find(nodes[i].reads.begin(), nodes[i].reads.end(), v) == nodes[i].reads.end())
+        nodes[i].reads.push_back(v);
+
+      if (index.count(def))
+        edge(index[def], i, nodes[index[def]].latency);
+    }
+  }
+
+  // Memory. Loads can pass each other, but nothing passes a store it may touch.
+  auto conflict = [&](int a, int b) {
+    auto &x = accesses[a], &y = accesses[b];
+    if (!x.base || !y.base)
+      return true;
+    if (x.base == y.base)
+      return !(x.known && y.known && (x.offset + x.size <= y.offset || y.offset + y.size <= x.offset));
+    return !disjointBases(x.base, y.base);
+  };
+  std::vector<int> memory;
+  for (int i = 0; i < n; i++) {
+    if (roles[i] == Plain)
+      continue;
+
+    for (auto j : memory) {
+      if ((roles[i] == Store || roles[j] == Store) && conflict(j, i))
+        edge(j, i, 0);
+    }
+    memory.push_back(i);
+  }
+
+  // In-place updates, e.g. post-increments: users of the updated value see either
+  // the old or the new one, depending on which side they're on.
+  for (int i = 0; i < n; i++) {
+    Op *updated = updates(region[i]);
+    if (!updated)
+      continue;
+
+    for (auto use : updated->getUses()) {
+      if (use == region[i] || !index.count(use))
+        continue;
+      int j = index[use];
+      if (j < i)
+        edge(j, i, 0);
+      else
+        edge(i, j, 0);
+    }
+  }
+
+  // The original order is a topological one, so heights can be done backwards.
+  for (int i = n - 1; i >= 0; i--) {
+    int height = 0;
+    for (auto [succ, lat] : nodes[i].succs)
+      height = std::max(height, lat + nodes[succ].height);
+    nodes[i].height = std::max(height, nodes[i].latency);
+  }
+
+  // Now go top-down.
+  std::vector<int> users(values.size());
+  for (int i = 0; i < values.size(); i++)
+    users[i] = values[i].users;
+  int live[2] = { 0, 0 };
+  for (auto &value : values) {
+    if (value.external)
+      live[value.fp]++;
+  }
+  int limit[2] = { intRegs, fpRegs };
+
+  // How much scheduling `i` now raises the number of live values of class `fp`.
+  auto delta = [&](int i, bool fp) {
+    int d = 0;
+    if (nodes[i].defines >= 0 && values[nodes[i].defines].fp == fp)
+      d++;
+    for (auto v : nodes[i].reads) {
+      if (values[v].fp == fp && users[v] == 1 && !values[v].escapes)
+        d--;
+    }
+    return d;
+  };
+
+  std::vector<int> ready;
+  for (int i = 0; i < n; i++) {
+    if (!nodes[i].preds)
+      ready.push_back(i);
+  }
+
+  std::vector<int> order;
+  int cycle = 0;
+  while (!ready.empty()) {
+    bool tight[2] = { live[0] >= limit[0], live[1] >= limit[1] };
+    auto pressure = [&](int i) {
+      int d = 0;
+      for (int fp = 0; fp < 2; fp++) {
+        if (tight[fp])
+          d += delta(i, fp);
+      }
+      return d;
+    };
+
+    int best = 0;
+    for (int k = 1; k < ready.size(); k++) {
+      int a = ready[k], b = ready[best];
+      if (tight[0] || tight[1]) {
+        int pa = pressure(a), pb = pressure(b);
+        if (pa != pb) {
+          if (pa < pb)
+            best = k;
+          continue;
+        }
+      }
+      bool stallA = nodes[a].ready > cycle, stallB = nodes[b].ready > cycle;
+      if (stallA != stallB) {
+        if (!stallA)
+          best = k;
+        continue;
+      }
+      if (nodes[a].height != nodes[b].height) {
+        if (nodes[a].height > nodes[b].height)
+          best = k;
+        continue;
+      }
+      if (a < b)
+        best = k;
+    }
+
+    int i = ready[best];
+    ready.erase(ready.begin() + best);
+    order.push_back(i);
+
+    cycle = std::max(cycle, nodes[i].ready);
+    for (auto v : nodes[i].reads) {
+      if (!--users[v] && !values[v].escapes)
+        live[values[v].fp]--;
+    }
+    if (nodes[i].defines >= 0)
+      live[values[nodes[i].defines].fp]++;
+
+    for (auto [succ, lat] : nodes[i].succs) {
+      nodes[succ].ready = std::max(nodes[succ].ready, cycle + lat);
+      if (!--nodes[succ].preds)
+        ready.push_back(succ);
+    }
+    cycle++;
+  }
+  assert(order.size() == n);
+
+  bool changed = false;
+  for (int i = 0; i < n; i++) {
+    if (order[i] != i)
+      changed = true;
+  }
+  if (!changed)
+    return false;
+
+  // Don't hand RegAlloc anything that it'd have to spill more for.
+  std::vector<std::vector<int>> reads(n);
+  std::vector<int> defines(n), original(n);
+  for (int i = 0; i < n; i++) {
+    reads[i] = nodes[i].reads;
+    defines[i] = nodes[i].defines;
+    original[i] = i;
+  }
+  auto [oldInt, oldFp] = peak(original, reads, defines, values);
+  auto [newInt, newFp] = peak(order, reads, defines, values);
+  if (newInt > std::max(oldInt, intRegs) || newFp > std::max(oldFp, fpRegs))
+    return false;
+
+  for (int k = 0; k < n; k++) {
+    if (order[k] != k)
+      moved++;
+  }
+  BasicBlock *bb = region[0]->getParent();
+  for (auto i : order) {
+    if (boundary)
+      region[i]->moveBefore(boundary);
+    else
+      region[i]->moveToEnd(bb);
+  }
+  return true;
+}
+
+void ListSchedule::runImpl(BasicBlock *bb) {
+  std::vector<Op*> region;
+  Op *last = bb->getLastOp();
+
+  // Collect the ops first; scheduling moves them around.
+  std::vector<Op*> ops;
+  for (auto op : bb->getOps())
+    ops.push_back(op);
+
+  for (auto op : ops) {
+    Access access;
+    Role role = classify(op, access);
+    if (isa<PhiOp>(op) || op == last || (role == Plain && op->has<ImpureAttr>()))
+      role = Barrier;
+
+    if (role != Barrier) {
+      region.push_back(op);
+      continue;
+    }
+    if (schedule(region, op))
+      reordered++;
+    region.clear();
+  }
+  if (schedule(region, nullptr))
+    reordered++;
+}
+
+void ListSchedule::runOnFunction(FuncOp *func) {
+  for (auto bb : func->getRegion()->getBlocks())
+    runImpl(bb);
+}
+
+void ListSchedule::run() {
+  for (auto func : collectFuncs())
+    runOnFunction(func);
+}
@@ -0,0 +1,65 @@
+#ifndef LIST_SCHEDULE_H
+#define LIST_SCHEDULE_H
+
+#include "Pass.h"
+#include "../codegen/Ops.h"
+
+namespace sys {
+
+// A list scheduler over machine ops, after lowering and before register allocation.
+//
+// Each block is cut into regions at ops that can't move (calls and the register
+// reads and writes around them, phis, terminators and so on). Inside a region,
+// ops are reordered top-down along a dependence graph of operands, memory accesses
+// and in-place updates, longest latency-weighted path first.
+//
+// The scheduler keeps an eye on register pressure, and gives up on any region
+// whose new order needs more registers than both the old order and the target has.
+//
+// Targets fill in the machine model through the virtual functions below.
+class ListSchedule : public Pass {
+  int reordered = 0;
+  int moved = 0;
+
+  struct Node;
+  void runImpl(BasicBlock *bb);
+  // Returns true if it changed anything.
+  bool schedule(const std::vector<Op*> &region, Op *boundary);
+protected:
+  enum Role { Plain, Load, Store, Barrier };
+
+  // Where a load or a store goes.
+  struct Access {
+    // The op defining the address.
+    Op *base = nullptr;
+    // Bytes away from `base`; only meaningful when `known`.
+    int offset = 0;
+    int size = 0;
+    bool known = false;
+  };
+
+  // Fills in `access` for loads and stores.
+  virtual Role classify(Op *op, Access &access) = 0;
+  // Cycles until the result of `op` can be used.
+  virtual int latency(Op *op) = 0;
+  // The operand `op` updates in place, if any.
+  // Other users of that operand must stay on the same side of `op`.
+  virtual Op *updates(Op*) { return nullptr; }
+  // Whether the result of `op` goes to a floating point (or vector) register.
+  virtual bool fpResult(Op *op) = 0;
+
+  // Allocatable registers of each class.
+  int intRegs = 0;
+  int fpRegs = 0;
+public:
+  ListSchedule(ModuleOp *module): Pass(module) {}
+
+  std::map<std::string, int> stats() override;
+  void run() override;
+  bool isFunctionPass() override { return true; }
+  void runOnFunction(FuncOp *func) override;
+};
+
+}
+
+#endif
@@ -1,5 +1,6 @@
 #include "LoopPasses.h"
 #include "../utils/Matcher.h"
+#include "AnalysisManager.h"
 
 using namespace sys;
 
@@ -116,6 +117,14 @@ LoopForest LoopAnalysis::runImpl(Region *region) {
     }
   }
 
+  findInductions(forest);
+  return forest;
+}
+
+void LoopAnalysis::findInductions(const LoopForest &forest) {
+  for (auto loop : forest.getLoops())
+    loop->induction = loop->start = loop->stop = loop->step = nullptr;
+
   // Try to find the induction variable.
   Rule addi("(add x y)");
   Rule br("(br (lt x y))");
@@ -188,17 +197,37 @@ LoopForest LoopAnalysis::runImpl(Region *region) {
       }
     }
   }
-
-  return forest;
 }
 
 void LoopAnalysis::run() {
   auto funcs = collectFuncs();
   for (auto func : funcs)
     info[func] = runImpl(func->getRegion());
+  owned = true;
+}
+
+void LoopAnalysis::runCached() {
+  auto funcs = collectFuncs();
+  for (auto func : funcs)
+    runCached(func);
+}
+
+void LoopAnalysis::runCached(FuncOp *func) {
+  auto analyses = AnalysisManager::current;
+  if (!analyses) {
+    info[func] = runImpl(func->getRegion());
+    owned = true;
+    return;
+  }
+
+  info[func] = analyses->getLoops(func);
+  owned = false;
 }
 
 LoopAnalysis::~LoopAnalysis() {
+  if (!owned)
+    return;
+
   for (const auto &[k, v] : info) {
     for (auto loop : v.getLoops())
       delete loop;
@@ -7,6 +7,7 @@
 
 #include <unordered_set>
 #include <set>
+#include <functional>
 
 // The whole content of this file should be run after Mem2Reg.
 namespace sys {
@@ -74,6 +75,9 @@ public:
 
 class LoopAnalysis : public Pass {
   std::map<FuncOp*, LoopForest> info;
+  // Whether the loops in `info` should be deleted with this object,
+  // rather than belonging to the AnalysisManager.
+  bool owned = true;
 
 public:
   LoopAnalysis(ModuleOp *module): Pass(module) {}
@@ -82,7 +86,14 @@ public:
   std::string name() override { return "loop-analysis"; }
   std::map<std::string, int> stats() override { return {}; }
   LoopForest runImpl(Region *region);
+  // Fills in the induction variable, start, stop and step of each loop.
+  void findInductions(const LoopForest &forest);
   void run() override;
+  // Same as run(), but reuses the results of previous passes when they still hold.
+  // Only call this at the start of a pass, before anything has changed.
+  void runCached();
+  // Same as above, for a single function.
+  void runCached(FuncOp *func);
   void reset() { info = {}; }
 
   auto getResult() { return info; }
@@ -171,19 +182,84 @@ public:
   void run() override;
 };
 
+// Guards a loop by a runtime check that its accesses don't overlap,
+// falling back to a copy of it when they might. Not a pass on its own;
+// Vectorize and LICM use it when alias analysis can't tell pointers apart.
+//
+// Each access is given as an address and the bytes read or written there.
+// An address can be invariant, linear in the induction variable, or a header phi
+// stepped by a constant; its range over the whole loop is computed in the preheader.
+// Accesses starting at the same place and moving in lockstep are also let through,
+// as they only meet within one iteration: the checked loop may reorder iterations
+// and hoist loads, but not reorder accesses within an iteration.
+class LoopVersion {
+  struct Access {
+    Op *addr;
+    int size;
+    bool stored;
+    // The address is `offset + coef * i` for the induction variable `i`.
+    // For a phi, `coef` is its step over the step of `i`.
+    int coef;
+    bool phi;
+  };
+
+  LoopInfo *info;
+  Builder builder;
+  std::vector<Access> accesses;
+  std::unordered_map<Op*, Op*> hoisted;
+  Op *lastOp = nullptr;
+  bool valid = false;
+
+  bool linear(Op *op, int &coef, int depth = 0);
+  bool exact();
+  Op *hoist(Op *op);
+  Op *offset(Op *op);
+  Op *last();
+  std::pair<Op*, Op*> range(const Access &access);
+public:
+  // The loop must be rotated, and leave only through its latch.
+  LoopVersion(LoopInfo *info);
+
+  // Whether `op` is the same in every iteration, and can be recomputed in the preheader.
+  bool invariant(Op *op, int depth = 0);
+  // Whether the range `addr` covers is known.
+  bool known(Op *addr);
+  // Records an access. Returns false, recording nothing, when the range isn't known.
+  bool add(Op *addr, int size, bool stored);
+
+  // Builds the condition, at the end of the preheader, that no pair of accesses
+  // involving a store overlap, skipping pairs where `apart` holds.
+  // Returns null if nothing needs checking.
+  Op *check(const std::function<bool(Op*, Op*)> &apart);
+  // Copies the loop, except for the ops in `skip`, and runs the original only when `cond` holds.
+  // The original gets a new preheader, and both copies exit through a new block.
+  // Returns the info of the copy, which isn't registered in any forest.
+  LoopInfo clone(Op *cond, const std::unordered_set<Op*> &skip = {});
+};
+
 class LICM : public Pass {
   int hoisted = 0;
+  int versioned = 0;
   DomTree domtree;
   // All addresses stored inside current loop.
   std::vector<Op*> stores;
   // Whether the current function has an impure call.
   bool impure;
+  // Some subloop has been hoisted, which adds blocks.
+  bool cfgChanged = false;
+  // Loads proven apart from the stores by a runtime check.
+  std::unordered_set<Op*> checked;
 
   // A store is hoistable when no branch or load has been met.
   void hoistVariant(LoopInfo *info, BasicBlock *bb, bool hoistable);
   void markVariant(LoopInfo *info, BasicBlock *bb, bool hoistable);
   void runImpl(LoopInfo *info);
   bool hoistSubloop(LoopInfo *outer);
+  // Versions an innermost loop so that loads blocked by may-alias stores can be hoisted.
+  void version(LoopInfo *info);
+  void hoistInvariants(FuncOp *func, const LoopForest &forest);
+  // Repeats hoistSubloop() until nothing changes.
+  void hoistSubloops(FuncOp *func, LoopForest forest);
 
   // Find out all stores in the loop and update `stores`.
   // Returns false when finds out unsuitable to hoist.
@@ -194,6 +270,9 @@ public:
   std::string name() override { return "licm"; }
   std::map<std::string, int> stats() override;
   void run() override;
+  Preserve preserves() override { return cfgChanged ? Preserve::Nothing : Preserve::CFG; }
+  bool isFunctionPass() override { return true; }
+  void runOnFunction(FuncOp *func) override;
 };
 
 class RemoveEmptyLoop : public Pass {
@@ -210,11 +289,16 @@ public:
 
 class Vectorize : public Pass {
   std::unordered_map<Op*, Op*> base;
+  // Whether the backend lowers floats, masks and reductions,
+  // rather than only elementwise integer ops.
+  bool neon;
+  // Whether float reductions may be reassociated.
+  bool fastMath;
   
   Op *findBase(Op *op);
   void runImpl(LoopInfo *info);
 public:
-  Vectorize(ModuleOp *module): Pass(module) {}
+  Vectorize(ModuleOp *module, bool neon, bool fastMath): Pass(module), neon(neon), fastMath(fastMath) {}
 
   std::string name() override { return "vectorize"; }
   std::map<std::string, int> stats() override { return {}; }
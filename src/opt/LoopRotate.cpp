@@ -135,7 +135,7 @@ void LoopRotate::runImpl(LoopInfo *info) {
 void LoopRotate::run() {
   Builder builder;
   LoopAnalysis loop(module);
-  loop.run();
+  loop.runCached();
   auto info = loop.getResult();
 
   auto funcs = collectFuncs();
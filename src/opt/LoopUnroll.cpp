@@ -234,12 +234,20 @@ bool ConstLoopUnroll::runImpl(LoopInfo *loop) {
   if (!isa<IntOp>(step))
     return false;
 
+  // With a profile, leave loops that never ran alone, and give hot ones a larger budget.
+  int budget = 1000;
+  auto freq = frequency(header);
+  if (freq == 0)
+    return false;
+  if (freq >= ProfileAttr::hot)
+    budget *= 2;
+
   // Fully unroll constant-bounded loops if it's small enough.
   if (lower && upper && isa<IntOp>(lower) && isa<IntOp>(upper)) {
     int low = V(lower);
     int high = V(upper);
     int times = (high - low) / V(step);
-    if (times <= 1000 / loopsize)
+    if (times <= budget / loopsize)
       unroll = times;
   }
   // Not a constant loop.
@@ -0,0 +1,446 @@
+#include "LoopPasses.h"
+
+using namespace sys;
+
+namespace {
+
+// Uses the 64-bit op when either side is.
+// Addresses don't always say so (arguments are i32), so they always use the 64-bit ops.
+template<class I, class L>
+Op *arith(Builder &builder, Value a, Value b) {
+  if (a.defining->getResultType() == Value::i64 || b.defining->getResultType() == Value::i64)
+    return builder.create<L>({ a, b });
+  return builder.create<I>({ a, b });
+}
+
+}
+
+LoopVersion::LoopVersion(LoopInfo *info): info(info) {
+  auto preheader = info->preheader;
+  if (!preheader || !isa<GotoOp>(preheader->getLastOp()))
+    return;
+
+  if (info->latches.size() != 1 || info->exits.size() != 1 || info->exitings.size() != 1)
+    return;
+
+  auto latch = info->getLatch();
+  auto term = latch->getLastOp();
+  if (!info->exitings.count(latch) || !isa<BranchOp>(term) || TARGET(term) != info->header)
+    return;
+
+  valid = true;
+}
+
+bool LoopVersion::invariant(Op *op, int depth) {
+  if (!info->contains(op->getParent()))
+    return true;
+
+  // Only arithmetic is recomputed.
+  if (depth > 8 || !(isa<IntOp>(op)
+      || isa<AddIOp>(op) || isa<SubIOp>(op) || isa<MulIOp>(op)
+      || isa<AddLOp>(op) || isa<SubLOp>(op) || isa<MulLOp>(op)))
+    return false;
+
+  for (auto operand : op->getOperands()) {
+    if (!invariant(operand.defining, depth + 1))
+      return false;
+  }
+  return true;
+}
+
+// Whether `op` is `offset + coef * i`, with `offset` invariant.
+bool LoopVersion::linear(Op *op, int &coef, int depth) {
+  if (op == info->induction) {
+    coef = 1;
+    return true;
+  }
+  if (invariant(op)) {
+    coef = 0;
+    return true;
+  }
+  if (depth > 8)
+    return false;
+
+  int a, b;
+  switch (op->opid) {
+  case AddIOp::id:
+  case AddLOp::id:
+    if (!linear(op->DEF(0), a, depth + 1) || !linear(op->DEF(1), b, depth + 1))
+      return false;
+    coef = a + b;
+    return true;
+  case SubIOp::id:
+  case SubLOp::id:
+    if (!linear(op->DEF(0), a, depth + 1) || !linear(op->DEF(1), b, depth + 1))
+      return false;
+    coef = a - b;
+    return true;
+  case MulIOp::id:
+  case MulLOp::id:
+    if (isa<IntOp>(op->DEF(1)) && linear(op->DEF(0), a, depth + 1)) {
+      coef = a * V(op->DEF(1));
+      return true;
+    }
+    if (isa<IntOp>(op->DEF(0)) && linear(op->DEF(1), a, depth + 1)) {
+      coef = a * V(op->DEF(0));
+      return true;
+    }
+    return false;
+  default:
+    return false;
+  }
+}
+
+bool LoopVersion::known(Op *addr) {
+  if (!valid)
+    return false;
+  if (invariant(addr))
+    return true;
+
+  // Anything moving needs to know how far the loop goes.
+  auto step = info->step;
+  if (!info->induction || !info->start || !info->stop || !step
+      || !isa<IntOp>(step) || V(step) <= 0 || !invariant(info->stop))
+    return false;
+
+  if (isa<PhiOp>(addr) && addr->getParent() == info->header && addr != info->induction) {
+    auto latchval = Op::getPhiFrom(addr, info->getLatch());
+    return isa<AddLOp>(latchval) && latchval->DEF(0) == addr && isa<IntOp>(latchval->DEF(1))
+      && V(latchval->DEF(1)) > 0 && V(latchval->DEF(1)) % V(step) == 0;
+  }
+
+  int coef;
+  return linear(addr, coef) && coef >= 0;
+}
+
+bool LoopVersion::add(Op *addr, int size, bool stored) {
+  if (!known(addr))
+    return false;
+
+  bool phi = isa<PhiOp>(addr) && addr->getParent() == info->header && addr != info->induction;
+  int coef;
+  if (phi)
+    coef = V(Op::getPhiFrom(addr, info->getLatch())->DEF(1)) / V(info->step);
+  else
+    linear(addr, coef);
+
+  accesses.push_back({ addr, size, stored, coef, phi });
+  return true;
+}
+
+// Whether the induction variable reaches exactly `stop - step`.
+// SCEV gives pointer inductions a stop of `start + n * step`.
+bool LoopVersion::exact() {
+  int step = V(info->step);
+  if (step == 1)
+    return true;
+
+  auto stop = info->stop;
+  if (!(isa<AddIOp>(stop) || isa<AddLOp>(stop)) || stop->DEF(0) != info->start)
+    return false;
+
+  auto mul = stop->DEF(1);
+  if (!(isa<MulIOp>(mul) || isa<MulLOp>(mul)))
+    return false;
+  return isa<IntOp>(mul->DEF(1)) && V(mul->DEF(1)) == step
+    || isa<IntOp>(mul->DEF(0)) && V(mul->DEF(0)) == step;
+}
+
+// Recomputes an invariant `op` at the insertion point, if it's inside the loop.
+Op *LoopVersion::hoist(Op *op) {
+  if (!info->contains(op->getParent()))
+    return op;
+  if (hoisted.count(op))
+    return hoisted[op];
+
+  std::vector<Op*> operands;
+  for (auto operand : op->getOperands())
+    operands.push_back(hoist(operand.defining));
+
+  auto copy = builder.copy(op);
+  for (int i = 0; i < operands.size(); i++)
+    copy->setOperand(i, operands[i]);
+  return hoisted[op] = copy;
+}
+
+// The invariant part of a linear `op`, or null when it's zero.
+Op *LoopVersion::offset(Op *op) {
+  if (op == info->induction)
+    return nullptr;
+  if (invariant(op))
+    return hoist(op);
+
+  Op *a, *b;
+  switch (op->opid) {
+  case AddIOp::id:
+  case AddLOp::id:
+    a = offset(op->DEF(0));
+    b = offset(op->DEF(1));
+    if (!a || !b)
+      return a ? a : b;
+    if (isa<AddLOp>(op))
+      return builder.create<AddLOp>({ Value(a), b });
+    return arith<AddIOp, AddLOp>(builder, a, b);
+  case SubIOp::id:
+  case SubLOp::id:
+    a = offset(op->DEF(0));
+    b = offset(op->DEF(1));
+    if (!b)
+      return a;
+    if (!a)
+      a = builder.create<IntOp>({ new IntAttr(0) });
+    if (isa<SubLOp>(op))
+      return builder.create<SubLOp>({ Value(a), b });
+    return arith<SubIOp, SubLOp>(builder, a, b);
+  default:
+    // A multiplication; the side that isn't a constant holds the induction variable.
+    int i = isa<IntOp>(op->DEF(1)) ? 0 : 1;
+    a = offset(op->DEF(i));
+    if (!a)
+      return nullptr;
+    if (isa<MulLOp>(op))
+      return builder.create<MulLOp>({ Value(a), hoist(op->DEF(1 - i)) });
+    return arith<MulIOp, MulLOp>(builder, a, hoist(op->DEF(1 - i)));
+  }
+}
+
+// The last value of the induction variable, given that the loop is entered with `start < stop`.
+// Only iterations other than the first check the stop, so they all stay below it.
+Op *LoopVersion::last() {
+  if (lastOp)
+    return lastOp;
+
+  auto dec = builder.create<IntOp>({ new IntAttr(exact() ? V(info->step) : 1) });
+  return lastOp = arith<SubIOp, SubLOp>(builder, hoist(info->stop), dec);
+}
+
+// The bytes an access covers through the whole loop, as [low, high).
+std::pair<Op*, Op*> LoopVersion::range(const Access &access) {
+  Op *low, *high;
+  const auto &scale = [&](Op *x) {
+    return access.coef == 1 ? x
+      : arith<MulIOp, MulLOp>(builder, x, builder.create<IntOp>({ new IntAttr(access.coef) }));
+  };
+
+  if (access.phi) {
+    low = Op::getPhiFrom(access.addr, info->preheader);
+    high = builder.create<AddLOp>({ Value(low), scale(arith<SubIOp, SubLOp>(builder, last(), info->start)) });
+  } else if (!access.coef)
+    low = high = hoist(access.addr);
+  else {
+    auto base = offset(access.addr);
+    low = scale(info->start);
+    high = scale(last());
+    if (base) {
+      low = builder.create<AddLOp>({ Value(base), low });
+      high = builder.create<AddLOp>({ Value(base), high });
+    }
+  }
+
+  auto size = builder.create<IntOp>({ new IntAttr(access.size) });
+  high = builder.create<AddLOp>({ Value(high), size });
+  return { low, high };
+}
+
+Op *LoopVersion::check(const std::function<bool(Op*, Op*)> &apart) {
+  std::vector<std::pair<int, int>> pairs;
+  for (int i = 0; i < accesses.size(); i++) {
+    for (int j = i + 1; j < accesses.size(); j++) {
+      const auto &a = accesses[i], &b = accesses[j];
+      if ((a.stored || b.stored) && !apart(a.addr, b.addr))
+        pairs.push_back({ i, j });
+    }
+  }
+  if (pairs.empty())
+    return nullptr;
+
+  builder.setBeforeOp(info->preheader->getLastOp());
+
+  std::unordered_map<int, std::pair<Op*, Op*>> ranges;
+  bool moving = false;
+  for (auto [i, j] : pairs) {
+    for (auto k : { i, j }) {
+      if (!ranges.count(k))
+        ranges[k] = range(accesses[k]);
+      moving |= accesses[k].coef > 0;
+    }
+  }
+
+  Value zero = builder.create<IntOp>({ new IntAttr(0) });
+  Op *cond = nullptr;
+  const auto &both = [&](Value x) {
+    cond = cond ? builder.create<AndIOp>({ cond, x }) : x.defining;
+  };
+
+  for (auto [i, j] : pairs) {
+    const auto &a = accesses[i], &b = accesses[j];
+    auto [la, ha] = ranges[i];
+    auto [lb, hb] = ranges[j];
+
+    // One ends before the other starts. Differences are compared instead of the pointers,
+    // as the ARM backend only compares the lower 32 bits.
+    Value before = builder.create<LeOp>({ zero, builder.create<SubLOp>({ Value(lb), ha }) });
+    Value after = builder.create<LeOp>({ zero, builder.create<SubLOp>({ Value(la), hb }) });
+    Value ok = builder.create<OrIOp>({ before, after });
+
+    if (a.coef > 0 && a.coef == b.coef && a.size == b.size) {
+      Value same = builder.create<EqOp>({ Value(la), lb });
+      ok = builder.create<OrIOp>({ ok, same });
+    }
+    both(ok);
+  }
+
+  // A loop entered with `start >= stop` still runs once, beyond the ranges above.
+  if (moving) {
+    auto span = arith<SubIOp, SubLOp>(builder, hoist(info->stop), info->start);
+    both(builder.create<LtOp>({ zero, span }));
+  }
+  return cond;
+}
+
+LoopInfo LoopVersion::clone(Op *cond, const std::unordered_set<Op*> &skip) {
+  auto header = info->header;
+  auto preheader = info->preheader;
+  auto latch = info->getLatch();
+  auto exit = info->getExit();
+  auto region = header->getParent();
+
+  std::vector<BasicBlock*> blocks;
+  for (auto bb : region->getBlocks()) {
+    if (info->contains(bb))
+      blocks.push_back(bb);
+  }
+
+  // The copy goes before the exit, with a preheader of its own.
+  // Both copies then leave through `merge`.
+  auto slowpre = region->insert(exit);
+  std::unordered_map<BasicBlock*, BasicBlock*> rewire;
+  for (auto bb : blocks)
+    rewire[bb] = region->insert(exit);
+  auto merge = region->insert(exit);
+
+  builder.setToBlockEnd(slowpre);
+  builder.create<GotoOp>({ new TargetAttr(rewire[header]) });
+  builder.setToBlockEnd(merge);
+  builder.create<GotoOp>({ new TargetAttr(exit) });
+
+  std::unordered_map<Op*, Op*> cloneMap;
+  for (auto bb : blocks) {
+    builder.setToBlockEnd(rewire[bb]);
+    for (auto op : bb->getOps()) {
+      if (!skip.count(op))
+        cloneMap[op] = builder.copy(op);
+    }
+  }
+
+  const auto &retarget = [&](BasicBlock *bb) {
+    if (rewire.count(bb))
+      return rewire[bb];
+    if (bb == exit)
+      return merge;
+    return bb == preheader ? slowpre : bb;
+  };
+
+  for (auto bb : blocks) {
+    for (auto op : bb->getOps()) {
+      if (skip.count(op))
+        continue;
+      auto cloned = cloneMap[op];
+      for (int i = 0; i < op->getOperandCount(); i++) {
+        if (cloneMap.count(op->DEF(i)))
+          cloned->setOperand(i, cloneMap[op->DEF(i)]);
+      }
+    }
+
+    auto v = rewire[bb];
+    auto term = v->getLastOp();
+    if (auto attr = term->find<TargetAttr>())
+      attr->bb = retarget(attr->bb);
+    if (auto attr = term->find<ElseAttr>())
+      attr->bb = retarget(attr->bb);
+
+    for (auto phi : v->getPhis()) {
+      for (auto attr : phi->getAttrs())
+        FROM(attr) = retarget(FROM(attr));
+    }
+  }
+
+  auto term = latch->getLastOp();
+  if (TARGET(term) == exit)
+    TARGET(term) = merge;
+  if (ELSE(term) == exit)
+    ELSE(term) = merge;
+
+  for (auto phi : exit->getPhis()) {
+    for (auto attr : phi->getAttrs()) {
+      if (FROM(attr) == latch)
+        FROM(attr) = merge;
+    }
+  }
+
+  // Values used after the loop come from whichever copy ran.
+  std::unordered_set<BasicBlock*> inside(blocks.begin(), blocks.end());
+  for (auto [_, v] : rewire)
+    inside.insert(v);
+
+  builder.setToBlockStart(merge);
+  for (auto bb : blocks) {
+    for (auto op : bb->getOps()) {
+      if (skip.count(op))
+        continue;
+      std::vector<Op*> uses = op->getUses();
+      Op *joined = nullptr;
+      for (auto use : uses) {
+        if (inside.count(use->getParent()))
+          continue;
+
+        if (!joined) {
+          joined = builder.create<PhiOp>({ op, cloneMap[op] }, { new FromAttr(latch), new FromAttr(rewire[latch]) });
+          joined->setResultType(op->getResultType());
+        }
+        for (int i = 0; i < use->getOperandCount(); i++) {
+          if (use->DEF(i) == op)
+            use->setOperand(i, joined);
+        }
+      }
+    }
+  }
+
+  // The original loop runs only when `cond` holds.
+  auto fast = region->insert(header);
+  builder.setToBlockEnd(fast);
+  builder.create<GotoOp>({ new TargetAttr(header) });
+  for (auto phi : header->getPhis()) {
+    for (auto attr : phi->getAttrs()) {
+      if (FROM(attr) == preheader)
+        FROM(attr) = fast;
+    }
+  }
+  builder.replace<BranchOp>(preheader->getLastOp(), { cond }, { new TargetAttr(fast), new ElseAttr(slowpre) });
+
+  info->preheader = fast;
+  info->exits = { merge };
+  for (auto loop = info->parent; loop; loop = loop->parent) {
+    loop->bbs.insert(inside.begin(), inside.end());
+    loop->bbs.insert({ fast, slowpre, merge });
+  }
+
+  const auto &mapped = [&](Op *op) {
+    return op && cloneMap.count(op) ? cloneMap[op] : op;
+  };
+
+  LoopInfo copy;
+  copy.header = rewire[header];
+  copy.preheader = slowpre;
+  copy.parent = info->parent;
+  copy.latches = { rewire[latch] };
+  copy.exitings = { rewire[latch] };
+  copy.exits = { merge };
+  for (auto bb : blocks)
+    copy.bbs.insert(rewire[bb]);
+  copy.induction = mapped(info->induction);
+  copy.start = mapped(info->start);
+  copy.stop = mapped(info->stop);
+  copy.step = mapped(info->step);
+  return copy;
+}
@@ -4,6 +4,8 @@
 #include "Pass.h"
 #include "../codegen/Attrs.h"
 #include "../codegen/Ops.h"
+#include <array>
+#include <functional>
 
 namespace sys {
 
@@ -26,6 +28,26 @@ public:
   std::string name() override { return "inst-schedule"; };
   std::map<std::string, int> stats() override { return {}; }
   void run() override;
+  Preserve preserves() override { return Preserve::CFG; }
+};
+
+// Superword-level parallelism: four stores to consecutive words in a block,
+// along with the isomorphic trees computing their values, become vector ops.
+// Runs after InstSchedule, which would take a 16-byte access to be disjoint from the words it covers.
+class SLP : public Pass {
+  int vectorized = 0;
+  // Whether the backend lowers float vectors as well.
+  bool neon;
+
+  bool pack(BasicBlock *bb, const std::array<Op*, 4> &stores);
+  void runImpl(BasicBlock *bb);
+public:
+  SLP(ModuleOp *module, bool neon): Pass(module), neon(neon) {}
+
+  std::string name() override { return "slp"; };
+  std::map<std::string, int> stats() override;
+  void run() override;
+  Preserve preserves() override { return Preserve::CFG; }
 };
 
 }
@@ -20,8 +20,8 @@ void Mem2Reg::runImpl(FuncOp *func) {
   domtree.clear();
 
   auto region = func->getRegion();
-  region->updateDomFront();
-  domtree = getDomTree(region);
+  updateDomFrontCached(func);
+  domtree = getDomTreeCached(region);
 
   Builder builder;
 
@@ -1,5 +1,6 @@
 #include "Pass.h"
 #include "../codegen/Attrs.h"
+#include "Analysis.h"
 
 using namespace sys;
 
@@ -51,7 +52,7 @@ std::map<std::string, GlobalOp*> Pass::getGlobalMap() {
 
 std::vector<FuncOp*> Pass::collectFuncs() {
   std::vector<FuncOp*> result;
-  auto toplevel = module->getRegion()->getFirstBlock()->getOps();
+  auto &toplevel = module->getRegion()->getFirstBlock()->getOps();
   for (auto op : toplevel) {
     if (auto fn = dyn_cast<FuncOp>(op))
       result.push_back(fn);
@@ -61,7 +62,7 @@ std::vector<FuncOp*> Pass::collectFuncs() {
 
 std::vector<GlobalOp*> Pass::collectGlobals() {
   std::vector<GlobalOp*> result;
-  auto toplevel = module->getRegion()->getFirstBlock()->getOps();
+  auto &toplevel = module->getRegion()->getFirstBlock()->getOps();
   for (auto op : toplevel) {
     if (auto glob = dyn_cast<GlobalOp>(op))
       result.push_back(glob);
@@ -69,9 +70,7 @@ std::vector<GlobalOp*> Pass::collectGlobals() {
   return result;
 }
 
-DomTree Pass::getDomTree(Region *region) {
-  region->updateDoms();
-
+static DomTree buildDomTree(Region *region) {
   DomTree tree;
   for (auto bb : region->getBlocks()) {
     if (auto idom = bb->getIdom())
@@ -80,11 +79,47 @@ DomTree Pass::getDomTree(Region *region) {
   return tree;
 }
 
+DomTree Pass::getDomTree(Region *region) {
+  region->updateDoms();
+  return buildDomTree(region);
+}
+
+DomTree Pass::getDomTreeCached(Region *region) {
+  auto func = dyn_cast<FuncOp>(region->getParent());
+  if (func && AnalysisManager::current)
+    AnalysisManager::current->updateDoms(func);
+  else
+    region->updateDoms();
+  return buildDomTree(region);
+}
+
+void Pass::updateDomFrontCached(FuncOp *func) {
+  if (AnalysisManager::current)
+    AnalysisManager::current->updateDomFront(func);
+  else
+    func->getRegion()->updateDomFront();
+}
+
+void Pass::updateLivenessCached(FuncOp *func) {
+  if (AnalysisManager::current)
+    AnalysisManager::current->updateLiveness(func);
+  else
+    func->getRegion()->updateLiveness();
+}
+
+void Pass::updateCallGraphCached() {
+  if (AnalysisManager::current)
+    AnalysisManager::current->updateCallGraph();
+  else
+    CallGraph(module).run();
+}
+
 void Pass::cleanup() {
   Op::release();
   
   // Put phi's types right.
-  runRewriter([&](PhiOp *op) {
+  // A phi only changes type because of its operands, so a worklist suffices.
+  runRewriterWorklist([&](PhiOp *op) {
     if (op->getResultType() == Value::f32)
       return false;
 
@@ -1,14 +1,17 @@
 #ifndef PASS_H
 #define PASS_H
 
+#include <deque>
 #include <map>
 #include <string>
 #include <type_traits>
 #include <vector>
 #include <iostream>
 #include <unordered_map>
+#include <unordered_set>
 
 #include "../codegen/Ops.h"
+#include "AnalysisManager.h"
 
 namespace sys {
   
@@ -25,6 +28,9 @@ class Pass {
 protected:
   ModuleOp *module;
 
+  // Applies `rewriter` to every op of its argument type inside `op`, in pre-order,
+  // until none of them succeeds. Nothing is walked when the module's OpIndex
+  // has no such op.
   template<class F>
   void runRewriter(Op *op, F rewriter) {
     using T = std::remove_pointer_t<argument_t<F>>;
@@ -36,10 +42,13 @@ protected:
       if (++total > 10000)
         assert(false);
       
-      auto ts = op->findAll<T>();
+      auto ts = module->getIndex()->collect(T::id, op);
       success = false;
-      for (auto t : ts)
-        success |= rewriter(cast<T>(t));
+      for (auto t : ts) {
+        // Might have been erased by an earlier rewrite in this round.
+        if (t->isIndexed())
+          success |= rewriter(cast<T>(t));
+      }
     } while (success);
   }
 
@@ -48,6 +57,65 @@ protected:
     runRewriter(module, rewriter);
   }
 
+  // Like runRewriter, but instead of rescanning after every success,
+  // only revisits the ops around a rewrite: the rewritten op, its operands,
+  // ops created meanwhile, and the users of those.
+  //
+  // Only use this when a rewrite can enable another only through def-use edges.
+  template<class F>
+  void runRewriterWorklist(Op *op, F rewriter) {
+    using T = std::remove_pointer_t<argument_t<F>>;
+
+    auto index = module->getIndex();
+    std::deque<Op*> worklist;
+    std::unordered_set<Op*> queued;
+    unsigned mark;
+    auto ts = index->collect(T::id, op, &mark);
+    auto enqueue = [&](Op *x) {
+      if (x->isIndexed() && isa<T>(x) && !queued.count(x) && OpIndex::marked(x, mark)) {
+        worklist.push_back(x);
+        queued.insert(x);
+      }
+    };
+
+    for (auto t : ts)
+      enqueue(t);
+
+    while (!worklist.empty()) {
+      auto t = worklist.front();
+      worklist.pop_front();
+      queued.erase(t);
+      // Erased ops are only freed in cleanup(), so this is safe.
+      if (!t->isIndexed())
+        continue;
+
+      std::vector<Op*> operands;
+      for (auto operand : t->getOperands())
+        operands.push_back(operand.defining);
+
+      OpIndex::Recorder created(index);
+      if (!rewriter(cast<T>(t)))
+        continue;
+
+      auto touched = created.ops;
+      touched.push_back(t);
+      for (auto x : touched) {
+        if (!x->isIndexed())
+          continue;
+        enqueue(x);
+        for (auto use : x->getUses())
+          enqueue(use);
+      }
+      for (auto x : operands)
+        enqueue(x);
+    }
+  }
+
+  template<class F>
+  void runRewriterWorklist(F rewriter) {
+    runRewriterWorklist(module, rewriter);
+  }
+
   // This will be faster than module->findAll<FuncOp>,
   // as it doesn't need to iterate through the contents of functions.
   std::vector<FuncOp*> collectFuncs();
@@ -56,6 +124,13 @@ protected:
   std::map<std::string, FuncOp*> getFunctionMap();
   std::map<std::string, GlobalOp*> getGlobalMap();
   DomTree getDomTree(Region *region);
+  // Same as above, but doesn't recompute dominators if they still hold.
+  // Only call this at the start of a pass, before anything has changed.
+  DomTree getDomTreeCached(Region *region);
+  // Likewise for Region::updateDomFront(), Region::updateLiveness() and CallGraph.
+  void updateDomFrontCached(FuncOp *func);
+  void updateLivenessCached(FuncOp *func);
+  void updateCallGraphCached();
 
   // Find the first op that isn't an AllocaOp.
   Op *nonalloca(Region *region);
@@ -68,6 +143,18 @@ public:
   virtual std::string name() = 0;
   virtual std::map<std::string, int> stats() = 0;
   virtual void run() = 0;
+  // What this pass leaves intact, so that AnalysisManager can keep it.
+  // Only valid after run().
+  virtual Preserve preserves() { return Preserve::Nothing; }
+
+  // A function pass does the same as run() by calling runOnFunction() on each function,
+  // in any order, followed by finish(). runOnFunction() must not touch anything outside
+  // its function, so that PassManager can run it on several functions at once,
+  // each thread with its own instance of the pass.
+  virtual bool isFunctionPass() { return false; }
+  virtual void runOnFunction(FuncOp*) {}
+  // Module-level work after all functions are done. Only called on one instance.
+  virtual void finish() {}
 };
 
 }
@@ -3,13 +3,46 @@
 #include "../utils/Exec.h"
 
 #include <iostream>
+#include <iomanip>
 #include <fstream>
 #include <sstream>
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <sys/resource.h>
 
 using namespace sys;
 
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double micros(Clock::time_point from, Clock::time_point to) {
+  return std::chrono::duration<double, std::micro>(to - from).count();
+}
+
+// In KiB on Linux.
+long peakRSS() {
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+void countIR(Op *op, int &ops, int &blocks) {
+  ops++;
+  for (auto region : op->getRegions()) {
+    for (auto bb : region->getBlocks()) {
+      blocks++;
+      for (auto x : bb->getOps())
+        countIR(x, ops, blocks);
+    }
+  }
+}
+
+}
+
 PassManager::PassManager(ModuleOp *module, const Options &opts):
-  module(module), opts(opts) {
+  module(module), analyses(module), opts(opts) {
   if (opts.compareWith.size()) {
     std::ifstream ifs(opts.compareWith);
     std::stringstream ss;
@@ -47,12 +80,105 @@ PassManager::PassManager(ModuleOp *module, const Options &opts):
 PassManager::~PassManager() {
   for (auto pass : passes)
     delete pass;
+  for (const auto &[_, v] : replicas) {
+    for (auto pass : v)
+      delete pass;
+  }
+}
+
+void PassManager::runPass(Pass *pass) {
+  if (pool && pass->isFunctionPass())
+    runParallel(pass);
+  else
+    pass->run();
+}
+
+void PassManager::runParallel(Pass *pass) {
+  auto &extra = replicas[pass];
+  while (extra.size() + 1 < pool->size())
+    extra.push_back(factories[pass]());
+
+  std::vector<std::pair<FuncOp*, size_t>> funcs;
+  for (auto op : module->getRegion()->getFirstBlock()->getOps()) {
+    auto func = dyn_cast<FuncOp>(op);
+    if (!func)
+      continue;
+    size_t size = 0;
+    for (auto bb : func->getRegion()->getBlocks())
+      size += bb->getOps().size();
+    funcs.push_back({ func, size });
+  }
+
+  // Deal out the functions beforehand, largest first to the least loaded thread.
+  std::stable_sort(funcs.begin(), funcs.end(), [](const auto &a, const auto &b) {
+    return a.second > b.second;
+  });
+  std::vector<std::vector<FuncOp*>> assigned(pool->size());
+  std::vector<size_t> load(pool->size());
+  for (auto [func, size] : funcs) {
+    int least = std::min_element(load.begin(), load.end()) - load.begin();
+    assigned[least].push_back(func);
+    load[least] += size;
+  }
+
+  std::mutex mutex;
+  std::vector<Op*> erased;
+
+  auto index = module->getIndex();
+  index->concurrent = true;
+  pool->run([&](int id) {
+    auto instance = id ? extra[id - 1] : pass;
+    for (auto func : assigned[id])
+      instance->runOnFunction(func);
+
+    if (!id)
+      return;
+    // Erased ops are released by cleanup() on the main thread.
+    auto mine = Op::takeErased();
+    std::lock_guard<std::mutex> lock(mutex);
+    erased.insert(erased.end(), mine.begin(), mine.end());
+  });
+  index->concurrent = false;
+
+  Op::adoptErased(erased);
+  pass->finish();
+}
+
+std::map<std::string, int> PassManager::stats(Pass *pass) {
+  auto stats = pass->stats();
+  for (auto replica : replicas[pass]) {
+    for (auto [k, v] : replica->stats())
+      stats[k] += v;
+  }
+  return stats;
+}
+
+Preserve PassManager::preserves(Pass *pass) {
+  auto preserved = pass->preserves();
+  for (auto replica : replicas[pass])
+    preserved = std::min(preserved, replica->preserves());
+  return preserved;
 }
 
 void PassManager::run() {
   pastFlatten = false;
   pastMem2Reg = false;
   inBackend = false;
+  pastRegAlloc = false;
+  pastVectorize = false;
+
+  auto pipelineStart = Clock::now();
+  AnalysisManager::current = &analyses;
+
+  if (opts.jobs > 1) {
+    // Each thread allocates from its own arena.
+    std::vector<Arena*> arenas;
+    for (int i = 1; i < opts.jobs; i++)
+      arenas.push_back(module->getArena()->fork());
+    pool = std::make_unique<ThreadPool>(opts.jobs, [arenas](int id) {
+      Arena::current = arenas[id - 1];
+    });
+  }
 
   for (auto pass : passes) {
     if (pass->name() == "flatten-cfg")
@@ -61,6 +187,10 @@ void PassManager::run() {
       pastMem2Reg = true;
     if (pass->name() == "rv-lower" || pass->name() == "arm-lower")
       inBackend = true;
+    if (pass->name() == "rv-regalloc" || pass->name() == "arm-regalloc")
+      pastRegAlloc = true;
+    if (pass->name() == "vectorize")
+      pastVectorize = true;
 
     if (pass->name() == opts.printBefore) {
       std::cerr << "===== Before " << pass->name() << " =====\n\n";
@@ -68,8 +198,30 @@ void PassManager::run() {
       std::cerr << "\n\n";
     }
 
-    pass->run();
-    pass->cleanup();
+    if (opts.timePasses) {
+      Timing timing { pass->name() };
+      timing.opsBefore = timing.blocksBefore = 0;
+      countIR(module, timing.opsBefore, timing.blocksBefore);
+      long peak = peakRSS();
+
+      auto start = Clock::now();
+      runPass(pass);
+      auto mid = Clock::now();
+      pass->cleanup();
+      auto end = Clock::now();
+
+      timing.start = micros(pipelineStart, start);
+      timing.run = micros(start, mid);
+      timing.cleanup = micros(mid, end);
+      timing.peakDelta = peakRSS() - peak;
+      timing.opsAfter = timing.blocksAfter = 0;
+      countIR(module, timing.opsAfter, timing.blocksAfter);
+      timings.push_back(timing);
+    } else {
+      runPass(pass);
+      pass->cleanup();
+    }
+    analyses.invalidate(preserves(pass));
 
     if (opts.verbose || pass->name() == opts.printAfter) {
       std::cerr << "===== After " << pass->name() << " =====\n\n";
@@ -85,14 +237,33 @@ void PassManager::run() {
       std::cerr << " passed\n";
     }
 
-    // We can't simulate for backend.
-    // Technically we have the capacity, but it's too much work.
-    if (opts.compareWith.size() && pastFlatten && !inBackend) {
+    // In the backend, machine IR is simulated instead.
+    // The interpreter knows nothing of vectors, so after vectorizing only machine IR is checked.
+    if (opts.compareWith.size() && pastFlatten && (inBackend || !pastVectorize)) {
       std::cerr << "checking " << pass->name() << "\n";
-      exec::Interpreter itp(module);
+      std::unique_ptr<exec::Interpreter> itp;
+      std::unique_ptr<exec::MachineInterpreter> mitp;
+      if (!inBackend)
+        itp = std::make_unique<exec::Interpreter>(module);
+      else if (opts.arm)
+        mitp = std::make_unique<exec::ArmInterpreter>(module, pastRegAlloc);
+      else
+        mitp = std::make_unique<exec::RvInterpreter>(module, pastRegAlloc);
+
       std::stringstream buffer(input);
-      itp.run(buffer);
-      std::string str = itp.out();
+      if (itp)
+        itp->run(buffer);
+      else
+        mitp->run(buffer);
+
+      if (mitp && mitp->error().size()) {
+        std::cerr << "simulation failed: " << mitp->error() << "\n";
+        std::cerr << "after pass: " << pass->name() << "\n";
+        assert(false);
+      }
+
+      std::string str = itp ? itp->out() : mitp->out();
+      int code = itp ? itp->exitcode() : mitp->exitcode();
       // Strip output.
       while (str.size() && std::isspace(str.back()))
         str.pop_back();
@@ -102,23 +273,149 @@ void PassManager::run() {
         std::cerr << "after pass: " << pass->name() << "\n";
         assert(false);
       }
-      if (exitcode != itp.exitcode()) {
-        std::cerr << "exit code mismatch:" << itp.exitcode() << " (expected " << exitcode << ")\n";
+      if (exitcode != code) {
+        std::cerr << "exit code mismatch:" << code << " (expected " << exitcode << ")\n";
         std::cerr << "after pass: " << pass->name() << "\n";
         assert(false);
       }
+
+      if (mitp && opts.stats)
+        simulated = mitp->counts();
     }
     
     if (opts.stats) {
       std::cerr << pass->name() << ":\n";
 
-      auto stats = pass->stats();
+      auto stats = this->stats(pass);
       if (!stats.size())
         std::cerr << "  <no stats>\n";
 
       for (auto [k, v] : stats)
         std::cerr << "  " << k << " : " << v << "\n";
+
+      if (inBackend && opts.compareWith.size()) {
+        long long insts = 0, reloads = 0;
+        for (const auto &[name, counts] : simulated) {
+          insts += counts.insts;
+          reloads += counts.reloads;
+        }
+        std::cerr << "  <simulated insts> : " << insts << "\n";
+        std::cerr << "  <simulated reloads> : " << reloads << "\n";
+      }
+    }
+  }
+
+  if (opts.stats) {
+    std::cerr << "arena:\n";
+    for (auto [k, v] : module->getArena()->stats())
+      std::cerr << "  " << k << " : " << v << "\n";
+
+    std::cerr << "analysis:\n";
+    for (auto [k, v] : analyses.stats())
+      std::cerr << "  " << k << " : " << v << "\n";
+
+    // Of the final machine code, as the last simulation saw it.
+    if (simulated.size()) {
+      std::cerr << "simulation:\n";
+      for (const auto &[name, counts] : simulated) {
+        std::cerr << "  " << name << " : " << counts.insts << " insts, "
+                  << counts.loads << " loads, " << counts.stores << " stores, "
+                  << counts.reloads << " reloads, " << counts.calls << " calls\n";
+      }
     }
   }
+
+  pool.reset();
+
+  if (opts.timePasses) {
+    report();
+    if (opts.traceFile.size())
+      writeTrace(opts.traceFile);
+  }
+}
+
+// Aggregates the timings by pass name, the most expensive first.
+void PassManager::report() {
+  struct Total {
+    std::string name;
+    int count = 0;
+    double run = 0;
+    double cleanup = 0;
+    int ops = 0;
+    int blocks = 0;
+    long peakDelta = 0;
+  };
+  std::map<std::string, Total> byName;
+  Total all { "total" };
+  for (const auto &t : timings) {
+    for (auto total : { &byName[t.name], &all }) {
+      total->count++;
+      total->run += t.run;
+      total->cleanup += t.cleanup;
+      total->ops += t.opsAfter - t.opsBefore;
+      total->blocks += t.blocksAfter - t.blocksBefore;
+      total->peakDelta += t.peakDelta;
+    }
+  }
+
+  std::vector<Total> sorted;
+  for (auto &[name, total] : byName) {
+    total.name = name;
+    sorted.push_back(total);
+  }
+  std::sort(sorted.begin(), sorted.end(), [](const Total &a, const Total &b) {
+    return a.run + a.cleanup > b.run + b.cleanup;
+  });
+  sorted.push_back(all);
+
+  auto &os = std::cerr;
+  os << "===== pass timing =====\n";
+  os << std::setw(10) << "total(ms)" << std::setw(10) << "run(ms)" << std::setw(12) << "cleanup(ms)"
+     << std::setw(7) << "%" << std::setw(7) << "count" << std::setw(9) << "ops"
+     << std::setw(9) << "blocks" << std::setw(11) << "peak(KiB)" << "  pass\n";
+
+  double sum = all.run + all.cleanup;
+  os << std::fixed << std::setprecision(2);
+  for (const auto &t : sorted) {
+    double cost = t.run + t.cleanup;
+    os << std::setw(10) << cost / 1000 << std::setw(10) << t.run / 1000 << std::setw(12) << t.cleanup / 1000
+       << std::setw(7) << (sum > 0 ? cost / sum * 100 : 0) << std::setw(7) << t.count
+       << std::showpos << std::setw(9) << t.ops << std::setw(9) << t.blocks << std::setw(11) << t.peakDelta
+       << std::noshowpos << "  " << t.name << "\n";
+  }
+  os.unsetf(std::ios::floatfield);
+  os << std::setprecision(6);
+}
+
+// Chrome trace-event format; open it in chrome://tracing or Perfetto.
+void PassManager::writeTrace(const std::string &path) {
+  std::ofstream ofs(path);
+  if (!ofs) {
+    std::cerr << "error: cannot write trace to " << path << "\n";
+    return;
+  }
+
+  ofs << std::fixed << std::setprecision(3);
+  ofs << "{\"traceEvents\":[\n";
+  bool first = true;
+  auto event = [&]() -> std::ostream& {
+    if (!first)
+      ofs << ",\n";
+    first = false;
+    return ofs;
+  };
+
+  for (const auto &t : timings) {
+    event() << "{\"name\":\"" << t.name << "\",\"cat\":\"run\",\"ph\":\"X\",\"pid\":1,\"tid\":1"
+            << ",\"ts\":" << t.start << ",\"dur\":" << t.run
+            << ",\"args\":{\"ops-before\":" << t.opsBefore << ",\"ops-after\":" << t.opsAfter
+            << ",\"blocks-before\":" << t.blocksBefore << ",\"blocks-after\":" << t.blocksAfter
+            << ",\"peak-rss-delta-kib\":" << t.peakDelta << "}}";
+    event() << "{\"name\":\"" << t.name << " (cleanup)\",\"cat\":\"cleanup\",\"ph\":\"X\",\"pid\":1,\"tid\":1"
+            << ",\"ts\":" << t.start + t.run << ",\"dur\":" << t.cleanup << "}";
+    event() << "{\"name\":\"ir\",\"ph\":\"C\",\"pid\":1,\"tid\":1,\"ts\":" << t.start + t.run + t.cleanup
+            << ",\"args\":{\"ops\":" << t.opsAfter << ",\"blocks\":" << t.blocksAfter << "}}";
+  }
+  ofs << "\n],\"displayTimeUnit\":\"ms\"}\n";
 }
 
@@ -3,22 +3,64 @@
 
 #include "Pass.h"
 #include "../main/Options.h"
+#include "../utils/ThreadPool.h"
+#include "../utils/MachineExec.h"
+
+#include <functional>
+#include <memory>
 
 namespace sys {
 
 class PassManager {
   std::vector<Pass*> passes;
   ModuleOp *module;
+  AnalysisManager analyses;
+
+  // Makes another instance of a pass, for the other threads of a function pass.
+  std::map<Pass*, std::function<Pass*()>> factories;
+  // Instances of a function pass other than the one in `passes`, one per extra thread.
+  std::map<Pass*, std::vector<Pass*>> replicas;
+  // Only exists under --jobs.
+  std::unique_ptr<ThreadPool> pool;
 
   bool pastFlatten;
   bool pastMem2Reg;
   bool inBackend;
+  bool pastRegAlloc;
+  bool pastVectorize;
   int exitcode;
   
   std::string input;
   std::string truth;
 
   Options opts;
+
+  // One invocation of a pass, recorded under --time-passes.
+  struct Timing {
+    std::string name;
+    // Microseconds since the pipeline started.
+    double start = 0;
+    // Microseconds spent in run() and cleanup().
+    double run = 0;
+    double cleanup = 0;
+    int opsBefore = 0, opsAfter = 0;
+    int blocksBefore = 0, blocksAfter = 0;
+    // Growth of the peak resident set size, in KiB.
+    long peakDelta = 0;
+  };
+  std::vector<Timing> timings;
+
+  // Dynamic counts of each function in the last simulation of machine IR, under --stats.
+  std::map<std::string, exec::MachineInterpreter::Counts> simulated;
+
+  void report();
+  void writeTrace(const std::string &path);
+
+  void runPass(Pass *pass);
+  void runParallel(Pass *pass);
+  // Summed or merged over all instances of the pass.
+  std::map<std::string, int> stats(Pass *pass);
+  Preserve preserves(Pass *pass);
 public:
   PassManager(ModuleOp *module, const Options &opts);
   ~PassManager();
@@ -28,8 +70,11 @@ public:
 
   template<class T, class... Args>
   void addPass(Args... args) {
-    auto pass = new T(module, std::forward<Args>(args)...);
+    auto pass = new T(module, args...);
     passes.push_back(pass);
+    factories[pass] = [module = module, args...]() -> Pass* {
+      return new T(module, args...);
+    };
   }
 };
 
@@ -4,8 +4,10 @@
 #include "Pass.h"
 #include "../codegen/CodeGen.h"
 #include "../codegen/Attrs.h"
+#include "../utils/Matcher.h"
 
 #include <set>
+#include <unordered_map>
 
 namespace sys {
 
@@ -33,6 +35,8 @@ public:
   std::string name() override { return "mem2reg"; };
   std::map<std::string, int> stats() override;
   void run() override;
+  bool isFunctionPass() override { return true; }
+  void runOnFunction(FuncOp *func) override { runImpl(func); }
 };
 
 // Global value numbering.
@@ -78,12 +82,17 @@ class GVN : public Pass {
 
   // Dominator-based Value Numbering Technique. See Briggs.
   void dvnt(BasicBlock *bb, Domtree &domtree);
+  // Discards phis with a single operand.
+  void tidyPhis(Op *root);
 public:
   GVN(ModuleOp *module): Pass(module) {}
     
   std::string name() override { return "gvn"; };
   std::map<std::string, int> stats() override;
   void run() override;
+  Preserve preserves() override { return Preserve::CFG; }
+  bool isFunctionPass() override { return true; }
+  void runOnFunction(FuncOp *func) override;
   void runImpl(Region *region);
 };
 
@@ -132,6 +141,7 @@ class GCM : public Pass {
 
   // Lowest common ancestor.
   BasicBlock *lca(BasicBlock *a, BasicBlock *b);
+  bool colder(BasicBlock *a, BasicBlock *b);
 
   void runImpl(Region *region, const LoopForest &forest);
 public:
@@ -140,19 +150,32 @@ public:
   std::string name() override { return "gcm"; };
   std::map<std::string, int> stats() override { return {}; }
   void run() override;
+  Preserve preserves() override { return Preserve::CFG; }
+  bool isFunctionPass() override { return true; }
+  void runOnFunction(FuncOp *func) override;
 };
 
 // Folds a wide range of expressions.
 class RegularFold : public Pass {
   int foldedTotal = 0;
-
+  int attempts = 0;
+  // Use the old driver that sweeps all ops until nothing changes.
+  bool sweep;
+  // Some branch has been folded into a goto.
+  bool cfgChanged = false;
+  // Rules indexed by the opid of their root, each merged into one matcher.
+  std::unordered_map<int, RuleSet<Rule>> buckets;
+
+  bool tryRules(Op *op);
   int runImpl(Region *region);
+  int runWorklist(const std::vector<FuncOp*> &funcs);
 public:
-  RegularFold(ModuleOp *module): Pass(module) {}
+  RegularFold(ModuleOp *module, bool sweep = false);
     
   std::string name() override { return "regular-fold"; };
   std::map<std::string, int> stats() override;
   void run() override;
+  Preserve preserves() override { return cfgChanged ? Preserve::Nothing : Preserve::CFG; }
 };
 
 class LateInline : public Pass {
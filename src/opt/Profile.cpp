@@ -0,0 +1,112 @@
+#include "Analysis.h"
+#include "LoopPasses.h"
+#include "../utils/Exec.h"
+
+#include <fstream>
+#include <sstream>
+
+using namespace sys;
+
+Profile::Profile(ModuleOp *module, const std::string &inputFile): Pass(module) {
+  if (inputFile.empty())
+    return;
+
+  std::ifstream ifs(inputFile);
+  std::stringstream ss;
+  ss << ifs.rdbuf();
+  input = ss.str();
+}
+
+std::map<std::string, int> Profile::stats() {
+  return {
+    { "profiled-ops", profiled }
+  };
+}
+
+// How many times control went from `from` to `to`.
+static long long edgeCount(BasicBlock *from, BasicBlock *to) {
+  auto term = from->getLastOp();
+  auto attr = term->find<ProfileAttr>();
+  if (!attr)
+    return 0;
+
+  if (!isa<BranchOp>(term))
+    return attr->count;
+
+  long long count = 0;
+  if (TARGET(term) == to)
+    count += attr->taken;
+  if (ELSE(term) == to)
+    count += attr->count - attr->taken;
+  return count;
+}
+
+static bool isVector(Value::Type ty) {
+  return ty == Value::i128 || ty == Value::f128;
+}
+
+// Whether anything has been vectorized, by Vectorize or SLP.
+static bool hasVectors(const std::vector<FuncOp*> &funcs) {
+  for (auto func : funcs) {
+    for (auto bb : func->getRegion()->getBlocks()) {
+      for (auto op : bb->getOps()) {
+        if (isVector(op->getResultType()))
+          return true;
+        for (auto v : op->getOperands()) {
+          if (isVector(v.defining->getResultType()))
+            return true;
+        }
+      }
+    }
+  }
+  return false;
+}
+
+void Profile::run() {
+  auto funcs = collectFuncs();
+  // The interpreter only knows scalars. Once there are vectors, keep the counts of the last run;
+  // they're off for vectorized loops, but still tell hot from cold.
+  if (hasVectors(funcs))
+    return;
+
+  // Counts of an older run might be stale by now.
+  for (auto func : funcs) {
+    for (auto bb : func->getRegion()->getBlocks()) {
+      for (auto op : bb->getOps())
+        op->remove<ProfileAttr>();
+    }
+  }
+
+  exec::Interpreter itp(module);
+  itp.useProfile();
+  std::stringstream buffer(input);
+  itp.run(buffer);
+  itp.annotate();
+
+  // Trip counts of loops: the header runs once per iteration,
+  // and is entered from outside the loop once per execution of the loop.
+  LoopAnalysis analysis(module);
+  analysis.runCached();
+  auto forests = analysis.getResult();
+  for (auto func : funcs) {
+    for (auto loop : forests[func].getLoops()) {
+      auto header = loop->header;
+      long long entries = 0;
+      for (auto pred : header->preds) {
+        if (!loop->contains(pred))
+          entries += edgeCount(pred, header);
+      }
+
+      auto attr = header->getLastOp()->find<ProfileAttr>();
+      if (attr && entries)
+        attr->trips = attr->count / entries;
+    }
+  }
+
+  for (auto func : funcs) {
+    for (auto bb : func->getRegion()->getBlocks()) {
+      for (auto op : bb->getOps())
+        profiled += op->has<ProfileAttr>();
+    }
+  }
+}
@@ -125,8 +125,6 @@ bool norange(Op *op) {
     NORANGE(BranchOp)
     NORANGE(ReturnOp)
     NORANGE(StoreOp)
-    NORANGE(CloneOp)
-    NORANGE(JoinOp)
   ;
 }
 
@@ -375,7 +373,7 @@ void Range::split(Region *region) {
     auto x2 = builder.create<PhiOp>({ x }, { new FromAttr(bb) });
 
     // Rename operations.
-    auto uses = x->getUses();
+    std::vector<Op*> uses = x->getUses();
     for (auto use : uses) {
       if (use == x1 || use == x2)
         continue;
@@ -1,5 +1,7 @@
 #include "Passes.h"
 #include "../utils/Matcher.h"
+#include "../codegen/OpIndex.h"
+#include <functional>
 
 using namespace sys;
 
@@ -249,9 +251,23 @@ static Rule rules[] = {
   "(change (i2f 'a) (?cvt 'a))",
 };
 
+RegularFold::RegularFold(ModuleOp *module, bool sweep): Pass(module), sweep(sweep) {
+  // Every rule here is rooted at a real op; a bare binding at the root
+  // would have to be tried on all ops.
+  std::map<int, std::vector<Rule*>> rooted;
+  for (auto &rule : rules) {
+    int opid = rule.rootOpid();
+    assert(opid != -1);
+    rooted[opid].push_back(&rule);
+  }
+  for (auto &[opid, list] : rooted)
+    buckets.emplace(opid, list);
+}
+
 std::map<std::string, int> RegularFold::stats() {
   return {
-    { "folded-ops", foldedTotal }
+    { "folded-ops", foldedTotal },
+    { "rule-attempts", attempts },
   };
 }
 
@@ -283,15 +299,25 @@ void tidyPhi(BasicBlock *bb, BasicBlock *from) {
     removePhiOperand(phi, from);
 }
 
+bool RegularFold::tryRules(Op *op) {
+  auto it = buckets.find(op->opid);
+  if (it == buckets.end())
+    return false;
+
+  attempts++;
+  return it->second.rewrite(op);
+}
+
 // This pass works on both structured control flow and flattened cfg.
 int RegularFold::runImpl(Region *region) {
   int folded = 0;
   for (auto bb : region->getBlocks()) {
-    auto ops = bb->getOps();
+    std::vector<Op*> ops = bb->getOps();
     for (auto op : ops) {
       // Match each rule.
       bool success = false;
       for (auto &rule : rules) {
+        attempts++;
         success = rule.rewrite(op);
         if (success) {
           folded++;
@@ -309,15 +335,81 @@ int RegularFold::runImpl(Region *region) {
   return folded;
 }
 
+// Seeds a worklist with every op, and after each rewrite only revisits what could
+// have started matching: the new ops, the old users, and the old operands.
+// Patterns are at most two levels deep, so users of users are revisited as well.
+int RegularFold::runWorklist(const std::vector<FuncOp*> &funcs) {
+  int folded = 0;
+  auto index = module->getIndex();
+  std::deque<Op*> worklist;
+  std::unordered_set<Op*> queued;
+  auto enqueue = [&](Op *x) {
+    if (x->isIndexed() && buckets.count(x->opid) && !queued.count(x)) {
+      worklist.push_back(x);
+      queued.insert(x);
+    }
+  };
+
+  // Pre-order, the same as the sweep.
+  const std::function<void (Region*)> seed = [&](Region *region) {
+    for (auto bb : region->getBlocks()) {
+      for (auto op : bb->getOps()) {
+        enqueue(op);
+        for (auto r : op->getRegions())
+          seed(r);
+      }
+    }
+  };
+  for (auto func : funcs)
+    seed(func->getRegion());
+
+  while (!worklist.empty()) {
+    auto op = worklist.front();
+    worklist.pop_front();
+    queued.erase(op);
+    // Erased ops are only freed in cleanup(), so this is safe.
+    if (!op->isIndexed())
+      continue;
+
+    std::vector<Op*> operands;
+    for (auto operand : op->getOperands())
+      operands.push_back(operand.defining);
+    // Rules like `(change (add x 0) x)` create nothing,
+    // so the users have to be remembered before they're moved to `x`.
+    std::vector<Op*> users = op->getUses();
+
+    OpIndex::Recorder created(index);
+    if (!tryRules(op))
+      continue;
+    folded++;
+
+    for (auto x : created.ops)
+      enqueue(x);
+    for (auto use : users) {
+      if (!use->isIndexed())
+        continue;
+      enqueue(use);
+      for (auto grand : use->getUses())
+        enqueue(grand);
+    }
+    for (auto x : operands)
+      enqueue(x);
+  }
+  return folded;
+}
+
 void RegularFold::run() {
   auto funcs = collectFuncs();
   int folded;
   do {
     folded = 0;
-    for (auto func : funcs) {
-      auto region = func->getRegion();
-      folded += runImpl(region);
-    }
+    if (sweep) {
+      for (auto func : funcs) {
+        auto region = func->getRegion();
+        folded += runImpl(region);
+      }
+    } else
+      folded += runWorklist(funcs);
 
     // Also, run some extra folds.
     Builder builder;
@@ -348,6 +440,7 @@ void RegularFold::run() {
       if (V(cond) == 0) {
         folded++;
         tidyPhi(TARGET(op), op->getParent());
+        cfgChanged = true;
         builder.replace<GotoOp>(op, { new TargetAttr(ELSE(op)) });
         return false;
       }
@@ -355,6 +448,7 @@ void RegularFold::run() {
       // V(cond) != 0
       folded++;
       tidyPhi(ELSE(op), op->getParent());
+      cfgChanged = true;
       builder.replace<GotoOp>(op, { new TargetAttr(TARGET(op)) });
       return false;
     });
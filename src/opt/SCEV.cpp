@@ -680,7 +680,7 @@ void SCEV::replaceAfter(LoopInfo *info) {
 
 void SCEV::run() {
   LoopAnalysis analysis(module);
-  analysis.run();
+  analysis.runCached();
   auto forests = analysis.getResult();
 
   auto funcs = collectFuncs();
@@ -689,7 +689,7 @@ void SCEV::run() {
   for (auto func : funcs) {
     const auto &forest = forests[func];
     auto region = func->getRegion();
-    domtree = getDomTree(region);
+    domtree = getDomTreeCached(region);
 
     for (auto loop : forest.getLoops()) {
       if (!loop->getParent())
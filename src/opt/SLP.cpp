@@ -0,0 +1,336 @@
+#include "LowerPasses.h"
+#include "../codegen/CodeGen.h"
+#include <array>
+#include <map>
+#include <unordered_set>
+
+using namespace sys;
+
+namespace {
+
+using Lanes = std::array<Op*, 4>;
+
+// Four scalars computed at once.
+struct Node {
+  enum Kind { Load, Splat, Arith } kind;
+  Lanes lanes;
+  int lhs = -1, rhs = -1;
+};
+
+// The pointer that `addr` is a constant distance from, and the distance.
+// Prefers the alias info, so that different ops getting the same global still agree.
+std::pair<Op*, int> locate(Op *addr) {
+  if (auto alias = addr->find<AliasAttr>(); alias && !alias->unknown && alias->location.size() == 1) {
+    const auto &[base, offsets] = *alias->location.begin();
+    if (offsets.size() == 1 && offsets[0] >= 0)
+      return { base, offsets[0] };
+  }
+
+  int offset = 0;
+  while (isa<AddLOp>(addr) && isa<IntOp>(addr->DEF(1))) {
+    offset += V(addr->DEF(1));
+    addr = addr->DEF(0);
+  }
+  return { addr, offset };
+}
+
+// Unlike mayAlias(), this takes the size of the accesses into account.
+bool overlap(Op *a, int sizeA, Op *b, int sizeB) {
+  const auto &intersect = [&](int x, int y) {
+    return x < y + sizeB && y < x + sizeA;
+  };
+
+  auto [ra, oa] = locate(a);
+  auto [rb, ob] = locate(b);
+  if (ra == rb)
+    return intersect(oa, ob);
+
+  auto aa = a->find<AliasAttr>(), ab = b->find<AliasAttr>();
+  if (!aa || !ab || aa->unknown || ab->unknown)
+    return true;
+
+  for (const auto &[base, offsets] : aa->location) {
+    auto it = ab->location.find(base);
+    if (it == ab->location.end())
+      continue;
+
+    for (int x : offsets) {
+      for (int y : it->second) {
+        if (x < 0 || y < 0 || intersect(x, y))
+          return true;
+      }
+    }
+  }
+  return false;
+}
+
+// A call might touch any memory.
+bool isBarrier(Op *op) {
+  return isa<CallOp>(op);
+}
+
+bool commutes(Op *op) {
+  return isa<AddIOp>(op) || isa<MulIOp>(op) || isa<AddFOp>(op) || isa<MulFOp>(op);
+}
+
+}
+
+std::map<std::string, int> SLP::stats() {
+  return {
+    { "vectorized-stores", vectorized },
+  };
+}
+
+bool SLP::pack(BasicBlock *bb, const std::array<Op*, 4> &stores) {
+  std::unordered_map<Op*, int> pos;
+  int p = 0;
+  for (auto op : bb->getOps())
+    pos[op] = p++;
+
+  Op *last = stores[0];
+  for (auto store : stores) {
+    if (pos[store] > pos[last])
+      last = store;
+  }
+  int end = pos[last];
+
+  // Build the tree bottom-up; children always come before their parents.
+  std::vector<Node> nodes;
+  std::map<Lanes, int> memo;
+  std::function<int(const Lanes&, int)> build = [&](const Lanes &lanes, int depth) {
+    if (memo.count(lanes))
+      return memo[lanes];
+    int &result = memo[lanes] = -1;
+
+    auto ty = lanes[0]->getResultType();
+    if (ty != Value::i32 && !(ty == Value::f32 && neon))
+      return -1;
+    for (auto op : lanes) {
+      if (op->getResultType() != ty)
+        return -1;
+    }
+
+    bool same = true;
+    for (auto op : lanes) {
+      if (op == lanes[0])
+        continue;
+      if (isa<IntOp>(op) && isa<IntOp>(lanes[0]) && V(op) == V(lanes[0]))
+        continue;
+      if (isa<FloatOp>(op) && isa<FloatOp>(lanes[0]) && F(op) == F(lanes[0]))
+        continue;
+      same = false;
+    }
+    if (same) {
+      nodes.push_back({ Node::Splat, lanes });
+      return result = nodes.size() - 1;
+    }
+
+    if (depth > 8)
+      return -1;
+    for (auto op : lanes) {
+      if (op->getParent() != bb || op->opid != lanes[0]->opid)
+        return -1;
+    }
+
+    // There's no gather, so the loads must be to consecutive words.
+    if (isa<LoadOp>(lanes[0])) {
+      auto [root, offset] = locate(lanes[0]->DEF());
+      for (int i = 0; i < 4; i++) {
+        if (SIZE(lanes[i]) != 4 || locate(lanes[i]->DEF()) != std::make_pair(root, offset + 4 * i))
+          return -1;
+      }
+      nodes.push_back({ Node::Load, lanes });
+      return result = nodes.size() - 1;
+    }
+
+    auto op0 = lanes[0];
+    bool supported = isa<AddIOp>(op0) || isa<SubIOp>(op0) || isa<MulIOp>(op0);
+    if (neon)
+      supported |= isa<AddFOp>(op0) || isa<SubFOp>(op0) || isa<MulFOp>(op0);
+    if (!supported)
+      return -1;
+
+    // Line up the operands of commutative ops by their kind.
+    Lanes lhs, rhs;
+    for (int i = 0; i < 4; i++) {
+      auto x = lanes[i]->DEF(0), y = lanes[i]->DEF(1);
+      if (i && commutes(op0) && x->opid != lhs[0]->opid && y->opid == lhs[0]->opid)
+        std::swap(x, y);
+      lhs[i] = x;
+      rhs[i] = y;
+    }
+
+    int l = build(lhs, depth + 1);
+    if (l < 0)
+      return -1;
+    int r = build(rhs, depth + 1);
+    if (r < 0)
+      return -1;
+
+    nodes.push_back({ Node::Arith, lanes, l, r });
+    return result = nodes.size() - 1;
+  };
+
+  Lanes values;
+  for (int i = 0; i < 4; i++)
+    values[i] = stores[i]->DEF(0);
+  int root = build(values, 0);
+  if (root < 0)
+    return false;
+
+  // Everything now happens at `last`. The tree's loads move down to it, and so do the stores.
+  std::unordered_set<Op*> group(stores.begin(), stores.end());
+  std::vector<Op*> ops(bb->getOps().begin(), bb->getOps().end());
+  for (const auto &node : nodes) {
+    if (node.kind != Node::Load)
+      continue;
+
+    for (auto load : node.lanes) {
+      for (auto store : stores) {
+        if (pos[store] < pos[load] && overlap(load->DEF(), 4, store->DEF(1), 4))
+          return false;
+      }
+      for (int i = pos[load] + 1; i < end; i++) {
+        auto op = ops[i];
+        if (isBarrier(op) || isa<StoreOp>(op) && !group.count(op) && overlap(load->DEF(), 4, op->DEF(1), SIZE(op)))
+          return false;
+      }
+    }
+  }
+
+  for (auto store : stores) {
+    for (int i = pos[store] + 1; i < end; i++) {
+      auto op = ops[i];
+      if (isBarrier(op))
+        return false;
+      if (isa<LoadOp>(op) && overlap(store->DEF(1), 4, op->DEF(), SIZE(op)))
+        return false;
+      if (isa<StoreOp>(op) && !group.count(op) && overlap(store->DEF(1), 4, op->DEF(1), SIZE(op)))
+        return false;
+    }
+  }
+
+  // Compare against the scalar ops that would go away.
+  std::unordered_set<Op*> tree;
+  for (const auto &node : nodes) {
+    if (node.kind != Node::Splat)
+      tree.insert(node.lanes.begin(), node.lanes.end());
+  }
+  int saved = stores.size();
+  for (auto op : tree) {
+    bool internal = true;
+    for (auto use : op->getUses())
+      internal &= tree.count(use) || group.count(use);
+    saved += internal;
+  }
+  if (nodes.size() + 1 >= saved)
+    return false;
+
+  Builder builder;
+  builder.setBeforeOp(last);
+  std::vector<Op*> vec(nodes.size());
+  for (int i = 0; i < nodes.size(); i++) {
+    const auto &node = nodes[i];
+    auto op0 = node.lanes[0];
+    auto ty = op0->getResultType();
+    switch (node.kind) {
+    case Node::Splat:
+      vec[i] = ty == Value::i32 ? (Op*) builder.create<BroadcastOp>({ op0 }) : builder.create<BroadcastFOp>({ op0 });
+      break;
+    case Node::Load:
+      vec[i] = builder.create<LoadOp>(ty == Value::i32 ? Value::i128 : Value::f128, { op0->DEF() }, { new SizeAttr(16) });
+      break;
+    case Node::Arith:
+      Value l = vec[node.lhs], r = vec[node.rhs];
+      if (isa<AddIOp>(op0))
+        vec[i] = builder.create<AddVOp>({ l, r });
+      if (isa<SubIOp>(op0))
+        vec[i] = builder.create<SubVOp>({ l, r });
+      if (isa<MulIOp>(op0))
+        vec[i] = builder.create<MulVOp>({ l, r });
+      if (isa<AddFOp>(op0))
+        vec[i] = builder.create<AddFVOp>({ l, r });
+      if (isa<SubFOp>(op0))
+        vec[i] = builder.create<SubFVOp>({ l, r });
+      if (isa<MulFOp>(op0))
+        vec[i] = builder.create<MulFVOp>({ l, r });
+      break;
+    }
+  }
+  builder.create<StoreOp>({ Value(vec[root]), stores[0]->DEF(1) }, { new SizeAttr(16) });
+
+  for (auto store : stores)
+    store->erase();
+
+  // Scalars still used elsewhere stay.
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (auto it = tree.begin(); it != tree.end();) {
+      auto op = *it;
+      if (op->getUses().size()) {
+        it++;
+        continue;
+      }
+      op->erase();
+      it = tree.erase(it);
+      changed = true;
+    }
+  }
+  return true;
+}
+
+void SLP::runImpl(BasicBlock *bb) {
+  // Candidate stores by what they're relative to, in order of appearance.
+  std::vector<Op*> roots;
+  std::unordered_map<Op*, std::map<int, Op*>> seeds;
+  std::unordered_set<Op*> clash;
+  for (auto op : bb->getOps()) {
+    if (!isa<StoreOp>(op) || SIZE(op) != 4)
+      continue;
+
+    auto ty = op->DEF(0)->getResultType();
+    if (ty != Value::i32 && !(ty == Value::f32 && neon))
+      continue;
+
+    auto [root, offset] = locate(op->DEF(1));
+    if (!seeds.count(root))
+      roots.push_back(root);
+    // Stored twice; the order between them would matter.
+    if (seeds[root].count(offset))
+      clash.insert(root);
+    seeds[root][offset] = op;
+  }
+
+  std::vector<std::array<Op*, 4>> groups;
+  for (auto root : roots) {
+    if (clash.count(root))
+      continue;
+
+    const auto &stores = seeds[root];
+    for (auto it = stores.begin(); it != stores.end(); it++) {
+      std::array<Op*, 4> group;
+      auto jt = it;
+      int offset = it->first, n = 0;
+      for (; n < 4 && jt != stores.end() && jt->first == offset + 4 * n; n++, jt++)
+        group[n] = jt->second;
+      if (n < 4)
+        continue;
+
+      groups.push_back(group);
+      it = std::prev(jt);
+    }
+  }
+
+  for (const auto &group : groups) {
+    if (pack(bb, group))
+      vectorized += 4;
+  }
+}
+
+void SLP::run() {
+  auto funcs = collectFuncs();
+  for (auto func : funcs) {
+    for (auto bb : func->getRegion()->getBlocks())
+      runImpl(bb);
+  }
+}
@@ -35,7 +35,7 @@ void SimplifyCFG::runImpl(Region *region) {
       bb->getLastOp()->erase();
 
       // Then move all instruction in `succ` to `bb`.
-      auto ops = succ->getOps();
+      std::vector<Op*> ops = succ->getOps();
       for (auto op : ops)
         op->moveToEnd(bb);
 
@@ -147,7 +147,7 @@ void Splice::runImpl(LoopInfo *loop) {
 
 void Splice::run() {
   LoopAnalysis analysis(module);
-  analysis.run();
+  analysis.runCached();
   auto forests = analysis.getResult();
 
   Range(module).run();
@@ -213,7 +213,7 @@ Op *SynthConstArray::reconstruct(smt::BvExpr *expr, Op *subscript, int c0, int c
 
 void SynthConstArray::run() {
   LoopAnalysis analysis(module);
-  analysis.run();
+  analysis.runCached();
   auto forests = analysis.getResult();
 
   // Find out const arrays.
@@ -293,7 +293,7 @@ void SynthConstArray::run() {
     }
 
     for (auto get : getself) {
-      auto uses = get->getUses();
+      std::vector<Op*> uses = get->getUses();
       const auto &forest = forests[get->getParentOp<FuncOp>()];
       for (auto use : uses) {
         // Constant places should have been done elsewhere.
@@ -366,7 +366,7 @@ void SynthConstArray::run() {
 
         // Find all loads related to induction variable.
         // TODO: also deal with things like `x[i + 'a]`.
-        auto phiuses = use->getUses();
+        std::vector<Op*> phiuses = use->getUses();
         for (auto phiuse : phiuses) {
           if (isa<LoadOp>(phiuse)) {
             // Substitute this with a reconstruction.
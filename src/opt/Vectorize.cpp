@@ -1,6 +1,7 @@
 #include "LoopPasses.h"
 #include "../utils/Matcher.h"
 #include <deque>
+#include <functional>
 
 using namespace sys;
 
@@ -43,6 +44,10 @@ void Vectorize::runImpl(LoopInfo *info) {
   if (info->latches.size() > 1 || !info->preheader)
     return;
 
+  // The preheader will choose between the vectorized loop and a scalar copy.
+  if (!isa<GotoOp>(info->preheader->getLastOp()))
+    return;
+
   auto header = info->header;
   auto latch = info->getLatch();
 
@@ -89,12 +94,39 @@ void Vectorize::runImpl(LoopInfo *info) {
   if (!info->stop)
     return;
 
-  // Ensure no branching except for the latch.
+  // Ensure no branching except for the latch, and ifs whose arms are empty.
+  // Such an if only chooses between values, so its phis become selects.
+  struct Choice {
+    Op *cond, *ifso, *ifnot;
+  };
+  std::unordered_map<Op*, Choice> choices;
+  std::vector<Op*> forks;
+
+  // Where `bb` leads to, if it's an empty arm of an if.
+  const auto &skip = [&](BasicBlock *bb) {
+    if (bb->getOpCount() == 1 && isa<GotoOp>(bb->getLastOp()) && bb->preds.size() == 1)
+      return TARGET(bb->getLastOp());
+    return bb;
+  };
+
   for (auto bb : info->getBlocks()) {
     auto term = bb->getLastOp();
-    if (isa<BranchOp>(term) && bb != latch) {
+    if (!isa<BranchOp>(term) || bb == latch)
+      continue;
+
+    auto ifso = TARGET(term), ifnot = ELSE(term);
+    auto merge = skip(ifso);
+    if (ifso == ifnot || merge != skip(ifnot) || merge->preds.size() != 2 || !info->contains(merge))
       return;
+
+    for (auto phi : merge->getPhis()) {
+      choices[phi] = {
+        term->DEF(0),
+        Op::getPhiFrom(phi, ifso == merge ? bb : ifso),
+        Op::getPhiFrom(phi, ifnot == merge ? bb : ifnot),
+      };
     }
+    forks.push_back(term);
   }
 
   // Ensure no calls anywhere.
@@ -106,50 +138,85 @@ void Vectorize::runImpl(LoopInfo *info) {
   }
 
   std::unordered_set<Op*> bases;
+  // Accumulators, along with the op that updates them each iteration.
+  std::unordered_map<Op*, Op*> reductions;
   
   // Ensure all phis have stride 4 and different bases.
   // (Stride 4 is to ensure loop step is 1; larger steps will hit memory wall)
+  // Pointers without a known base, like parameters, are checked at runtime instead.
   for (auto phi : phis) {
     auto latchval = Op::getPhiFrom(phi, latch);
     if (!isa<AddLOp>(latchval)) {
-      // Other phi nodes cannot easily get mutated.
-      return;
+      // Other phi nodes can only be accumulators, like `s = s + a[i]`.
+      // Those are kept in a vector of partial results, one per lane.
+      if (!neon || !info->contains(latchval->getParent()))
+        return;
+
+      auto ty = phi->getResultType();
+      bool reducible = ty == Value::i32
+        ? isa<AddIOp>(latchval) || isa<SubIOp>(latchval) || isa<MulIOp>(latchval)
+        // Reassociating changes the rounding.
+        : ty == Value::f32 && fastMath &&
+          (isa<AddFOp>(latchval) || isa<SubFOp>(latchval) || isa<MulFOp>(latchval));
+      if (!reducible)
+        return;
+
+      // Exactly one operand is the accumulator, and for subtraction it's the first.
+      bool lhs = latchval->DEF(0) == phi, rhs = latchval->DEF(1) == phi;
+      if (lhs == rhs || (rhs && (isa<SubIOp>(latchval) || isa<SubFOp>(latchval))))
+        return;
+
+      // Partial results are meaningless to anything else in the loop.
+      if (phi->getUses().size() != 1)
+        return;
+      for (auto use : latchval->getUses()) {
+        if (use != phi && info->contains(use->getParent()))
+          return;
+      }
+
+      reductions[phi] = latchval;
+      continue;
     }
 
     auto base = findBase(latchval);
-    if (!base || !isa<IntOp>(latchval->DEF(1)) || V(latchval->DEF(1)) != 4)
+    if (!isa<IntOp>(latchval->DEF(1)) || V(latchval->DEF(1)) != 4)
       return;
 
+    if (!base)
+      continue;
     if (bases.count(base))
       return;
     bases.insert(base);
   }
 
-  // Ensure the same base isn't both read and written in the same iteration.
-  std::unordered_set<Op*> stored, loaded;
+  std::unordered_set<Op*> stored, accessed;
   std::vector<Op*> loads, stores, addrs;
   for (auto bb : info->getBlocks()) {
     for (auto op : bb->getOps()) {
       if (isa<StoreOp>(op))
-        stored.insert(findBase(op->DEF(1))),
+        stored.insert(op->DEF(1)),
         addrs.push_back(op->DEF(1)),
         stores.push_back(op);
 
       if (isa<LoadOp>(op))
-        loaded.insert(findBase(op->DEF(0))),
         addrs.push_back(op->DEF(0)),
         loads.push_back(op);
     }
   }
 
-  // Accessed unknown places.
-  if (stored.count(nullptr) || loaded.count(nullptr))
-    return;
-
   // Ensure we only read/store to those phis.
   std::unordered_set<Op*> phiset(phis.begin(), phis.end());
   for (auto x : addrs) {
-    if (!phiset.count(x))
+    if (!phiset.count(x) || reductions.count(x))
+      return;
+  }
+  accessed.insert(addrs.begin(), addrs.end());
+
+  // Ensure what's read and written through unknown bases doesn't overlap.
+  // It's only known at runtime; a scalar copy of the loop runs instead when it might.
+  LoopVersion version(info);
+  for (auto phi : phis) {
+    if (accessed.count(phi) && !version.add(phi, 4, stored.count(phi)))
       return;
   }
 
@@ -164,6 +231,10 @@ void Vectorize::runImpl(LoopInfo *info) {
   Builder builder;
   std::unordered_map<Op*, Op*> opmap;
   std::unordered_set<Op*> visited;
+  // The results of compares.
+  std::unordered_set<Op*> masks;
+  // Masks of `ne`, which are built as `eq` with the selects swapped.
+  std::unordered_set<Op*> negated;
 
   const auto &replace = [&](Op *old, Op *op) {
     opmap[old] = op;
@@ -171,9 +242,117 @@ void Vectorize::runImpl(LoopInfo *info) {
     erased.push_back(old);
   };
 
+  const auto &vectorOf = [](Value::Type ty) {
+    return ty == Value::i32 ? Value::i128 : ty == Value::f32 ? Value::f128 : Value::unit;
+  };
+
+  // The vector holding `v` for 4 iterations at once.
+  // Anything the same in every iteration is broadcast where it's used.
+  const auto &lanes = [&](Op *v) -> Op* {
+    if (opmap.count(v))
+      return opmap[v];
+
+    if (info->contains(v->getParent()) && !isa<IntOp>(v) && !isa<FloatOp>(v))
+      return nullptr;
+
+    Op *splat = nullptr;
+    if (v->getResultType() == Value::i32)
+      splat = builder.create<BroadcastOp>({ v });
+    if (v->getResultType() == Value::f32 && neon)
+      splat = builder.create<BroadcastFOp>({ v });
+    if (splat)
+      created.push_back(splat);
+    return splat;
+  };
+
+  const auto &binary = [&](Op *x, const std::function<Op*(Value, Value)> &make) {
+    auto ty = vectorOf(x->DEF(0)->getResultType());
+    auto a = lanes(x->DEF(0)), b = lanes(x->DEF(1));
+    if (!a || !b || a->getResultType() != ty || b->getResultType() != ty)
+      return false;
+
+    replace(x, make(a, b));
+    return true;
+  };
+
+  std::unordered_set<Op*> forkset(forks.begin(), forks.end());
+
+  // The result of a compare is only meaningful to selects.
+  const auto &compare = [&](Op *x, const std::function<Op*(Value, Value)> &make, bool negate) {
+    if (!neon)
+      return false;
+    for (auto use : x->getUses()) {
+      if (forkset.count(use))
+        continue;
+      if (!isa<SelectOp>(use) || use->DEF(1) == x || use->DEF(2) == x)
+        return false;
+    }
+    if (!binary(x, make))
+      return false;
+    
+    masks.insert(opmap[x]);
+    if (negate)
+      negated.insert(opmap[x]);
+    return true;
+  };
+
+  const auto &select = [&](Op *x, Op *cond, Op *ifso, Op *ifnot) {
+    auto mask = opmap.count(cond) ? opmap[cond] : nullptr;
+    auto a = lanes(ifso), b = lanes(ifnot);
+    if (!masks.count(mask) || !a || !b || a->getResultType() != b->getResultType())
+      return false;
+
+    if (negated.count(mask))
+      std::swap(a, b);
+    replace(x, builder.create<SelectVOp>(a->getResultType(), { mask, a, b }));
+    return true;
+  };
+
+#define BINARY(Ty, VTy) \
+  case Ty::id: \
+    success = binary(x, [&](Value a, Value b) -> Op* { return builder.create<VTy>({ a, b }); }); \
+    break
+
+#define COMPARE(Ty, VTy, negate) \
+  case Ty::id: \
+    success = compare(x, [&](Value a, Value b) -> Op* { return builder.create<VTy>({ a, b }); }, negate); \
+    break
+
+  // Each accumulator starts out as the identity in every lane,
+  // and the initial value is folded in after the loop.
+  for (auto phi : phis) {
+    if (!reductions.count(phi))
+      continue;
+
+    auto latchval = reductions[phi];
+    auto ty = phi->getResultType();
+    bool mul = isa<MulIOp>(latchval) || isa<MulFOp>(latchval);
+
+    builder.setBeforeOp(info->preheader->getLastOp());
+    Op *identity, *init;
+    if (ty == Value::i32) {
+      identity = builder.create<IntOp>({ new IntAttr(mul) });
+      init = builder.create<BroadcastOp>({ identity });
+    } else {
+      identity = builder.create<FloatOp>({ new FloatAttr(mul) });
+      init = builder.create<BroadcastFOp>({ identity });
+    }
+    created.push_back(identity);
+    created.push_back(init);
+
+    // The value from the latch is filled in once it's vectorized.
+    builder.setBeforeOp(phi);
+    auto vphi = builder.create<PhiOp>({ init, init }, { new FromAttr(info->preheader), new FromAttr(latch) });
+    vphi->setResultType(vectorOf(ty));
+    replace(phi, vphi);
+
+    queue.push_back(latchval);
+  }
+
   // First deal with all loads.
   for (auto load : loads) {
-    if (load->getResultType() != Value::i32) {
+    auto ty = vectorOf(load->getResultType());
+    if (ty == Value::unit || (ty == Value::f128 && !neon)) {
       success = false;
       break;
     }
@@ -181,11 +360,14 @@ void Vectorize::runImpl(LoopInfo *info) {
     visited.insert(load);
     builder.setBeforeOp(load);
 
-    auto ld = builder.create<LoadOp>(Value::i128, load->getOperands(), { new SizeAttr(16) });
+    auto ld = builder.create<LoadOp>(ty, load->getOperands(), { new SizeAttr(16) });
     replace(load, ld);
     
-    for (auto x : load->getUses())
-      queue.push_back(x);
+    // Uses after the loop take their values from the side loop below.
+    for (auto x : load->getUses()) {
+      if (info->contains(x->getParent()))
+        queue.push_back(x);
+    }
   }
 
   while (success && !queue.empty()) {
@@ -197,13 +379,17 @@ void Vectorize::runImpl(LoopInfo *info) {
     // If some of its operands inside the loop have not been visited, visit them first.
     bool ready = true;
     if (info->contains(x->getParent())) {
-      const std::vector<Value> &waitlist = isa<StoreOp>(x)
-        ? std::vector { x->getOperand(0) }
-        : x->getOperands();
+      std::vector<Value> waitlist = x->getOperands();
+      if (isa<StoreOp>(x))
+        waitlist = { x->getOperand(0) };
+      if (choices.count(x)) {
+        const auto &choice = choices[x];
+        waitlist = { choice.cond, choice.ifso, choice.ifnot };
+      }
       
       for (auto operand : waitlist) {
         auto def = operand.defining;
-        if (!visited.count(def) && info->contains(def->getParent()) && !isa<PhiOp>(def)) {
+        if (!visited.count(def) && info->contains(def->getParent()) && !phiset.count(def)) {
           queue.push_back(def);
           ready = false;
           continue;
@@ -221,112 +407,41 @@ void Vectorize::runImpl(LoopInfo *info) {
 
     builder.setBeforeOp(x);
     switch (x->opid) {
-    case IntOp::id: {
-      auto b = builder.create<BroadcastOp>({ x });
-      created.push_back(b);
+    case IntOp::id:
+    case FloatOp::id:
+      // These are broadcast by their users.
       break;
-    }
-    case LoadOp::id: {
-      // These loads are definitely outside the loop.
-      // All loads inside this loop have been processed above.
-      // Moreover, as all stores in this loop only stores to some of the phis,
-      // the load must be loop-invariant.
-      // Therefore just record it as it is.
-      assert(!info->contains(x->getParent()));
-      opmap[x] = x;
-      break;
-    }
     case StoreOp::id: {
-      auto value = x->DEF(0);
-      // Optimize memset-like operations.
-      if (isa<IntOp>(value) || !info->contains(value->getParent())) {
-        auto b = builder.create<BroadcastOp>({ value });
-        created.push_back(b);
-        auto st = builder.create<StoreOp>({ b, x->DEF(1) }, { new SizeAttr(16) });
-        replace(x, st);
-        break;
-      }
-
-      BAD(!opmap.count(value) || opmap[value]->getResultType() != Value::i128);
-      auto st = builder.create<StoreOp>({ opmap[value], x->DEF(1) }, { new SizeAttr(16) });
+      // This also turns memset-like stores of invariants into broadcasts.
+      auto value = lanes(x->DEF(0));
+      BAD(!value || value->getResultType() != vectorOf(x->DEF(0)->getResultType()));
+      auto st = builder.create<StoreOp>({ value, x->DEF(1) }, { new SizeAttr(16) });
       replace(x, st);
       break;
     }
-    case AddIOp::id: {
-      auto a = x->DEF(0), b = x->DEF(1);
-      if (opmap.count(a) && opmap.count(b)) {
-        auto aty = opmap[a]->getResultType();
-        auto bty = opmap[b]->getResultType();
-        if (aty == bty && aty == Value::i128) {
-          auto vop = builder.create<AddVOp>({ opmap[a]->getResult(), opmap[b] });
-          replace(x, vop);
-          break;
-        }
-      }
-      if (opmap.count(b) && !opmap.count(a))
-        std::swap(a, b);
-      if (opmap.count(a) && !opmap.count(b)) {
-        auto aty = opmap[a]->getResultType();
-        auto bty = b->getResultType();
-        
-        // `b` has to be loop invariant.
-        // TODO: when `b` itself is loop counter, perhaps optimizable?
-        BAD(info->contains(b->getParent()));
-
-        if (aty == Value::i128 && bty == Value::i32) {
-          auto broadcast = builder.create<BroadcastOp>({ b });
-          created.push_back(broadcast);
-          auto viop = builder.create<AddVOp>({ opmap[a]->getResult(), broadcast });
-          replace(x, viop);
-          break;
-        }
-        if (aty == Value::i32 && bty == Value::i32) {
-          auto add = builder.create<AddIOp>({ opmap[a]->getResult(), b });
-          replace(x, add);
-          break;
-        }
-      }
-      success = false;
+    BINARY(AddIOp, AddVOp);
+    BINARY(SubIOp, SubVOp);
+    BINARY(MulIOp, MulVOp);
+    BINARY(AddFOp, AddFVOp);
+    BINARY(SubFOp, SubFVOp);
+    BINARY(MulFOp, MulFVOp);
+    COMPARE(EqOp, EqVOp, false);
+    COMPARE(NeOp, EqVOp, true);
+    COMPARE(LtOp, LtVOp, false);
+    COMPARE(LeOp, LeVOp, false);
+    COMPARE(EqFOp, EqFVOp, false);
+    COMPARE(NeFOp, EqFVOp, true);
+    COMPARE(LtFOp, LtFVOp, false);
+    COMPARE(LeFOp, LeFVOp, false);
+    case SelectOp::id:
+      success = select(x, x->DEF(0), x->DEF(1), x->DEF(2));
       break;
-    }
-    case MulIOp::id: {
-      auto a = x->DEF(0), b = x->DEF(1);
-      if (opmap.count(a) && opmap.count(b)) {
-        auto aty = opmap[a]->getResultType();
-        auto bty = opmap[b]->getResultType();
-        if (aty == bty && aty == Value::i128) {
-          auto vop = builder.create<MulVOp>({ opmap[a]->getResult(), opmap[b] });
-          replace(x, vop);
-          break;
-        }
-      }
-      if (opmap.count(b) && !opmap.count(a))
-        std::swap(a, b);
-      if (opmap.count(a) && !opmap.count(b)) {
-        auto aty = opmap[a]->getResultType();
-        auto bty = b->getResultType();
-        
-        // `b` has to be loop invariant.
-        // TODO: when `b` itself is loop counter, perhaps optimizable?
-        BAD(info->contains(b->getParent()));
-
-        if (aty == Value::i128 && bty == Value::i32) {
-          auto broadcast = builder.create<BroadcastOp>({ b });
-          created.push_back(broadcast);
-          auto viop = builder.create<MulVOp>({ opmap[a]->getResult(), broadcast });
-          replace(x, viop);
-          break;
-        }
-        if (aty == Value::i32 && bty == Value::i32) {
-          auto add = builder.create<MulIOp>({ opmap[a]->getResult(), b });
-          replace(x, add);
-          break;
-        }
-      }
-      success = false;
+    case PhiOp::id: {
+      BAD(!choices.count(x));
+      const auto &choice = choices[x];
+      success = select(x, choice.cond, choice.ifso, choice.ifnot);
       break;
     }
-    // TODO: check PhiOp and deal with accumulator?
     default:
       std::cerr << "met unhandlable " << x;
       success = false;
@@ -334,6 +449,38 @@ void Vectorize::runImpl(LoopInfo *info) {
     }
   }
 
+#undef BINARY
+#undef COMPARE
+
+  if (success) {
+    // Close the cycles of the accumulators.
+    for (auto [phi, latchval] : reductions) {
+      if (!opmap.count(latchval)) {
+        success = false;
+        break;
+      }
+      opmap[phi]->setOperand(1, opmap[latchval]);
+    }
+  }
+
+  if (success) {
+    // Everything in the loop that used an erased op must have been erased as well,
+    // except for the branches of ifs, which go away below.
+    std::unordered_set<Op*> gone(erased.begin(), erased.end());
+    for (auto op : erased) {
+      for (auto use : op->getUses()) {
+        if (!gone.count(use) && !forkset.count(use) && info->contains(use->getParent()))
+          success = false;
+      }
+    }
+
+    // Nothing can be left to choose between the arms.
+    for (auto [phi, _] : choices) {
+      if (!gone.count(phi))
+        success = false;
+    }
+  }
+
   if (!success) {
     // Undo operations.
     std::cerr << "undo for loop " << bbmap[info->header] << "\n";
@@ -346,9 +493,24 @@ void Vectorize::runImpl(LoopInfo *info) {
 
   // Success.
   std::cerr << "success, vectorized loop " << bbmap[info->header] << "\n";
+  std::unordered_set<Op*> unwanted(created.begin(), created.end());
+
+  // The vectorized loop runs at least once, and leaves at least one iteration to the side loop;
+  // that takes 5 iterations (of 4 bytes each). Shorter loops run a scalar copy instead,
+  // as do those whose pointers might overlap.
+  builder.setBeforeOp(info->preheader->getLastOp());
+  Op *end = info->stop;
+  if (isa<IntOp>(end) && info->contains(end->getParent()))
+    end = builder.create<IntOp>({ new IntAttr(V(end)) });
+
+  Value sixteen = builder.create<IntOp>({ new IntAttr(16) });
+  Value span = builder.create<SubLOp>({ end, Value(info->start) });
+  Op *guard = builder.create<LtOp>({ sixteen, span });
+  if (auto apart = version.check([&](Op *a, Op *b) { return findBase(a) && findBase(b); }))
+    guard = builder.create<AndIOp>({ guard, Value(apart) });
+  version.clone(guard, unwanted);
 
   // Create a side loop.
-  std::unordered_set<Op*> unwanted(created.begin(), created.end());
   auto exit = info->getExit();
   auto region = header->getParent();
 
@@ -384,12 +546,20 @@ void Vectorize::runImpl(LoopInfo *info) {
   }
 
   // Rewire blocks.
-  for (auto [_, v] : rewireMap) {
+  for (auto [k, v] : rewireMap) {
     auto term = v->getLastOp();
     if (auto attr = term->find<TargetAttr>(); attr && rewireMap.count(attr->bb))
       attr->bb = rewireMap[attr->bb];
     if (auto attr = term->find<ElseAttr>(); attr && rewireMap.count(attr->bb))
       attr->bb = rewireMap[attr->bb];
+
+    // The phis merging ifs; those in the header are dealt with below.
+    if (k == header)
+      continue;
+    for (auto phi : v->getPhis()) {
+      for (auto attr : phi->getAttrs())
+        FROM(attr) = rewireMap[FROM(attr)];
+    }
   }
 
   // The latch's exit branch should get to the new preheader instead.
@@ -446,23 +616,77 @@ void Vectorize::runImpl(LoopInfo *info) {
     }
   }
 
+  // Likewise for anything else after the loop; the side loop always runs last.
+  std::unordered_set<BasicBlock*> side { newpreheader };
+  for (auto [_, v] : rewireMap)
+    side.insert(v);
+  for (auto bb : info->getBlocks()) {
+    for (auto op : bb->getOps()) {
+      if (!cloneMap.count(op))
+        continue;
+
+      std::vector<Op*> uses = op->getUses();
+      for (auto use : uses) {
+        auto parent = use->getParent();
+        if (info->contains(parent) || side.count(parent))
+          continue;
+        for (int i = 0; i < use->getOperandCount(); i++) {
+          if (use->DEF(i) == op)
+            use->setOperand(i, cloneMap[op]);
+        }
+      }
+    }
+  }
+
   // For the side loop, all values from preheader should come from the phis in the main loop.
-  std::unordered_map<Op*, Op*> phiMap;
-  for (auto phi : phis)
-    phiMap[Op::getPhiFrom(phi, info->preheader)] = Op::getPhiFrom(phi, latch);
-  
-  for (auto phi : headerPhis) {
-    for (int i = 0; i < phi->getOperandCount(); i++) {
-      auto attr = phi->getAttrs()[i];
+  // An accumulator instead starts from its lanes combined with its initial value.
+  builder.setBeforeOp(newpreheader->getLastOp());
+  for (auto phi : phis) {
+    auto cloned = cloneMap[phi];
+    Op *value;
+    if (reductions.count(phi)) {
+      auto latchval = reductions[phi];
+      auto vec = opmap[latchval];
+      auto ty = phi->getResultType();
+      bool mul = isa<MulIOp>(latchval) || isa<MulFOp>(latchval);
+
+      const auto &combine = [&](Value a, Value b) -> Op* {
+        if (ty == Value::i32)
+          return mul ? (Op*) builder.create<MulIOp>({ a, b }) : builder.create<AddIOp>({ a, b });
+        return mul ? (Op*) builder.create<MulFOp>({ a, b }) : builder.create<AddFOp>({ a, b });
+      };
+
+      Op *sum;
+      if (ty == Value::i32 && !mul)
+        sum = builder.create<ReduceAddVOp>({ vec });
+      else {
+        sum = builder.create<ExtractOp>(ty, { vec }, { new IntAttr(0) });
+        for (int i = 1; i < 4; i++)
+          sum = combine(sum, builder.create<ExtractOp>(ty, { vec }, { new IntAttr(i) }));
+      }
+      // A subtraction has negated its lanes already.
+      value = combine(Op::getPhiFrom(phi, info->preheader), sum);
+    } else
+      value = Op::getPhiFrom(phi, latch);
+
+    for (int i = 0; i < cloned->getOperandCount(); i++) {
+      auto attr = cloned->getAttrs()[i];
       if (FROM(attr) == info->preheader) {
         FROM(attr) = newpreheader;
-        // Reset the operand to the value from the previous loop's latch.
-        phi->setOperand(i, phiMap[phi->DEF(i)]);
+        cloned->setOperand(i, value);
         break;
       }
     }
   }
 
+  // The ifs have become selects, so they just run through one of their arms.
+  for (auto term : forks) {
+    auto ifso = TARGET(term), ifnot = ELSE(term);
+    builder.replace<GotoOp>(term, { new TargetAttr(ifso) });
+    if (skip(ifnot) != ifnot)
+      ifnot->forceErase();
+  }
+
   // Commit operations and erase the original ones.
   for (auto op : erased) {
     op->replaceAllUsesWith(opmap[op]);
@@ -471,6 +695,10 @@ void Vectorize::runImpl(LoopInfo *info) {
 
   // The stride is quadrapled.
   for (auto phi : phis) {
+    // Erased above.
+    if (reductions.count(phi))
+      continue;
+
     auto latchval = Op::getPhiFrom(phi, latch);
 
     if (isa<AddIOp>(latchval) && isa<IntOp>(latchval->DEF(1))) {
@@ -490,7 +718,7 @@ void Vectorize::runImpl(LoopInfo *info) {
 
 void Vectorize::run() {
   LoopAnalysis analysis(module);
-  analysis.run();
+  analysis.runCached();
   auto forests = analysis.getResult();
 
   auto funcs = collectFuncs();
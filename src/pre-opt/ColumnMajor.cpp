@@ -16,6 +16,15 @@ Op *findIndvar(Op *addr, int i) {
 
 }
 
+Op *ColumnMajor::canonical(Op *base) {
+  if (!base || !isa<GetGlobalOp>(base))
+    return base;
+  auto &result = globals[NAME(base)];
+  if (!result)
+    result = base;
+  return result;
+}
+
 void ColumnMajor::collectDepth(Region *region, int depth) {
   for (auto bb : region->getBlocks()) {
     for (auto op : bb->getOps()) {
@@ -37,7 +46,7 @@ void ColumnMajor::collectDepth(Region *region, int depth) {
 
       if (!addr->has<BaseAttr>())
         continue;
-      auto base = BASE(addr);
+      auto base = canonical(BASE(addr));
       // Only the deepest loop nest matters.
       if (depth < data[base].depth)
         continue;
@@ -136,7 +145,7 @@ void ColumnMajor::run() {
 
     for (auto addr : addrs) {
       // We've ensured all addresses have a base in `collectDepth`.
-      if (BASE(addr) != base)
+      if (canonical(BASE(addr)) != base)
         continue;
 
       // Find the ForOp fpr the corresponding subscripts for this address.
@@ -165,7 +174,7 @@ void ColumnMajor::run() {
       Value v2i = builder.create<IntOp>({ new IntAttr(v2) });
       Value mul1 = builder.create<MulIOp>({ outer, v2i });
       Value mul2 = builder.create<MulIOp>({ inner, v1i });
-      Value add1 = builder.create<AddLOp>({ base, mul1 });
+      Value add1 = builder.create<AddLOp>({ BASE(addr), mul1 });
       Op *add2 = builder.create<AddLOp>({ add1, mul2 });
 
       addr->replaceAllUsesWith(add2);
@@ -61,7 +61,7 @@ int EarlyConstFold::foldImpl() {
       if (op->getRegions().size() > region) {
         auto ifso = op->getRegion(region);
         for (auto bb : ifso->getBlocks()) {
-          auto ops = bb->getOps();
+          std::vector<Op*> ops = bb->getOps();
           for (auto inner : ops)
             inner->moveBefore(op);
         }
@@ -109,7 +109,7 @@ void EarlyConstFold::run() {
     auto allocas = module->findAll<AllocaOp>();
   
     for (auto alloca : allocas) {
-      auto uses = alloca->getUses();
+      std::vector<Op*> uses = alloca->getUses();
       Op *store = nullptr;
       bool good = true;
       for (auto use : uses) {
@@ -160,7 +160,7 @@ void EarlyConstFold::run() {
       if (nonConst.count(global))
         continue;
 
-      auto uses = get->getUses();
+      std::vector<Op*> uses = get->getUses();
       for (auto use : uses) {
         assert(!isa<StoreOp>(use));
 
@@ -183,7 +183,7 @@ void EarlyConstFold::run() {
           if (!INT(y))
             continue;
 
-          auto targets = use->getUses();
+          std::vector<Op*> targets = use->getUses();
           for (auto target : targets) {
             assert(!isa<StoreOp>(target));
 
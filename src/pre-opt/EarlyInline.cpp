@@ -139,7 +139,7 @@ void EarlyInline::run() {
         int vi = V(get);
         Op *arg = call->DEF(vi);
 
-        auto uses = addr->getUses();
+        std::vector<Op*> uses = addr->getUses();
         int storecount = 0;
         for (auto use : uses) {
           if (isa<StoreOp>(use) && ++storecount >= 2)
@@ -73,25 +73,15 @@ void Parallelize::run() {
     if (opcount(loop->getRegion()) <= 100 && loop->findAll<CallOp>().empty() && loop->findAll<ForOp>().size() <= 1)
       continue;
 
-    // Split the loop into two halves.
+    // The pool hands out chunks of consecutive iterations.
     // To avoid hassles, ensure the step is 1.
     auto step = loop->DEF(2);
     if (!isa<IntOp>(step) || V(step) != 1)
       continue;
 
     auto stop = loop->DEF(1), start = loop->DEF(0);
-    builder.setBeforeOp(loop);
-
-    // Avoid overflow: use (start - stop >> 1) + start.
-    auto diff = builder.create<SubIOp>({ stop->getResult(), start });
-    auto one = builder.create<IntOp>({ new IntAttr(1) });
-    auto div = builder.create<RShiftOp>({ diff, one });
-    auto newstop = builder.create<AddIOp>({ div, start });
 
-    // For main thread, change `stop` to that value.
-    loop->setOperand(1, newstop);
-
-    // Create a new function.
+    // Move the whole loop into a new function, which runs the iterations in [lo, hi).
     auto parent = loop->getParentOp<FuncOp>();
     const auto &name = NAME(parent);
 
@@ -99,7 +89,9 @@ void Parallelize::run() {
     auto workername = "__worker_" + std::to_string(cnt++) + "_" + name;
     auto worker = builder.create<FuncOp>({
       new NameAttr(workername),
-      new ArgCountAttr(0)
+      new ArgCountAttr(2),
+      new ImpureAttr,
+      new WorkerAttr
     });
 
     // Copy the loop and set proper bounds.
@@ -110,9 +102,10 @@ void Parallelize::run() {
     // We must create a new alloca for the induction variable.
     auto ivAddr = builder.create<AllocaOp>({ new SizeAttr(4) });
 
-    // `newstop` will be marked as captured below.
+    auto lo = builder.create<GetArgOp>(Value::i32, { new IntAttr(0) });
+    auto hi = builder.create<GetArgOp>(Value::i32, { new IntAttr(1) });
     auto newone = builder.create<IntOp>({ new IntAttr(1) });
-    auto copiedLoop = builder.create<ForOp>({ newstop, stop, step, ivAddr });
+    auto copiedLoop = builder.create<ForOp>({ lo, hi, newone, ivAddr });
 
     // Copy the loop content.
     auto bbloop = loop->getRegion()->getFirstBlock();
@@ -145,15 +138,19 @@ void Parallelize::run() {
 
     // Collect captured values.
     builder.setBeforeOp(copiedLoop);
-    std::unordered_set<Op*> captured { newstop, stop };
-    for (auto [_, v] : cloneMap) {
+    std::unordered_set<Op*> captured;
+    // The map grows as we go, so walk a snapshot of it.
+    std::vector<Op*> copies;
+    for (auto [_, v] : cloneMap)
+      copies.push_back(v);
+    for (auto v : copies) {
       if (v == copiedLoop)
         continue;
 
       for (int i = 0; i < v->getOperandCount(); i++) {
         auto def = v->DEF(i);
 
-        if (isa<IntOp>(def) || isa<GetGlobalOp>(def) || isa<AllocaOp>(def))
+        if ((isa<IntOp>(def) || isa<GetGlobalOp>(def) || isa<AllocaOp>(def)) && !cloneMap.count(def))
           cloneMap[def] = builder.copy(def);
         else if (!cloneMap.count(def))
           captured.insert(def);
@@ -166,13 +163,14 @@ void Parallelize::run() {
     }
 
     // Resolve captured operations by promoting these to global variables.
+    // Every thread of the pool only reads them.
     for (auto op : captured) {
       // Create a dedicated global for this value.
       builder.setToRegionStart(module->getRegion());
       auto fp = op->getResultType() == Value::f32;
       auto init = fp
-        ? (Attr*) new IntArrayAttr(new int(0), 1)
-        : (Attr*) new FloatArrayAttr(new float(0), 1);
+        ? (Attr*) new FloatArrayAttr(new float(0), 1)
+        : (Attr*) new IntArrayAttr(new int(0), 1);
       auto gname = "__worker_global_" + std::to_string(cnt++);
       auto global = builder.create<GlobalOp>({ init,
         new SizeAttr(4),
@@ -204,34 +202,33 @@ void Parallelize::run() {
     }
     for (auto [alloca, init] : allocaMap) {
       assert(cloneMap.count(init));
-      builder.create<StoreOp>({ cloneMap[init]->getResult(), cloneMap[alloca] });
+      builder.create<StoreOp>({ cloneMap[init]->getResult(), cloneMap[alloca] }, { new SizeAttr(4) });
     }
-    // Also replace the `stop` and `step` values.
-    copiedLoop->setOperand(0, cloneMap[newstop]);
-    copiedLoop->setOperand(1, cloneMap[stop]);
+    // The bounds come from the pool instead.
+    copiedLoop->setOperand(0, lo);
+    copiedLoop->setOperand(1, hi);
     copiedLoop->setOperand(2, newone);
 
-    // Clone a thread.
+    // The original loop becomes a call over the whole range.
+    // It's a plain call to everything before the backend, which then dispatches it to the pool.
     builder.setBeforeOp(loop);
-    builder.create<CloneOp>({ new NameAttr(workername) });
-    builder.setAfterOp(loop);
-    builder.create<JoinOp>({ new NameAttr(workername) });
-
-    // Create a WakeOp at the end.
-    builder.setToRegionEnd(worker->getRegion());
-    builder.create<WakeOp>({ new NameAttr(workername) });
+    builder.create<CallOp>(Value::i32, { start, stop }, { new NameAttr(workername), new ImpureAttr });
+    // The induction variable ends where the serial loop would leave it.
+    // That's `stop`, unless the loop never ran at all.
+    Value lt = builder.create<LtOp>({ start->getResult(), stop->getResult() });
+    Value end = builder.create<SelectOp>({ lt, stop->getResult(), start->getResult() });
+    builder.create<StoreOp>({ end, loop->getOperand(3) }, { new SizeAttr(4) });
+    loop->erase();
+  }
 
-    // Create globals that gets used by backend.
+  // Read by the runtime: the thread count, and whether chunks are dynamic.
+  // The stacks of the pool are sized from it; see arm::Dump.
+  if (cnt) {
     builder.setToRegionStart(module->getRegion());
     builder.create<GlobalOp>({ new ImpureAttr,
-      new IntArrayAttr(new int[2] { }, 2),
+      new IntArrayAttr(new int[2] { threads, dynamic }, 2),
       new SizeAttr(8), // It might get localized when size = 4.
-      new NameAttr("_lock" + workername)
-    });
-    builder.create<GlobalOp>({ new ImpureAttr,
-      new IntArrayAttr(new int[2048] { }, 2048),
-      new SizeAttr(8192),
-      new NameAttr("_stack" + workername)
+      new NameAttr("_pool_threads")
     });
   }
 
@@ -94,7 +94,10 @@ class ColumnMajor : public Pass {
     bool valid = true;
   };
   std::unordered_map<Op*, AccessData> data;
+  // Each function has its own GetGlobalOp; these are the ones standing for all of them.
+  std::unordered_map<std::string, Op*> globals;
 
+  Op *canonical(Op *base);
   void collectDepth(Region *region, int depth);
 public:
   ColumnMajor(ModuleOp *module): Pass(module) {}
@@ -104,9 +107,15 @@ public:
   void run() override;
 };
 
+// Runs parallelizable loops on a pool of threads.
+// Each loop becomes a function over a chunk of it; see rt/arm-pool.s for how chunks are handed out.
 class Parallelize : public Pass {
+  // Including the main thread.
+  int threads;
+  // Whether threads take small chunks as they go, rather than one share each.
+  bool dynamic;
 public:
-  Parallelize(ModuleOp *module): Pass(module) {}
+  Parallelize(ModuleOp *module, int threads, bool dynamic): Pass(module), threads(threads), dynamic(dynamic) {}
 
   std::string name() override { return "parallelize"; }
   std::map<std::string, int> stats() override { return {}; }
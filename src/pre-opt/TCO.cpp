@@ -49,7 +49,7 @@ bool TCO::runImpl(FuncOp *func) {
   auto after = loop->appendRegion();
   auto afterEntry = after->appendBlock();
 
-  auto bbs = region->getBlocks();
+  std::vector<BasicBlock*> bbs = region->getBlocks();
   for (auto bb : bbs) {
     if (bb != tail)
       bb->moveAfter(afterEntry);
@@ -174,7 +174,7 @@ bool TCO::runAdd(FuncOp *func) {
   auto after = loop->appendRegion();
   auto afterEntry = after->appendBlock();
 
-  auto bbs = region->getBlocks();
+  std::vector<BasicBlock*> bbs = region->getBlocks();
   for (auto bb : bbs) {
     if (bb != tail)
       bb->moveAfter(afterEntry);
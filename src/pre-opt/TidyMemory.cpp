@@ -13,7 +13,7 @@ void TidyMemory::runImpl(Region *region) {
   // Maps stored addresses into the value.
   std::unordered_map<Op*, Op*> values;
   for (auto bb : region->getBlocks()) {
-    auto ops = bb->getOps();
+    std::vector<Op*> ops = bb->getOps();
     for (auto op : ops) {
       // Conservatively invalidates all stores.
       if (op->getRegionCount()) {
@@ -32,7 +32,7 @@ void tidymod(Op *loop, int vi) {
   auto entry = region->getFirstBlock();
   Builder builder;
 
-  auto ops = entry->getOps();
+  std::vector<Op*> ops = entry->getOps();
   for (auto op : ops) {
     if (!isa<ModIOp>(op))
       continue;
@@ -109,7 +109,7 @@ void unroll(Op *loop, int vi) {
   auto entry = region->getFirstBlock();
 
   Builder builder;
-  std::list<Op*> body = entry->getOps();
+  std::vector<Op*> body = entry->getOps();
   std::unordered_map<Op*, Op*> opmap;
 
   const std::function<void (Op*)> copy = [&](Op *x) {
@@ -304,7 +304,7 @@ bool Unswitch::ltconst(Op *loop, Op *cond) {
   auto region = loop->getRegion();
   auto entry = region->getFirstBlock();
 
-  std::list<Op*> body = entry->getOps();
+  std::vector<Op*> body = entry->getOps();
   std::unordered_map<Op*, Op*> opmap;
 
   const std::function<void (Op*)> copy = [&](Op *x) {
@@ -458,7 +458,7 @@ bool Unswitch::gtconst(Op *loop, Op *cond) {
   auto region = loop->getRegion();
   auto entry = region->getFirstBlock();
 
-  std::list<Op*> body = entry->getOps();
+  std::vector<Op*> body = entry->getOps();
   std::unordered_map<Op*, Op*> opmap;
 
   const std::function<void (Op*)> copy = [&](Op *x) {
@@ -546,7 +546,7 @@ bool Unswitch::invariant(Op *loop, Op *cond) {
   auto region = loop->getRegion(isWhile);
   auto entry = region->getFirstBlock();
 
-  std::list<Op*> body = entry->getOps();
+  std::vector<Op*> body = entry->getOps();
   std::unordered_map<Op*, Op*> opmap;
 
   // Hoist the `if` outside the loop.
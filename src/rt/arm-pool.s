@@ -0,0 +1,232 @@
+; R"(
+# A pool of threads for parallel loops, started by the first of them.
+# In between, the workers sleep on a futex instead of spinning.
+#
+# `_pool_threads` holds the number of threads, counting the main one,
+# and whether chunks are dynamic. It's emitted by the compiler, along with `_pool_stacks`.
+#
+# Layout of `_pool_task`:
+#    0: the function to run on each chunk, as f(lo, hi)
+#    8: start of the range
+#   12: end of the range
+#   16: the next chunk to take, when dynamic
+#   20: size of a chunk
+#   24: generation, bumped for each task; workers wait on it
+#   28: workers yet to finish; the main thread waits on it
+#   32: whether the pool is started
+
+# x0: Start of the range
+# x1: End of the range (exclusive)
+# x2: Function pointer
+pool_run:
+  stp x29, x30, [sp, #-48]!
+  stp x19, x20, [sp, #16]
+  cmp w1, w0
+  b.le 4f
+  adrp x19, _pool_task
+  add x19, x19, :lo12:_pool_task
+
+  # Start the pool on first use. It might get fewer threads than asked for,
+  # so the chunks are only sized afterwards.
+  ldr w9, [x19, #32]
+  cbnz w9, 1f
+  stp x0, x1, [sp, #32]
+  str x2, [x19]
+  mov w9, #1
+  str w9, [x19, #32]
+  bl pool_start
+  ldp x0, x1, [sp, #32]
+  ldr x2, [x19]
+1:
+  str x2, [x19]
+  stp w0, w1, [x19, #8]
+  str w0, [x19, #16]
+
+  # Static chunks give each thread one share; dynamic ones are 4 times smaller.
+  sub w9, w1, w0
+  adrp x10, _pool_threads
+  add x10, x10, :lo12:_pool_threads
+  ldp w11, w12, [x10]
+  sub w13, w11, #1
+  str w13, [x19, #28]
+  cbz w12, 2f
+  lsl w11, w11, #2
+2:
+  add w9, w9, w11
+  sub w9, w9, #1
+  udiv w9, w9, w11
+  str w9, [x19, #20]
+
+  # Publish the task, then wake everyone.
+  # Syscall 98:
+  #   futex(addr, FUTEX_WAKE_PRIVATE, count)
+  add x0, x19, #24
+  ldr w1, [x0]
+  add w1, w1, #1
+  stlr w1, [x0]
+  mov x1, #129
+  mov w2, #0x7fffffff
+  mov x8, #98
+  svc #0
+
+  # The main thread is thread 0.
+  mov x0, #0
+  bl pool_chunks
+
+  # Wait for the others.
+  #   futex(addr, FUTEX_WAIT_PRIVATE, expected, NULL)
+  add x20, x19, #28
+3:
+  ldar w2, [x20]
+  cbz w2, 4f
+  mov x0, x20
+  mov x1, #128
+  mov x3, #0
+  mov x8, #98
+  svc #0
+  b 3b
+4:
+  ldp x19, x20, [sp, #16]
+  ldp x29, x30, [sp], #48
+  ret
+
+pool_start:
+  stp x29, x30, [sp, #-32]!
+  stp x19, x20, [sp, #16]
+  mov x19, #1
+1:
+  adrp x9, _pool_threads
+  ldr w9, [x9, :lo12:_pool_threads]
+  cmp x19, x9
+  b.ge 3f
+
+  # The stack of thread i ends 1 MiB * i into `_pool_stacks`.
+  adrp x20, _pool_stacks
+  add x20, x20, :lo12:_pool_stacks
+  add x20, x20, x19, lsl #20
+
+  # Syscall 220:
+  #   clone(flags, stack_top, parent_tid_ptr, child_tid_ptr, tls)
+  # CLONE_VM | CLONE_FS | CLONE_FILES | CLONE_SIGHAND | CLONE_THREAD | CLONE_SYSVSEM
+  mov x0, #3840
+  movk x0, #5, lsl 16
+  mov x1, x20
+  mov x2, #0
+  mov x3, #0
+  mov x4, #0
+  mov x8, #220
+  svc #0
+  cbz x0, 4f
+  tbz x0, #63, 2f
+
+  # No more threads; make do with the ones already started.
+  adrp x9, _pool_threads
+  str w19, [x9, :lo12:_pool_threads]
+  b 3f
+2:
+  add x19, x19, #1
+  b 1b
+3:
+  ldp x19, x20, [sp, #16]
+  ldp x29, x30, [sp], #32
+  ret
+
+  # For the child, run tasks forever.
+  # It goes away along with the process, at exit_group().
+4:
+  mov sp, x20
+  mov x0, x19
+  b pool_worker
+
+# x0: Thread id
+pool_worker:
+  mov x19, x0
+  mov w20, #0
+  adrp x21, _pool_task
+  add x21, x21, :lo12:_pool_task
+1:
+  # Sleep until the generation changes.
+  add x0, x21, #24
+  ldar w1, [x0]
+  cmp w1, w20
+  b.ne 2f
+  mov x1, #128
+  mov w2, w20
+  mov x3, #0
+  mov x8, #98
+  svc #0
+  b 1b
+2:
+  mov w20, w1
+  mov x0, x19
+  bl pool_chunks
+
+  # The last one to finish wakes the main thread.
+  add x0, x21, #28
+3:
+  ldaxr w1, [x0]
+  sub w1, w1, #1
+  stlxr w2, w1, [x0]
+  cbnz w2, 3b
+  cbnz w1, 1b
+  mov x1, #129
+  mov x2, #1
+  mov x8, #98
+  svc #0
+  b 1b
+
+# x0: Thread id
+pool_chunks:
+  stp x29, x30, [sp, #-48]!
+  stp x19, x20, [sp, #16]
+  stp x21, x22, [sp, #32]
+  adrp x19, _pool_task
+  add x19, x19, :lo12:_pool_task
+  ldr w20, [x19, #20]
+  ldr w21, [x19, #12]
+  adrp x9, _pool_threads
+  add x9, x9, :lo12:_pool_threads
+  ldr w9, [x9, #4]
+  cbnz w9, 1f
+
+  # Static: thread i takes the i-th share.
+  ldr w10, [x19, #8]
+  madd w0, w0, w20, w10
+  cmp w0, w21
+  b.ge 3f
+  add w1, w0, w20
+  cmp w1, w21
+  csel w1, w1, w21, lt
+  ldr x9, [x19]
+  blr x9
+  b 3f
+
+  # Dynamic: take the next chunk, until there's none left.
+1:
+  add x9, x19, #16
+2:
+  ldaxr w22, [x9]
+  add w10, w22, w20
+  stlxr w11, w10, [x9]
+  cbnz w11, 2b
+  cmp w22, w21
+  b.ge 3f
+  add w1, w22, w20
+  cmp w1, w21
+  csel w1, w1, w21, lt
+  mov w0, w22
+  ldr x9, [x19]
+  blr x9
+  b 1b
+3:
+  ldp x21, x22, [sp, #32]
+  ldp x19, x20, [sp, #16]
+  ldp x29, x30, [sp], #48
+  ret
+
+.section .bss
+.balign 16
+_pool_task:
+  .skip 64
+.text
+)"
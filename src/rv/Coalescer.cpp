@@ -0,0 +1,379 @@
+#include "Coalescer.h"
+#include <algorithm>
+#include <climits>
+
+using namespace sys;
+using namespace sys::rv;
+
+// The names follow the paper (and Appel's "Modern Compiler Implementation"),
+// so that it's easy to check one against the other.
+
+Coalescer::Coalescer(const Reg *order, int regcount): order(order), regcount(regcount) {
+  for (int i = 0; i < regcount; i++) {
+    values.push_back(nullptr);
+    adjList.emplace_back();
+    moveList.emplace_back();
+    // Registers are never simplified.
+    degree.push_back(INT_MAX / 2);
+    cost.push_back(0);
+    alias.push_back(i);
+    color.push_back(i);
+    nodeState.push_back(Precolored);
+  }
+}
+
+void Coalescer::add(Op *op, long long weight) {
+  int n = values.size();
+  nodeOf[op] = n;
+  values.push_back(op);
+  adjList.emplace_back();
+  moveList.emplace_back();
+  degree.push_back(0);
+  cost.push_back(weight);
+  alias.push_back(n);
+  color.push_back(-1);
+  nodeState.push_back(Initial);
+}
+
+int Coalescer::node(Op *op) {
+  return nodeOf.count(op) ? nodeOf[op] : -1;
+}
+
+int Coalescer::regNode(Reg reg) {
+  for (int i = 0; i < regcount; i++) {
+    if (order[i] == reg)
+      return i;
+  }
+  return -1;
+}
+
+void Coalescer::addEdge(int u, int v) {
+  if (u == v || adjacent(u, v))
+    return;
+
+  adjSet.insert((long long) u << 32 | v);
+  adjSet.insert((long long) v << 32 | u);
+  if (!precolored(u)) {
+    adjList[u].push_back(v);
+    degree[u]++;
+  }
+  if (!precolored(v)) {
+    adjList[v].push_back(u);
+    degree[v]++;
+  }
+}
+
+void Coalescer::interfere(Op *a, Op *b) {
+  int u = node(a), v = node(b);
+  if (u >= 0 && v >= 0)
+    addEdge(u, v);
+}
+
+void Coalescer::forbid(Op *op, Reg reg) {
+  int u = node(op), r = regNode(reg);
+  if (u >= 0 && r >= 0)
+    addEdge(u, r);
+}
+
+void Coalescer::move(Op *a, Op *b, long long weight) {
+  int u = node(a), v = node(b);
+  if (u < 0 || v < 0 || u == v)
+    return;
+
+  int m = moves.size();
+  moves.push_back({ u, v, weight });
+  moveState.push_back(Worklist);
+  moveList[u].push_back(m);
+  moveList[v].push_back(m);
+  moveWorklist.insert({ -weight, m });
+}
+
+void Coalescer::move(Op *a, Reg reg, long long weight) {
+  int u = node(a), r = regNode(reg);
+  if (u < 0 || r < 0)
+    return;
+
+  int m = moves.size();
+  moves.push_back({ u, r, weight });
+  moveState.push_back(Worklist);
+  moveList[u].push_back(m);
+  moveList[r].push_back(m);
+  moveWorklist.insert({ -weight, m });
+}
+
+std::vector<int> Coalescer::adjacentOf(int n) {
+  std::vector<int> result;
+  for (auto m : adjList[n]) {
+    if (nodeState[m] != Selected && nodeState[m] != Coalesced)
+      result.push_back(m);
+  }
+  return result;
+}
+
+std::vector<int> Coalescer::nodeMoves(int n) {
+  std::vector<int> result;
+  for (auto m : moveList[n]) {
+    if (moveState[m] != Done)
+      result.push_back(m);
+  }
+  return result;
+}
+
+void Coalescer::makeWorklist() {
+  for (int n = regcount; n < values.size(); n++) {
+    if (degree[n] >= regcount) {
+      spillList.insert(n);
+      nodeState[n] = Spill;
+    } else if (moveRelated(n)) {
+      freezeList.insert(n);
+      nodeState[n] = Freeze;
+    } else {
+      simplifyList.insert(n);
+      nodeState[n] = Simplify;
+    }
+  }
+}
+
+void Coalescer::simplify() {
+  int n = *simplifyList.begin();
+  simplifyList.erase(n);
+  nodeState[n] = Selected;
+  selectStack.push_back(n);
+  for (auto m : adjacentOf(n))
+    decrementDegree(m);
+}
+
+void Coalescer::decrementDegree(int m) {
+  if (precolored(m))
+    return;
+
+  int d = degree[m]--;
+  if (d != regcount || nodeState[m] != Spill)
+    return;
+
+  enableMoves(m);
+  for (auto n : adjacentOf(m))
+    enableMoves(n);
+  spillList.erase(m);
+  if (moveRelated(m)) {
+    freezeList.insert(m);
+    nodeState[m] = Freeze;
+  } else {
+    simplifyList.insert(m);
+    nodeState[m] = Simplify;
+  }
+}
+
+void Coalescer::enableMoves(int n) {
+  for (auto m : nodeMoves(n)) {
+    if (moveState[m] == Active) {
+      moveState[m] = Worklist;
+      moveWorklist.insert({ -moves[m].weight, m });
+    }
+  }
+}
+
+void Coalescer::addWorklist(int u) {
+  if (!precolored(u) && nodeState[u] == Freeze && !moveRelated(u) && degree[u] < regcount) {
+    freezeList.erase(u);
+    simplifyList.insert(u);
+    nodeState[u] = Simplify;
+  }
+}
+
+// George's test.
+bool Coalescer::ok(int t, int r) {
+  return degree[t] < regcount || precolored(t) || adjacent(t, r);
+}
+
+// Briggs' test.
+bool Coalescer::conservative(const std::vector<int> &nodes) {
+  int k = 0;
+  for (auto n : nodes) {
+    if (degree[n] >= regcount)
+      k++;
+  }
+  return k < regcount;
+}
+
+int Coalescer::getAlias(int n) {
+  while (nodeState[n] == Coalesced)
+    n = alias[n];
+  return n;
+}
+
+void Coalescer::coalesce() {
+  auto [_, m] = *moveWorklist.begin();
+  moveWorklist.erase(moveWorklist.begin());
+
+  int x = getAlias(moves[m].x);
+  int y = getAlias(moves[m].y);
+  int u = x, v = y;
+  if (precolored(y))
+    std::swap(u, v);
+
+  if (u == v) {
+    moveState[m] = Done;
+    coalesced++;
+    addWorklist(u);
+    return;
+  }
+
+  // Constrained.
+  if (precolored(v) || adjacent(u, v)) {
+    moveState[m] = Done;
+    addWorklist(u);
+    addWorklist(v);
+    return;
+  }
+
+  bool safe;
+  if (precolored(u)) {
+    auto adj = adjacentOf(v);
+    safe = std::all_of(adj.begin(), adj.end(), [&](int t) { return ok(t, u); });
+  } else {
+    auto adj = adjacentOf(u);
+    for (auto t : adjacentOf(v)) {
+      if (std::find(adj.begin(), adj.end(), t) == adj.end())
+        adj.push_back(t);
+    }
+    safe = conservative(adj);
+  }
+
+  if (!safe) {
+    moveState[m] = Active;
+    return;
+  }
+  moveState[m] = Done;
+  coalesced++;
+  combine(u, v);
+  addWorklist(u);
+}
+
+void Coalescer::combine(int u, int v) {
+  if (nodeState[v] == Freeze)
+    freezeList.erase(v);
+  else
+    spillList.erase(v);
+  nodeState[v] = Coalesced;
+  alias[v] = u;
+  cost[u] += cost[v];
+  for (auto m : moveList[v])
+    moveList[u].push_back(m);
+  enableMoves(v);
+
+  for (auto t : adjacentOf(v)) {
+    addEdge(t, u);
+    decrementDegree(t);
+  }
+  if (!precolored(u) && degree[u] >= regcount && nodeState[u] == Freeze) {
+    freezeList.erase(u);
+    spillList.insert(u);
+    nodeState[u] = Spill;
+  }
+}
+
+void Coalescer::freeze() {
+  int u = *freezeList.begin();
+  freezeList.erase(u);
+  simplifyList.insert(u);
+  nodeState[u] = Simplify;
+  freezeMoves(u);
+}
+
+void Coalescer::freezeMoves(int u) {
+  for (auto m : nodeMoves(u)) {
+    int x = moves[m].x, y = moves[m].y;
+    int v = getAlias(y) == getAlias(u) ? getAlias(x) : getAlias(y);
+    if (moveState[m] == Worklist)
+      moveWorklist.erase({ -moves[m].weight, m });
+    moveState[m] = Done;
+
+    if (!precolored(v) && nodeState[v] == Freeze && nodeMoves(v).empty() && degree[v] < regcount) {
+      freezeList.erase(v);
+      simplifyList.insert(v);
+      nodeState[v] = Simplify;
+    }
+  }
+}
+
+void Coalescer::selectSpill() {
+  // The cheapest to spill for the most neighbours it frees.
+  int m = -1;
+  for (auto n : spillList) {
+    if (m < 0 || (double) cost[n] / degree[n] < (double) cost[m] / degree[m])
+      m = n;
+  }
+  spillList.erase(m);
+  simplifyList.insert(m);
+  nodeState[m] = Simplify;
+  freezeMoves(m);
+}
+
+void Coalescer::assignColors() {
+  while (!selectStack.empty()) {
+    int n = selectStack.back();
+    selectStack.pop_back();
+
+    std::vector<bool> okColors(regcount, true);
+    for (auto w : adjList[n]) {
+      int a = getAlias(w);
+      if (nodeState[a] == Colored || precolored(a))
+        okColors[color[a]] = false;
+    }
+
+    // Take the register of a move partner if possible, even if the move was frozen.
+    int c = -1;
+    for (auto m : moveList[n]) {
+      int x = getAlias(moves[m].x), y = getAlias(moves[m].y);
+      int other = x == n ? y : x;
+      if ((nodeState[other] == Colored || precolored(other)) && okColors[color[other]]) {
+        c = color[other];
+        break;
+      }
+    }
+    for (int i = 0; i < regcount && c < 0; i++) {
+      if (okColors[i])
+        c = i;
+    }
+
+    if (c < 0) {
+      nodeState[n] = SpilledNode;
+      continue;
+    }
+    nodeState[n] = Colored;
+    color[n] = c;
+  }
+
+  std::unordered_map<int, std::vector<Op*>> groups;
+  for (int n = regcount; n < values.size(); n++) {
+    int a = getAlias(n);
+    if (nodeState[a] == SpilledNode)
+      groups[a].push_back(values[n]);
+    else
+      assignment[values[n]] = order[color[a]];
+  }
+
+  // Keep it deterministic.
+  for (int n = regcount; n < values.size(); n++) {
+    if (groups.count(n))
+      spilled.push_back(groups[n]);
+  }
+}
+
+void Coalescer::run() {
+  makeWorklist();
+  for (;;) {
+    if (!simplifyList.empty())
+      simplify();
+    else if (!moveWorklist.empty())
+      coalesce();
+    else if (!freezeList.empty())
+      freeze();
+    else if (!spillList.empty())
+      selectSpill();
+    else
+      break;
+  }
+  assignColors();
+}
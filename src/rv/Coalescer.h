@@ -0,0 +1,105 @@
+#ifndef RV_COALESCER_H
+#define RV_COALESCER_H
+
+#include "RvAttrs.h"
+#include "../codegen/OpBase.h"
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace sys::rv {
+
+// Iterated register coalescing (George & Appel, TOPLAS 1996) for one register class.
+//
+// Values are colored with the `regcount` registers in `order`. Registers outside of it
+// (`sp`, the spill registers and so on) are simply ignored.
+// Moves are coalesced conservatively: Briggs' test between two values,
+// and George's test between a value and a register.
+//
+// There's no rebuild after spilling, as RegAlloc reloads spilled values
+// into registers reserved for that.
+class Coalescer {
+  const Reg *order;
+  int regcount;
+
+  struct Move {
+    int x, y;
+    long long weight;
+  };
+
+  // Nodes [0, regcount) are the registers; the rest are values.
+  std::vector<Op*> values;
+  std::unordered_map<Op*, int> nodeOf;
+
+  std::unordered_set<long long> adjSet;
+  std::vector<std::vector<int>> adjList;
+  std::vector<int> degree;
+  std::vector<long long> cost;
+  std::vector<int> alias;
+  std::vector<int> color;
+
+  std::vector<Move> moves;
+  std::vector<std::vector<int>> moveList;
+
+  enum NodeState { Precolored, Initial, Simplify, Freeze, Spill, Coalesced, Selected, SpilledNode, Colored };
+  enum MoveState { Worklist, Active, Done };
+  std::vector<NodeState> nodeState;
+  std::vector<MoveState> moveState;
+
+  std::set<int> simplifyList, freezeList, spillList;
+  // Ordered by descending weight, so that hot moves are coalesced first.
+  std::set<std::pair<long long, int>> moveWorklist;
+  std::vector<int> selectStack;
+
+  int node(Op *op);
+  int regNode(Reg reg);
+  bool precolored(int n) { return n < regcount; }
+  bool adjacent(int u, int v) { return adjSet.count((long long) u << 32 | v); }
+
+  void addEdge(int u, int v);
+  std::vector<int> adjacentOf(int n);
+  std::vector<int> nodeMoves(int n);
+  bool moveRelated(int n) { return !nodeMoves(n).empty(); }
+
+  void makeWorklist();
+  void simplify();
+  void decrementDegree(int m);
+  void enableMoves(int n);
+  void coalesce();
+  void addWorklist(int u);
+  bool ok(int t, int r);
+  bool conservative(const std::vector<int> &nodes);
+  int getAlias(int n);
+  void combine(int u, int v);
+  void freeze();
+  void freezeMoves(int u);
+  void selectSpill();
+  void assignColors();
+public:
+  // Number of moves that went away.
+  int coalesced = 0;
+
+  Coalescer(const Reg *order, int regcount);
+
+  // Adds a value to be colored. Values must be added before everything else about them.
+  void add(Op *op, long long cost);
+  void interfere(Op *a, Op *b);
+  // `op` can't be in `reg`.
+  void forbid(Op *op, Reg reg);
+  // `a` and `b` would like to share a register.
+  void move(Op *a, Op *b, long long weight);
+  // `a` would like to be in `reg`.
+  void move(Op *a, Reg reg, long long weight);
+
+  void run();
+
+  // Results. The values that didn't get a register are grouped by what they've coalesced into;
+  // each group can share a single stack slot.
+  std::unordered_map<Op*, Reg> assignment;
+  std::vector<std::vector<Op*>> spilled;
+};
+
+}
+
+#endif
@@ -0,0 +1,317 @@
+#include "CostModel.h"
+#include "RvOps.h"
+#include "RvAttrs.h"
+#include "../codegen/Attrs.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+using namespace sys;
+using namespace sys::rv;
+
+namespace {
+
+// What the table is indexed by.
+enum Kind {
+  IntAlu, IntMul, IntDiv, Load, Store, Branch,
+  FpAdd, FpMul, FpDiv, FpCvt, FpMove,
+  // Doesn't become an instruction.
+  Pseudo,
+};
+
+Kind classify(int opid) {
+  switch (opid) {
+  case rv::MulwOp::id:
+  case rv::MulOp::id:
+  case rv::MulhOp::id:
+  case rv::MulhuOp::id:
+  case rv::VmulOp::id:
+  case MulIOp::id:
+  case MulLOp::id:
+  case MulshOp::id:
+  case MuluhOp::id:
+    return IntMul;
+
+  case rv::DivwOp::id:
+  case rv::DivOp::id:
+  case rv::RemwOp::id:
+  case rv::RemOp::id:
+  case DivIOp::id:
+  case ModIOp::id:
+  case DivLOp::id:
+  case ModLOp::id:
+    return IntDiv;
+
+  case rv::LoadOp::id:
+  case rv::FldOp::id:
+  case rv::VleOp::id:
+  case sys::LoadOp::id:
+    return Load;
+
+  case rv::StoreOp::id:
+  case rv::FsdOp::id:
+  case rv::VseOp::id:
+  case sys::StoreOp::id:
+    return Store;
+
+  case rv::BeqOp::id:
+  case rv::BneOp::id:
+  case rv::BltOp::id:
+  case rv::BgeOp::id:
+  case rv::BleOp::id:
+  case rv::BgtOp::id:
+  case rv::JOp::id:
+  case rv::CallOp::id:
+  case rv::RetOp::id:
+  case BranchOp::id:
+  case GotoOp::id:
+  case sys::CallOp::id:
+  case ReturnOp::id:
+    return Branch;
+
+  case rv::FaddOp::id:
+  case rv::FsubOp::id:
+  case rv::FeqOp::id:
+  case rv::FltOp::id:
+  case rv::FleOp::id:
+  case AddFOp::id:
+  case SubFOp::id:
+  case EqFOp::id:
+  case NeFOp::id:
+  case LtFOp::id:
+  case LeFOp::id:
+    return FpAdd;
+
+  case rv::FmulOp::id:
+  case MulFOp::id:
+    return FpMul;
+
+  case rv::FdivOp::id:
+  case DivFOp::id:
+    return FpDiv;
+
+  case rv::FcvtswOp::id:
+  case rv::FcvtwsRtzOp::id:
+  case F2IOp::id:
+  case I2FOp::id:
+    return FpCvt;
+
+  case rv::FmvOp::id:
+  case rv::FmvwxOp::id:
+  case rv::FmvdxOp::id:
+  case rv::FmvxdOp::id:
+    return FpMove;
+
+  case rv::ReadRegOp::id:
+  case rv::WriteRegOp::id:
+  case rv::PlaceHolderOp::id:
+  case rv::SubSpOp::id:
+  case PhiOp::id:
+    return Pseudo;
+
+  default:
+    return IntAlu;
+  }
+}
+
+using Timing = CostModel::Timing;
+
+// Roughly XiangShan Nanhu (`-mcpu=xiangshan-nanhu` in llvm-mca),
+// though issuing in order rather than out of it.
+Timing nanhu(Kind kind) {
+  switch (kind) {
+  case IntMul: return { CostModel::Mul, 3, 1 };
+  case IntDiv: return { CostModel::Div, 20, 20 };
+  case Load: return { CostModel::Lsu, 3, 1 };
+  case Store: return { CostModel::Lsu, 1, 1 };
+  case Branch: return { CostModel::Bru, 1, 1 };
+  case FpAdd: return { CostModel::Fpu, 3, 1 };
+  case FpMul: return { CostModel::Fpu, 3, 1 };
+  case FpDiv: return { CostModel::Fdiv, 12, 12 };
+  case FpCvt: return { CostModel::Fpu, 3, 1 };
+  case FpMove: return { CostModel::Fpu, 2, 1 };
+  case Pseudo: return { CostModel::Alu, 0, 0 };
+  default: return { CostModel::Alu, 1, 1 };
+  }
+}
+
+// A single-issue, five-stage pipeline with slow multi-cycle units.
+Timing scalar(Kind kind) {
+  switch (kind) {
+  case IntMul: return { CostModel::Mul, 4, 1 };
+  case IntDiv: return { CostModel::Div, 34, 34 };
+  case Load: return { CostModel::Lsu, 2, 1 };
+  case Store: return { CostModel::Lsu, 1, 1 };
+  case Branch: return { CostModel::Bru, 2, 1 };
+  case FpAdd: return { CostModel::Fpu, 4, 1 };
+  case FpMul: return { CostModel::Fpu, 4, 1 };
+  case FpDiv: return { CostModel::Fdiv, 20, 20 };
+  case FpCvt: return { CostModel::Fpu, 4, 1 };
+  case FpMove: return { CostModel::Fpu, 1, 1 };
+  case Pseudo: return { CostModel::Alu, 0, 0 };
+  default: return { CostModel::Alu, 1, 1 };
+  }
+}
+
+CostModel::Core selected = CostModel::Nanhu;
+
+}
+
+CostModel::CostModel(Core core): core(core) {
+  std::fill(units, units + UNIT_COUNT, 1);
+  if (core == Nanhu) {
+    width = 2;
+    units[Alu] = 2;
+    units[Lsu] = 2;
+    units[Fpu] = 2;
+  } else
+    width = 1;
+}
+
+CostModel &CostModel::get() {
+  static CostModel models[] = { CostModel(Nanhu), CostModel(Scalar) };
+  return models[selected];
+}
+
+bool CostModel::select(const std::string &name) {
+  if (name == "nanhu")
+    selected = Nanhu;
+  else if (name == "scalar")
+    selected = Scalar;
+  else
+    return false;
+  return true;
+}
+
+const char *CostModel::coreName() const {
+  return core == Nanhu ? "nanhu" : "scalar";
+}
+
+CostModel::Timing CostModel::timing(int opid) const {
+  auto kind = classify(opid);
+  return core == Nanhu ? nanhu(kind) : scalar(kind);
+}
+
+int CostModel::chain(std::initializer_list<int> opids) const {
+  int total = 0;
+  for (auto opid : opids)
+    total += latency(opid);
+  return total;
+}
+
+int CostModel::slots(Op *op) const {
+  if (classify(op->opid) == Pseudo)
+    return 0;
+
+  // `lui` + `addi` for anything past the 12-bit immediate, unless the low bits are zero.
+  if (isa<LiOp>(op)) {
+    int64_t v = V(op);
+    return (v < -2048 || v >= 2048) && (v & 0xfff) ? 2 : 1;
+  }
+  // `auipc` + `addi`.
+  if (isa<LaOp>(op))
+    return 2;
+  return 1;
+}
+
+int CostModel::blockCycles(BasicBlock *bb) const {
+  // When the result of an op, or the value in a register, becomes usable.
+  std::unordered_map<Op*, int> ready;
+  int regReady[(int) Reg::v31 + 1] = {};
+  // When each instance of each unit is free again.
+  std::vector<int> free[UNIT_COUNT];
+  for (int i = 0; i < UNIT_COUNT; i++)
+    free[i].resize(units[i]);
+
+  int cycle = 0, issued = 0, end = 0;
+  for (auto op : bb->getOps()) {
+    int n = slots(op);
+    if (!n)
+      continue;
+
+    auto t = timing(op->opid);
+    int at = cycle;
+    if (auto rs = op->find<RsAttr>())
+      at = std::max(at, regReady[(int) rs->reg]);
+    if (auto rs2 = op->find<Rs2Attr>())
+      at = std::max(at, regReady[(int) rs2->reg]);
+    for (auto operand : op->getOperands()) {
+      auto def = operand.defining;
+      if (ready.count(def))
+        at = std::max(at, ready[def]);
+    }
+
+    // Instructions issue in order, so nothing goes before `cycle`.
+    auto &instances = free[t.unit];
+    int k;
+    for (;;) {
+      if (at > cycle) {
+        cycle = at;
+        issued = 0;
+      }
+      k = std::min_element(instances.begin(), instances.end()) - instances.begin();
+      if (instances[k] > cycle) {
+        at = instances[k];
+        continue;
+      }
+      if (issued >= width) {
+        at = cycle + 1;
+        continue;
+      }
+      break;
+    }
+
+    // Multi-instruction ops issue back to back, each using the result of the previous one.
+    issued += n;
+    instances[k] = cycle + t.occupancy + n - 1;
+    int done = cycle + t.latency + n - 1;
+    ready[op] = done;
+    if (auto rd = op->find<RdAttr>())
+      regReady[(int) rd->reg] = done;
+    end = std::max(end, cycle + n);
+  }
+  return end;
+}
+
+std::map<BasicBlock*, long long> CostModel::blockWeights(FuncOp *func) const {
+  std::vector<BasicBlock*> bbs = func->getRegion()->getBlocks();
+  std::unordered_map<BasicBlock*, int> index;
+  for (int i = 0; i < bbs.size(); i++)
+    index[bbs[i]] = i;
+
+  // A jump back in the layout closes a loop over everything in between.
+  std::vector<int> depth(bbs.size());
+  for (int i = 0; i < bbs.size(); i++) {
+    if (!bbs[i]->getOpCount())
+      continue;
+
+    auto term = bbs[i]->getLastOp();
+    std::vector<BasicBlock*> targets;
+    if (auto target = term->find<TargetAttr>())
+      targets.push_back(target->bb);
+    if (auto ifnot = term->find<ElseAttr>())
+      targets.push_back(ifnot->bb);
+
+    for (auto target : targets) {
+      if (!index.count(target) || index[target] > i)
+        continue;
+      for (int j = index[target]; j <= i; j++)
+        depth[j]++;
+    }
+  }
+
+  std::map<BasicBlock*, long long> weights;
+  for (int i = 0; i < bbs.size(); i++) {
+    auto freq = frequency(bbs[i]);
+    if (freq >= 0) {
+      weights[bbs[i]] = freq;
+      continue;
+    }
+
+    long long weight = 1;
+    for (int d = 0; d < std::min(depth[i], 9); d++)
+      weight *= 10;
+    weights[bbs[i]] = weight;
+  }
+  return weights;
+}
@@ -0,0 +1,69 @@
+#ifndef RV_COST_MODEL_H
+#define RV_COST_MODEL_H
+
+#include "../codegen/Ops.h"
+#include <initializer_list>
+#include <iostream>
+#include <string>
+
+namespace sys::rv {
+
+// A static cycle estimate for `rv::` code, in place of llvm-mca (see mca.sh).
+//
+// The core is in-order: ops issue one after another, each waiting for its operands,
+// for a free slot in the issue group and for a free functional unit.
+// The latencies and occupancies come from a per-core table.
+class CostModel {
+public:
+  enum Core { Nanhu, Scalar };
+  enum Unit { Alu, Mul, Div, Lsu, Fpu, Fdiv, Bru, UNIT_COUNT };
+
+  struct Timing {
+    Unit unit;
+    // Cycles until the result can be used.
+    int latency;
+    // Cycles the unit stays busy; 1 if it's pipelined.
+    int occupancy;
+  };
+
+private:
+  Core core;
+  // Ops issued per cycle.
+  int width;
+  // Instances of each unit.
+  int units[UNIT_COUNT];
+
+  // Machine instructions `op` stands for, as Dump emits them.
+  int slots(Op *op) const;
+public:
+  CostModel(Core core);
+
+  // The core chosen with --rv-core; Nanhu unless told otherwise.
+  static CostModel &get();
+  // Returns false if there's no such core.
+  static bool select(const std::string &name);
+
+  const char *coreName() const;
+
+  // Also takes mid-level ops, costed as what they lower to.
+  Timing timing(int opid) const;
+  int latency(int opid) const { return timing(opid).latency; }
+  int latency(Op *op) const { return latency(op->opid); }
+
+  // Latency of running `opids` one after another, each using the result of the previous one.
+  int chain(std::initializer_list<int> opids) const;
+
+  // Cycles until the last op of `bb` issues.
+  // Works both before and after register allocation.
+  int blockCycles(BasicBlock *bb) const;
+
+  // How often each block of `func` is expected to run:
+  // the profile count if there is one, or 10^(loop depth) otherwise.
+  // Loops are found from the block layout, so this works on allocated code
+  // whose branches fall through.
+  std::map<BasicBlock*, long long> blockWeights(FuncOp *func) const;
+};
+
+}
+
+#endif
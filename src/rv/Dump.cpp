@@ -5,6 +5,7 @@
 #include "RvOps.h"
 #include "RvPasses.h"
 #include "RvAttrs.h"
+#include "CostModel.h"
 #include "../codegen/Attrs.h"
 
 using namespace sys;
@@ -40,6 +41,11 @@ void dumpOp(Op *op, std::ostream &os) {
     { "fmvdx", "fmv.d.x" },
     { "fmvxd", "fmv.x.d" },
     { "fmv", "fmv.s" },
+    { "vadd", "vadd.vv" },
+    { "vsub", "vsub.vv" },
+    { "vmul", "vmul.vv" },
+    { "vmvvx", "vmv.v.x" },
+    { "vmv", "vmv1r.v" },
   };
 
   // Skip the initial "rv."
@@ -115,6 +121,21 @@ void dumpOp(Op *op, std::ostream &os) {
     return;
   }
 
+  if (isa<VleOp>(op)) {
+    os << "vle32.v " << RD(op) << ", (" << RS(op) << ")\n";
+    return;
+  }
+
+  if (isa<VseOp>(op)) {
+    os << "vse32.v " << RS(op) << ", (" << RS2(op) << ")\n";
+    return;
+  }
+
+  if (isa<VsetivliOp>(op)) {
+    os << "vsetivli zero, 4, e32, m1, ta, ma\n";
+    return;
+  }
+
   std::stringstream ss;
   ss << name << " ";
   
@@ -223,9 +244,35 @@ void Dump::dump(std::ostream &os) {
   }
 }
 
+void Dump::report(std::ostream &os) {
+  auto &model = CostModel::get();
+  os << "cost report (" << model.coreName() << "):\n";
+
+  auto funcs = module->findAll<FuncOp>();
+  for (auto func : funcs) {
+    auto weights = model.blockWeights(cast<FuncOp>(func));
+    long long total = 0;
+
+    os << NAME(func) << ":\n";
+    for (auto bb : func->getRegion()->getBlocks()) {
+      int cycles = model.blockCycles(bb);
+      auto weight = weights[bb];
+      total += cycles * weight;
+
+      os << "  .Lbb" << getCount(bb) << " : " << cycles << " cycles x " << weight
+         << (frequency(bb) >= 0 ? " (profile)\n" : " (loop depth)\n");
+    }
+    os << "  total : " << total << " cycles\n";
+  }
+}
+
 void Dump::run() {
   if (out.size() != 0) {
     std::ofstream ofs(out);
     dump(ofs);
   } else dump(std::cout);
+
+  // After dumping, so that the block labels agree with the assembly.
+  if (costReport)
+    report(std::cerr);
 }
@@ -19,10 +19,10 @@ bool inRange(int x) {
   return x >= -2048 && x <= 2047;
 }
 
-void InstCombine::run() {
+void InstCombine::runImpl(Op *root) {
   Builder builder;
 
-  runRewriter([&](AddOp *op) {
+  runRewriter(root, [&](AddOp *op) {
     auto x = op->getOperand(0).defining;
     auto y = op->getOperand(1).defining;
     if (isa<LiOp>(x) && inRange(x)) {
@@ -40,7 +40,7 @@ void InstCombine::run() {
     return false;
   });
 
-  runRewriter([&](AddwOp *op) {
+  runRewriter(root, [&](AddwOp *op) {
     auto x = op->getOperand(0).defining;
     auto y = op->getOperand(1).defining;
     if (isa<LiOp>(x) && inRange(x)) {
@@ -58,7 +58,7 @@ void InstCombine::run() {
     return false;
   });
 
-  runRewriter([&](SubOp *op) {
+  runRewriter(root, [&](SubOp *op) {
     auto x = op->getOperand(0).defining;
     auto y = op->getOperand(1).defining;
     // Note we can't fold on `x`.
@@ -76,7 +76,7 @@ void InstCombine::run() {
     return false;
   });
 
-  runRewriter([&](SubwOp *op) {
+  runRewriter(root, [&](SubwOp *op) {
     auto x = op->getOperand(0).defining;
     auto y = op->getOperand(1).defining;
     // Note we can't fold on `x`.
@@ -94,7 +94,7 @@ void InstCombine::run() {
     return false;
   });
 
-  runRewriter([&](SllwOp *op) {
+  runRewriter(root, [&](SllwOp *op) {
     auto x = op->getOperand(0).defining;
     auto y = op->getOperand(1).defining;
 
@@ -111,7 +111,7 @@ void InstCombine::run() {
     return false;
   });
 
-  runRewriter([&](SrawOp *op) {
+  runRewriter(root, [&](SrawOp *op) {
     auto x = op->getOperand(0).defining;
     auto y = op->getOperand(1).defining;
 
@@ -128,7 +128,7 @@ void InstCombine::run() {
     return false;
   });
 
-  runRewriter([&](SraOp *op) {
+  runRewriter(root, [&](SraOp *op) {
     auto x = op->getOperand(0).defining;
     auto y = op->getOperand(1).defining;
 
@@ -145,7 +145,7 @@ void InstCombine::run() {
     return false;
   });
 
-  runRewriter([&](SllOp *op) {
+  runRewriter(root, [&](SllOp *op) {
     auto x = op->getOperand(0).defining;
     auto y = op->getOperand(1).defining;
 
@@ -162,7 +162,7 @@ void InstCombine::run() {
     return false;
   });
 
-  runRewriter([&](AndOp *op) {
+  runRewriter(root, [&](AndOp *op) {
     auto x = op->getOperand(0).defining;
     auto y = op->getOperand(1).defining;
     if (isa<LiOp>(x) && inRange(x)) {
@@ -180,7 +180,7 @@ void InstCombine::run() {
     return false;
   });
 
-  runRewriter([&](StoreOp *op) {
+  runRewriter(root, [&](StoreOp *op) {
     auto value = op->getOperand(0);
     auto addr = op->getOperand(1).defining;
     if (isa<AddiOp>(addr)) {
@@ -196,7 +196,7 @@ void InstCombine::run() {
     return false;
   });
 
-  runRewriter([&](LoadOp *op) {
+  runRewriter(root, [&](LoadOp *op) {
     auto addr = op->getOperand(0).defining;
     if (isa<AddiOp>(addr)) {
       auto offset = V(addr);
@@ -211,9 +211,13 @@ void InstCombine::run() {
     return false;
   });
 
-  RvDCE(module).run();
+  RvDCE dce(module);
+  if (auto func = dyn_cast<FuncOp>(root))
+    dce.runOnFunction(func);
+  else
+    dce.run();
 
-  runRewriter([&](AddiwOp *op) {
+  runRewriter(root, [&](AddiwOp *op) {
     if (V(op) == 0) {
       op->replaceAllUsesWith(op->getOperand().defining);
       op->erase();
@@ -225,7 +229,7 @@ void InstCombine::run() {
     // becomes
     //   %addr = add %1 %2
     //   %x    = load %def <V2 + V>
-    auto uses = op->getUses();
+    std::vector<Op*> uses = op->getUses();
     for (auto add : uses) {
       if (!isa<AddOp>(add))
         continue;
@@ -250,7 +254,7 @@ void InstCombine::run() {
     return false;
   });
 
-  runRewriter([&](AddiOp *op) {
+  runRewriter(root, [&](AddiOp *op) {
     if (V(op) == 0) {
       op->replaceAllUsesWith(op->getOperand().defining);
       op->erase();
@@ -262,7 +266,7 @@ void InstCombine::run() {
     // becomes
     //   %addr = add %1 %2
     //   %x    = load %def <V2 + V>
-    auto uses = op->getUses();
+    std::vector<Op*> uses = op->getUses();
     for (auto add : uses) {
       if (!isa<AddOp>(add))
         continue;
@@ -287,7 +291,7 @@ void InstCombine::run() {
     return false;
   });
 
-  runRewriter([&](PhiOp *op) {
+  runRewriter(root, [&](PhiOp *op) {
     // Remove phi with a single operand.
     if (op->getOperands().size() == 1) {
       auto def = op->getOperand().defining;
@@ -299,7 +303,7 @@ void InstCombine::run() {
   });
 
   // Replace (snez x) where x is always between 0 and 1.
-  runRewriter([&](SnezOp *op) {
+  runRewriter(root, [&](SnezOp *op) {
     auto def = op->DEF(0);
     if (isa<SltOp>(def) || isa<SltiOp>(def) || isa<SnezOp>(def) || isa<SeqzOp>(def)) {
       op->replaceAllUsesWith(def);
@@ -308,7 +312,7 @@ void InstCombine::run() {
     return false;
   });
 
-  runRewriter([&](BeqOp *op) {
+  runRewriter(root, [&](BeqOp *op) {
     auto def = op->DEF(0);
     auto zero = op->DEF(1);
     // Replace `beq (seqz x), zero` with `bne x, zero`.
@@ -324,7 +328,7 @@ void InstCombine::run() {
     return false;
   });
   
-  runRewriter([&](BneOp *op) {
+  runRewriter(root, [&](BneOp *op) {
     auto def = op->DEF(0);
     auto zero = op->DEF(1);
     // Replace `bne (seqz x), zero` with `beq x, zero`.
@@ -342,10 +346,14 @@ void InstCombine::run() {
   
   // Only run this after all int-related fold completes.
   // Rewrite `li a0, 0` into reading from `zero`.
-  runRewriter([&](LiOp *op) {
+  runRewriter(root, [&](LiOp *op) {
     if (V(op) == 0)
       builder.replace<ReadRegOp>(op, Value::i32, { new RegAttr(Reg::zero)} );
     
     return false;
   });
 }
+
+void InstCombine::run() {
+  runImpl(module);
+}
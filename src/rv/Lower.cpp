@@ -7,6 +7,16 @@
 using namespace sys::rv;
 using namespace sys;
 
+// The alignment an alloca of `size` bytes wants. Arrays that can be accessed
+// 16 bytes at a time are worth keeping 16-aligned.
+static size_t alignOf(size_t size) {
+  if (size % 16 == 0)
+    return 16;
+  if (size % 8 == 0)
+    return 8;
+  return 4;
+}
+
 // Combines all alloca's into a SubSpOp.
 // Also rewrites load/stores with sp-offset.
 static void rewriteAlloca(FuncOp *func) {
@@ -28,6 +38,11 @@ static void rewriteAlloca(FuncOp *func) {
     allocas.push_back(cast<AllocaOp>(op));
   }
 
+  // `sp` is 16-aligned. Laying out by decreasing alignment needs no padding in between.
+  std::stable_sort(allocas.begin(), allocas.end(), [](Op *a, Op *b) {
+    return alignOf(SIZE(a)) > alignOf(SIZE(b));
+  });
+
   for (auto op : allocas) {
     // Translate itself into `sp + offset`.
     builder.setBeforeOp(op);
@@ -44,6 +59,143 @@ static void rewriteAlloca(FuncOp *func) {
   func->add<StackOffsetAttr>(total);
 }
 
+static bool usesVectors(Op *op) {
+  if (isa<PhiOp>(op))
+    return false;
+  if (op->getResultType() == Value::i128)
+    return true;
+  for (auto operand : op->getOperands()) {
+    if (operand.defining->getResultType() == Value::i128)
+      return true;
+  }
+  return false;
+}
+
+// Phi's of vectors become `vmv` right before the terminators of their predecessors.
+static bool feedsVectorPhi(BasicBlock *bb) {
+  for (auto succ : bb->succs) {
+    for (auto phi : succ->getPhis()) {
+      if (phi->getResultType() == Value::i128)
+        return true;
+    }
+  }
+  return false;
+}
+
+// Whether `vl` and `vtype` must be set before `op`.
+static bool needsConfig(Op *op) {
+  return usesVectors(op) || (op == op->getParent()->getLastOp() && feedsVectorPhi(op->getParent()));
+}
+
+// Vector ops only ever work on 4 x i32, so `vl` and `vtype` never change once set.
+// They're set lazily before the first vector op on each path. Calls don't preserve them,
+// so that also applies after each call; loop headers get them from their preheaders instead.
+static void configureVectors(FuncOp *func) {
+  Builder builder;
+
+  auto region = func->getRegion();
+  bool used = false;
+  for (auto bb : region->getBlocks()) {
+    for (auto op : bb->getOps()) {
+      if (op->getResultType() == Value::i128)
+        used = true;
+    }
+  }
+  if (!used)
+    return;
+
+  region->updateDoms();
+  auto entry = region->getFirstBlock();
+
+  // Whether `vl` and `vtype` are set at the end of each block, on every path there.
+  // Starts optimistic and only ever goes from true to false.
+  std::unordered_map<BasicBlock*, bool> configuredOut;
+  auto configuredIn = [&](BasicBlock *bb) {
+    if (bb == entry || bb->preds.empty())
+      return false;
+    for (auto pred : bb->preds) {
+      if (!configuredOut[pred])
+        return false;
+    }
+    return true;
+  };
+
+  // Whether `bb` needs `vl` and `vtype` before it reaches a call.
+  auto needsOnEntry = [&](BasicBlock *bb) {
+    for (auto op : bb->getOps()) {
+      if (isa<sys::rv::CallOp>(op))
+        return false;
+      if (needsConfig(op))
+        return true;
+    }
+    return false;
+  };
+
+  bool hoisted;
+  do {
+    for (auto bb : region->getBlocks())
+      configuredOut[bb] = true;
+
+    bool changed;
+    do {
+      changed = false;
+      for (auto bb : region->getBlocks()) {
+        bool configured = configuredIn(bb);
+        for (auto op : bb->getOps()) {
+          if (isa<sys::rv::CallOp>(op))
+            configured = false;
+          if (isa<VsetivliOp>(op) || needsConfig(op))
+            configured = true;
+        }
+        if (configured != configuredOut[bb]) {
+          configuredOut[bb] = configured;
+          changed = true;
+        }
+      }
+    } while (changed);
+
+    // A loop header that needs them only because of the way in gets them before it.
+    hoisted = false;
+    for (auto bb : region->getBlocks()) {
+      if (configuredIn(bb) || !needsOnEntry(bb))
+        continue;
+
+      bool loop = false, backedges = true;
+      for (auto pred : bb->preds) {
+        if (!bb->dominates(pred))
+          continue;
+        loop = true;
+        backedges &= configuredOut[pred];
+      }
+      if (!loop || !backedges)
+        continue;
+
+      for (auto pred : bb->preds) {
+        if (configuredOut[pred])
+          continue;
+        builder.setBeforeOp(pred->getLastOp());
+        builder.create<VsetivliOp>();
+        hoisted = true;
+      }
+    }
+  } while (hoisted);
+
+  for (auto bb : region->getBlocks()) {
+    bool configured = configuredIn(bb);
+    for (auto op : bb->getOps()) {
+      if (isa<sys::rv::CallOp>(op))
+        configured = false;
+      if (isa<VsetivliOp>(op))
+        configured = true;
+      if (!configured && needsConfig(op)) {
+        builder.setBeforeOp(op);
+        builder.create<VsetivliOp>();
+        configured = true;
+      }
+    }
+  }
+}
+
 #define REPLACE(BeforeTy, AfterTy) \
   runRewriter([&](BeforeTy *op) { \
     builder.replace<AfterTy>(op, op->getOperands(), op->getAttrs()); \
@@ -151,6 +303,27 @@ void Lower::run() {
   REPLACE(LeFOp, FleOp);
   REPLACE(F2IOp, FcvtwsRtzOp);
   REPLACE(I2FOp, FcvtswOp);
+
+  // Vectors, from Vectorize (with --rvv).
+  REPLACE(AddVOp, VaddOp);
+  REPLACE(SubVOp, VsubOp);
+  REPLACE(MulVOp, VmulOp);
+  REPLACE(BroadcastOp, VmvvxOp);
+
+  // `vle32.v` and `vse32.v` have no offset.
+  runRewriter([&](sys::LoadOp *op) {
+    if (op->getResultType() != Value::i128 || SIZE(op) != 16)
+      return false;
+    builder.replace<VleOp>(op, op->getOperands());
+    return true;
+  });
+
+  runRewriter([&](sys::StoreOp *op) {
+    if (op->DEF(0)->getResultType() != Value::i128 || SIZE(op) != 16)
+      return false;
+    builder.replace<VseOp>(op, op->getOperands());
+    return true;
+  });
   
   runRewriter([&](FloatOp *op) {
     float value = F(op);
@@ -390,6 +563,8 @@ void Lower::run() {
   });
 
   auto funcs = collectFuncs();
-  for (auto func : funcs)
+  for (auto func : funcs) {
     rewriteAlloca(func);
+    configureVectors(func);
+  }
 }
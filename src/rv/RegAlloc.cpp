@@ -1,5 +1,8 @@
 #include "RvPasses.h"
 #include "Regs.h"
+#include "Coalescer.h"
+#include "CostModel.h"
+#include "../utils/LinearScan.h"
 #include <unordered_set>
 
 using namespace sys;
@@ -7,40 +10,44 @@ using namespace sys::rv;
 
 namespace {
 
+std::string suffix(RegClass cls) {
+  return cls == FPClass ? "f" : cls == VecClass ? "v" : "";
+}
+
 class SpilledRdAttr : public AttrImpl<SpilledRdAttr, RVLINE + 2097152> {
 public:
-  bool fp;
+  RegClass cls;
   int offset;
   Op *ref;
 
-  SpilledRdAttr(bool fp, int offset, Op *ref): fp(fp), offset(offset), ref(ref) {}
+  SpilledRdAttr(RegClass cls, int offset, Op *ref): cls(cls), offset(offset), ref(ref) {}
 
-  std::string toString() override { return "<rd-spilled = " + std::to_string(offset) + (fp ? "f" : "") + ">"; }
-  SpilledRdAttr *clone() override { return new SpilledRdAttr(fp, offset, ref); }
+  std::string toString() override { return "<rd-spilled = " + std::to_string(offset) + suffix(cls) + ">"; }
+  SpilledRdAttr *clone() override { return new SpilledRdAttr(cls, offset, ref); }
 };
 
 class SpilledRsAttr : public AttrImpl<SpilledRsAttr, RVLINE + 2097152> {
 public:
-  bool fp;
+  RegClass cls;
   int offset;
   Op *ref;
 
-  SpilledRsAttr(bool fp, int offset, Op *ref): fp(fp), offset(offset), ref(ref) {}
+  SpilledRsAttr(RegClass cls, int offset, Op *ref): cls(cls), offset(offset), ref(ref) {}
 
-  std::string toString() override { return "<rs-spilled = " + std::to_string(offset) + (fp ? "f" : "") + ">"; }
-  SpilledRsAttr *clone() override { return new SpilledRsAttr(fp, offset, ref); }
+  std::string toString() override { return "<rs-spilled = " + std::to_string(offset) + suffix(cls) + ">"; }
+  SpilledRsAttr *clone() override { return new SpilledRsAttr(cls, offset, ref); }
 };
 
 class SpilledRs2Attr : public AttrImpl<SpilledRs2Attr, RVLINE + 2097152> {
 public:
-  bool fp;
+  RegClass cls;
   int offset;
   Op *ref;
 
-  SpilledRs2Attr(bool fp, int offset, Op *ref): fp(fp), offset(offset), ref(ref) {}
+  SpilledRs2Attr(RegClass cls, int offset, Op *ref): cls(cls), offset(offset), ref(ref) {}
 
-  std::string toString() override { return "<rs2-spilled = " + std::to_string(offset) + + (fp ? "f" : "") + ">"; }
-  SpilledRs2Attr *clone() override { return new SpilledRs2Attr(fp, offset, ref); }
+  std::string toString() override { return "<rs2-spilled = " + std::to_string(offset) + suffix(cls) + ">"; }
+  SpilledRs2Attr *clone() override { return new SpilledRs2Attr(cls, offset, ref); }
 };
 
 }
@@ -49,6 +56,8 @@ std::map<std::string, int> RegAlloc::stats() {
   return {
     { "spilled", spilled },
     { "peepholed", convertedTotal },
+    { "coalesced", coalescedTotal },
+    { "rematerialized", rematerialized },
   };
 }
 
@@ -72,7 +81,7 @@ std::map<std::string, int> RegAlloc::stats() {
     op->add<Spilled##AttrTy> GET_SPILLED_ARGS(v##Index);
 
 #define GET_SPILLED_ARGS(op) \
-  (fpreg(op->getResultType()), spillOffset[op], op)
+  (regclass(op->getResultType()), spillOffset[op], op)
 
 #define BINARY ADD_ATTR(0, RsAttr) ADD_ATTR(1, Rs2Attr)
 #define UNARY ADD_ATTR(0, RsAttr)
@@ -113,6 +122,263 @@ struct Event {
   Op *op;
 };
 
+// Physical registers as a bit mask. There are 96 of them, counting the vector ones.
+using RegSet = unsigned __int128;
+
+static RegSet bit(Reg reg) {
+  return (RegSet) 1 << (int) reg;
+}
+
+// The registers `op` reads or writes.
+static RegSet regsOf(Op *op) {
+  RegSet regs = 0;
+  if (op->has<RdAttr>())
+    regs |= bit(RD(op));
+  if (op->has<RsAttr>())
+    regs |= bit(RS(op));
+  if (op->has<Rs2Attr>())
+    regs |= bit(RS2(op));
+  return regs;
+}
+
+// Finds the registers that still hold something after each op, once the region is in registers.
+// Spilled operands and results aren't in any register, so they don't count.
+static std::unordered_map<Op*, RegSet> liveAfter(Region *region) {
+  RegSet clobbered = 0, args = 0;
+  for (auto reg : callerSaved)
+    clobbered |= bit(reg);
+  for (auto reg : vecRegs)
+    clobbered |= bit(reg);
+  for (int i = 0; i < 8; i++)
+    args |= bit(argRegs[i]) | bit(fargRegs[i]);
+
+  // A call reads the argument registers written since the previous one.
+  std::unordered_map<Op*, RegSet> callArgs;
+  for (auto bb : region->getBlocks()) {
+    RegSet written = 0;
+    for (auto op : bb->getOps()) {
+      if (isa<rv::CallOp>(op)) {
+        callArgs[op] = written;
+        written = 0;
+      } else if (op->has<RdAttr>())
+        written |= bit(RD(op)) & args;
+    }
+  }
+
+  const auto step = [&](Op *op, RegSet live) {
+    if (isa<rv::CallOp>(op))
+      return (live & ~clobbered) | callArgs[op];
+    if (isa<rv::RetOp>(op))
+      return live | bit(Reg::a0) | bit(Reg::fa0);
+    if (op->has<RdAttr>())
+      live &= ~bit(RD(op));
+    if (op->has<RsAttr>())
+      live |= bit(RS(op));
+    if (op->has<Rs2Attr>())
+      live |= bit(RS2(op));
+    return live;
+  };
+
+  region->updatePreds();
+  const auto &bbs = region->getBlocks();
+  std::unordered_map<BasicBlock*, RegSet> liveIn;
+  bool changed;
+  do {
+    changed = false;
+    for (auto it = bbs.rbegin(); it != bbs.rend(); it++) {
+      auto bb = *it;
+      RegSet live = 0;
+      for (auto succ : bb->succs)
+        live |= liveIn[succ];
+      for (auto op = bb->getLastOp(); op; op = op->prevOp())
+        live = step(op, live);
+
+      if (live != liveIn[bb]) {
+        liveIn[bb] = live;
+        changed = true;
+      }
+    }
+  } while (changed);
+
+  std::unordered_map<Op*, RegSet> result;
+  for (auto bb : bbs) {
+    RegSet live = 0;
+    for (auto succ : bb->succs)
+      live |= liveIn[succ];
+    for (auto op = bb->getLastOp(); op; op = op->prevOp()) {
+      result[op] = live;
+      live = step(op, live);
+    }
+  }
+  return result;
+}
+
+// Finds the values that are `sp` plus a constant, i.e. the addresses of locals,
+// along with that constant. Only those outside of the call sequences, where `sp` is moved, count.
+static std::unordered_map<Op*, int> frameAddresses(Region *region) {
+  std::unordered_map<Op*, int> result;
+  for (auto bb : region->getBlocks()) {
+    int delta = 0;
+    for (auto op : bb->getOps()) {
+      if (isa<SubSpOp>(op))
+        delta += V(op);
+      if (delta)
+        continue;
+
+      if (isa<ReadRegOp>(op) && REG(op) == Reg::sp)
+        result[op] = 0;
+      if (isa<AddiOp>(op) && result.count(op->DEF(0)))
+        result[op] = result[op->DEF(0)] + V(op);
+      if (isa<AddOp>(op) && result.count(op->DEF(0)) && isa<LiOp>(op->DEF(1)))
+        result[op] = result[op->DEF(0)] + V(op->DEF(1));
+    }
+  }
+  return result;
+}
+
+// Colors `ops` with a Coalescer for each register class, in place of the greedy loop.
+// Returns the number of moves coalesced away; values that didn't get a register
+// end up in `spilled`, grouped by the register they would have shared.
+static int colorCoalescing(Op *funcOp, const std::vector<Op*> &ops,
+                           std::unordered_map<Op*, std::set<Op*>> &interf,
+                           std::map<Op*, Reg> &assignment,
+                           const Reg *order, int regcount, const Reg *orderf, int regcountf,
+                           std::vector<std::vector<Op*>> &spilled) {
+  Coalescer ints(order, regcount), fps(orderf, regcountf), vecs(vecRegs, regcountv);
+  auto of = [&](Op *op) -> Coalescer& {
+    switch (regclass(op->getResultType())) {
+    case FPClass: return fps;
+    case VecClass: return vecs;
+    default: return ints;
+    }
+  };
+
+  // Each def and use costs as much as its block runs; see CostModel::blockWeights().
+  auto weights = CostModel::get().blockWeights(cast<FuncOp>(funcOp));
+  std::unordered_map<Op*, long long> cost;
+  for (const auto &[bb, weight] : weights) {
+    for (auto op : bb->getOps()) {
+      cost[op] += weight;
+      for (auto v : op->getOperands())
+        cost[v.defining] += weight;
+    }
+  }
+
+  auto frame = frameAddresses(funcOp->getRegion());
+
+  // Go in program order, so that the result doesn't depend on pointer values.
+  std::unordered_set<Op*> candidates(ops.begin(), ops.end());
+  std::vector<Op*> nodes;
+  for (auto bb : funcOp->getRegion()->getBlocks()) {
+    for (auto op : bb->getOps()) {
+      if (!candidates.count(op) || assignment.count(op) || !hasRd(op))
+        continue;
+
+      // In the whole function, `sp` and `zero` are read-only.
+      if (isa<ReadRegOp>(op) && (REG(op) == Reg::sp || REG(op) == Reg::zero)) {
+        assignment[op] = REG(op);
+        continue;
+      }
+
+      // Spilled constants and addresses are rematerialized rather than reloaded.
+      auto c = cost[op];
+      if (isa<LiOp>(op) || isa<LaOp>(op) || frame.count(op))
+        c /= 4;
+      of(op).add(op, c);
+      nodes.push_back(op);
+    }
+  }
+
+  for (auto op : nodes) {
+    for (auto v : interf[op]) {
+      if (!assignment.count(v)) {
+        of(op).interfere(op, v);
+        continue;
+      }
+      auto reg = assignment[v];
+      if (reg != Reg::sp && reg != Reg::zero)
+        of(op).forbid(op, reg);
+    }
+  }
+
+  for (auto bb : funcOp->getRegion()->getBlocks()) {
+    auto weight = weights[bb];
+    for (auto op : bb->getOps()) {
+      if (isa<PhiOp>(op)) {
+        const auto &operands = op->getOperands();
+        const auto &attrs = op->getAttrs();
+        for (size_t i = 0; i < operands.size(); i++)
+          of(op).move(op, operands[i].defining, weights[FROM(attrs[i])]);
+      }
+      if (isa<ReadRegOp>(op))
+        of(op).move(op, REG(op), weight);
+      if (isa<WriteRegOp>(op))
+        of(op->DEF(0)).move(op->DEF(0), REG(op), weight);
+    }
+  }
+
+  int coalesced = 0;
+  for (auto coalescer : { &ints, &fps, &vecs }) {
+    coalescer->run();
+    coalesced += coalescer->coalesced;
+    for (auto [op, reg] : coalescer->assignment)
+      assignment[op] = reg;
+    for (const auto &group : coalescer->spilled)
+      spilled.push_back(group);
+  }
+  return coalesced;
+}
+
+// Allocates every value of the region by linear scan, for --fast-regalloc.
+// Values that didn't get a register end up in `slots`, numbered from 0.
+static int colorLinear(Region *region, std::map<Op*, Reg> &assignment,
+                       const Reg *order, int regcount, const Reg *orderf, int regcountf,
+                       std::unordered_map<Op*, int> &slots) {
+  // Indexed by RegClass.
+  std::vector<std::vector<int>> orders(3);
+  for (int i = 0; i < regcount; i++)
+    orders[IntClass].push_back((int) order[i]);
+  for (int i = 0; i < regcountf; i++)
+    orders[FPClass].push_back((int) orderf[i]);
+  for (int i = 0; i < regcountv; i++)
+    orders[VecClass].push_back((int) vecRegs[i]);
+
+  LinearScan scan(orders);
+  for (auto [op, reg] : assignment)
+    scan.fix(op, (int) reg);
+
+  for (auto bb : region->getBlocks()) {
+    for (auto op : bb->getOps()) {
+      if (assignment.count(op) || !hasRd(op))
+        continue;
+
+      // In the whole function, `sp` and `zero` are read-only.
+      if (isa<ReadRegOp>(op) && (REG(op) == Reg::sp || REG(op) == Reg::zero)) {
+        assignment[op] = REG(op);
+        continue;
+      }
+
+      scan.add(op, regclass(op->getResultType()));
+      if (isa<ReadRegOp>(op))
+        scan.hint(op, (int) REG(op));
+      if (isa<PhiOp>(op)) {
+        for (auto v : op->getOperands())
+          scan.tie(op, v.defining);
+      }
+      for (auto use : op->getUses()) {
+        if (isa<WriteRegOp>(use))
+          scan.hint(op, (int) REG(use));
+      }
+    }
+  }
+
+  scan.run(region);
+  for (auto [op, reg] : scan.assignment)
+    assignment[op] = (Reg) reg;
+  slots = scan.slot;
+  return scan.slotCount;
+}
+
 void RegAlloc::runImpl(Region *region, bool isLeaf) {
   const Reg *order = isLeaf ? leafOrder : normalOrder;
   const Reg *orderf = isLeaf ? leafOrderf : normalOrderf;
@@ -125,8 +391,17 @@ void RegAlloc::runImpl(Region *region, bool isLeaf) {
 
   auto funcOp = region->getParent();
 
+  bool hasVectors = false;
+  for (auto bb : region->getBlocks()) {
+    for (auto op : bb->getOps()) {
+      if (vecreg(op->getResultType()))
+        hasVectors = true;
+    }
+  }
+
   // First of all, add 35 precolored placeholders before each call.
   // This denotes that a CallOp clobbers those registers.
+  // Vector registers are clobbered as well, but only matter when there are vectors at all.
   runRewriter(funcOp, [&](CallOp *op) {
     // Make sure arguments don't conflict.
     std::vector<Op*> writes;
@@ -154,6 +429,11 @@ void RegAlloc::runImpl(Region *region, bool isLeaf) {
       if (isFP(reg))
         placeholder->setResultType(Value::f32);
     }
+    for (int i = 0; hasVectors && i < vecRegCnt; i++) {
+      auto placeholder = builder.create<PlaceHolderOp>();
+      assignment[placeholder] = vecRegs[i];
+      placeholder->setResultType(Value::i128);
+    }
 
     return false;
   });
@@ -222,6 +502,13 @@ void RegAlloc::runImpl(Region *region, bool isLeaf) {
   // Maps a phi to its operands.
   std::unordered_map<Op*, std::vector<Op*>> phiOperand;
 
+  // Constants, global addresses and addresses of locals are recomputed at each use if spilled,
+  // rather than stored and reloaded. The cheapest of them are the first to give up their registers.
+  auto frameAddr = frameAddresses(region);
+  const auto rematerializable = [&](Op *op) {
+    return isa<LiOp>(op) || isa<LaOp>(op) || frameAddr.count(op);
+  };
+
   int currentPriority = 2;
   for (auto bb : region->getBlocks()) {
     // Scan through the block and see the place where the value's last used.
@@ -249,8 +536,11 @@ void RegAlloc::runImpl(Region *region, bool isLeaf) {
       if (isa<ReadRegOp>(op))
         priority[op] = 1;
       
+      // Those that take a single instruction to rematerialize.
       if (isa<LiOp>(op) && (V(op) <= 2047 && V(op) >= -2048))
         priority[op] = -2;
+      if (isa<AddiOp>(op) && frameAddr.count(op) && frameAddr[op] < 2048)
+        priority[op] = -2;
 
       if (isa<PhiOp>(op)) {
         priority[op] = currentPriority + 1;
@@ -268,6 +558,10 @@ void RegAlloc::runImpl(Region *region, bool isLeaf) {
     for (auto op : bb->getLiveOut())
       lastUsed[op] = ops.size();
 
+    // LinearScan works out intervals of its own, and never needs the graph.
+    if (mode == Linear)
+      continue;
+
     // We use event-driven approach to optimize it into O(n log n + E).
     std::vector<Event> events;
     for (auto [op, v] : lastUsed) {
@@ -294,10 +588,10 @@ void RegAlloc::runImpl(Region *region, bool isLeaf) {
 
       if (event.start) {
         for (Op* activeOp : active) {
-          // FP and int are using different registers.
+          // FP, int and vectors are using different registers.
           // However, they are using the same stack,
           // so that must be taken into account when spilling.
-          if (fpreg(activeOp->getResultType()) ^ fpreg(op->getResultType())) {
+          if (regclass(activeOp->getResultType()) != regclass(op->getResultType())) {
             spillInterf[op].insert(activeOp);
             spillInterf[activeOp].insert(op);
             continue;
@@ -320,141 +614,208 @@ void RegAlloc::runImpl(Region *region, bool isLeaf) {
   for (auto [k, v] : priority)
     ops.push_back(k);
 
-  // Sort by **descending** degree.
-  std::sort(ops.begin(), ops.end(), [&](Op *a, Op *b) {
-    auto pa = priority[a];
-    auto pb = priority[b];
-    return pa == pb ? interf[a].size() > interf[b].size() : pa > pb;
-  });
-
   std::unordered_map<Op*, int> spillOffset;
-  int currentOffset = STACKOFF(funcOp);
+  // Spill slots are 8 bytes; keep them aligned after the locals.
+  int currentOffset = (STACKOFF(funcOp) + 7) / 8 * 8;
   int highest = 0;
 
-  for (auto op : ops) {
-    // Do not allocate colored instructions.
-    if (assignment.count(op))
-      continue;
-
-    std::unordered_set<Reg> bad, unpreferred;
+  // Gives `group`, which shares a register, a stack slot instead.
+  auto spill = [&](const std::vector<Op*> &group) {
+    spilled += group.size();
+    // Try to see all spill offsets of conflicting ops.
+    int desired = currentOffset;
+    std::unordered_set<int> conflict;
 
-    for (auto v : interf[op]) {
-      // In the whole function, `sp` and `zero` are read-only.
-      if (assignment.count(v) && assignment[v] != Reg::sp && assignment[v] != Reg::zero)
-        bad.insert(assignment[v]);
-    }
+    // Consider both `interf` (of the same register type)
+    // and `spillInterf` (of different register type).
+    for (auto op : group) {
+      for (auto v : interf[op]) {
+        if (!spillOffset.count(v))
+          continue;
 
-    if (isa<PhiOp>(op)) {
-      // Dislike everything that might interfere with phi's operands.
-      const auto &operands = phiOperand[op];
-      for (auto x : operands) {
-        for (auto v : interf[x]) {
-          if (assignment.count(v) && assignment[v] != Reg::sp && assignment[v] != Reg::zero)
-            unpreferred.insert(assignment[v]);
-        }
+        conflict.insert(spillOffset[v]);
       }
-    }
+      for (auto v : spillInterf[op]) {
+        if (!spillOffset.count(v))
+          continue;
 
-    if (prefer.count(op)) {
-      auto ref = prefer[op];
-      // Try to allocate the same register as `ref`.
-      if (assignment.count(ref) && !bad.count(assignment[ref])) {
-        assignment[op] = assignment[ref];
-        continue;
+        conflict.insert(spillOffset[v]);
       }
     }
 
-    // See if there's any preferred registers.
-    int preferred = -1;
-    for (auto use : op->getUses()) {
-      if (isa<WriteRegOp>(use)) {
-        auto reg = REG(use);
-        if (!bad.count(reg)) {
-          preferred = (int) reg;
-          break;
+    // Try find a space.
+    while (conflict.count(desired))
+      desired += 8;
+
+    for (auto op : group)
+      spillOffset[op] = desired;
+
+    // Update `highest`, which will indicate the size allocated.
+    if (desired > highest)
+      highest = desired;
+  };
+
+  // Spill code needs scratch registers, which are taken wherever something is free (see below).
+  // So that something always is, a function that spills at all gives up the last two registers
+  // of each class to that, and is colored once more.
+  const auto precolored = assignment;
+  int spilledBefore = spilled, coalescedBefore = coalescedTotal;
+  RegSet scratch = 0;
+  for (int reserved = 0; ; reserved = 2) {
+    int intCnt = regcount - reserved, fpCnt = regcountf - reserved;
+
+    if (mode == Linear) {
+      std::unordered_map<Op*, int> slots;
+      int count = colorLinear(region, assignment, order, intCnt, orderf, fpCnt, slots);
+      for (auto [op, slot] : slots)
+        spillOffset[op] = currentOffset + slot * 8;
+      if (count)
+        highest = currentOffset + (count - 1) * 8;
+      spilled += slots.size();
+    } else if (mode == Coalescing) {
+      std::vector<std::vector<Op*>> groups;
+      coalescedTotal += colorCoalescing(funcOp, ops, interf, assignment, order, intCnt, orderf, fpCnt, groups);
+      for (const auto &group : groups)
+        spill(group);
+    } else {
+      // With a profile, values that are defined or used more often are more costly to spill,
+      // so they're allocated first. Without one, every cost is zero.
+      std::unordered_map<Op*, long long> cost;
+      for (auto bb : region->getBlocks()) {
+        auto freq = frequency(bb);
+        if (freq <= 0)
+          continue;
+
+        for (auto op : bb->getOps()) {
+          cost[op] += freq;
+          for (auto v : op->getOperands())
+            cost[v.defining] += freq;
         }
       }
-    }
-    if (isa<ReadRegOp>(op)) {
-      auto reg = REG(op);
-      if (!bad.count(reg))
-        preferred = (int) reg;
-    }
 
-    if (preferred != -1) {
-      assignment[op] = (Reg) preferred;
-      continue;
-    }
+      // Sort by **descending** spill cost, then degree.
+      std::sort(ops.begin(), ops.end(), [&](Op *a, Op *b) {
+        auto pa = priority[a];
+        auto pb = priority[b];
+        if (pa != pb)
+          return pa > pb;
+        if (cost[a] != cost[b])
+          return cost[a] > cost[b];
+        return interf[a].size() > interf[b].size();
+      });
+
+      for (auto op : ops) {
+        // Do not allocate colored instructions.
+        if (assignment.count(op))
+          continue;
 
-    auto rcnt = !fpreg(op->getResultType()) ? regcount : regcountf;
-    auto rorder = !fpreg(op->getResultType()) ? order : orderf;
+        std::unordered_set<Reg> bad, unpreferred;
 
-    for (int i = 0; i < rcnt; i++) {
-      if (!bad.count(rorder[i]) && !unpreferred.count(rorder[i])) {
-        assignment[op] = rorder[i];
-        break;
-      }
-    }
+        for (auto v : interf[op]) {
+          // In the whole function, `sp` and `zero` are read-only.
+          if (assignment.count(v) && assignment[v] != Reg::sp && assignment[v] != Reg::zero)
+            bad.insert(assignment[v]);
+        }
 
-    // We have excluded too much. Try it again.
-    if (!assignment.count(op) && unpreferred.size()) {
-      for (int i = 0; i < rcnt; i++) {
-        if (!bad.count(rorder[i])) {
-          assignment[op] = rorder[i];
-          break;
+        if (isa<PhiOp>(op)) {
+          // Dislike everything that might interfere with phi's operands.
+          const auto &operands = phiOperand[op];
+          for (auto x : operands) {
+            for (auto v : interf[x]) {
+              if (assignment.count(v) && assignment[v] != Reg::sp && assignment[v] != Reg::zero)
+                unpreferred.insert(assignment[v]);
+            }
+          }
         }
-      }
-    }
 
-    if (assignment.count(op))
-      continue;
+        if (prefer.count(op)) {
+          auto ref = prefer[op];
+          // Try to allocate the same register as `ref`.
+          if (assignment.count(ref) && !bad.count(assignment[ref])) {
+            assignment[op] = assignment[ref];
+            continue;
+          }
+        }
 
-    spilled++;
-    // Spilled. Try to see all spill offsets of conflicting ops.
-    int desired = currentOffset;
-    std::unordered_set<int> conflict;
+        // See if there's any preferred registers.
+        int preferred = -1;
+        for (auto use : op->getUses()) {
+          if (isa<WriteRegOp>(use)) {
+            auto reg = REG(use);
+            if (!bad.count(reg)) {
+              preferred = (int) reg;
+              break;
+            }
+          }
+        }
+        if (isa<ReadRegOp>(op)) {
+          auto reg = REG(op);
+          if (!bad.count(reg))
+            preferred = (int) reg;
+        }
 
-    // Consider both `interf` (of the same register type)
-    // and `spillInterf` (of different register type).
-    for (auto v : interf[op]) {
-      if (!spillOffset.count(v))
-        continue;
+        if (preferred != -1) {
+          assignment[op] = (Reg) preferred;
+          continue;
+        }
 
-      conflict.insert(spillOffset[v]);
-    }
-    for (auto v : spillInterf[op]) {
-      if (!spillOffset.count(v))
-        continue;
+        auto cls = regclass(op->getResultType());
+        auto rcnt = cls == IntClass ? intCnt : cls == FPClass ? fpCnt : regcountv;
+        auto rorder = cls == IntClass ? order : cls == FPClass ? orderf : vecRegs;
 
-      conflict.insert(spillOffset[v]);
-    }
+        for (int i = 0; i < rcnt; i++) {
+          if (!bad.count(rorder[i]) && !unpreferred.count(rorder[i])) {
+            assignment[op] = rorder[i];
+            break;
+          }
+        }
 
-    // Try find a space.
-    while (conflict.count(desired))
-      desired += 8;
+        // We have excluded too much. Try it again.
+        if (!assignment.count(op) && unpreferred.size()) {
+          for (int i = 0; i < rcnt; i++) {
+            if (!bad.count(rorder[i])) {
+              assignment[op] = rorder[i];
+              break;
+            }
+          }
+        }
 
-    spillOffset[op] = desired;
+        if (assignment.count(op))
+          continue;
 
-    // Update `highest`, which will indicate the size allocated.
-    if (desired > highest)
-      highest = desired;
-  }
+        spill({ op });
+      }
+    }
 
-  // Only a single register is spilled. Let's use s10.
-  if (highest == currentOffset) {
-    for (auto [op, _] : spillOffset)
-      assignment[op] = fpreg(op->getResultType()) ? fspillReg : spillReg;
+    if (spillOffset.empty() || reserved)
+      break;
+
+    for (int i = 1; i <= 2; i++)
+      scratch |= bit(order[regcount - i]) | bit(orderf[regcountf - i]);
+
+    assignment = precolored;
     spillOffset.clear();
+    highest = 0;
+    spilled = spilledBefore;
+    coalescedTotal = coalescedBefore;
   }
 
-  // Only 2 registers are spilled. Let's use s10 and s11..
-  if (highest == currentOffset + 8) {
-    for (auto [op, offset] : spillOffset) {
-      auto fp = fpreg(op->getResultType());
-      assignment[op] = offset ? (fp ? fspillReg2 : spillReg2) : (fp ? fspillReg : spillReg);
+  // Vectors need 16 bytes, so their slots are moved above everything else, after the rest is settled.
+  // Vectors that shared a slot still share one.
+  std::vector<std::pair<Op*, int>> spilledVecs;
+  std::map<int, int> vecSlots;
+  for (auto [op, offset] : spillOffset) {
+    if (vecreg(op->getResultType())) {
+      spilledVecs.push_back({ op, offset });
+      vecSlots[offset] = 0;
     }
-    spillOffset.clear();
   }
+  int vecSlotCnt = 0;
+  for (auto &[_, slot] : vecSlots)
+    slot = vecSlotCnt++;
+
+  // Floating-point registers that hold spilled values instead of the stack.
+  RegSet homes = 0;
 
   // If possible, map some offsets to floating-point registers.
   if (spillOffset.size()) {
@@ -467,14 +828,14 @@ void RegAlloc::runImpl(Region *region, bool isLeaf) {
     }
 
     std::unordered_map<int, Reg> fpmv;
-    auto off = STACKOFF(funcOp);
     for (auto reg : leafOrderf) {
-      if (highest <= off)
+      if (highest < currentOffset)
         break;
-      if (used.count(reg) || (!isLeaf && !calleeSaved.count(reg)))
+      if (used.count(reg) || (scratch & bit(reg)) || (!isLeaf && !calleeSaved.count(reg)))
         continue;
 
       fpmv[highest] = reg;
+      homes |= bit(reg);
       highest -= 8;
     }
 
@@ -488,9 +849,28 @@ void RegAlloc::runImpl(Region *region, bool isLeaf) {
   if (spillOffset.size())
     STACKOFF(funcOp) = highest + 8;
 
+  if (vecSlotCnt) {
+    int vecBase = (STACKOFF(funcOp) + 15) / 16 * 16;
+    for (auto [op, offset] : spilledVecs)
+      spillOffset[op] = vecBase + vecSlots[offset] * 16;
+    STACKOFF(funcOp) = vecBase + vecSlotCnt * 16;
+  }
+
+  // A spilled value that's cheap to recompute is never stored, unless its slot is shared
+  // (by coalescing), in which case the others might depend on the store.
+  std::unordered_map<int, int> slotUsers;
+  for (auto [_, offset] : spillOffset)
+    slotUsers[offset]++;
+  std::unordered_set<Op*> remat;
+  for (auto [op, offset] : spillOffset) {
+    if (rematerializable(op) && slotUsers[offset] == 1)
+      remat.insert(op);
+  }
+
   const auto getReg = [&](Op *op) {
+    auto cls = regclass(op->getResultType());
     return assignment.count(op) ? assignment[op] :
-      fpreg(op->getResultType()) ? orderf[0] : order[0];
+      cls == FPClass ? orderf[0] : cls == VecClass ? vecRegs[0] : order[0];
   };
 
   // Convert all operands to registers.
@@ -548,6 +928,14 @@ void RegAlloc::runImpl(Region *region, bool isLeaf) {
   LOWER(FcvtwsRtzOp, UNARY);
   LOWER(FmvwxOp, UNARY);
 
+  LOWER(VaddOp, BINARY);
+  LOWER(VsubOp, BINARY);
+  LOWER(VmulOp, BINARY);
+  // The value comes first, then the address.
+  LOWER(VseOp, BINARY);
+  LOWER(VleOp, UNARY);
+  LOWER(VmvvxOp, UNARY);
+
   // Note that some ops are dealt with later.
   // We can't remove all operands here.
   for (auto bb : region->getBlocks()) {
@@ -609,7 +997,7 @@ void RegAlloc::runImpl(Region *region, bool isLeaf) {
 
   // This contains all phis to be removed.
   std::vector<Op*> allPhis;
-  auto bbs = region->getBlocks();
+  std::vector<BasicBlock*> bbs = region->getBlocks();
 
   // Split edges.
   for (auto bb : bbs) {
@@ -689,6 +1077,8 @@ void RegAlloc::runImpl(Region *region, bool isLeaf) {
 #define SPILLABLE(op, Ty) (op->has<Ty##Attr>() ? op->get<Ty##Attr>()->reg : SOFFSET(op, Ty))
 
   // Detect circular copies and calculate a correct order.
+  // Each cycle goes through a temp, from the first move to the last one.
+  std::vector<std::tuple<Op*, Op*, RegClass>> cycleTemps;
   std::unordered_map<BasicBlock*, std::vector<std::pair<Reg, Reg>>> moveMap;
   std::unordered_map<BasicBlock*, std::map<std::pair<Reg, Reg>, Op*>> revMap;
   for (auto bb : bbs) {
@@ -703,19 +1093,16 @@ void RegAlloc::runImpl(Region *region, bool isLeaf) {
         auto term = bb->getLastOp();
         builder.setBeforeOp(term);
         auto def = ops[i].defining;
+        std::vector<Attr*> attrs {
+          new ImpureAttr,
+          spillOffset.count(phi) ? (Attr*) new SpilledRdAttr GET_SPILLED_ARGS(phi) : RDC(getReg(phi)),
+          spillOffset.count(def) ? (Attr*) new SpilledRsAttr GET_SPILLED_ARGS(def) : RSC(getReg(def))
+        };
         Op *mv;
-        if (fpreg(phi->getResultType())) {
-          mv = builder.create<FmvOp>({
-            new ImpureAttr,
-            spillOffset.count(phi) ? (Attr*) new SpilledRdAttr GET_SPILLED_ARGS(phi) : RDC(getReg(phi)),
-            spillOffset.count(def) ? (Attr*) new SpilledRsAttr GET_SPILLED_ARGS(def) : RSC(getReg(def))
-          });
-        } else {
-          mv = builder.create<MvOp>({
-            new ImpureAttr,
-            spillOffset.count(phi) ? (Attr*) new SpilledRdAttr GET_SPILLED_ARGS(phi) : RDC(getReg(phi)),
-            spillOffset.count(def) ? (Attr*) new SpilledRsAttr GET_SPILLED_ARGS(def) : RSC(getReg(def))
-          });
+        switch (regclass(phi->getResultType())) {
+        case FPClass: mv = builder.create<FmvOp>(attrs); break;
+        case VecClass: mv = builder.create<VmvOp>(attrs); break;
+        default: mv = builder.create<MvOp>(attrs); break;
         }
         moves.push_back(mv);
       }
@@ -808,11 +1195,19 @@ void RegAlloc::runImpl(Region *region, bool isLeaf) {
       assert(!cycle.empty());
 
       // Move the header's value to temp.
+      // The header might be a spill slot, so it's the destination attribute that moves along.
       Reg headerSrc = moveGraph[header];
       auto mv = revMap[bb][{ header, headerSrc }];
-      bool fp = isFP(header);
-      Reg tmp = fp ? fspillReg2 : spillReg2;
-      RD(mv) = tmp;
+      auto cls = isa<FmvOp>(mv) ? FPClass : isa<VmvOp>(mv) ? VecClass : IntClass;
+      Attr *dst;
+      if (auto spilledRd = mv->find<SpilledRdAttr>()) {
+        dst = spilledRd->clone();
+        mv->remove<SpilledRdAttr>();
+        mv->add<RdAttr>(Reg::zero);
+      } else {
+        dst = RDC(RD(mv));
+        RD(mv) = Reg::zero;
+      }
       mv->moveBefore(term);
 
       // For the rest of the cycle, perform the moves in order.
@@ -824,8 +1219,15 @@ void RegAlloc::runImpl(Region *region, bool isLeaf) {
       }
 
       // Move from temp into the header.
+      // The temp itself is picked once the whole function is in registers; see below.
       builder.setBeforeOp(term);
-      CREATE_MV(fp, header, tmp);
+      Op *back;
+      switch (cls) {
+      case FPClass: back = builder.create<FmvOp>({ dst, RSC(Reg::zero) }); break;
+      case VecClass: back = builder.create<VmvOp>({ dst, RSC(Reg::zero) }); break;
+      default: back = builder.create<MvOp>({ dst, RSC(Reg::zero) }); break;
+      }
+      cycleTemps.push_back({ mv, back, cls });
     }
   }
 
@@ -852,16 +1254,81 @@ void RegAlloc::runImpl(Region *region, bool isLeaf) {
     }
   }
 
+  // From here on, scratch registers are whatever is free at the point they're needed.
+  // When nothing is, one is borrowed: pushed onto the stack before and popped after.
+  // That never happens to vectors, as two vector registers are always left uncolored.
+  const auto scavenge = [&](RegClass cls, RegSet busy) {
+    const Reg *pool = cls == FPClass ? orderf : cls == VecClass ? vecRegs : order;
+    int cnt = cls == FPClass ? regcountf : cls == VecClass ? vecRegCnt : regcount;
+    for (int i = 0; i < cnt; i++) {
+      if (!(busy & bit(pool[i])) && !(homes & bit(pool[i])))
+        return pool[i];
+    }
+    return Reg::zero;
+  };
+
+  const auto push = [&](const std::vector<Reg> &regs) {
+    int size = (regs.size() * 8 + 15) / 16 * 16;
+    builder.create<SubSpOp>({ new IntAttr(size) });
+    for (int i = 0; i < regs.size(); i++) {
+      if (isFP(regs[i]))
+        builder.create<FsdOp>({ RSC(regs[i]), RS2C(Reg::sp), new IntAttr(i * 8) });
+      else
+        builder.create<StoreOp>({ RSC(regs[i]), RS2C(Reg::sp), new IntAttr(i * 8), new SizeAttr(8) });
+    }
+    return size;
+  };
+
+  const auto pop = [&](const std::vector<Reg> &regs) {
+    int size = (regs.size() * 8 + 15) / 16 * 16;
+    for (int i = 0; i < regs.size(); i++) {
+      Op *ld;
+      if (isFP(regs[i]))
+        ld = builder.create<FldOp>({ RDC(regs[i]), RSC(Reg::sp), new IntAttr(i * 8) });
+      else
+        ld = builder.create<LoadOp>(Value::i64, { RDC(regs[i]), RSC(Reg::sp), new IntAttr(i * 8), new SizeAttr(8) });
+      ld->add<ReloadAttr>();
+    }
+    builder.create<SubSpOp>({ new IntAttr(-size) });
+  };
+
+  auto live = liveAfter(region);
+
+  for (auto [first, last, cls] : cycleTemps) {
+    RegSet busy = 0, pinned = 0;
+    for (auto op = first; ; op = op->nextOp()) {
+      busy |= live[op];
+      pinned |= regsOf(op);
+      if (op == last)
+        break;
+    }
+
+    Reg tmp = scavenge(cls, busy | pinned);
+    if (tmp == Reg::zero) {
+      assert(cls != VecClass);
+      tmp = scavenge(cls, pinned);
+      builder.setBeforeOp(first);
+      push({ tmp });
+      builder.setAfterOp(last);
+      pop({ tmp });
+    }
+    RD(first) = tmp;
+    RS(last) = tmp;
+  }
+  if (cycleTemps.size())
+    live = liveAfter(region);
+
   // Deal with spilled variables.
   std::vector<Op*> remove;
   for (auto bb : region->getBlocks()) {
     int delta = 0;
-    for (auto op : bb->getOps()) {
+    std::vector<Op*> ops(bb->getOps().begin(), bb->getOps().end());
+    for (auto op : ops) {
       // We might encounter spilling around calls.
       // For example:
       //   addi sp, sp, -192    ; setting up 24 extra arguments
       //   mv a0, ...
-      //   ld s11, OFFSET(sp)   ; !!! ADJUST HERE
+      //   ld t0, OFFSET(sp)    ; !!! ADJUST HERE
       //
       // That's why we need an extra "delta".
       // No need for dominance analysis etc. because the SubSp is well-bracketed inside a block.
@@ -870,79 +1337,150 @@ void RegAlloc::runImpl(Region *region, bool isLeaf) {
         continue;
       }
 
-      if (auto rd = op->find<SpilledRdAttr>()) {
-        // We will rematerialize them later.
-        if (isa<LiOp>(rd->ref) || isa<LaOp>(rd->ref)) {
-          remove.push_back(op);
-          continue;
-        }
+      auto rd = op->find<SpilledRdAttr>();
+      auto rs = op->find<SpilledRsAttr>();
+      auto rs2 = op->find<SpilledRs2Attr>();
 
-        int offset = delta + rd->offset;
-        bool fp = rd->fp;
-        auto reg = fp ? fspillReg : spillReg;
+      // We will rematerialize them later.
+      if (rd && remat.count(rd->ref)) {
+        remove.push_back(op);
+        rematerialized++;
+        continue;
+      }
+      if (!rd && !rs && !rs2)
+        continue;
 
-        builder.setAfterOp(op);
-        if (offset < delta)
-          builder.create<FmvdxOp>({ RDC(Reg(delta - offset)), RSC(reg) });
-        else if (offset < 2048)
-          builder.create<StoreOp>({ RSC(reg), RS2C(Reg::sp), new IntAttr(offset), new SizeAttr(8) });
-        else if (offset < 4096) {
-          builder.create<AddiOp>({ RDC(spillReg2), RSC(Reg::sp), new IntAttr(2047), new SizeAttr(8) });
-          builder.create<StoreOp>({ RSC(reg), RS2C(spillReg2), new IntAttr(offset - 2047), new SizeAttr(8) });
+      // Registers `op` itself uses can't be borrowed; others that are live can.
+      // Reloads must leave alone what's live into `op`, and the result what's live out of it.
+      RegSet pinned = regsOf(op);
+      std::vector<Reg> borrowed;
+      auto take = [&](RegClass cls, RegSet busy) {
+        Reg reg = scavenge(cls, busy);
+        if (reg == Reg::zero) {
+          assert(cls != VecClass);
+          reg = scavenge(cls, pinned);
+          borrowed.push_back(reg);
         }
-        else assert(false);
-        op->add<RdAttr>(reg);
+        pinned |= bit(reg);
+        return reg;
+      };
+
+      // Pushing moves the slots by at most 32 bytes, so decide on address registers with that in mind.
+      auto far = [&](int slot) {
+        return slot >= 0 && delta + slot + 32 >= 2048;
+      };
+
+      Reg rsReg = Reg::zero, rs2Reg = Reg::zero, rdReg = Reg::zero;
+      Reg rsAddr = Reg::zero, rs2Addr = Reg::zero, rdAddr = Reg::zero;
+      RegSet in = live[op] | regsOf(op);
+      if (rs)
+        rsReg = take(rs->cls, in);
+      if (rs2)
+        rs2Reg = take(rs2->cls, in | bit(rsReg));
+
+      // An integer reload can compute its own address; others can share another register.
+      // Vectors always need one, as `vle32.v` takes no offset.
+      auto needsAddr = [&](SpilledRsAttr *rs, SpilledRs2Attr *rs2) {
+        return (rs && (rs->cls == VecClass || (rs->cls == FPClass && far(rs->offset)))) ||
+          (rs2 && (rs2->cls == VecClass || (rs2->cls == FPClass && far(rs2->offset))));
+      };
+      if (needsAddr(rs, rs2)) {
+        Reg addr = take(IntClass, in | bit(rsReg) | bit(rs2Reg));
+        rsAddr = rs2Addr = addr;
       }
+      if (rs && rs->cls == IntClass)
+        rsAddr = rsReg;
+      if (rs2 && rs2->cls == IntClass)
+        rs2Addr = rs2Reg;
+
+      if (rd) {
+        rdReg = take(rd->cls, live[op]);
+        if (rd->cls == VecClass || far(rd->offset))
+          rdAddr = take(IntClass, live[op] | bit(rdReg));
+      }
+
+      builder.setBeforeOp(op);
+      int base = delta;
+      if (borrowed.size())
+        base += push(borrowed);
 
-      if (auto rs = op->find<SpilledRsAttr>()) {
-        int offset = delta + rs->offset;
-        bool fp = rs->fp;
-        auto reg = fp ? fspillReg : spillReg;
-        auto ldty = fp ? Value::f32 : Value::i64;
+      // Brings the spilled value back into `reg`.
+      auto reload = [&](RegClass cls, int slot, Op *ref, Reg reg, Reg addr) {
+        int offset = base + slot;
+        auto ldty = cls == FPClass ? Value::f32 : Value::i64;
 
-        builder.setBeforeOp(op);
         // Rematerialized.
-        auto ref = rs->ref;
-        if (isa<LiOp>(ref))
-          builder.create<LiOp>({ RDC(reg), new IntAttr(V(ref)) });
-        else if (isa<LaOp>(ref))
-          builder.create<LaOp>({ RDC(reg), new NameAttr(NAME(ref)) });
-        else if (offset < delta)
-          builder.create<FmvxdOp>({ RDC(reg), RSC(Reg(delta - offset)) });
+        if (remat.count(ref)) {
+          if (isa<LiOp>(ref))
+            builder.create<LiOp>({ RDC(reg), new IntAttr(V(ref)) });
+          else if (isa<LaOp>(ref))
+            builder.create<LaOp>({ RDC(reg), new NameAttr(NAME(ref)) });
+          else if (base + frameAddr[ref] < 2048)
+            builder.create<AddiOp>({ RDC(reg), RSC(Reg::sp), new IntAttr(base + frameAddr[ref]) });
+          else {
+            builder.create<LiOp>({ RDC(reg), new IntAttr(base + frameAddr[ref]) });
+            builder.create<AddOp>({ RDC(reg), RSC(reg), RS2C(Reg::sp) });
+          }
+          return;
+        }
+
+        Op *ld;
+        if (cls == VecClass) {
+          if (offset < 2048)
+            builder.create<AddiOp>({ RDC(addr), RSC(Reg::sp), new IntAttr(offset) });
+          else {
+            builder.create<LiOp>({ RDC(addr), new IntAttr(offset) });
+            builder.create<AddOp>({ RDC(addr), RSC(addr), RS2C(Reg::sp) });
+          }
+          ld = builder.create<VleOp>({ RDC(reg), RSC(addr) });
+        }
+        else if (offset < base)
+          ld = builder.create<FmvxdOp>({ RDC(reg), RSC(Reg(base - offset)) });
         else if (offset < 2048)
-          builder.create<LoadOp>(ldty, { RDC(reg), RSC(Reg::sp), new IntAttr(offset), new SizeAttr(8) });
+          ld = builder.create<LoadOp>(ldty, { RDC(reg), RSC(Reg::sp), new IntAttr(offset), new SizeAttr(8) });
         else if (offset < 4096) {
-          builder.create<AddiOp>({ RDC(spillReg), RSC(Reg::sp), new IntAttr(2047), new SizeAttr(8) });
-          builder.create<LoadOp>(ldty, { RDC(reg), RSC(spillReg), new IntAttr(offset - 2047), new SizeAttr(8) });
+          builder.create<AddiOp>({ RDC(addr), RSC(Reg::sp), new IntAttr(2047), new SizeAttr(8) });
+          ld = builder.create<LoadOp>(ldty, { RDC(reg), RSC(addr), new IntAttr(offset - 2047), new SizeAttr(8) });
         }
         else assert(false);
-        op->add<RsAttr>(reg);
-      }
+        ld->add<ReloadAttr>();
+      };
 
-      if (auto rs2 = op->find<SpilledRs2Attr>()) {
-        int offset = delta + rs2->offset;
-        bool fp = rs2->fp;
-        auto reg = fp ? fspillReg2 : spillReg2;
-        auto ldty = fp ? Value::f32 : Value::i64;
+      if (rs) {
+        reload(rs->cls, rs->offset, rs->ref, rsReg, rsAddr);
+        op->add<RsAttr>(rsReg);
+      }
+      if (rs2) {
+        reload(rs2->cls, rs2->offset, rs2->ref, rs2Reg, rs2Addr);
+        op->add<Rs2Attr>(rs2Reg);
+      }
 
-        builder.setBeforeOp(op);
-        // Rematerialized.
-        auto ref = rs2->ref;
-        if (isa<LiOp>(ref))
-          builder.create<LiOp>({ RDC(reg), new IntAttr(V(ref)) });
-        else if (isa<LaOp>(ref))
-          builder.create<LaOp>({ RDC(reg), new NameAttr(NAME(ref)) });
-        else if (offset < delta)
-          builder.create<FmvxdOp>({ RDC(reg), RSC(Reg(delta - offset)) });
+      builder.setAfterOp(op);
+      if (rd) {
+        int offset = base + rd->offset;
+        if (rd->cls == VecClass) {
+          if (offset < 2048)
+            builder.create<AddiOp>({ RDC(rdAddr), RSC(Reg::sp), new IntAttr(offset) });
+          else {
+            builder.create<LiOp>({ RDC(rdAddr), new IntAttr(offset) });
+            builder.create<AddOp>({ RDC(rdAddr), RSC(rdAddr), RS2C(Reg::sp) });
+          }
+          builder.create<VseOp>({ RSC(rdReg), RS2C(rdAddr) });
+        }
+        else if (offset < base)
+          builder.create<FmvdxOp>({ RDC(Reg(base - offset)), RSC(rdReg) });
         else if (offset < 2048)
-          builder.create<LoadOp>(ldty, { RDC(reg), RSC(Reg::sp), new IntAttr(offset), new SizeAttr(8) });
+          builder.create<StoreOp>({ RSC(rdReg), RS2C(Reg::sp), new IntAttr(offset), new SizeAttr(8) });
         else if (offset < 4096) {
-          builder.create<AddiOp>({ RDC(spillReg2), RSC(Reg::sp), new IntAttr(2047), new SizeAttr(8) });
-          builder.create<LoadOp>(ldty, { RDC(reg), RSC(spillReg2), new IntAttr(offset - 2047), new SizeAttr(8) });
+          builder.create<AddiOp>({ RDC(rdAddr), RSC(Reg::sp), new IntAttr(2047), new SizeAttr(8) });
+          builder.create<StoreOp>({ RSC(rdReg), RS2C(rdAddr), new IntAttr(offset - 2047), new SizeAttr(8) });
         }
         else assert(false);
-        op->add<Rs2Attr>(reg);
+        op->add<RdAttr>(rdReg);
       }
+
+      if (borrowed.size())
+        pop(borrowed);
     }
   }
 
@@ -950,17 +1488,14 @@ void RegAlloc::runImpl(Region *region, bool isLeaf) {
     op->erase();
 }
 
-void RegAlloc::run() {
+void RegAlloc::runOnFunction(FuncOp *func) {
+  auto calls = func->findAll<sys::rv::CallOp>();
+  runImpl(func->getRegion(), calls.size() == 0);
+}
+
+void RegAlloc::finish() {
   auto funcs = collectFuncs();
   fnMap = getFunctionMap();
-  std::set<FuncOp*> leaves;
-
-  for (auto func : funcs) {
-    auto calls = func->findAll<sys::rv::CallOp>();
-    if (calls.size() == 0)
-      leaves.insert(func);
-    runImpl(func->getRegion(), calls.size() == 0);
-  }
 
   // Have a look at what registers are used inside each function.
   for (auto func : funcs) {
@@ -978,7 +1513,16 @@ void RegAlloc::run() {
   }
 
   for (auto func : funcs) {
-    proEpilogue(func, leaves.count(func));
+    // Calls are still there after allocation.
+    bool isLeaf = func->findAll<sys::rv::CallOp>().empty();
+    proEpilogue(func, isLeaf);
     tidyup(func->getRegion());
   }
 }
+
+void RegAlloc::run() {
+  auto funcs = collectFuncs();
+  for (auto func : funcs)
+    runOnFunction(func);
+  finish();
+}
@@ -196,6 +196,14 @@ int RegAlloc::latePeephole(Op *funcOp) {
     }
     return false;
   });
+  runRewriter(funcOp, [&](VmvOp *op) {
+    if (RD(op) == RS(op)) {
+      converted++;
+      op->erase();
+      return true;
+    }
+    return false;
+  });
 
   return converted;
 }
@@ -273,7 +281,7 @@ void RegAlloc::tidyup(Region *region) {
       bb->succs.erase(succ);
 
       // Then move all instruction in `succ` to `bb`.
-      auto ops = succ->getOps();
+      std::vector<Op*> ops = succ->getOps();
       for (auto op : ops)
         op->moveToEnd(bb);
 
@@ -324,13 +332,12 @@ void save(Builder builder, const std::vector<Reg> &regs, int offset) {
     if (offset < 2048)
       CREATE_STORE(Reg::sp, offset)
     else {
-      // li   t6, offset
-      // addi t6, t6, sp
-      // sd   reg, 0(t6)
-      // (Because reg might be `s11`)
-      builder.create<LiOp>({ RDC(spillReg2), new IntAttr(offset) });
-      builder.create<AddOp>({ RDC(spillReg2), RSC(spillReg2), RS2C(Reg::sp) });
-      CREATE_STORE(spillReg2, 0);
+      // li   t0, offset
+      // add  t0, t0, sp
+      // sd   reg, 0(t0)
+      builder.create<LiOp>({ RDC(frameReg), new IntAttr(offset) });
+      builder.create<AddOp>({ RDC(frameReg), RSC(frameReg), RS2C(Reg::sp) });
+      CREATE_STORE(frameReg, 0);
     }
   }
 }
@@ -351,12 +358,12 @@ void load(Builder builder, const std::vector<Reg> &regs, int offset) {
     if (offset < 2048)
       CREATE_LOAD(Reg::sp, offset)
     else {
-      // li   s11, offset
-      // addi s11, s11, sp
-      // ld   reg, 0(s11)
-      builder.create<LiOp>({ RDC(spillReg), new IntAttr(offset) });
-      builder.create<AddOp>({ RDC(spillReg), RSC(spillReg), RS2C(Reg::sp) });
-      CREATE_LOAD(spillReg, 0);
+      // li   t0, offset
+      // add  t0, t0, sp
+      // ld   reg, 0(t0)
+      builder.create<LiOp>({ RDC(frameReg), new IntAttr(offset) });
+      builder.create<AddOp>({ RDC(frameReg), RSC(frameReg), RS2C(Reg::sp) });
+      CREATE_LOAD(frameReg, 0);
     }
   }
 }
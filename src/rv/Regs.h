@@ -5,11 +5,9 @@
 
 namespace sys::rv {
 
-// We use dedicated registers as the "spill" register, for simplicity.
-const Reg spillReg = Reg::s10;
-const Reg spillReg2 = Reg::s11;
-const Reg fspillReg = Reg::fs10;
-const Reg fspillReg2 = Reg::fs11;
+// Addresses the far end of the frame in the prologue and epilogue,
+// where no caller-saved register holds anything yet (or anymore).
+const Reg frameReg = Reg::t0;
 
 // Order for leaf functions. Prioritize temporaries.
 const Reg leafOrder[] = {
@@ -21,7 +19,7 @@ const Reg leafOrder[] = {
   
   Reg::s0, Reg::s1, Reg::s2, Reg::s3, 
   Reg::s4, Reg::s5, Reg::s6, Reg::s7,
-  Reg::s8, Reg::s9,
+  Reg::s8, Reg::s9, Reg::s10, Reg::s11,
 };
 // Order for non-leaf functions.
 const Reg normalOrder[] = {
@@ -34,7 +32,7 @@ const Reg normalOrder[] = {
 
   Reg::s0, Reg::s1, Reg::s2, Reg::s3, 
   Reg::s4, Reg::s5, Reg::s6, Reg::s7,
-  Reg::s8, Reg::s9,
+  Reg::s8, Reg::s9, Reg::s10, Reg::s11,
 };
 const Reg argRegs[] = {
   Reg::a0, Reg::a1, Reg::a2, Reg::a3,
@@ -78,7 +76,7 @@ const Reg leafOrderf[] = {
   
   Reg::fs0, Reg::fs1, Reg::fs2, Reg::fs3, 
   Reg::fs4, Reg::fs5, Reg::fs6, Reg::fs7,
-  Reg::fs8, Reg::fs9,
+  Reg::fs8, Reg::fs9, Reg::fs10, Reg::fs11,
 };
 // Order for non-leaf functions.
 const Reg normalOrderf[] = {
@@ -91,19 +89,47 @@ const Reg normalOrderf[] = {
 
   Reg::fs0, Reg::fs1, Reg::fs2, Reg::fs3, 
   Reg::fs4, Reg::fs5, Reg::fs6, Reg::fs7,
-  Reg::fs8, Reg::fs9,
+  Reg::fs8, Reg::fs9, Reg::fs10, Reg::fs11,
 };
 const Reg fargRegs[] = {
   Reg::fa0, Reg::fa1, Reg::fa2, Reg::fa3,
   Reg::fa4, Reg::fa5, Reg::fa6, Reg::fa7,
 };
-constexpr int leafRegCntf = 30;
-constexpr int normalRegCntf = 30;
+constexpr int leafRegCntf = sizeof(leafOrderf) / sizeof(Reg);
+constexpr int normalRegCntf = sizeof(normalOrderf) / sizeof(Reg);
+
+// Vector registers, all caller-saved. `v0` is left alone, as it's the mask register.
+const Reg vecRegs[] = {
+  Reg::v1, Reg::v2, Reg::v3, Reg::v4,
+  Reg::v5, Reg::v6, Reg::v7, Reg::v8,
+  Reg::v9, Reg::v10, Reg::v11, Reg::v12,
+  Reg::v13, Reg::v14, Reg::v15, Reg::v16,
+  Reg::v17, Reg::v18, Reg::v19, Reg::v20,
+  Reg::v21, Reg::v22, Reg::v23, Reg::v24,
+  Reg::v25, Reg::v26, Reg::v27, Reg::v28,
+  Reg::v29, Reg::v30, Reg::v31,
+};
+constexpr int vecRegCnt = sizeof(vecRegs) / sizeof(Reg);
+// Values are only ever colored with these; the last two vector registers are kept for spill code.
+constexpr int regcountv = vecRegCnt - 2;
 
 inline bool fpreg(Value::Type ty) {
   return ty == Value::f32;
 }
 
+inline bool vecreg(Value::Type ty) {
+  return ty == Value::i128;
+}
+
+// The register classes, as the allocator sees them.
+enum RegClass {
+  IntClass, FPClass, VecClass,
+};
+
+inline RegClass regclass(Value::Type ty) {
+  return fpreg(ty) ? FPClass : vecreg(ty) ? VecClass : IntClass;
+}
+
 }
 
 #endif
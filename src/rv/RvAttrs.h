@@ -73,7 +73,39 @@ namespace rv {
   X(fa4) \
   X(fa5) \
   X(fa6) \
-  X(fa7)
+  X(fa7) \
+  X(v0) \
+  X(v1) \
+  X(v2) \
+  X(v3) \
+  X(v4) \
+  X(v5) \
+  X(v6) \
+  X(v7) \
+  X(v8) \
+  X(v9) \
+  X(v10) \
+  X(v11) \
+  X(v12) \
+  X(v13) \
+  X(v14) \
+  X(v15) \
+  X(v16) \
+  X(v17) \
+  X(v18) \
+  X(v19) \
+  X(v20) \
+  X(v21) \
+  X(v22) \
+  X(v23) \
+  X(v24) \
+  X(v25) \
+  X(v26) \
+  X(v27) \
+  X(v28) \
+  X(v29) \
+  X(v30) \
+  X(v31)
 
 #define X(name) name,
 enum class Reg : signed {
@@ -97,6 +129,10 @@ inline bool isFP(Reg reg) {
   return (int) Reg::ft0 <= (int) reg && (int) Reg::fa7 >= (int) reg;
 }
 
+inline bool isVec(Reg reg) {
+  return (int) Reg::v0 <= (int) reg && (int) Reg::v31 >= (int) reg;
+}
+
 class RegAttr : public AttrImpl<RegAttr, RVLINE> {
 public:
   Reg reg;
@@ -148,6 +184,15 @@ public:
   StackOffsetAttr *clone() override { return new StackOffsetAttr(offset); }
 };
 
+// Marks the ops RegAlloc inserts to bring a spilled value back into a register.
+class ReloadAttr : public AttrImpl<ReloadAttr, RVLINE> {
+public:
+  ReloadAttr() {}
+
+  std::string toString() override { return "<reload>"; }
+  ReloadAttr *clone() override { return new ReloadAttr; }
+};
+
 }
 
 #define STACKOFF(op) (op)->get<StackOffsetAttr>()->offset
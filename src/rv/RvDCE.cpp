@@ -14,7 +14,7 @@ bool RvDCE::isImpure(Op *op) {
       isa<BneOp>(op) || isa<BltOp>(op) ||
       isa<BgeOp>(op) || isa<BeqOp>(op) || isa<WriteRegOp>(op) ||
       isa<StoreOp>(op) || isa<RetOp>(op) ||
-      isa<CallOp>(op))
+      isa<CallOp>(op) || isa<VseOp>(op) || isa<VsetivliOp>(op))
     return true;
 
   return false;
@@ -57,3 +57,17 @@ void RvDCE::run() {
       op->erase();
   } while (removeable.size());
 }
+
+void RvDCE::runOnFunction(FuncOp *func) {
+  auto region = func->getRegion();
+  markImpure(region);
+
+  do {
+    removeable.clear();
+    runOnRegion(region);
+
+    elim += removeable.size();
+    for (auto op : removeable)
+      op->erase();
+  } while (removeable.size());
+}
@@ -24,6 +24,8 @@ public:
   std::string name() override { return "rv-dce"; };
   std::map<std::string, int> stats() override;
   void run() override;
+  bool isFunctionPass() override { return true; }
+  void runOnFunction(FuncOp *func) override;
 };
 
 }
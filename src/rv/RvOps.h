@@ -42,6 +42,7 @@
 #define RVOP(Ty) RVOPBASE(Value::i32, Ty)
 #define RVOPL(Ty) RVOPBASE(Value::i64, Ty)
 #define RVOPF(Ty) RVOPBASE(Value::f32, Ty)
+#define RVOPV(Ty) RVOPBASE(Value::i128, Ty)
 
 namespace sys {
 
@@ -121,6 +122,17 @@ RVOPF(FmulOp);
 RVOPF(FdivOp);
 RVOPF(FmvOp);
 
+// ====== Vector Ops (RVV 1.0) ======
+// Vectors are always 4 x i32, as set up by `vsetivli`; see Lower.
+RVOP(VsetivliOp); // vsetivli zero, 4, e32, m1, ta, ma
+RVOPV(VleOp); // vle32.v
+RVOP(VseOp); // vse32.v
+RVOPV(VaddOp); // vadd.vv
+RVOPV(VsubOp); // vsub.vv
+RVOPV(VmulOp); // vmul.vv
+RVOPV(VmvvxOp); // vmv.v.x, i.e. broadcast
+RVOPV(VmvOp); // vmv1r.v, a whole register
+
 inline bool hasRd(Op *op) {
   return !(
     isa<StoreOp>(op) ||
@@ -133,7 +145,9 @@ inline bool hasRd(Op *op) {
     isa<BleOp>(op) ||
     isa<BgtOp>(op) ||
     isa<WriteRegOp>(op) ||
-    isa<CallOp>(op)
+    isa<CallOp>(op) ||
+    isa<VseOp>(op) ||
+    isa<VsetivliOp>(op)
   );
 }
 
@@ -2,6 +2,7 @@
 #define RV_PASSES_H
 
 #include "../opt/Pass.h"
+#include "../opt/ListSchedule.h"
 #include "RvAttrs.h"
 #include "RvOps.h"
 #include "../codegen/Ops.h"
@@ -35,17 +36,47 @@ public:
 
 class InstCombine : public Pass {
   int combined = 0;
+
+  // Combines everything inside `root`, which is either the module or a function.
+  void runImpl(Op *root);
 public:
   InstCombine(ModuleOp *module): Pass(module) {}
 
   std::string name() override { return "rv-inst-combine"; };
   std::map<std::string, int> stats() override;
   void run() override;
+  bool isFunctionPass() override { return true; }
+  void runOnFunction(FuncOp *func) override { runImpl(func); }
+};
+
+// Reorders ops before allocation, with latencies from CostModel.
+class Schedule : public ListSchedule {
+protected:
+  Role classify(Op *op, Access &access) override;
+  int latency(Op *op) override;
+  bool fpResult(Op *op) override;
+public:
+  Schedule(ModuleOp *module);
+
+  std::string name() override { return "rv-schedule"; };
 };
 
 class RegAlloc : public Pass {
+public:
+  enum Mode {
+    // Colors values one by one in order of priority; moves are only hints.
+    Greedy,
+    // Iterated register coalescing; see Coalescer.
+    Coalescing,
+    // Linear scan, for compile time; see LinearScan.
+    Linear,
+  };
+private:
+  Mode mode;
   int spilled = 0;
   int convertedTotal = 0;
+  int coalescedTotal = 0;
+  int rematerialized = 0;
 
   std::map<FuncOp*, std::set<Reg>> usedRegisters;
   std::map<std::string, FuncOp*> fnMap;
@@ -56,20 +87,27 @@ class RegAlloc : public Pass {
   int latePeephole(Op *funcOp);
   void tidyup(Region *region);
 public:
-  RegAlloc(ModuleOp *module): Pass(module) {}
+  RegAlloc(ModuleOp *module, Mode mode = Greedy): Pass(module), mode(mode) {}
 
   std::string name() override { return "rv-regalloc"; };
   std::map<std::string, int> stats() override;
   void run() override;
+  bool isFunctionPass() override { return true; }
+  void runOnFunction(FuncOp *func) override;
+  void finish() override;
 };
 
 // Dumps the output.
 class Dump : public Pass {
   std::string out;
+  bool costReport;
 
   void dump(std::ostream &os);
+  // Estimated cycles of each block and function; see CostModel.
+  void report(std::ostream &os);
 public:
-  Dump(ModuleOp *module, const std::string &out): Pass(module), out(out) {}
+  Dump(ModuleOp *module, const std::string &out, bool costReport = false):
+    Pass(module), out(out), costReport(costReport) {}
 
   std::string name() override { return "rv-dump"; };
   std::map<std::string, int> stats() override { return {}; }
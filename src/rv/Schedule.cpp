@@ -0,0 +1,55 @@
+#include "RvPasses.h"
+#include "CostModel.h"
+#include "Regs.h"
+
+using namespace sys;
+using namespace sys::rv;
+
+Schedule::Schedule(ModuleOp *module): ListSchedule(module) {
+  intRegs = normalRegCnt;
+  fpRegs = normalRegCntf;
+}
+
+ListSchedule::Role Schedule::classify(Op *op, Access &access) {
+  if (isa<LoadOp>(op) || isa<StoreOp>(op)) {
+    bool load = isa<LoadOp>(op);
+    bool fp = load ? op->getResultType() == Value::f32 : op->DEF(0)->getResultType() == Value::f32;
+
+    access.base = load ? op->DEF(0) : op->DEF(1);
+    access.offset = V(op);
+    // `flw` and `fsw` ignore the size.
+    if (fp || op->has<SizeAttr>()) {
+      access.size = fp ? 4 : SIZE(op);
+      access.known = true;
+    }
+    return load ? Load : Store;
+  }
+
+  if (isa<VleOp>(op) || isa<VseOp>(op)) {
+    bool load = isa<VleOp>(op);
+    access.base = load ? op->DEF(0) : op->DEF(1);
+    access.offset = 0;
+    access.size = 16;
+    access.known = true;
+    return load ? Load : Store;
+  }
+
+  // The sequence around a call must stay as it is;
+  // and reading `sp` or `zero` is the only register read that can move.
+  if (isa<CallOp>(op) || isa<WriteRegOp>(op) || isa<SubSpOp>(op) || isa<PlaceHolderOp>(op) ||
+      isa<VsetivliOp>(op))
+    return Barrier;
+  if (isa<ReadRegOp>(op))
+    return REG(op) == Reg::sp || REG(op) == Reg::zero ? Plain : Barrier;
+
+  return Plain;
+}
+
+int Schedule::latency(Op *op) {
+  return CostModel::get().latency(op);
+}
+
+// Vectors have a register file of their own; counting them with floats errs on the safe side.
+bool Schedule::fpResult(Op *op) {
+  return fpreg(op->getResultType()) || vecreg(op->getResultType());
+}
@@ -0,0 +1,302 @@
+#include "RvOps.h"
+#include "RvAttrs.h"
+#include "Regs.h"
+#include "../codegen/Attrs.h"
+#include "../utils/MachineExec.h"
+
+using namespace sys;
+using namespace sys::exec;
+using namespace sys::rv;
+
+RvInterpreter::RvInterpreter(ModuleOp *module, bool allocated): MachineInterpreter(module, allocated) {
+  spReg = (int) Reg::sp;
+  zeroReg = (int) Reg::zero;
+  linkReg = (int) Reg::ra;
+  for (auto reg : rv::argRegs)
+    argRegs.push_back((int) reg);
+  for (auto reg : rv::fargRegs)
+    fargRegs.push_back((int) reg);
+  for (auto reg : rv::calleeSaved)
+    calleeSaved.push_back((int) reg);
+  for (auto reg : rv::callerSaved)
+    callerSaved.push_back((int) reg);
+  for (auto reg : rv::vecRegs)
+    callerSaved.push_back((int) reg);
+  intExt = W32S;
+  // `div` gives all ones when dividing by zero.
+  divByZero = -1;
+}
+
+int RvInterpreter::frameSize(Op *func) {
+  return func->has<rv::StackOffsetAttr>() ? STACKOFF(func) : 0;
+}
+
+// Before allocation, sources are operands; after it, they're `rs` and `rs2`.
+int RvInterpreter::source(Op *op, int i) {
+  if (!allocated)
+    return slot(op->DEF(i));
+  return reg((int) (i == 0 ? RS(op) : RS2(op)));
+}
+
+int RvInterpreter::dest(Op *op) {
+  if (!allocated)
+    return slot(op);
+  return regDest((int) RD(op));
+}
+
+// Whether `op` brings back a spilled value.
+// RegAlloc marks everything it inserts for that, whichever register it happens to use.
+bool RvInterpreter::reloads(Op *op) {
+  return allocated && op->has<rv::ReloadAttr>();
+}
+
+#define BINARY(Ty, kind, w) \
+  case rv::Ty::id: \
+    inst.code = kind; \
+    inst.width = w; \
+    inst.rd = dest(op); \
+    inst.a = source(op, 0); \
+    inst.b = source(op, 1); \
+    break
+
+#define UNARY_I(Ty, kind, w) \
+  case rv::Ty::id: \
+    inst.code = kind; \
+    inst.width = w; \
+    inst.rd = dest(op); \
+    inst.a = source(op, 0); \
+    inst.imm = V(op); \
+    break
+
+#define UNARY(Ty, kind, w) \
+  case rv::Ty::id: \
+    inst.code = kind; \
+    inst.width = w; \
+    inst.rd = dest(op); \
+    inst.a = source(op, 0); \
+    break
+
+#define COMPARE(Ty, kind, cmp) \
+  case rv::Ty::id: \
+    inst.code = kind; \
+    inst.cond = cmp; \
+    inst.rd = dest(op); \
+    inst.a = source(op, 0); \
+    inst.b = source(op, 1); \
+    break
+
+#define BRANCH(Ty, cmp) \
+  case rv::Ty::id: \
+    inst.code = Branch; \
+    inst.cond = cmp; \
+    inst.a = source(op, 0); \
+    inst.b = source(op, 1); \
+    break
+
+void RvInterpreter::decode(Op *op, Inst &inst) {
+  switch (op->opid) {
+  case rv::LiOp::id: {
+    int64_t v = V(op);
+    inst.code = Li;
+    inst.rd = dest(op);
+    inst.imm = v;
+    // `lui` + `addi` for anything past the 12-bit immediate, unless the low bits are zero.
+    if ((v < -2048 || v >= 2048) && (v & 0xfff))
+      inst.weight = 2;
+    break;
+  }
+  case rv::LaOp::id:
+    inst.code = Li;
+    inst.rd = dest(op);
+    inst.imm = address(NAME(op));
+    // `auipc` + `addi`.
+    inst.weight = 2;
+    break;
+
+  BINARY(AddOp, Add, W64);
+  BINARY(AddwOp, Add, W32S);
+  BINARY(SubOp, Sub, W64);
+  BINARY(SubwOp, Sub, W32S);
+  BINARY(MulOp, Mul, W64);
+  BINARY(MulwOp, Mul, W32S);
+  BINARY(MulhOp, Mulh, W64);
+  BINARY(MulhuOp, Mulhu, W64);
+  BINARY(DivOp, Div, W64);
+  BINARY(DivwOp, Div, W32S);
+  BINARY(RemOp, Rem, W64);
+  BINARY(RemwOp, Rem, W32S);
+  BINARY(SllOp, Sll, W64);
+  BINARY(SllwOp, Sll, W32S);
+  BINARY(SrlOp, Srl, W64);
+  BINARY(SrlwOp, Srl, W32S);
+  BINARY(SraOp, Sra, W64);
+  BINARY(SrawOp, Sra, W32S);
+  BINARY(AndOp, And, W64);
+  BINARY(OrOp, Or, W64);
+  BINARY(XorOp, Xor, W64);
+  BINARY(FaddOp, Fadd, W64);
+  BINARY(FsubOp, Fsub, W64);
+  BINARY(FmulOp, Fmul, W64);
+  BINARY(FdivOp, Fdiv, W64);
+
+  UNARY_I(AddiOp, Add, W64);
+  UNARY_I(AddiwOp, Add, W32S);
+  UNARY_I(SlliOp, Sll, W64);
+  UNARY_I(SlliwOp, Sll, W32S);
+  UNARY_I(SrliOp, Srl, W64);
+  UNARY_I(SrliwOp, Srl, W32S);
+  UNARY_I(SraiOp, Sra, W64);
+  UNARY_I(SraiwOp, Sra, W32S);
+  UNARY_I(AndiOp, And, W64);
+  UNARY_I(OriOp, Or, W64);
+  UNARY_I(XoriOp, Xor, W64);
+
+  UNARY(MvOp, Mov, W64);
+  UNARY(FmvOp, MovS, W64);
+  UNARY(FmvwxOp, MovS, W64);
+  UNARY(FmvdxOp, Mov64, W64);
+  UNARY(FcvtswOp, Scvtf, W64);
+  UNARY(FcvtwsRtzOp, Fcvtzs, W32S);
+
+  BINARY(VaddOp, AddV, W64);
+  BINARY(VsubOp, SubV, W64);
+  BINARY(VmulOp, MulV, W64);
+  UNARY(VmvvxOp, Dup, W64);
+  UNARY(VmvOp, Mov, W64);
+
+  COMPARE(SltOp, Cset, Lt);
+  COMPARE(FeqOp, CsetF, Eq);
+  COMPARE(FltOp, CsetF, Lt);
+  COMPARE(FleOp, CsetF, Le);
+
+  case rv::FmvxdOp::id:
+    inst.code = Mov64;
+    inst.rd = dest(op);
+    inst.a = source(op, 0);
+    inst.reload = allocated && reloads(op);
+    break;
+  case rv::SltiOp::id:
+    inst.code = Cset;
+    inst.cond = Lt;
+    inst.rd = dest(op);
+    inst.a = source(op, 0);
+    inst.imm = V(op);
+    break;
+  case rv::SeqzOp::id:
+  case rv::SnezOp::id:
+    inst.code = Cset;
+    inst.cond = isa<rv::SeqzOp>(op) ? Eq : Ne;
+    inst.rd = dest(op);
+    inst.a = source(op, 0);
+    inst.imm = 0;
+    break;
+
+  BRANCH(BeqOp, Eq);
+  BRANCH(BneOp, Ne);
+  BRANCH(BltOp, Lt);
+  BRANCH(BgeOp, Ge);
+  BRANCH(BleOp, Le);
+  BRANCH(BgtOp, Gt);
+
+  case rv::JOp::id:
+    inst.code = Jump;
+    break;
+  case rv::CallOp::id:
+    inst.code = Call;
+    break;
+  case rv::RetOp::id:
+    inst.code = Ret;
+    break;
+
+  case rv::LoadOp::id: {
+    bool fp = allocated ? rv::isFP(RD(op)) : op->getResultType() == Value::f32;
+    inst.code = Load;
+    inst.rd = dest(op);
+    inst.a = source(op, 0);
+    inst.imm = V(op);
+    // `flw` ignores the size.
+    inst.size = fp ? 4 : SIZE(op);
+    inst.width = fp ? W32Z : inst.size == 8 ? W64 : W32S;
+    inst.reload = allocated && reloads(op);
+    break;
+  }
+  case rv::FldOp::id:
+    inst.code = Load;
+    inst.rd = dest(op);
+    inst.a = source(op, 0);
+    inst.imm = V(op);
+    inst.size = 8;
+    inst.reload = allocated && reloads(op);
+    break;
+  case rv::StoreOp::id: {
+    bool fp = allocated ? rv::isFP(RS(op)) : op->DEF(0)->getResultType() == Value::f32;
+    inst.code = Store;
+    inst.a = source(op, 0);
+    inst.b = source(op, 1);
+    inst.imm = V(op);
+    inst.size = fp ? 4 : SIZE(op);
+    break;
+  }
+  case rv::VleOp::id:
+    inst.code = Load;
+    inst.rd = dest(op);
+    inst.a = source(op, 0);
+    inst.imm = 0;
+    inst.size = 16;
+    inst.reload = allocated && reloads(op);
+    break;
+  case rv::VseOp::id:
+    inst.code = Store;
+    inst.a = source(op, 0);
+    inst.b = source(op, 1);
+    inst.imm = 0;
+    inst.size = 16;
+    break;
+  case rv::VsetivliOp::id:
+    inst.code = VConfig;
+    break;
+  case rv::FsdOp::id:
+    inst.code = Store;
+    inst.a = source(op, 0);
+    inst.b = source(op, 1);
+    inst.imm = V(op);
+    inst.size = 8;
+    break;
+
+  // The rest are pseudo-ops that only exist before allocation, and don't become instructions.
+  case rv::SubSpOp::id:
+    inst.code = SubSp;
+    inst.imm = V(op);
+    inst.weight = 0;
+    break;
+  case rv::ReadRegOp::id:
+    inst.code = Mov;
+    inst.rd = dest(op);
+    inst.a = reg((int) REG(op));
+    inst.weight = 0;
+    break;
+  case rv::WriteRegOp::id:
+    inst.code = Mov;
+    inst.rd = regDest((int) REG(op));
+    inst.a = source(op, 0);
+    inst.weight = 0;
+    break;
+  case rv::PlaceHolderOp::id:
+    inst.weight = 0;
+    if (!allocated && op->getOperandCount()) {
+      inst.code = Mov;
+      inst.rd = dest(op);
+      inst.a = source(op, 0);
+    } else
+      inst.code = Nop;
+    break;
+
+  default:
+    // Only an error if it's actually reached.
+    inst.code = Unknown;
+    break;
+  }
+
+  inst.vector = isa<rv::VaddOp>(op) || isa<rv::VsubOp>(op) || isa<rv::VmulOp>(op) ||
+    isa<rv::VmvvxOp>(op) || isa<rv::VmvOp>(op) || isa<rv::VleOp>(op) || isa<rv::VseOp>(op);
+}
@@ -1,4 +1,5 @@
 #include "RvPasses.h"
+#include "CostModel.h"
 #include "../opt/LoopPasses.h"
 #include <cmath>
 
@@ -49,7 +50,7 @@ void hoistLi(LoopInfo *loop) {
   auto term = loop->preheader->getLastOp();
 
   for (auto bb : loop->bbs) {
-    auto ops = bb->getOps();
+    std::vector<Op*> ops = bb->getOps();
     for (auto op : ops) {
       if (isa<LiOp>(op))
         op->moveBefore(term);
@@ -63,6 +64,13 @@ int StrengthReduct::runImpl() {
   Builder builder;
 
   int converted = 0;
+
+  // Whether running `seq`, one after another, beats a single `opid`.
+  // Any `li` is left out, as it gets hoisted out of loops.
+  auto &model = CostModel::get();
+  auto cheaper = [&](std::initializer_list<int> seq, int opid) {
+    return model.chain(seq) < model.latency(opid);
+  };
   
   // ===================
   // Rewrite MulOp.
@@ -103,14 +111,15 @@ int StrengthReduct::runImpl() {
 
     auto bits = __builtin_popcount(i);
 
-    if (bits == 1) {
+    if (bits == 1 && cheaper({ SlliOp::id }, MulwOp::id)) {
       converted++;
       builder.setBeforeOp(op);
       builder.replace<SlliOp>(op, { x }, { new IntAttr(__builtin_ctz(i)) });
       return true;
     }
 
-    if (bits == 2) {
+    // The two shifts are independent.
+    if (bits == 2 && cheaper({ SlliwOp::id, AddwOp::id }, MulwOp::id)) {
       converted++;
       builder.setBeforeOp(op);
       int firstPlace = __builtin_ctz(i);
@@ -126,6 +135,9 @@ int StrengthReduct::runImpl() {
     }
 
     // Similar to above, but for sub instead of add.
+    if (!cheaper({ SlliwOp::id, SubwOp::id }, MulwOp::id))
+      return false;
+
     for (int place = 0; place < 31; place++) {
       if (__builtin_popcount(i + (1 << place)) == 1) {
         converted++;
@@ -175,7 +187,7 @@ int StrengthReduct::runImpl() {
     if (i <= 0)
       return false;
 
-    if (i == 2) {
+    if (i == 2 && cheaper({ SrliwOp::id, AddOp::id, SraiwOp::id }, DivwOp::id)) {
       // See clang output: x / 2 should become
       //   srliw   a1, a0, 31
       //   add     a0, a0, a1
@@ -190,7 +202,7 @@ int StrengthReduct::runImpl() {
     }
 
     auto bits = __builtin_popcount(i);
-    if (bits == 1) {
+    if (bits == 1 && cheaper({ SlliOp::id, SrliOp::id, AddOp::id, SraiwOp::id }, DivwOp::id)) {
       // See clang output: x / 2^n should become
       //   slli    a1, a0, 1
       //   srli    a1, a1, (64 - n)
@@ -211,6 +223,10 @@ int StrengthReduct::runImpl() {
     // See https://gmplib.org/~tege/divcnst-pldi94.pdf,
     // Section 5.
     // For signed integer, we know that N = 31.
+    // The longer of the two sequences below is checked.
+    if (!cheaper({ MulOp::id, SraiOp::id, AddwOp::id, SraiwOp::id, SubwOp::id }, DivwOp::id))
+      return false;
+
     converted++;
     auto [shPost, m, l] = chooseMultiplier(i);
     auto n = x.defining;
@@ -270,7 +286,7 @@ int StrengthReduct::runImpl() {
       return true;
     }
 
-    if (i == 2) {
+    if (i == 2 && cheaper({ SrliwOp::id, AddOp::id, AndiOp::id, SubwOp::id }, RemwOp::id)) {
       // Clang output of x % 2:
       //   srliw   a1, a0, 31
       //   add     a1, a1, a0
@@ -286,7 +302,7 @@ int StrengthReduct::runImpl() {
       return true;
     }
 
-    if (__builtin_popcount(i) == 1) {
+    if (__builtin_popcount(i) == 1 && cheaper({ SlliOp::id, SrliOp::id, AddOp::id, AndiOp::id, SubwOp::id }, RemwOp::id)) {
       // Clang output of x % 2^n:
       //   slli    a1, a0, 1
       //   srli    a1, a1, (64 - n)
@@ -317,6 +333,10 @@ int StrengthReduct::runImpl() {
     //   %quot = x / y
     //   %mul = %quot * y
     //   x - %mul
+    // This only pays off if the division becomes a multiplication above.
+    if (!cheaper({ MulOp::id, SraiOp::id, SubwOp::id, MulwOp::id, SubwOp::id }, RemwOp::id))
+      return false;
+
     converted++;
     builder.setBeforeOp(op);
     auto quot = builder.create<DivwOp>(op->getOperands(), op->getAttrs());
@@ -39,7 +39,72 @@ Interpreter::Interpreter(ModuleOp *module) {
   }
 }
 
+// Defined in Pass.cpp
+namespace sys {
+  bool isExtern(const std::string &name);
+}
+
+// Every opcode has a label of the same name in execf().
+#define BYTECODES(X) \
+  X(Const) X(Mov) X(GetArg) X(Alloca) X(Call) X(Goto) X(Branch) X(Ret) X(RetVoid) \
+  X(AddI) X(SubI) X(MulI) X(DivI) X(ModI) X(Eq) X(Ne) X(Lt) X(Le) \
+  X(AndI) X(OrI) X(XorI) X(LShift) X(RShift) X(AddL) X(SubL) X(MulL) X(RShiftL) \
+  X(AddF) X(SubF) X(MulF) X(DivF) X(EqF) X(LeF) X(LtF) X(NeF) \
+  X(Not) X(SetNotZero) X(Minus) X(MinusF) X(I2F) X(F2I) \
+  X(LoadI32) X(LoadI64) X(LoadF) X(StoreI32) X(StoreI64) X(StoreF) X(Select) \
+  X(Count) X(CountedBranch) X(UndefPhi) X(Unknown)
+
+namespace {
+
+#define BYTECODE_ENUM(x) x,
+enum Code { BYTECODES(BYTECODE_ENUM) };
+#undef BYTECODE_ENUM
+
+// Allocas are served from chunks of at least this size.
+const size_t CHUNK_SIZE = 1 << 20;
+
+}
+
+struct Interpreter::Inst {
+  // The address of the handler in execf(). Filled in when the function first runs.
+  const void *handler;
+  int code;
+  // Slots of the result and the operands, in the frame of the function.
+  // Jumps hold code offsets in `b` and `c` instead.
+  int dst, a, b, c;
+  // Pre-decoded attributes: the constant, the size of an alloca, the index of a call site,
+  // the counter of a counted branch.
+  Value imm;
+  // Only for error messages.
+  Op *op;
+};
+
+struct Interpreter::CallSite {
+  std::string name;
+  bool external;
+  // Resolved on the first call.
+  Function *callee = nullptr;
+  std::vector<int> args;
+};
+
+struct Interpreter::Function {
+  std::vector<Inst> code;
+  std::vector<CallSite> calls;
+  int slots = 0;
+  bool threaded = false;
+
+  // Under profiling, the op each counter is for, and whether it counts
+  // taken branches rather than executions.
+  std::vector<std::pair<Op*, bool>> counters;
+  std::vector<long long> counts;
+};
+
 Interpreter::~Interpreter() {
+  for (const auto &[name, fn] : compiled)
+    delete fn;
+  for (auto chunk : chunks)
+    delete[] chunk.base;
+
   for (const auto &[name, ptr] : globalMap) {
     // Hopefully this won't violate strict aliasing rule.
     if (fpGlobals.count(name))
@@ -49,182 +114,228 @@ Interpreter::~Interpreter() {
   }
 }
 
-intptr_t Interpreter::eval(Op *op) {
-  if (!value.count(op))
-    sys_unreachable("undefined op" << op);
-  if (op->getResultType() == sys::Value::f32)
-    sys_unreachable("op of float type: " << op);
-  return value[op].vi;
-}
+// Each op gets a slot in the frame, and each block is laid out in order.
+// Phis don't produce code in their own block; instead, every edge into a block
+// with phis gets a stub that does the moves and then jumps to the block.
+Interpreter::Function *Interpreter::compile(Op *func) {
+  auto fn = new Function;
+  auto region = func->getRegion();
 
-float Interpreter::evalf(Op *op) {
-  if (!value.count(op))
-    sys_unreachable("undefined op" << op);
-  if (op->getResultType() != sys::Value::f32)
-    sys_unreachable("op of non-float type: " << op);
-  return value[op].vf;
-}
+  std::unordered_map<Op*, int> slots;
+  std::unordered_map<BasicBlock*, int> blocks;
+  for (auto bb : region->getBlocks()) {
+    int id = blocks.size();
+    blocks[bb] = id;
+    for (auto op : bb->getOps())
+      slots[op] = fn->slots++;
+  }
 
-void Interpreter::store(Op *op, intptr_t v) {
-  value[op] = Value { .vi = v };
-}
+  // Jumps target labels until everything is laid out.
+  // The first labels are blocks; the rest are edge stubs.
+  std::vector<int> labels(blocks.size());
+  std::map<std::pair<BasicBlock*, BasicBlock*>, int> edges;
+  std::vector<int> jumps;
 
-void Interpreter::store(Op *op, float v) {
-  value[op] = Value { .vf = v };
-}
+  auto edge = [&](BasicBlock *from, BasicBlock *to) {
+    if (!isa<PhiOp>(to->getFirstOp()))
+      return blocks[to];
 
-// The registers are in fact 64-bit.
-#define EXEC_BINARY(Ty, sign) \
-  case Ty::id: \
-    store(op, (intptr_t) ((eval(op->DEF(0)) sign eval(op->DEF(1))) & 0xffffffff)); \
-    break
+    auto key = std::make_pair(from, to);
+    if (!edges.count(key)) {
+      edges[key] = labels.size();
+      labels.push_back(-1);
+    }
+    return edges[key];
+  };
 
-#define EXEC_BINARY_L(Ty, sign) \
-  case Ty::id: \
-    store(op, (intptr_t) ((eval(op->DEF(0)) sign eval(op->DEF(1))))); \
-    break
+  auto emit = [&](int code, Op *op) -> Inst& {
+    Inst inst { nullptr, code, slots[op], 0, 0, 0, Value { .vi = 0 }, op };
+    int *fields[] = { &inst.a, &inst.b, &inst.c };
+    const auto &operands = op->getOperands();
+    for (size_t i = 0; i < operands.size() && i < 3; i++)
+      *fields[i] = slots[operands[i].defining];
+    fn->code.push_back(inst);
+    return fn->code.back();
+  };
 
-#define EXEC_BINARY_F(Ty, sign) \
-  case Ty::id: \
-    store(op, evalf(op->DEF(0)) sign evalf(op->DEF(1))); \
-    break
+  auto counter = [&](Op *op, bool taken) {
+    fn->counters.push_back({ op, taken });
+    return (int) fn->counters.size() - 1;
+  };
 
-#define EXEC_BINARY_FCOMP(Ty, sign) \
-  case Ty::id: \
-    store(op, (intptr_t) (evalf(op->DEF(0)) sign evalf(op->DEF(1)))); \
-    break
+  auto jump = [&](Op *op, int target) {
+    jumps.push_back(fn->code.size());
+    emit(Goto, op).b = target;
+  };
 
-#define EXEC_UNARY(Ty, sign) \
+#define LOWER(Ty, code) \
   case Ty::id: \
-    store(op, (intptr_t) (sign eval(op->DEF()))); \
+    emit(code, op); \
     break
 
-#define EXEC_UNARY_F(Ty, sign) \
-  case Ty::id: \
-    store(op, sign evalf(op->DEF())); \
-    break
+  for (auto bb : region->getBlocks()) {
+    labels[blocks[bb]] = fn->code.size();
+    // A block's count lives on its terminator.
+    if (profiling)
+      emit(Count, bb->getLastOp()).a = counter(bb->getLastOp(), false);
 
-// Defined in Pass.cpp
-namespace sys {
-  bool isExtern(const std::string &name);
-}
+    for (auto op : bb->getOps()) {
+      switch (op->opid) {
+      case PhiOp::id:
+        break;
+      case IntOp::id:
+        emit(Const, op).imm.vi = V(op);
+        break;
+      case FloatOp::id:
+        emit(Const, op).imm.vf = F(op);
+        break;
+      case GetGlobalOp::id: {
+        const auto &name = NAME(op);
+        if (!globalMap.count(name))
+          sys_unreachable("unknown global: " << name);
+        emit(Const, op).imm = globalMap[name];
+        break;
+      }
+      case GetArgOp::id:
+        emit(GetArg, op).a = V(op);
+        break;
+      case AllocaOp::id:
+        emit(Alloca, op).imm.vi = SIZE(op);
+        break;
+      case CallOp::id: {
+        if (profiling)
+          emit(Count, op).a = counter(op, false);
 
-void Interpreter::exec(Op *op) {
-  switch (op->opid) {
-  case IntOp::id:
-    store(op, (intptr_t) V(op));
-    break;
-  case FloatOp::id:
-    store(op, F(op));
-    break;
-  case I2FOp::id:
-    store(op, (float) eval(op->DEF()));
-    break;
-  case F2IOp::id:
-    store(op, (intptr_t) evalf(op->DEF()));
-    break;
-  EXEC_BINARY(AddIOp, +);
-  EXEC_BINARY(SubIOp, -);
-  EXEC_BINARY(MulIOp, *);
-  EXEC_BINARY(DivIOp, /);
-  EXEC_BINARY(ModIOp, %);
-  EXEC_BINARY(EqOp, ==);
-  EXEC_BINARY(NeOp, !=);
-  EXEC_BINARY(LtOp, <);
-  EXEC_BINARY(LeOp, <=);
-  EXEC_BINARY(AndIOp, &);
-  EXEC_BINARY(OrIOp, |);
-  EXEC_BINARY(XorIOp, ^);
-  EXEC_BINARY(LShiftOp, <<);
-  
-  EXEC_BINARY_L(AddLOp, +);
-  EXEC_BINARY_L(MulLOp, *);
-  EXEC_BINARY_L(RShiftLOp, >>);
-
-  EXEC_BINARY_F(AddFOp, +);
-  EXEC_BINARY_F(SubFOp, -);
-  EXEC_BINARY_F(MulFOp, *);
-  EXEC_BINARY_F(DivFOp, /);
-  EXEC_BINARY_FCOMP(EqFOp, ==);
-  EXEC_BINARY_FCOMP(LeFOp, <=);
-  EXEC_BINARY_FCOMP(LtFOp, <);
-  EXEC_BINARY_FCOMP(NeFOp, !=);
-
-  EXEC_UNARY(NotOp, !);
-  EXEC_UNARY(SetNotZeroOp, !!);
-  EXEC_UNARY(MinusOp, -);
-
-  EXEC_UNARY_F(MinusFOp, -);
-  case RShiftOp::id: {
-    auto x = eval(op->DEF(0));
-    auto y = eval(op->DEF(1));
-    if (x & 0x80000000)
-      // This is a negative 32-bit integer.
-      store(op, (intptr_t) ((int) x >> y));
-    else
-      store(op, x >> y);
-    break;
-  }
-  case PhiOp::id: {
-    const auto &ops = op->getOperands();
-    const auto &attrs = op->getAttrs();
-    bool success = false;
-    for (int i = 0; i < ops.size(); i++) {
-      if (FROM(attrs[i]) == prev) {
-        value[op] = value[ops[i].defining];
-        success = true;
+        CallSite site;
+        site.name = NAME(op);
+        site.external = isExtern(site.name);
+        for (auto operand : op->getOperands())
+          site.args.push_back(slots[operand.defining]);
+        emit(Call, op).imm.vi = fn->calls.size();
+        fn->calls.push_back(site);
+        break;
+      }
+      case GotoOp::id:
+        jump(op, edge(bb, TARGET(op)));
+        break;
+      case BranchOp::id: {
+        jumps.push_back(fn->code.size());
+        auto &inst = emit(profiling ? CountedBranch : Branch, op);
+        inst.b = edge(bb, TARGET(op));
+        inst.c = edge(bb, ELSE(op));
+        if (profiling)
+          inst.imm.vi = counter(op, true);
+        break;
+      }
+      case ReturnOp::id:
+        emit(op->getOperandCount() ? Ret : RetVoid, op);
+        break;
+      case LoadOp::id: {
+        size_t size = SIZE(op);
+        if (op->getResultType() == sys::Value::f32)
+          emit(LoadF, op);
+        else if (size == 4)
+          emit(LoadI32, op);
+        else if (size == 8)
+          emit(LoadI64, op);
+        else
+          emit(Unknown, op);
+        break;
+      }
+      case StoreOp::id: {
+        size_t size = SIZE(op);
+        if (op->DEF(0)->getResultType() == sys::Value::f32)
+          emit(StoreF, op);
+        else if (size == 4)
+          emit(StoreI32, op);
+        else if (size == 8)
+          emit(StoreI64, op);
+        else
+          emit(Unknown, op);
+        break;
+      }
+      LOWER(AddIOp, AddI);
+      LOWER(SubIOp, SubI);
+      LOWER(MulIOp, MulI);
+      LOWER(DivIOp, DivI);
+      LOWER(ModIOp, ModI);
+      LOWER(EqOp, Eq);
+      LOWER(NeOp, Ne);
+      LOWER(LtOp, Lt);
+      LOWER(LeOp, Le);
+      LOWER(AndIOp, AndI);
+      LOWER(OrIOp, OrI);
+      LOWER(XorIOp, XorI);
+      LOWER(LShiftOp, LShift);
+      LOWER(RShiftOp, RShift);
+      LOWER(AddLOp, AddL);
+      LOWER(SubLOp, SubL);
+      LOWER(MulLOp, MulL);
+      LOWER(RShiftLOp, RShiftL);
+      LOWER(AddFOp, AddF);
+      LOWER(SubFOp, SubF);
+      LOWER(MulFOp, MulF);
+      LOWER(DivFOp, DivF);
+      LOWER(EqFOp, EqF);
+      LOWER(LeFOp, LeF);
+      LOWER(LtFOp, LtF);
+      LOWER(NeFOp, NeF);
+      LOWER(NotOp, Not);
+      LOWER(SetNotZeroOp, SetNotZero);
+      LOWER(MinusOp, Minus);
+      LOWER(MinusFOp, MinusF);
+      LOWER(I2FOp, I2F);
+      LOWER(F2IOp, F2I);
+      LOWER(SelectOp, Select);
+      default:
+        // Only an error if it's actually reached.
+        emit(Unknown, op);
         break;
       }
     }
-    if (!success)
-      sys_unreachable("undef phi: coming from " << bbmap[prev] << ", current place is " << bbmap[op->getParent()]);
-    break;
   }
-  case GetGlobalOp::id: {
-    const auto &name = NAME(op);
-    if (!globalMap.count(name))
-      sys_unreachable("unknown global: " << name);
 
-    value[op] = globalMap[name];
-    break;
-  }
-  case LoadOp::id: {
-    size_t size = SIZE(op);
-    bool fp = op->getResultType() == sys::Value::f32;
-    intptr_t addr = eval(op->DEF());
-    if (fp)
-      store(op, *(float*) addr);
-    else if (size == 4)
-      store(op, (intptr_t) *(int*) addr);
-    else if (size == 8)
-      store(op, *(intptr_t*) addr);
-    else
-      assert(false);
-    break;
-  }
-  case StoreOp::id: {
-    size_t size = SIZE(op);
-    intptr_t addr = eval(op->DEF(1));
-    Op *def = op->DEF(0);
-    bool fp = def->getResultType() == sys::Value::f32;
-    if (fp)
-      *(float*) addr = evalf(def);
-    else if (size == 4)
-      *(int*) addr = eval(def);
-    else if (size == 8)
-      *(intptr_t*) addr = eval(def);
-    else
-      assert(false);
-    break;
+#undef LOWER
+
+  for (auto [key, label] : edges) {
+    auto [from, to] = key;
+    labels[label] = fn->code.size();
+    // Phis are executed one after another, so later ones see the earlier moves.
+    for (auto phi : to->getPhis()) {
+      const auto &ops = phi->getOperands();
+      const auto &attrs = phi->getAttrs();
+      bool found = false;
+      for (size_t i = 0; i < ops.size(); i++) {
+        if (FROM(attrs[i]) == from) {
+          emit(Mov, phi).a = slots[ops[i].defining];
+          found = true;
+          break;
+        }
+      }
+      if (!found)
+        emit(UndefPhi, phi);
+    }
+    jump(to->getFirstOp(), blocks[to]);
   }
-  case SelectOp::id: {
-    Op *cond = op->DEF(0);
-    store(op, eval(cond) ? eval(op->DEF(1)) : eval(op->DEF(2)));
-    break;
+
+  for (auto i : jumps) {
+    auto &inst = fn->code[i];
+    inst.b = labels[inst.b];
+    if (inst.code == Branch || inst.code == CountedBranch)
+      inst.c = labels[inst.c];
   }
-  default:
-    sys_unreachable("unknown op type: " << ip);
+  fn->counts.resize(fn->counters.size());
+  return fn;
+}
+
+Interpreter::Function *Interpreter::getFunction(const std::string &name) {
+  auto &fn = compiled[name];
+  if (!fn) {
+    if (!fnMap.count(name))
+      sys_unreachable("unknown function: " << name);
+    fn = compile(fnMap[name]);
   }
+  return fn;
 }
 
 Interpreter::Value Interpreter::applyExtern(const std::string &name, const std::vector<Value> &args) {
@@ -288,101 +399,302 @@ Interpreter::Value Interpreter::applyExtern(const std::string &name, const std::
   sys_unreachable("unknown extern function: " << name);
 }
 
-Interpreter::Value Interpreter::execf(Region *region, const std::vector<Value> &args) {
-  auto entry = region->getFirstBlock();
-  ip = entry->getFirstOp();
-  while (!isa<ReturnOp>(ip)) {
-    switch (ip->opid) {
-    case GotoOp::id: {
-      auto dest = TARGET(ip);
-      prev = ip->getParent();
-      ip = dest->getFirstOp();
-      break;
-    }
-    case BranchOp::id: {
-      auto def = ip->DEF(0);
-      auto dest = eval(def) ? TARGET(ip) : ELSE(ip);
-      prev = ip->getParent();
-      ip = dest->getFirstOp();
-      break;
-    }
-    // Note that we need the stack space to live long enough,
-    // till we exit this interpreted function.
-    case AllocaOp::id: {
-      void *space = alloca(SIZE(ip));
-      store(ip, (intptr_t) space);
-      ip = ip->nextOp();
-      break;
-    }
-    case CallOp::id: {
-      bool utilized = false;
-      switch (cache_type) {
-      case 3: {
-        auto i = args[0].vi, j = args[1].vi, k = args[2].vi;
-        if (i < CACHE_3_N && j < CACHE_3_N && k < CACHE_3_N && i >= 0 && j >= 0 && k >= 0) {
-          value[ip] = { ((cache_3_ptr) cache)[i][j][k] };
-          utilized = true;
-        }
-        break;
-      }
-      case 2: {
-        auto i = args[0].vi, j = args[1].vi;
-        if (i < CACHE_2_N && j < CACHE_2_N && i >= 0 && j >= 0) {
-          value[ip] = { ((cache_2_ptr) cache)[i][j] };
-          utilized = true;
-        }
-        break;
-      }
-      }
-      if (utilized) {
-        ip = ip->nextOp();
-        break;
-      }
-      const auto &name = NAME(ip);
-      auto operands = ip->getOperands();
-      std::vector<Value> args;
-      args.reserve(operands.size());
-      for (auto operand : operands)
-        args.push_back(value[operand.defining]);
-      if (isExtern(name)) {
-        value[ip] = applyExtern(name, args);
-        ip = ip->nextOp();
-      }
-      else {
-        Op *call = ip;
-        Value v;
-        {
-          SemanticScope scope(*this);
-          v = execf(fnMap[name]->getRegion(), args);
-        }
-        value[call] = v;
-        ip = call->nextOp();
-      }
-      break;
+// The registers are in fact 64-bit.
+// 32-bit values are kept sign-extended, as constants and loads already are.
+#define EXEC_BINARY(Ty, sign) \
+  L_##Ty: \
+    v[pc->dst].vi = (intptr_t) (int) (v[pc->a].vi sign v[pc->b].vi); \
+    NEXT
+
+#define EXEC_BINARY_L(Ty, sign) \
+  L_##Ty: \
+    v[pc->dst].vi = (intptr_t) (v[pc->a].vi sign v[pc->b].vi); \
+    NEXT
+
+#define EXEC_BINARY_F(Ty, sign) \
+  L_##Ty: \
+    v[pc->dst] = Value { .vf = v[pc->a].vf sign v[pc->b].vf }; \
+    NEXT
+
+#define EXEC_BINARY_FCOMP(Ty, sign) \
+  L_##Ty: \
+    v[pc->dst].vi = (intptr_t) (v[pc->a].vf sign v[pc->b].vf); \
+    NEXT
+
+#define EXEC_UNARY(Ty, sign) \
+  L_##Ty: \
+    v[pc->dst].vi = (intptr_t) (int) (sign v[pc->a].vi); \
+    NEXT
+
+#define EXEC_UNARY_F(Ty, sign) \
+  L_##Ty: \
+    v[pc->dst] = Value { .vf = sign v[pc->a].vf }; \
+    NEXT
+
+// Threaded dispatch: each handler jumps straight to the next one.
+#define NEXT goto *(++pc)->handler
+#define JUMP(to) do { pc = code + (to); goto *pc->handler; } while (0)
+
+void *Interpreter::allocate(size_t size) {
+  // Keep everything 16-byte aligned, like a real stack.
+  size = (size + 15) & ~size_t(15);
+  while (chunk < chunks.size() && used + size > chunks[chunk].size) {
+    chunk++;
+    used = 0;
+  }
+  if (chunk == chunks.size()) {
+    size_t chunkSize = std::max(size, CHUNK_SIZE);
+    chunks.push_back(Chunk { new char[chunkSize], chunkSize });
+  }
+  void *space = chunks[chunk].base + used;
+  used += size;
+  return space;
+}
+
+struct Interpreter::Activation {
+  Function *fn;
+  Inst *pc;
+  // Indices into `stack`.
+  size_t fp;
+  size_t args;
+  // Where allocas were when the call started.
+  size_t chunk;
+  size_t used;
+};
+
+Interpreter::Value Interpreter::execf(Function *fn, const Value *args, size_t argc) {
+#define BYTECODE_LABEL(x) &&L_##x,
+  static const void *const handlers[] = { BYTECODES(BYTECODE_LABEL) };
+#undef BYTECODE_LABEL
+
+  std::vector<Activation> calls;
+  Inst *code, *pc;
+  size_t fp, argp;
+  // The frame and arguments of the current call. Reload with RELOAD() after `stack` grows.
+  Value *v, *a;
+
+#define RELOAD() (v = stack.data() + fp, a = stack.data() + argp)
+
+  // Pushes a frame for `fn`, whose `argc` arguments are right below `sp`.
+  auto enter = [&](Function *fn, size_t argc) {
+    if (!fn->threaded) {
+      for (auto &inst : fn->code)
+        inst.handler = handlers[inst.code];
+      fn->threaded = true;
     }
-    case GetArgOp::id: {
-      value[ip] = args[V(ip)];
-      ip = ip->nextOp();
-      break;
+    argp = sp - argc;
+    fp = sp;
+    sp += fn->slots;
+    if (sp > stack.size())
+      stack.resize(std::max(sp, stack.size() * 2));
+    code = fn->code.data();
+    pc = code;
+    RELOAD();
+  };
+
+  // Popping the outermost frame returns to this point.
+  size_t base = sp;
+  size_t baseChunk = chunk, baseUsed = used;
+  if (sp + argc > stack.size())
+    stack.resize(std::max(sp + argc, stack.size() * 2));
+  std::copy(args, args + argc, stack.begin() + sp);
+  sp += argc;
+  enter(fn, argc);
+  goto *pc->handler;
+
+L_Const:
+  v[pc->dst] = pc->imm;
+  NEXT;
+L_Mov:
+  v[pc->dst] = v[pc->a];
+  NEXT;
+L_GetArg:
+  v[pc->dst] = a[pc->a];
+  NEXT;
+// The space lives until this interpreted function returns.
+L_Alloca:
+  v[pc->dst].vi = (intptr_t) allocate(pc->imm.vi);
+  NEXT;
+L_Call: {
+  auto &site = fn->calls[pc->imm.vi];
+  const auto &slots = site.args;
+  switch (cache_type) {
+  case 3: {
+    auto i = v[slots[0]].vi, j = v[slots[1]].vi, k = v[slots[2]].vi;
+    if (i < CACHE_3_N && j < CACHE_3_N && k < CACHE_3_N && i >= 0 && j >= 0 && k >= 0) {
+      v[pc->dst] = { ((cache_3_ptr) cache)[i][j][k] };
+      NEXT;
     }
-    default:
-      exec(ip);
-      ip = ip->nextOp();
-      break;
+    break;
+  }
+  case 2: {
+    auto i = v[slots[0]].vi, j = v[slots[1]].vi;
+    if (i < CACHE_2_N && j < CACHE_2_N && i >= 0 && j >= 0) {
+      v[pc->dst] = { ((cache_2_ptr) cache)[i][j] };
+      NEXT;
     }
+    break;
   }
-  // Now `ip` is a ReturnOp.
-  if (ip->getOperandCount()) {
-    auto def = ip->DEF(0);
-    return value[def];
   }
+
+  if (site.external) {
+    std::vector<Value> callArgs;
+    callArgs.reserve(slots.size());
+    for (auto slot : slots)
+      callArgs.push_back(v[slot]);
+    v[pc->dst] = applyExtern(site.name, callArgs);
+    NEXT;
+  }
+
+  if (!site.callee)
+    site.callee = getFunction(site.name);
+  calls.push_back(Activation { fn, pc, fp, argp, chunk, used });
+
+  // Push the arguments at the top of the stack, where the callee expects them.
+  if (sp + slots.size() > stack.size()) {
+    stack.resize(std::max(sp + slots.size(), stack.size() * 2));
+    RELOAD();
+  }
+  for (auto slot : slots)
+    stack[sp++] = v[slot];
+  fn = site.callee;
+  enter(fn, slots.size());
+  goto *pc->handler;
+}
+L_Goto:
+  JUMP(pc->b);
+L_Branch:
+  JUMP(v[pc->a].vi ? pc->b : pc->c);
+L_Count:
+  fn->counts[pc->a]++;
+  NEXT;
+L_CountedBranch:
+  if (v[pc->a].vi) {
+    fn->counts[pc->imm.vi]++;
+    JUMP(pc->b);
+  }
+  JUMP(pc->c);
+L_Ret:
+L_RetVoid: {
+  Value result = pc->code == Ret ? v[pc->a] : Value();
+  // Pop the frame and the arguments in one go.
+  sp = argp;
+  if (calls.empty()) {
+    assert(sp == base);
+    chunk = baseChunk;
+    used = baseUsed;
+    return result;
+  }
+
+  auto caller = calls.back();
+  calls.pop_back();
+  chunk = caller.chunk;
+  used = caller.used;
+  fn = caller.fn;
+  code = fn->code.data();
+  pc = caller.pc;
+  fp = caller.fp;
+  argp = caller.args;
+  RELOAD();
+  v[pc->dst] = result;
+  NEXT;
+}
+
+  EXEC_BINARY(AddI, +);
+  EXEC_BINARY(SubI, -);
+  EXEC_BINARY(MulI, *);
+  EXEC_BINARY(DivI, /);
+  EXEC_BINARY(ModI, %);
+  EXEC_BINARY(Eq, ==);
+  EXEC_BINARY(Ne, !=);
+  EXEC_BINARY(Lt, <);
+  EXEC_BINARY(Le, <=);
+  EXEC_BINARY(AndI, &);
+  EXEC_BINARY(OrI, |);
+  EXEC_BINARY(XorI, ^);
+  EXEC_BINARY(LShift, <<);
+
+  EXEC_BINARY_L(AddL, +);
+  EXEC_BINARY_L(SubL, -);
+  EXEC_BINARY_L(MulL, *);
+  EXEC_BINARY_L(RShiftL, >>);
+
+  EXEC_BINARY_F(AddF, +);
+  EXEC_BINARY_F(SubF, -);
+  EXEC_BINARY_F(MulF, *);
+  EXEC_BINARY_F(DivF, /);
+  EXEC_BINARY_FCOMP(EqF, ==);
+  EXEC_BINARY_FCOMP(LeF, <=);
+  EXEC_BINARY_FCOMP(LtF, <);
+  EXEC_BINARY_FCOMP(NeF, !=);
+
+  EXEC_UNARY(Not, !);
+  EXEC_UNARY(SetNotZero, !!);
+  EXEC_UNARY(Minus, -);
+
+  EXEC_UNARY_F(MinusF, -);
+
+L_RShift:
+  v[pc->dst].vi = (intptr_t) ((int) v[pc->a].vi >> v[pc->b].vi);
+  NEXT;
+L_I2F:
+  v[pc->dst] = Value { .vf = (float) (int) v[pc->a].vi };
+  NEXT;
+L_F2I:
+  v[pc->dst].vi = (intptr_t) v[pc->a].vf;
+  NEXT;
+L_LoadI32:
+  v[pc->dst].vi = (intptr_t) *(int*) v[pc->a].vi;
+  NEXT;
+L_LoadI64:
+  v[pc->dst].vi = *(intptr_t*) v[pc->a].vi;
+  NEXT;
+L_LoadF:
+  v[pc->dst] = Value { .vf = *(float*) v[pc->a].vi };
+  NEXT;
+L_StoreI32:
+  *(int*) v[pc->b].vi = v[pc->a].vi;
+  NEXT;
+L_StoreI64:
+  *(intptr_t*) v[pc->b].vi = v[pc->a].vi;
+  NEXT;
+L_StoreF:
+  *(float*) v[pc->b].vi = v[pc->a].vf;
+  NEXT;
+L_Select:
+  v[pc->dst].vi = v[pc->a].vi ? v[pc->b].vi : v[pc->c].vi;
+  NEXT;
+L_UndefPhi:
+  sys_unreachable("undef phi: " << pc->op);
+  return Value();
+L_Unknown:
+  sys_unreachable("unknown op type: " << pc->op);
   return Value();
+
+#undef RELOAD
+}
+
+void Interpreter::annotate() {
+  for (const auto &[name, func] : fnMap)
+    getFunction(name);
+
+  for (const auto &[name, fn] : compiled) {
+    for (size_t i = 0; i < fn->counters.size(); i++) {
+      auto [op, taken] = fn->counters[i];
+      auto attr = op->find<ProfileAttr>();
+      if (!attr) {
+        op->add<ProfileAttr>();
+        attr = op->find<ProfileAttr>();
+      }
+      (taken ? attr->taken : attr->count) = fn->counts[i];
+    }
+  }
 }
 
 void Interpreter::run(std::istream &input) {
   inbuf << std::hexfloat << input.rdbuf();
   outbuf << std::hexfloat;
-  auto exit = execf(fnMap["main"]->getRegion(), {});
+  auto exit = execf(getFunction("main"), nullptr, 0);
   retcode = exit.vi;
 }
 
@@ -391,7 +703,7 @@ void Interpreter::runFunction(const std::string &func, const std::vector<int> &a
   values.reserve(args.size());
   for (auto x : args)
     values.push_back(Value { .vi = x });
-  auto exit = execf(fnMap[func]->getRegion(), values);
+  auto exit = execf(getFunction(func), values.data(), values.size());
   if (cache) {
     if (cache_type == 3) {
       auto x = (cache_3_ptr) cache;
@@ -27,41 +27,50 @@ class Interpreter {
     float vf;
   };
 
-  using SymbolTable = std::unordered_map<Op*, Value>;
+  // A function lowered to bytecode; see compile().
+  struct Inst;
+  struct CallSite;
+  struct Function;
+  // The state of a caller, saved while its callee runs.
+  // Calls don't recurse on the host stack.
+  struct Activation;
 
   std::stringstream outbuf, inbuf;
   std::map<std::string, Op*> fnMap;
   std::set<std::string> fpGlobals;
   std::map<std::string, Value> globalMap;
+  // Functions are compiled when they're first called.
+  std::map<std::string, Function*> compiled;
+
+  // Arguments and frames of active calls, one after another.
+  // Each call pushes its arguments and then `slots` values for its ops.
+  std::vector<Value> stack;
+  // The first free element of `stack`.
+  size_t sp = 0;
+
+  // Memory for allocas. Chunks never move, as the program holds pointers into them,
+  // and are kept around for later calls once freed.
+  struct Chunk {
+    char *base;
+    size_t size;
+  };
+  std::vector<Chunk> chunks;
+  // The chunk currently allocated from, and the bytes used in it.
+  size_t chunk = 0;
+  size_t used = 0;
 
-  SymbolTable value;
-  // Used for phi functions.
-  BasicBlock *prev;
-  // Instruction pointer.
-  Op *ip;
-
-  intptr_t eval(Op *op);
-  float evalf(Op *op);
-
-  void store(Op *op, float v);
-  void store(Op *op, intptr_t v);
+  void *allocate(size_t size);
 
-  void exec(Op *op);
-  Value execf(Region *region, const std::vector<Value> &args);
+  Function *compile(Op *func);
+  Function *getFunction(const std::string &name);
+  Value execf(Function *fn, const Value *args, size_t argc);
 
   Value applyExtern(const std::string &name, const std::vector<Value> &args);
 
   unsigned retcode;
   int *cache = nullptr;
   int cache_type = 0;
-
-  struct SemanticScope {
-    Interpreter &parent;
-    SymbolTable table;
-  public:
-    SemanticScope(Interpreter &itp): parent(itp), table(itp.value) {}
-    ~SemanticScope() { parent.value = table; }
-  };
+  bool profiling = false;
 public:
   Interpreter(ModuleOp *module);
   ~Interpreter();
@@ -70,6 +79,10 @@ public:
   void runFunction(const std::string &func, const std::vector<int> &args);
   void useCache(cache_3 cache) { this->cache = (int*) cache; cache_type = 3; }
   void useCache(cache_2 cache) { this->cache = (int*) cache; cache_type = 2; }
+  // Counts blocks, branches and calls from now on; call before running anything.
+  void useProfile() { profiling = true; }
+  // Writes the counts so far as ProfileAttrs. Functions that never ran get zeros.
+  void annotate();
   std::string out() { return outbuf.str(); }
   int exitcode() { return retcode & 0xff; }
 };
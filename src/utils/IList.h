@@ -0,0 +1,178 @@
+#ifndef ILIST_H
+#define ILIST_H
+
+#include <cassert>
+#include <cstddef>
+#include <iterator>
+#include <vector>
+
+namespace sys {
+
+template<class T>
+class IList;
+
+// Embeds the links of an intrusive list into `T`.
+// `T` must publicly derive from IListNode<T>.
+template<class T>
+class IListNode {
+  T *prev = nullptr;
+  T *next = nullptr;
+
+  friend class IList<T>;
+protected:
+  T *getPrevNode() const { return prev; }
+  T *getNextNode() const { return next; }
+};
+
+// A doubly-linked list whose links live inside the elements,
+// so insertion, removal and moving never allocate.
+//
+// It mimics the parts of std::list<T*> that passes use,
+// except that it can't be copied. Convert it to a vector to take a snapshot.
+template<class T>
+class IList {
+  T *head = nullptr;
+  T *tail = nullptr;
+  size_t count = 0;
+
+  static IListNode<T> *node(T *x) { return x; }
+public:
+  class iterator {
+    T *cur;
+    const IList *list;
+
+    friend class IList;
+  public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = T*;
+    using difference_type = std::ptrdiff_t;
+    using pointer = T**;
+    // Returned by value, so that std::reverse_iterator doesn't dangle.
+    using reference = T*;
+
+    iterator(): cur(nullptr), list(nullptr) {}
+    iterator(T *cur, const IList *list): cur(cur), list(list) {}
+
+    T *const &operator*() const { return cur; }
+
+    iterator &operator++() { cur = node(cur)->next; return *this; }
+    iterator &operator--() { cur = cur ? node(cur)->prev : list->tail; return *this; }
+    iterator operator++(int) { auto old = *this; ++*this; return old; }
+    iterator operator--(int) { auto old = *this; --*this; return old; }
+
+    bool operator==(const iterator &other) const { return cur == other.cur; }
+    bool operator!=(const iterator &other) const { return cur != other.cur; }
+  };
+
+  using const_iterator = iterator;
+  using reverse_iterator = std::reverse_iterator<iterator>;
+  using const_reverse_iterator = reverse_iterator;
+
+  IList() = default;
+  IList(const IList &other) = delete;
+  IList &operator=(const IList &other) = delete;
+
+  iterator begin() const { return iterator(head, this); }
+  iterator end() const { return iterator(nullptr, this); }
+  reverse_iterator rbegin() const { return reverse_iterator(end()); }
+  reverse_iterator rend() const { return reverse_iterator(begin()); }
+
+  size_t size() const { return count; }
+  bool empty() const { return !count; }
+  T *front() const { return head; }
+  T *back() const { return tail; }
+
+  // The iterator pointing at `x`, which must be in this list.
+  iterator iter(T *x) const { return iterator(x, this); }
+
+  // Links `x` before `at`.
+  void insert(iterator at, T *x) {
+    auto n = node(x);
+    T *before = at.cur;
+    T *after = before ? node(before)->prev : tail;
+
+    n->prev = after;
+    n->next = before;
+    if (after)
+      node(after)->next = x;
+    else
+      head = x;
+    if (before)
+      node(before)->prev = x;
+    else
+      tail = x;
+    count++;
+  }
+
+  void push_back(T *x) { insert(end(), x); }
+  void push_front(T *x) { insert(begin(), x); }
+
+  // Unlinks `x`. Its own links are left intact, so an iterator
+  // sitting on `x` can still advance past it.
+  void remove(T *x) {
+    auto n = node(x);
+    if (n->prev)
+      node(n->prev)->next = n->next;
+    else
+      head = n->next;
+    if (n->next)
+      node(n->next)->prev = n->prev;
+    else
+      tail = n->prev;
+    count--;
+  }
+
+  // Moves [first, last) out of `other` before `at`, relinking only the two ends.
+  // `onMove` is called on every moved element (e.g. to update parent pointers).
+  template<class F>
+  void splice(iterator at, IList &other, iterator first, iterator last, F onMove) {
+    if (first == last)
+      return;
+
+    T *b = first.cur;
+    T *e = last.cur ? node(last.cur)->prev : other.tail;
+
+    size_t n = 0;
+    for (T *x = b; ; x = node(x)->next) {
+      onMove(x);
+      n++;
+      if (x == e)
+        break;
+    }
+
+    // Detach from `other`.
+    T *bp = node(b)->prev;
+    T *en = node(e)->next;
+    if (bp)
+      node(bp)->next = en;
+    else
+      other.head = en;
+    if (en)
+      node(en)->prev = bp;
+    else
+      other.tail = bp;
+    other.count -= n;
+
+    // Attach to this list.
+    T *before = at.cur;
+    T *after = before ? node(before)->prev : tail;
+    node(b)->prev = after;
+    node(e)->next = before;
+    if (after)
+      node(after)->next = b;
+    else
+      head = b;
+    if (before)
+      node(before)->prev = e;
+    else
+      tail = e;
+    count += n;
+  }
+
+  // Takes a snapshot, which stays valid when the list is mutated.
+  operator std::vector<T*>() const { return std::vector<T*>(begin(), end()); }
+};
+
+}
+
+#endif
@@ -0,0 +1,227 @@
+#include "LinearScan.h"
+#include "../codegen/Ops.h"
+#include <algorithm>
+#include <queue>
+
+using namespace sys;
+
+LinearScan::LinearScan(const std::vector<std::vector<int>> &order): order(order) {}
+
+void LinearScan::fix(Op *op, int reg) {
+  fixedReg[op] = reg;
+}
+
+void LinearScan::add(Op *op, int cls) {
+  index[op] = intervals.size();
+  intervals.push_back({ op, 0, 0, cls });
+}
+
+void LinearScan::hint(Op *op, int reg) {
+  regHint[op] = reg;
+}
+
+void LinearScan::tie(Op *a, Op *b) {
+  partners[a].push_back(b);
+  partners[b].push_back(a);
+}
+
+void LinearScan::alias(Op *b, Op *a) {
+  aliasOf[b] = a;
+  aliased.insert(a);
+}
+
+bool LinearScan::blocked(int reg, int start, int end) {
+  if (!fixed.count(reg))
+    return false;
+
+  // The last fixed interval that starts before `end`.
+  const auto &list = fixed[reg];
+  auto it = std::lower_bound(list.begin(), list.end(), std::make_pair(end, 0));
+  if (it == list.begin())
+    return false;
+  int i = it - list.begin() - 1;
+  return fixedMaxEnd[reg][i] > start;
+}
+
+int LinearScan::tryHint(const Interval &cur, const std::vector<bool> &busy) {
+  const auto &regs = order[cur.cls];
+  auto usable = [&](int reg) {
+    auto it = std::find(regs.begin(), regs.end(), reg);
+    if (it == regs.end())
+      return -1;
+    int k = it - regs.begin();
+    return !busy[k] && !blocked(reg, cur.start, cur.end) ? k : -1;
+  };
+
+  if (regHint.count(cur.op)) {
+    int k = usable(regHint[cur.op]);
+    if (k >= 0)
+      return k;
+  }
+  for (auto other : partners[cur.op]) {
+    int reg = -1;
+    if (assignment.count(other))
+      reg = assignment[other];
+    else if (fixedReg.count(other))
+      reg = fixedReg[other];
+    if (reg < 0)
+      continue;
+
+    int k = usable(reg);
+    if (k >= 0)
+      return k;
+  }
+  return -1;
+}
+
+void LinearScan::run(Region *region) {
+  // Number the ops in layout order.
+  std::unordered_map<Op*, int> pos;
+  std::unordered_map<Op*, int> start, end;
+  int p = 0;
+  for (auto bb : region->getBlocks()) {
+    for (auto op : bb->getOps()) {
+      pos[op] = p;
+      // A value that's never used still takes a register where it's defined.
+      start[op] = p;
+      end[op] = p + 1;
+      p++;
+    }
+  }
+
+  // Intervals are half-open: a value last used by some op doesn't clash with its result.
+  p = 0;
+  for (auto bb : region->getBlocks()) {
+    int blockStart = p;
+    int blockEnd = p + bb->getOpCount();
+    for (auto op : bb->getOps()) {
+      // Phi operands are live out of the predecessors instead.
+      if (!isa<PhiOp>(op)) {
+        for (auto v : op->getOperands()) {
+          auto def = v.defining;
+          end[def] = std::max(end[def], pos[op]);
+        }
+      }
+      p++;
+    }
+    for (auto op : bb->getLiveIn())
+      start[op] = std::min(start[op], blockStart);
+    for (auto op : bb->getLiveOut())
+      end[op] = std::max(end[op], blockEnd);
+  }
+
+  // Intervals are spans in layout order, so the union of two is the span covering both.
+  for (auto [b, a] : aliasOf) {
+    start[a] = std::min(start[a], start[b]);
+    end[a] = std::max(end[a], end[b]);
+  }
+
+  for (auto &interval : intervals) {
+    interval.start = start[interval.op];
+    interval.end = end[interval.op];
+  }
+
+  for (auto [op, reg] : fixedReg)
+    fixed[reg].push_back({ start[op], end[op] });
+  for (auto &[reg, list] : fixed) {
+    std::sort(list.begin(), list.end());
+    auto &maxEnd = fixedMaxEnd[reg];
+    int furthest = 0;
+    for (auto [_, e] : list) {
+      furthest = std::max(furthest, e);
+      maxEnd.push_back(furthest);
+    }
+  }
+
+  std::vector<int> sorted(intervals.size());
+  for (int i = 0; i < sorted.size(); i++)
+    sorted[i] = i;
+  std::stable_sort(sorted.begin(), sorted.end(), [&](int a, int b) {
+    return intervals[a].start < intervals[b].start;
+  });
+
+  // Per class, the interval holding each register (by its index in `order`), or -1.
+  std::vector<std::vector<int>> holder;
+  for (const auto &regs : order)
+    holder.emplace_back(regs.size(), -1);
+  std::vector<int> spilled;
+
+  for (auto i : sorted) {
+    auto &cur = intervals[i];
+    auto &regs = order[cur.cls];
+    auto &held = holder[cur.cls];
+
+    // Expire whatever has ended.
+    std::vector<bool> busy(regs.size());
+    for (int k = 0; k < regs.size(); k++) {
+      if (held[k] >= 0 && intervals[held[k]].end <= cur.start)
+        held[k] = -1;
+      busy[k] = held[k] >= 0;
+    }
+
+    int k = tryHint(cur, busy);
+    for (int j = 0; j < regs.size() && k < 0; j++) {
+      if (!busy[j] && !blocked(regs[j], cur.start, cur.end))
+        k = j;
+    }
+
+    if (k < 0) {
+      // Spill whatever lives the longest, if that's not `cur` itself.
+      // Aliased intervals stay in registers unless there's no other way.
+      bool pinned = aliased.count(cur.op);
+      int victim = -1;
+      for (int j = 0; j < regs.size(); j++) {
+        if (held[j] < 0 || blocked(regs[j], cur.start, cur.end) || aliased.count(intervals[held[j]].op))
+          continue;
+        if (victim < 0 || intervals[held[j]].end > intervals[held[victim]].end)
+          victim = j;
+      }
+
+      if (victim < 0 || !pinned && intervals[held[victim]].end <= cur.end) {
+        spilled.push_back(i);
+        continue;
+      }
+
+      int v = held[victim];
+      intervals[v].reg = -1;
+      assignment.erase(intervals[v].op);
+      spilled.push_back(v);
+      k = victim;
+    }
+
+    held[k] = i;
+    cur.reg = regs[k];
+    assignment[cur.op] = cur.reg;
+  }
+
+  // Now the same for stack slots, which are unlimited.
+  std::stable_sort(spilled.begin(), spilled.end(), [&](int a, int b) {
+    return intervals[a].start < intervals[b].start;
+  });
+  // (end, slot) of the slots in use.
+  std::priority_queue<std::pair<int, int>, std::vector<std::pair<int, int>>, std::greater<>> inUse;
+  std::priority_queue<int, std::vector<int>, std::greater<>> available;
+  for (auto i : spilled) {
+    auto &cur = intervals[i];
+    while (!inUse.empty() && inUse.top().first <= cur.start) {
+      available.push(inUse.top().second);
+      inUse.pop();
+    }
+
+    int s;
+    if (!available.empty()) {
+      s = available.top();
+      available.pop();
+    } else
+      s = slotCount++;
+    slot[cur.op] = s;
+    inUse.push({ cur.end, s });
+  }
+
+  for (auto [b, a] : aliasOf) {
+    if (assignment.count(a))
+      assignment[b] = assignment[a];
+    else if (slot.count(a))
+      slot[b] = slot[a];
+  }
+}
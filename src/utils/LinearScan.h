@@ -0,0 +1,75 @@
+#ifndef LINEAR_SCAN_H
+#define LINEAR_SCAN_H
+
+#include "../codegen/OpBase.h"
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace sys {
+
+// Linear scan register allocation (Poletto & Sarkar, TOPLAS 1999),
+// for when compile time matters more than the code. Shared by both backends;
+// registers are plain integers here.
+//
+// Each value gets a single interval over the blocks in layout order, from its definition
+// to its last use, stretched over every block it's live across. Values that come
+// precolored are fixed intervals, which nothing in the same register may overlap.
+// When registers run out, the interval that ends last is spilled.
+//
+// The allocators reload a spilled value at each of its uses, so there's no need to
+// split intervals further; stack slots are handed out by a second scan over the spilled ones.
+class LinearScan {
+  struct Interval {
+    Op *op;
+    int start, end;
+    int cls;
+    int reg = -1;
+  };
+
+  // The registers of each class, in order of preference.
+  std::vector<std::vector<int>> order;
+  std::vector<Interval> intervals;
+  std::unordered_map<Op*, int> index;
+
+  std::unordered_map<Op*, int> fixedReg;
+  // For each register, the precolored intervals sorted by start,
+  // with the furthest end of any of them so far.
+  std::unordered_map<int, std::vector<std::pair<int, int>>> fixed;
+  std::unordered_map<int, std::vector<int>> fixedMaxEnd;
+
+  std::unordered_map<Op*, int> regHint;
+  std::unordered_map<Op*, std::vector<Op*>> partners;
+  // Maps an op to the one whose interval it's folded into.
+  std::unordered_map<Op*, Op*> aliasOf;
+  std::unordered_set<Op*> aliased;
+
+  bool blocked(int reg, int start, int end);
+  int tryHint(const Interval &cur, const std::vector<bool> &busy);
+public:
+  LinearScan(const std::vector<std::vector<int>> &order);
+
+  // `op` is already in `reg`.
+  void fix(Op *op, int reg);
+  // `op` needs a register of the class `cls`, an index into the orders.
+  void add(Op *op, int cls);
+  // `op` would like to be in `reg`.
+  void hint(Op *op, int reg);
+  // `a` and `b` would like to share a register.
+  void tie(Op *a, Op *b);
+  // `b` must be in the same register as `a`, which has been added. `b` isn't added itself;
+  // the interval of `a` grows to cover it. Such intervals are only spilled as a last resort.
+  void alias(Op *b, Op *a);
+
+  // The region must have liveness up to date.
+  void run(Region *region);
+
+  std::unordered_map<Op*, int> assignment;
+  // Spilled values; those live at the same time never share a slot.
+  std::unordered_map<Op*, int> slot;
+  int slotCount = 0;
+};
+
+}
+
+#endif
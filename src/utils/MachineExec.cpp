@@ -0,0 +1,911 @@
+#include "MachineExec.h"
+#include "../codegen/Attrs.h"
+#include <algorithm>
+#include <cmath>
+#include <climits>
+#include <cstring>
+#include <cstdlib>
+
+using namespace sys;
+using namespace sys::exec;
+
+#define sys_unreachable(x) \
+  do { std::cerr << x << "\n"; assert(false); } while (0)
+
+// Defined in Pass.cpp
+namespace sys {
+  bool isExtern(const std::string &name);
+}
+
+namespace {
+
+using Word = MachineInterpreter::Word;
+using Width = MachineInterpreter::Width;
+using Cond = MachineInterpreter::Cond;
+
+// The stack is committed lazily by the host, so a big one costs nothing until it's used.
+const size_t STACK_SIZE = 256 << 20;
+
+// Before register allocation, the registers at the entry of a function are kept in the first slots:
+// the integer arguments, the floating point arguments, and sp.
+const int ENTRY_ARGS = 0;
+const int ENTRY_FARGS = 8;
+const int ENTRY_SP = 16;
+const int ENTRY_SLOTS = 17;
+
+// What callers leave in the link register; each depth gets its own value.
+const uint64_t LINK_BASE = 0x5a5a000000000000ull;
+// What an extern leaves in the registers it's allowed to clobber.
+const uint64_t POISON = 0xdeadbeefdeadbeefull;
+
+size_t round16(size_t x) {
+  return (x + 15) & ~size_t(15);
+}
+
+uint64_t extend(uint64_t x, Width width) {
+  switch (width) {
+  case MachineInterpreter::W32S:
+    return (int64_t) (int32_t) x;
+  case MachineInterpreter::W32Z:
+    return (uint32_t) x;
+  default:
+    return x;
+  }
+}
+
+// Compares as 32-bit integers unless `width` is W64, like `cmp w0, w1` on arm.
+bool compare(uint64_t a, uint64_t b, Cond cond, Width width) {
+  int64_t x = width == MachineInterpreter::W64 ? (int64_t) a : (int32_t) a;
+  int64_t y = width == MachineInterpreter::W64 ? (int64_t) b : (int32_t) b;
+  switch (cond) {
+  case MachineInterpreter::Eq: return x == y;
+  case MachineInterpreter::Ne: return x != y;
+  case MachineInterpreter::Lt: return x < y;
+  case MachineInterpreter::Le: return x <= y;
+  case MachineInterpreter::Gt: return x > y;
+  case MachineInterpreter::Ge: return x >= y;
+  }
+  return false;
+}
+
+bool compareF(float x, float y, Cond cond) {
+  switch (cond) {
+  case MachineInterpreter::Eq: return x == y;
+  case MachineInterpreter::Ne: return !(x == y);
+  case MachineInterpreter::Lt: return x < y;
+  case MachineInterpreter::Le: return x <= y;
+  case MachineInterpreter::Gt: return x > y;
+  case MachineInterpreter::Ge: return x >= y;
+  }
+  return false;
+}
+
+Word scalar(uint64_t x) {
+  Word w;
+  w.x[0] = x;
+  w.x[1] = 0;
+  return w;
+}
+
+Word scalarF(float f) {
+  Word w;
+  w.x[0] = w.x[1] = 0;
+  w.f[0] = f;
+  return w;
+}
+
+}
+
+struct MachineInterpreter::Function {
+  std::string name;
+  std::vector<Inst> code;
+  int slots = 0;
+  // Bytes taken from the stack on entry, before register allocation.
+  int frame = 0;
+  Counts counts;
+};
+
+MachineInterpreter::MachineInterpreter(ModuleOp *module, bool allocated): allocated(allocated) {
+  auto region = module->getRegion();
+  auto block = region->getFirstBlock();
+  for (auto op : block->getOps()) {
+    if (isa<GlobalOp>(op)) {
+      const auto &name = NAME(op);
+      size_t size = SIZE(op);
+
+      // Keep globals 16-byte aligned, as Dump does; vector accesses rely on that.
+      char *vp = (char*) aligned_alloc(16, round16(size));
+      memset(vp, 0, round16(size));
+      if (auto intArr = op->find<IntArrayAttr>())
+        memcpy(vp, intArr->vi, size);
+      if (auto fpArr = op->find<FloatArrayAttr>())
+        memcpy(vp, fpArr->vf, size);
+      globalMap[name] = (uint64_t) vp;
+      globalSize[(uint64_t) vp] = size;
+      continue;
+    }
+
+    if (isa<FuncOp>(op)) {
+      fnMap[NAME(op)] = op;
+      continue;
+    }
+
+    sys_unreachable("unexpected top level op: " << op);
+  }
+
+  stackSize = STACK_SIZE;
+  stack = new char[stackSize];
+}
+
+MachineInterpreter::~MachineInterpreter() {
+  for (const auto &[name, fn] : compiled)
+    delete fn;
+  for (const auto &[addr, size] : globalSize)
+    free((void*) addr);
+  delete[] stack;
+}
+
+int MachineInterpreter::slot(Op *op) {
+  auto it = slots->find(op);
+  if (it == slots->end())
+    sys_unreachable("no slot for op: " << op);
+  return SLOT_BASE + it->second;
+}
+
+uint64_t MachineInterpreter::address(const std::string &global) {
+  if (!globalMap.count(global))
+    sys_unreachable("unknown global: " << global);
+  return globalMap[global];
+}
+
+char *MachineInterpreter::memory(uint64_t addr, size_t size) {
+  auto base = (uint64_t) stack;
+  if (addr >= base && addr + size <= base + stackSize)
+    return (char*) addr;
+
+  // The last global that starts at or before `addr`.
+  auto it = globalSize.upper_bound(addr);
+  if (it == globalSize.begin())
+    return nullptr;
+  --it;
+  if (addr + size <= it->first + it->second)
+    return (char*) addr;
+  return nullptr;
+}
+
+void MachineInterpreter::fail(Op *op, const std::string &msg) {
+  if (failure.size())
+    return;
+  std::stringstream ss;
+  ss << msg;
+  if (op)
+    ss << ": " << op;
+  failure = ss.str();
+}
+
+// Lays out the blocks in order, so that post-RA blocks without a terminator fall through
+// like they do in the assembly.
+// Before register allocation, phis are done like in Interpreter, with a stub on each edge;
+// the stub does a parallel copy, as the phis of a block all read their operands at once.
+MachineInterpreter::Function *MachineInterpreter::compile(Op *func) {
+  auto fn = new Function;
+  fn->name = NAME(func);
+  auto region = func->getRegion();
+
+  std::unordered_map<Op*, int> slotMap;
+  slots = &slotMap;
+
+  std::unordered_map<BasicBlock*, int> blocks;
+  for (auto bb : region->getBlocks()) {
+    int id = blocks.size();
+    blocks[bb] = id;
+  }
+
+  if (!allocated) {
+    fn->slots = ENTRY_SLOTS;
+    fn->frame = round16(frameSize(func));
+    for (auto bb : region->getBlocks()) {
+      for (auto op : bb->getOps())
+        slotMap[op] = fn->slots++;
+    }
+  }
+
+  // Where each argument comes from, assigned the way RegAlloc does it:
+  // in order of index, to the next free register of its kind, or else to the next stack slot.
+  std::unordered_map<Op*, Inst> argLoads;
+  if (!allocated) {
+    auto gets = func->findAll<GetArgOp>();
+    std::sort(gets.begin(), gets.end(), [](Op *a, Op *b) { return V(a) < V(b); });
+    int cnt = 0, fcnt = 0, stackArgs = 0;
+    for (auto op : gets) {
+      Inst inst;
+      inst.op = op;
+      inst.rd = slot(op);
+      inst.weight = 0;
+      bool fp = op->getResultType() == Value::f32;
+      if (fp && fcnt < 8) {
+        inst.code = Mov;
+        inst.a = SLOT_BASE + ENTRY_FARGS + fcnt++;
+      } else if (!fp && cnt < 8) {
+        inst.code = Mov;
+        inst.a = SLOT_BASE + ENTRY_ARGS + cnt++;
+      } else {
+        inst.code = Load;
+        inst.a = SLOT_BASE + ENTRY_SP;
+        inst.imm = 8 * stackArgs++;
+        inst.size = fp ? 4 : 8;
+        inst.width = fp ? W32Z : W64;
+        inst.weight = 1;
+      }
+      argLoads[op] = inst;
+    }
+  }
+
+  std::vector<int> labels(blocks.size());
+  std::map<std::pair<BasicBlock*, BasicBlock*>, int> edges;
+  std::vector<int> jumps;
+
+  auto edge = [&](BasicBlock *from, BasicBlock *to) {
+    if (allocated || !isa<PhiOp>(to->getFirstOp()))
+      return blocks[to];
+
+    auto key = std::make_pair(from, to);
+    if (!edges.count(key)) {
+      edges[key] = labels.size();
+      labels.push_back(-1);
+    }
+    return edges[key];
+  };
+
+  for (auto bb : region->getBlocks()) {
+    labels[blocks[bb]] = fn->code.size();
+
+    for (auto op : bb->getOps()) {
+      if (isa<PhiOp>(op))
+        continue;
+
+      if (isa<GetArgOp>(op)) {
+        if (argLoads.count(op))
+          fn->code.push_back(argLoads[op]);
+        else {
+          Inst inst;
+          inst.op = op;
+          fn->code.push_back(inst);
+        }
+        continue;
+      }
+
+      Inst inst;
+      inst.op = op;
+      decode(op, inst);
+
+      switch (inst.code) {
+      case Jump:
+      case Branch:
+        jumps.push_back(fn->code.size());
+        inst.target = edge(bb, TARGET(op));
+        // After allocation, a branch falls through when not taken.
+        if (!allocated && inst.code == Branch)
+          inst.other = edge(bb, ELSE(op));
+        break;
+      case Call: {
+        CallSite site;
+        site.name = NAME(op);
+        site.external = isExtern(site.name);
+        inst.imm = sites.size();
+        sites.push_back(site);
+        break;
+      }
+      default:
+        break;
+      }
+      fn->code.push_back(inst);
+    }
+  }
+
+  // Running past the last block is an error.
+  Inst end;
+  end.op = func;
+  fn->code.push_back(end);
+
+  for (auto [key, label] : edges) {
+    auto [from, to] = key;
+    labels[label] = fn->code.size();
+
+    auto phis = to->getPhis();
+    std::vector<int> temps;
+    for (auto phi : phis) {
+      const auto &ops = phi->getOperands();
+      const auto &attrs = phi->getAttrs();
+      Inst inst;
+      inst.op = phi;
+      inst.weight = 0;
+      for (size_t i = 0; i < ops.size(); i++) {
+        if (FROM(attrs[i]) == from) {
+          inst.code = Mov;
+          inst.a = slot(ops[i].defining);
+          break;
+        }
+      }
+      inst.rd = SLOT_BASE + fn->slots++;
+      temps.push_back(inst.rd);
+      fn->code.push_back(inst);
+    }
+    for (size_t i = 0; i < phis.size(); i++) {
+      Inst inst;
+      inst.code = Mov;
+      inst.op = phis[i];
+      inst.weight = 0;
+      inst.rd = slot(phis[i]);
+      inst.a = temps[i];
+      fn->code.push_back(inst);
+    }
+
+    Inst jump;
+    jump.code = Jump;
+    jump.op = to->getFirstOp();
+    jump.weight = 0;
+    jump.target = blocks[to];
+    jumps.push_back(fn->code.size());
+    fn->code.push_back(jump);
+  }
+
+  for (auto i : jumps) {
+    auto &inst = fn->code[i];
+    inst.target = labels[inst.target];
+    if (inst.other >= 0)
+      inst.other = labels[inst.other];
+  }
+
+  slots = nullptr;
+  return fn;
+}
+
+MachineInterpreter::Function *MachineInterpreter::getFunction(const std::string &name) {
+  auto &fn = compiled[name];
+  if (!fn) {
+    if (!fnMap.count(name))
+      sys_unreachable("unknown function: " << name);
+    fn = compile(fnMap[name]);
+  }
+  return fn;
+}
+
+// Arguments and results go through the registers of the calling convention.
+void MachineInterpreter::applyExtern(const std::string &name) {
+  auto arg = [&](int i) { return regs[argRegs[i]].x[0]; };
+  auto argf = [&](int i) { return regs[fargRegs[i]].f[0]; };
+
+  bool hasResult = false, hasResultF = false;
+  uint64_t result = 0;
+  float resultF = 0;
+
+  if (name == "getint") {
+    int x; inbuf >> x;
+    result = x;
+    hasResult = true;
+  } else if (name == "getch") {
+    char x = inbuf.get();
+    result = x;
+    hasResult = true;
+  } else if (name == "getfloat") {
+    std::string x; inbuf >> x;
+    resultF = strtof(x.c_str(), nullptr);
+    hasResultF = true;
+  } else if (name == "getarray" || name == "getfarray") {
+    int n; inbuf >> n;
+    auto ptr = memory(arg(0), (size_t) std::max(n, 0) * 4);
+    if (!ptr) {
+      fail(nullptr, name + " out of bounds");
+      return;
+    }
+    for (int i = 0; i < n; i++) {
+      if (name == "getarray") {
+        // See Interpreter: some inputs exceed the range of int.
+        unsigned x; inbuf >> x;
+        memcpy(ptr + i * 4, &x, 4);
+      } else {
+        std::string x; inbuf >> x;
+        float f = strtof(x.c_str(), nullptr);
+        memcpy(ptr + i * 4, &f, 4);
+      }
+    }
+    result = n;
+    hasResult = true;
+  } else if (name == "putint") {
+    outbuf << (int) (unsigned) arg(0);
+  } else if (name == "putch") {
+    outbuf << (char) arg(0);
+  } else if (name == "putfloat") {
+    outbuf << argf(0);
+  } else if (name == "putarray" || name == "putfarray") {
+    int n = arg(0);
+    auto ptr = memory(arg(1), (size_t) std::max(n, 0) * 4);
+    if (!ptr) {
+      fail(nullptr, name + " out of bounds");
+      return;
+    }
+    outbuf << n << ":";
+    for (int i = 0; i < n; i++) {
+      if (name == "putarray") {
+        int x; memcpy(&x, ptr + i * 4, 4);
+        outbuf << " " << x;
+      } else {
+        float x; memcpy(&x, ptr + i * 4, 4);
+        outbuf << " " << x;
+      }
+    }
+    outbuf << "\n";
+  } else if (name != "_sysy_starttime" && name != "_sysy_stoptime") {
+    fail(nullptr, "unknown extern function: " + name);
+    return;
+  }
+
+  // A real extern may clobber anything the convention allows.
+  if (allocated) {
+    for (auto reg : callerSaved) {
+      if (reg != linkReg)
+        regs[reg] = scalar(POISON);
+    }
+  }
+  if (hasResult)
+    regs[argRegs[0]] = scalar(extend(result, intExt));
+  if (hasResultF)
+    regs[fargRegs[0]] = scalarF(resultF);
+}
+
+void MachineInterpreter::execute(Function *entry) {
+  // The state of a caller, saved while its callee runs.
+  struct Activation {
+    Function *fn;
+    Inst *pc;
+    size_t base;
+    // sp and the link register at entry.
+    uint64_t sp;
+    uint64_t link;
+    // Where the callee-saved registers at entry are kept in `saved`.
+    size_t saved;
+  };
+  std::vector<Activation> calls;
+
+  Function *fn;
+  Inst *pc;
+  size_t base = 0, top = 0;
+  uint64_t entrySp = 0, link = 0;
+  size_t savedAt = 0;
+  Word *v;
+
+#define RELOAD() (v = frames.data() + base)
+#define R(loc) ((loc) < SLOT_BASE ? regs[loc] : v[(loc) - SLOT_BASE])
+
+  auto enter = [&](Function *callee) {
+    fn = callee;
+    fn->counts.calls++;
+    base = top;
+    top += fn->slots;
+    if (top > frames.size())
+      frames.resize(std::max(top, frames.size() * 2));
+    RELOAD();
+
+    link = LINK_BASE + calls.size();
+    regs[linkReg] = scalar(link);
+    entrySp = regs[spReg].x[0];
+    savedAt = saved.size();
+    if (allocated) {
+      for (auto reg : calleeSaved)
+        saved.push_back(regs[reg].x[0]);
+    } else {
+      for (int i = 0; i < 8; i++) {
+        v[ENTRY_ARGS + i] = regs[argRegs[i]];
+        v[ENTRY_FARGS + i] = regs[fargRegs[i]];
+      }
+      v[ENTRY_SP] = regs[spReg];
+      regs[spReg].x[0] -= fn->frame;
+    }
+    pc = fn->code.data();
+  };
+
+  enter(entry);
+  bool vconfigured = false;
+
+  for (;;) {
+    Inst &in = *pc++;
+    auto &counts = fn->counts;
+    counts.insts += in.weight;
+
+    if (in.vector && !vconfigured) {
+      fail(in.op, "vector op without vsetivli");
+      return;
+    }
+
+    uint64_t a = in.a >= 0 ? R(in.a).x[0] : 0;
+    uint64_t b = in.b >= 0 ? R(in.b).x[0] : in.imm;
+    uint64_t c = in.c >= 0 ? R(in.c).x[0] : 0;
+    float fa = in.a >= 0 ? R(in.a).f[0] : 0;
+    float fb = in.b >= 0 ? R(in.b).f[0] : 0;
+    float fc = in.c >= 0 ? R(in.c).f[0] : 0;
+    int mask = in.width == W64 ? 63 : 31;
+
+#define SET(x) (R(in.rd) = scalar(extend((x), in.width)))
+#define SETF(x) (R(in.rd) = scalarF(x))
+#define ACCESS(ptr, addr, size) \
+    char *ptr = memory((addr), (size)); \
+    if (!ptr) { \
+      fail(in.op, "access out of bounds"); \
+      return; \
+    }
+
+    switch (in.code) {
+    case Nop:
+      break;
+    case VConfig:
+      vconfigured = true;
+      break;
+    case Mov:
+      R(in.rd) = R(in.a);
+      break;
+    case MovS:
+      R(in.rd) = scalar((uint32_t) a);
+      break;
+    case Mov64:
+      R(in.rd) = scalar(a);
+      break;
+    case Li:
+      SET(in.imm);
+      break;
+    case Movk: {
+      uint64_t keep = R(in.rd).x[0] & ~(0xffffull << in.shift);
+      SET(keep | ((uint64_t) (in.imm & 0xffff) << in.shift));
+      break;
+    }
+    case SubSp:
+      regs[spReg].x[0] -= in.imm;
+      break;
+    case Add:
+      SET(a + b);
+      break;
+    case Sub:
+      SET(a - b);
+      break;
+    case Mul:
+      SET(a * b);
+      break;
+    case Div:
+    case Rem: {
+      int64_t x = in.width == W64 ? (int64_t) a : (int32_t) a;
+      int64_t y = in.width == W64 ? (int64_t) b : (int32_t) b;
+      int64_t min = in.width == W64 ? INT64_MIN : INT32_MIN;
+      bool div = in.code == Div;
+      if (y == 0)
+        SET(div ? divByZero : x);
+      else if (x == min && y == -1)
+        SET(div ? x : 0);
+      else
+        SET(div ? x / y : x % y);
+      break;
+    }
+    case Udiv: {
+      uint64_t x = in.width == W64 ? a : (uint32_t) a;
+      uint64_t y = in.width == W64 ? b : (uint32_t) b;
+      SET(y ? x / y : divByZero);
+      break;
+    }
+    case Mulh:
+      SET((uint64_t) (((__int128) (int64_t) a * (int64_t) b) >> 64));
+      break;
+    case Mulhu:
+      SET((uint64_t) (((unsigned __int128) a * b) >> 64));
+      break;
+    case Smull:
+      SET((uint64_t) ((int64_t) (int32_t) a * (int32_t) b));
+      break;
+    case And:
+      SET(a & b);
+      break;
+    case Or:
+      SET(a | b);
+      break;
+    case Xor:
+      SET(a ^ b);
+      break;
+    case Sll:
+      SET(a << (b & mask));
+      break;
+    case Srl:
+      SET(in.width == W64 ? a >> (b & mask) : (uint32_t) a >> (b & mask));
+      break;
+    case Sra:
+      SET(in.width == W64 ? (int64_t) a >> (b & mask) : (int32_t) a >> (b & mask));
+      break;
+    case Neg:
+      SET(-a);
+      break;
+    case AddLsl:
+      SET(a + (b << in.shift));
+      break;
+    case AddLsr:
+      SET(a + (in.width == W64 ? b >> in.shift : (uint32_t) b >> in.shift));
+      break;
+    case AddAsr:
+      SET(a + (in.width == W64 ? (int64_t) b >> in.shift : (int32_t) b >> in.shift));
+      break;
+    case Madd:
+      SET(c + a * b);
+      break;
+    case Msub:
+      SET(c - a * b);
+      break;
+    case Cset:
+      R(in.rd) = scalar(compare(a, b, in.cond, in.width));
+      break;
+    case CsetTst:
+      R(in.rd) = scalar(compare((uint32_t) (a & b), 0, in.cond, W32Z));
+      break;
+    case CsetF:
+      R(in.rd) = scalar(compareF(fa, in.b >= 0 ? fb : 0.0f, in.cond));
+      break;
+    case Csel:
+      SET(compare(a, 0, in.cond, in.width) ? b : c);
+      break;
+    case Cneg:
+      SET((int32_t) a < 0 ? -b : b);
+      break;
+    case Fadd:
+      SETF(fa + fb);
+      break;
+    case Fsub:
+      SETF(fa - fb);
+      break;
+    case Fmul:
+      SETF(fa * fb);
+      break;
+    case Fdiv:
+      SETF(fa / fb);
+      break;
+    case Fmadd:
+      SETF(fmaf(fa, fb, fc));
+      break;
+    case Fmsub:
+      SETF(fmaf(-fa, fb, fc));
+      break;
+    case Fneg:
+      SETF(-fa);
+      break;
+    case Scvtf:
+      SETF((float) (int32_t) a);
+      break;
+    case Fcvtzs: {
+      // Both targets saturate; they only disagree on NaN.
+      int32_t x;
+      if (std::isnan(fa))
+        x = in.width == W32S ? INT32_MAX : 0;
+      else if (fa >= 2147483648.0f)
+        x = INT32_MAX;
+      else if (fa < -2147483648.0f)
+        x = INT32_MIN;
+      else
+        x = (int32_t) fa;
+      SET((uint64_t) (int64_t) x);
+      break;
+    }
+    case Dup: {
+      Word w;
+      for (int i = 0; i < 4; i++)
+        w.w[i] = (uint32_t) a;
+      R(in.rd) = w;
+      break;
+    }
+    case AddV:
+    case SubV:
+    case MulV:
+    case MlaV: {
+      Word x = R(in.a), y = R(in.b), w = in.c >= 0 ? R(in.c) : scalar(0);
+      for (int i = 0; i < 4; i++) {
+        if (in.code == AddV)
+          w.w[i] = x.w[i] + y.w[i];
+        else if (in.code == SubV)
+          w.w[i] = x.w[i] - y.w[i];
+        else if (in.code == MulV)
+          w.w[i] = x.w[i] * y.w[i];
+        else
+          w.w[i] += x.w[i] * y.w[i];
+      }
+      R(in.rd) = w;
+      break;
+    }
+    case FaddV:
+    case FsubV:
+    case FmulV: {
+      Word x = R(in.a), y = R(in.b), w;
+      for (int i = 0; i < 4; i++) {
+        if (in.code == FaddV)
+          w.f[i] = x.f[i] + y.f[i];
+        else if (in.code == FsubV)
+          w.f[i] = x.f[i] - y.f[i];
+        else
+          w.f[i] = x.f[i] * y.f[i];
+      }
+      R(in.rd) = w;
+      break;
+    }
+    // Lanes that compare true get all bits set.
+    case CmpV:
+    case CmpFV: {
+      Word x = R(in.a), y = R(in.b), w;
+      for (int i = 0; i < 4; i++) {
+        bool holds = in.code == CmpV
+          ? compare(x.w[i], y.w[i], in.cond, W32Z)
+          : compareF(x.f[i], y.f[i], in.cond);
+        w.w[i] = holds ? ~0u : 0;
+      }
+      R(in.rd) = w;
+      break;
+    }
+    case AndV:
+    case BicV:
+    case OrrV: {
+      Word x = R(in.a), y = R(in.b), w;
+      for (int i = 0; i < 2; i++) {
+        if (in.code == AndV)
+          w.x[i] = x.x[i] & y.x[i];
+        else if (in.code == BicV)
+          w.x[i] = x.x[i] & ~y.x[i];
+        else
+          w.x[i] = x.x[i] | y.x[i];
+      }
+      R(in.rd) = w;
+      break;
+    }
+    case AddAcross: {
+      Word x = R(in.a);
+      R(in.rd) = scalar((uint32_t) (x.w[0] + x.w[1] + x.w[2] + x.w[3]));
+      break;
+    }
+    case Lane:
+      R(in.rd) = scalar(R(in.a).w[in.imm]);
+      break;
+    case Load:
+    case LoadIdx:
+    case LoadPost: {
+      uint64_t addr = in.code == Load ? a + in.imm : in.code == LoadIdx ? a + (b << in.shift) : a;
+      ACCESS(ptr, addr, in.size);
+      counts.loads++;
+      if (in.reload)
+        counts.reloads++;
+
+      Word w = scalar(0);
+      memcpy(&w, ptr, in.size);
+      if (in.size < 16)
+        w.x[0] = extend(w.x[0], in.width);
+      if (in.code == LoadPost)
+        R(in.a).x[0] += in.imm;
+      R(in.rd) = w;
+      break;
+    }
+    case LoadPair: {
+      uint64_t addr = a + in.imm;
+      ACCESS(ptr, addr, 2 * in.size);
+      counts.loads++;
+      Word lo = scalar(0), hi = scalar(0);
+      memcpy(&lo, ptr, in.size);
+      memcpy(&hi, ptr + in.size, in.size);
+      R(in.rd) = lo;
+      R(in.c) = hi;
+      break;
+    }
+    case Store:
+    case StoreIdx:
+    case StorePost: {
+      uint64_t at = R(in.b).x[0];
+      uint64_t addr = in.code == Store ? at + in.imm : in.code == StoreIdx ? at + (c << in.shift) : at;
+      ACCESS(ptr, addr, in.size);
+      counts.stores++;
+      Word w = R(in.a);
+      memcpy(ptr, &w, in.size);
+      if (in.code == StorePost)
+        R(in.b).x[0] += in.imm;
+      break;
+    }
+    case StorePair: {
+      uint64_t addr = c + in.imm;
+      ACCESS(ptr, addr, 2 * in.size);
+      counts.stores++;
+      Word lo = R(in.a), hi = R(in.b);
+      memcpy(ptr, &lo, in.size);
+      memcpy(ptr + in.size, &hi, in.size);
+      break;
+    }
+    case Jump:
+      pc = fn->code.data() + in.target;
+      break;
+    case Branch:
+      if (compare(a, b, in.cond, in.width))
+        pc = fn->code.data() + in.target;
+      else if (in.other >= 0)
+        pc = fn->code.data() + in.other;
+      break;
+    case Call: {
+      auto &site = sites[in.imm];
+      vconfigured = false;
+      if (site.external) {
+        regs[linkReg] = scalar(LINK_BASE + calls.size() + 1);
+        applyExtern(site.name);
+        if (failure.size())
+          return;
+        break;
+      }
+
+      if (!site.callee)
+        site.callee = getFunction(site.name);
+      calls.push_back(Activation { fn, pc, base, entrySp, link, savedAt });
+      enter(site.callee);
+      break;
+    }
+    case Ret: {
+      if (allocated) {
+        if (regs[spReg].x[0] != entrySp) {
+          fail(in.op, "sp isn't restored on return");
+          return;
+        }
+        if (regs[linkReg].x[0] != link) {
+          fail(in.op, "the return address is clobbered");
+          return;
+        }
+        int i = 0;
+        for (auto reg : calleeSaved) {
+          if (regs[reg].x[0] != saved[savedAt + i++]) {
+            fail(in.op, "callee-saved register " + std::to_string(reg) + " is clobbered");
+            return;
+          }
+        }
+        saved.resize(savedAt);
+      } else
+        regs[spReg].x[0] = entrySp;
+
+      top = base;
+      if (calls.empty())
+        return;
+
+      auto caller = calls.back();
+      calls.pop_back();
+      vconfigured = false;
+      fn = caller.fn;
+      pc = caller.pc;
+      base = caller.base;
+      entrySp = caller.sp;
+      link = caller.link;
+      savedAt = caller.saved;
+      RELOAD();
+      break;
+    }
+    default:
+      fail(in.op, "unknown op");
+      return;
+    }
+
+#undef SET
+#undef SETF
+#undef ACCESS
+  }
+
+#undef R
+#undef RELOAD
+}
+
+void MachineInterpreter::run(std::istream &input) {
+  inbuf << std::hexfloat << input.rdbuf();
+  outbuf << std::hexfloat;
+
+  for (auto &reg : regs)
+    reg = scalar(0);
+  regs[spReg] = scalar((uint64_t) (stack + stackSize));
+  execute(getFunction("main"));
+  retcode = regs[argRegs[0]].x[0];
+}
+
+std::map<std::string, MachineInterpreter::Counts> MachineInterpreter::counts() {
+  std::map<std::string, Counts> result;
+  for (const auto &[name, fn] : compiled)
+    result[name] = fn->counts;
+  return result;
+}
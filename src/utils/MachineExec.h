@@ -0,0 +1,200 @@
+#ifndef MACHINE_EXEC_H
+#define MACHINE_EXEC_H
+
+#include "../codegen/Ops.h"
+#include <cstdint>
+#include <sstream>
+#include <map>
+#include <unordered_map>
+
+namespace sys::exec {
+
+// Runs the machine IR of a backend (rv:: or arm::), both before and after register allocation.
+//
+// Before allocation, ops still refer to each other and get a slot each, like in Interpreter;
+// ReadReg/WriteReg and calls go through the register file.
+// After allocation, everything lives in registers and on the stack, exactly as Dump will emit it.
+// Memory is the host's: globals are host arrays and the stack is one big host buffer.
+//
+// The targets only decode their ops into the shared instructions below;
+// see rv/Simulate.cpp and arm/Simulate.cpp.
+class MachineInterpreter {
+public:
+  // Dynamic counts for a function, summed over all its calls.
+  struct Counts {
+    // Machine instructions, as Dump emits them.
+    long long insts = 0;
+    long long loads = 0;
+    long long stores = 0;
+    // Loads (or moves from fp registers) that bring back a spilled value.
+    long long reloads = 0;
+    long long calls = 0;
+  };
+
+  // A register or a slot; 16 bytes for vectors.
+  union Word {
+    uint64_t x[2];
+    uint32_t w[4];
+    float f[4];
+  };
+
+  // How a 32-bit result is extended to the register.
+  enum Width { W64, W32S, W32Z };
+  enum Cond { Eq, Ne, Lt, Le, Gt, Ge };
+
+#define MACHINE_CODES(X) \
+  X(Nop) X(Mov) X(MovS) X(Mov64) X(Li) X(Movk) X(SubSp) \
+  X(Add) X(Sub) X(Mul) X(Div) X(Rem) X(Udiv) X(Mulh) X(Mulhu) X(Smull) \
+  X(And) X(Or) X(Xor) X(Sll) X(Srl) X(Sra) X(Neg) \
+  X(AddLsl) X(AddLsr) X(AddAsr) X(Madd) X(Msub) \
+  X(Cset) X(CsetTst) X(CsetF) X(Csel) X(Cneg) \
+  X(Fadd) X(Fsub) X(Fmul) X(Fdiv) X(Fmadd) X(Fmsub) X(Fneg) X(Scvtf) X(Fcvtzs) \
+  X(Dup) X(AddV) X(SubV) X(MulV) X(MlaV) X(FaddV) X(FsubV) X(FmulV) \
+  X(CmpV) X(CmpFV) X(AndV) X(BicV) X(OrrV) X(AddAcross) X(Lane) \
+  X(Load) X(LoadIdx) X(LoadPost) X(LoadPair) \
+  X(Store) X(StoreIdx) X(StorePost) X(StorePair) \
+  X(Jump) X(Branch) X(Call) X(Ret) X(VConfig) X(Unknown)
+
+#define MACHINE_ENUM(x) x,
+  enum Code { MACHINE_CODES(MACHINE_ENUM) };
+#undef MACHINE_ENUM
+
+  // Registers take locations [0, SLOT_BASE); slots of the current frame come after.
+  static constexpr int SLOT_BASE = 128;
+  // Writes to the zero register go here, and it's never read.
+  static constexpr int DISCARD = SLOT_BASE - 1;
+
+  struct Inst {
+    int code = Unknown;
+    // Also the width of the comparison, for compares and branches.
+    Width width = W64;
+    Cond cond = Eq;
+    // Locations of the result and the sources, or -1.
+    // A missing second source means `imm` instead.
+    int rd = -1, a = -1, b = -1, c = -1;
+    int64_t imm = 0;
+    // Shift amount of shifted adds, indexed accesses and movk.
+    int shift = 0;
+    // Bytes accessed by loads and stores.
+    int size = 0;
+    // Code offsets for jumps; `other` is -1 when falling through.
+    int target = -1, other = -1;
+    // Machine instructions this stands for.
+    int weight = 1;
+    bool reload = false;
+    // Needs a VConfig first, as RVV needs `vl` and `vtype` set. Calls don't keep them.
+    bool vector = false;
+    Op *op = nullptr;
+  };
+
+protected:
+  // What the interpreter needs to know about the target's registers and conventions.
+  int spReg, zeroReg;
+  // Where calls leave the return address.
+  int linkReg;
+  std::vector<int> argRegs, fargRegs;
+  std::vector<int> calleeSaved, callerSaved;
+  // What a 32-bit integer returned from an extern looks like in a register.
+  Width intExt;
+  // The result of an integer division by zero.
+  int64_t divByZero;
+
+  // Whether the module has gone through register allocation.
+  bool allocated;
+
+  // The location of a register, and where writing to it goes.
+  int reg(int r) { return r; }
+  int regDest(int r) { return r == zeroReg ? DISCARD : r; }
+  // The location of the value of `op`, in the function being compiled.
+  int slot(Op *op);
+  uint64_t address(const std::string &global);
+
+  // Fills in `inst` for a target op. Jumps, branches and calls only need `code`;
+  // their targets and callees are read from the op's attributes.
+  virtual void decode(Op *op, Inst &inst) = 0;
+  // Bytes of stack a function takes before register allocation,
+  // when there's no prologue to allocate them yet.
+  virtual int frameSize(Op *func) = 0;
+
+private:
+  struct Function;
+  struct CallSite {
+    std::string name;
+    bool external;
+    // Resolved on the first call.
+    Function *callee = nullptr;
+  };
+
+  std::stringstream outbuf, inbuf;
+  std::map<std::string, Op*> fnMap;
+  std::map<std::string, uint64_t> globalMap;
+  // Sizes of the globals by their address, for checking accesses.
+  std::map<uint64_t, size_t> globalSize;
+  std::map<std::string, Function*> compiled;
+  std::vector<CallSite> sites;
+
+  // The slots of the function being compiled.
+  std::unordered_map<Op*, int> *slots = nullptr;
+
+  Word regs[SLOT_BASE];
+  // Frames of active calls, one after another.
+  std::vector<Word> frames;
+  // Callee-saved registers at the entry of each active call, after allocation.
+  std::vector<uint64_t> saved;
+
+  char *stack;
+  size_t stackSize;
+
+  unsigned retcode = 0;
+  std::string failure;
+
+  Function *compile(Op *func);
+  Function *getFunction(const std::string &name);
+  void execute(Function *fn);
+  void applyExtern(const std::string &name);
+
+  // The host address for an access, or null if it's out of bounds.
+  char *memory(uint64_t addr, size_t size);
+  void fail(Op *op, const std::string &msg);
+public:
+  MachineInterpreter(ModuleOp *module, bool allocated);
+  MachineInterpreter(const MachineInterpreter &other) = delete;
+  virtual ~MachineInterpreter();
+
+  void run(std::istream &input);
+  std::string out() { return outbuf.str(); }
+  int exitcode() { return retcode & 0xff; }
+  // Empty unless the program did something the machine can't,
+  // like accessing memory out of bounds or returning with a callee-saved register clobbered.
+  const std::string &error() { return failure; }
+  // Counts of every function that has been called.
+  std::map<std::string, Counts> counts();
+};
+
+// Implemented in rv/Simulate.cpp.
+class RvInterpreter : public MachineInterpreter {
+  int source(Op *op, int i);
+  int dest(Op *op);
+  bool reloads(Op *op);
+protected:
+  void decode(Op *op, Inst &inst) override;
+  int frameSize(Op *func) override;
+public:
+  RvInterpreter(ModuleOp *module, bool allocated);
+};
+
+// Implemented in arm/Simulate.cpp.
+class ArmInterpreter : public MachineInterpreter {
+  int source(Op *op, int i);
+  int dest(Op *op);
+  bool reloads(Op *op, int reg);
+protected:
+  void decode(Op *op, Inst &inst) override;
+  int frameSize(Op *func) override;
+public:
+  ArmInterpreter(ModuleOp *module, bool allocated);
+};
+
+}
+
+#endif
@@ -4,24 +4,6 @@
 
 using namespace sys;
 
-#define MATCH_TERNARY(opcode, Ty) \
-  if (opname == opcode && isa<Ty>(op)) { \
-    return matchExpr(list->elements[1], op->getOperand(0).defining) && \
-           matchExpr(list->elements[2], op->getOperand(1).defining) && \
-           matchExpr(list->elements[3], op->getOperand(2).defining); \
-  }
-
-#define MATCH_BINARY(opcode, Ty) \
-  if (opname == opcode && isa<Ty>(op)) { \
-    return matchExpr(list->elements[1], op->getOperand(0).defining) && \
-           matchExpr(list->elements[2], op->getOperand(1).defining); \
-  }
-
-#define MATCH_UNARY(opcode, Ty) \
-  if (opname == opcode && isa<Ty>(op)) { \
-    return matchExpr(list->elements[1], op->getOperand(0).defining); \
-  }
-
 #define EVAL_BINARY(opcode, op) \
   if (opname == "!" opcode) { \
     int a = evalExpr(list->elements[1]); \
@@ -88,8 +70,157 @@ using namespace sys;
     return builder.create<Ty>({ a }); \
   }
 
+// The ops a pattern can match, by opname.
+static int opidOf(std::string_view opname) {
+  static const std::map<std::string_view, int> opids = {
+    { "select", SelectOp::id },
+    { "eq", EqOp::id },
+    { "ne", NeOp::id },
+    { "le", LeOp::id },
+    { "lt", LtOp::id },
+    { "feq", EqFOp::id },
+    { "fne", NeFOp::id },
+    { "fle", LeFOp::id },
+    { "flt", LtFOp::id },
+    { "add", AddIOp::id },
+    { "sub", SubIOp::id },
+    { "mul", MulIOp::id },
+    { "div", DivIOp::id },
+    { "mod", ModIOp::id },
+    { "and", AndIOp::id },
+    { "or", OrIOp::id },
+    { "xor", XorIOp::id },
+    { "addl", AddLOp::id },
+    { "subl", SubLOp::id },
+    { "mull", MulLOp::id },
+    { "divl", DivLOp::id },
+    { "fadd", AddFOp::id },
+    { "fsub", SubFOp::id },
+    { "fmul", MulFOp::id },
+    { "fdiv", DivFOp::id },
+    { "store", StoreOp::id },
+    { "lshift", LShiftOp::id },
+    { "rshift", RShiftOp::id },
+    { "not", NotOp::id },
+    { "snz", SetNotZeroOp::id },
+    { "minus", MinusOp::id },
+    { "fminus", MinusFOp::id },
+    { "br", BranchOp::id },
+    { "f2i", F2IOp::id },
+    { "i2f", I2FOp::id },
+    { "load", LoadOp::id },
+  };
+  auto it = opids.find(opname);
+  if (it == opids.end()) {
+    std::cerr << "unknown opname in pattern: " << opname << "\n";
+    assert(false);
+  }
+  return it->second;
+}
+
+MatchTree::~MatchTree() {
+  for (auto root : roots)
+    release(root);
+}
+
+void MatchTree::release(Node *node) {
+  for (auto child : node->children)
+    release(child);
+  delete node;
+}
+
+void MatchTree::add(const std::vector<MatchInst> &program) {
+  assert(!program.empty() && program.back().kind == MatchInst::Accept);
+
+  auto *level = &roots;
+  for (const auto &inst : program) {
+    if (inst.kind == MatchInst::Opcode && inst.first + inst.count > (int) regs.size())
+      regs.resize(inst.first + inst.count);
+    if (inst.kind >= MatchInst::Bind && inst.kind < MatchInst::Accept && inst.arg >= (int) slots.size())
+      slots.resize(inst.arg + 1);
+
+    // Only merge with the last child, so that the order of rules is kept.
+    if (level->empty() || !(level->back()->inst == inst) || inst.kind == MatchInst::Accept)
+      level->push_back(new Node { inst, {} });
+    level = &level->back()->children;
+  }
+  if (regs.empty())
+    regs.resize(1);
+}
+
+void MatchTree::reset() {
+  for (auto &slot : slots)
+    slot.bound = false;
+}
+
+void MatchTree::bind(int slot, Op *op) {
+  slots[slot].op = op;
+  slots[slot].bound = true;
+}
+
+bool MatchTree::exec(const MatchInst &inst) {
+  Op *op = regs[inst.reg];
+
+  switch (inst.kind) {
+  case MatchInst::Opcode:
+    if (op->opid != inst.arg)
+      return false;
+    for (int i = 0; i < inst.count; i++)
+      regs[inst.first + i] = op->getOperand(i).defining;
+    return true;
+  case MatchInst::IsInt:
+    return isa<IntOp>(op);
+  case MatchInst::IsFloat:
+    return isa<FloatOp>(op);
+  case MatchInst::IntValue:
+    return V(op) == inst.arg;
+  case MatchInst::FloatValue:
+    return F(op) == inst.fvalue;
+  case MatchInst::Accept:
+    return true;
+  default:
+    break;
+  }
+
+  // Bindings.
+  auto &slot = slots[inst.arg];
+  if (slot.bound) {
+    switch (inst.kind) {
+    case MatchInst::Bind: return slot.op == op;
+    case MatchInst::BindInt: return V(slot.op) == V(op);
+    case MatchInst::BindFloat: return F(slot.op) == F(op);
+    case MatchInst::BindImm: return slot.imm == V(op);
+    case MatchInst::BindTarget: return slot.bb == TARGET(op);
+    case MatchInst::BindElse: return slot.bb == ELSE(op);
+    default: assert(false);
+    }
+  }
+
+  switch (inst.kind) {
+  case MatchInst::BindImm: slot.imm = V(op); break;
+  case MatchInst::BindTarget: slot.bb = TARGET(op); break;
+  case MatchInst::BindElse: slot.bb = ELSE(op); break;
+  default: slot.op = op; break;
+  }
+  slot.bound = true;
+  trail.push_back(inst.arg);
+  return true;
+}
+
 Rule::Rule(const char *text): text(text) {
   pattern = parse();
+
+  // `(change x y)` matches `x`; anything else matches itself.
+  Expr *matcher = pattern;
+  auto list = dyn_cast<List>(pattern);
+  if (list && cast<Atom>(list->elements[0])->value == "change")
+    matcher = list->elements[1];
+
+  regs = 1;
+  compile(matcher, 0);
+  program.push_back({ MatchInst::Accept });
+  resolve(pattern);
+  tree.add(program);
 }
 
 Rule::~Rule() {
@@ -107,9 +238,11 @@ void Rule::release(Expr *expr) {
 void Rule::dump(std::ostream &os) {
   dump(pattern, os);
   os << "\n===== binding starts =====\n";
-  for (auto [k, v] : binding) {
+  for (auto [k, slot] : slotOf) {
+    if (!binding || !(*binding)[slot].bound)
+      continue;
     os << k << " = ";
-    v->dump(os);
+    (*binding)[slot].op->dump(os);
   }
   os << "\n===== binding ends =====\n";
 }
@@ -165,107 +298,76 @@ Expr *Rule::parse() {
   return new Atom(tok);
 }
 
-bool Rule::matchExpr(Expr *expr, Op* op) {
-  if (auto* atom = dyn_cast<Atom>(expr)) {
+// Emits the checks that `expr` matches the op in `regs[reg]`.
+void Rule::compile(Expr *expr, int reg) {
+  if (auto atom = dyn_cast<Atom>(expr)) {
     std::string_view var = atom->value;
+    if (!slotOf.count(var)) {
+      int slot = slotOf.size();
+      slotOf[var] = slot;
+    }
+    atom->slot = slotOf[var];
 
     // This is a float literal.
     if (var[0] == '*') {
-      if (!isa<FloatOp>(op))
-        return false;
-
+      program.push_back({ MatchInst::IsFloat, reg });
       if (std::isdigit(var[1]) || var[1] == '-') {
-        std::string str(var.substr(1));
-        if (std::stof(str) != F(op))
-          return false;
+        MatchInst inst { MatchInst::FloatValue, reg };
+        inst.fvalue = std::stof(std::string(var.substr(1)));
+        program.push_back(inst);
       }
-
-      if (binding.count(var))
-        return F(binding[var]) == F(op);
-
-      binding[var] = op;
-      return true;
+      program.push_back({ MatchInst::BindFloat, reg, atom->slot });
+      return;
     }
 
     // A normal binding.
     if (var[0] != '\'' && !(std::isdigit(var[0]) || var[0] == '-')) {
-      if (binding.count(var))
-        return binding[var] == op;
-
-      binding[var] = op;
-      return true;
+      program.push_back({ MatchInst::Bind, reg, atom->slot });
+      return;
     }
 
     // This denotes a int-constant.
-    if (!isa<IntOp>(op)) {
-      return false;
-    }
+    program.push_back({ MatchInst::IsInt, reg });
 
     // This is a int literal.
-    if (std::isdigit(var[0]) || var[0] == '-') {
-      std::string str(var);
-      if (std::stoi(str) != V(op))
-        return false;
-    }
-
-    if (binding.count(var))
-      return V(binding[var]) == V(op);
+    if (std::isdigit(var[0]) || var[0] == '-')
+      program.push_back({ MatchInst::IntValue, reg, std::stoi(std::string(var)) });
 
-    binding[var] = op;
-    return true;
+    program.push_back({ MatchInst::BindInt, reg, atom->slot });
+    return;
   }
 
-  List *list = dyn_cast<List>(expr);
-  if (!list)
-    return false;
-
+  List *list = cast<List>(expr);
   assert(!list->elements.empty());
-  Atom *head = dyn_cast<Atom>(list->elements[0]);
-  if (!head)
-    return false;
+  Atom *head = cast<Atom>(list->elements[0]);
 
-  std::string_view opname = head->value;
+  MatchInst inst { MatchInst::Opcode, reg, opidOf(head->value) };
+  inst.first = regs;
+  inst.count = list->elements.size() - 1;
+  regs += inst.count;
+  program.push_back(inst);
+
+  for (int i = 0; i < inst.count; i++)
+    compile(list->elements[i + 1], inst.first + i);
+}
+
+// Points variables outside the matcher to their slots.
+void Rule::resolve(Expr *expr) {
+  if (auto atom = dyn_cast<Atom>(expr)) {
+    if (atom->slot == -1 && slotOf.count(atom->value))
+      atom->slot = slotOf[atom->value];
+    return;
+  }
+
+  auto list = cast<List>(expr);
+  for (size_t i = 1; i < list->elements.size(); i++)
+    resolve(list->elements[i]);
+}
 
-  MATCH_TERNARY("select", SelectOp);
-
-  MATCH_BINARY("eq", EqOp);
-  MATCH_BINARY("ne", NeOp);
-  MATCH_BINARY("le", LeOp);
-  MATCH_BINARY("lt", LtOp);
-  MATCH_BINARY("feq", EqFOp);
-  MATCH_BINARY("fne", NeFOp);
-  MATCH_BINARY("fle", LeFOp);
-  MATCH_BINARY("flt", LtFOp);
-  MATCH_BINARY("add", AddIOp);
-  MATCH_BINARY("sub", SubIOp);
-  MATCH_BINARY("mul", MulIOp);
-  MATCH_BINARY("div", DivIOp);
-  MATCH_BINARY("mod", ModIOp);
-  MATCH_BINARY("and", AndIOp);
-  MATCH_BINARY("or", OrIOp);
-  MATCH_BINARY("xor", XorIOp);
-  MATCH_BINARY("addl", AddLOp);
-  MATCH_BINARY("subl", SubLOp);
-  MATCH_BINARY("mull", MulLOp);
-  MATCH_BINARY("divl", DivLOp);
-  MATCH_BINARY("fadd", AddFOp);
-  MATCH_BINARY("fsub", SubFOp);
-  MATCH_BINARY("fmul", MulFOp);
-  MATCH_BINARY("fdiv", DivFOp);
-  MATCH_BINARY("store", StoreOp);
-  MATCH_BINARY("lshift", LShiftOp);
-  MATCH_BINARY("rshift", RShiftOp);
-
-  MATCH_UNARY("not", NotOp);
-  MATCH_UNARY("snz", SetNotZeroOp);
-  MATCH_UNARY("minus", MinusOp);
-  MATCH_UNARY("fminus", MinusFOp);
-  MATCH_UNARY("br", BranchOp);
-  MATCH_UNARY("f2i", F2IOp);
-  MATCH_UNARY("i2f", I2FOp);
-  MATCH_UNARY("load", LoadOp);
-
-  return false;
+Op *Rule::bound(Atom *atom) {
+  if (atom->slot == -1 || !(*binding)[atom->slot].bound)
+    return nullptr;
+  return (*binding)[atom->slot].op;
 }
 
 int Rule::evalExpr(Expr *expr) {
@@ -276,7 +378,7 @@ int Rule::evalExpr(Expr *expr) {
     }
 
     if (atom->value[0] == '\'') {
-      auto lint = binding[atom->value];
+      auto lint = bound(atom);
       return V(lint);
     }
   }
@@ -334,7 +436,7 @@ float Rule::evalFExpr(Expr *expr) {
     }
 
     if (atom->value[0] == '*') {
-      auto lint = binding[atom->value];
+      auto lint = bound(atom);
       return F(lint);
     }
   }
@@ -365,11 +467,12 @@ Op *Rule::buildExpr(Expr *expr) {
       return builder.create<IntOp>({ new IntAttr(result) });
     }
 
-    if (!binding.count(atom->value)) {
+    auto op = bound(atom);
+    if (!op) {
       std::cerr << "unbound variable: " << atom->value << "\n";
       assert(false);
     }
-    return binding[atom->value];
+    return op;
   }
 
   auto list = dyn_cast<List>(expr);
@@ -435,47 +538,58 @@ Op *Rule::buildExpr(Expr *expr) {
 }
 
 bool Rule::match(Op *op, const std::map<std::string, Op*> &external) {
-  loc = 0;
-  failed = false;
-  binding.clear();
-  externalStrs.clear();
-  
+  tree.reset();
   for (auto [k, v] : external) {
-    externalStrs.push_back(k);
-    binding[externalStrs.back()] = v;
+    if (slotOf.count(k))
+      tree.bind(slotOf[k], v);
   }
 
-  return matchExpr(pattern, op);
+  binding = &tree.getSlots();
+  return tree.match(op, [](int) { return true; });
 }
 
 Op *Rule::extract(const std::string &name) {
-  if (!binding.count(name)) {
+  if (!slotOf.count(name) || !(*binding)[slotOf[name]].bound) {
     std::cerr << "querying unknown name: " << name << "\n";
     dump();
     assert(false);
   }
-  return binding[name];
+  return (*binding)[slotOf[name]].op;
 }
 
-bool Rule::rewrite(Op *op) {
-  loc = 0;
-  failed = false;
-  binding.clear();
-  
-  auto list = dyn_cast<List>(pattern);
-  assert(dyn_cast<Atom>(list->elements[0])->value == "change");
-  auto matcher = list->elements[1];
-  auto rewriter = list->elements[2];
+int Rule::rootOpid() {
+  if (program[0].kind != MatchInst::Opcode)
+    return -1;
+  return program[0].arg;
+}
 
-  if (!matchExpr(matcher, op))
-    return false;
+bool Rule::apply(Op *op, const std::vector<MatchSlot> &slots) {
+  failed = false;
+  binding = &slots;
 
   builder.setBeforeOp(op);
-  Op *opnew = buildExpr(rewriter);
-  if (!opnew || failed)
+  // Everything built goes right before `op`.
+  Op *prev = op->prevOp();
+  auto list = cast<List>(pattern);
+  Op *opnew = buildExpr(list->elements[2]);
+  if (!opnew || failed) {
+    // Take back what got built before failing, such as the constants of `!only-if`.
+    // Later ones use earlier ones, so go backwards.
+    while (op->prevOp() != prev)
+      op->prevOp()->erase();
     return false;
+  }
 
   op->replaceAllUsesWith(opnew);
   op->erase();
   return true;
 }
+
+bool Rule::rewrite(Op *op) {
+  assert(cast<Atom>(cast<List>(pattern)->elements[0])->value == "change");
+
+  tree.reset();
+  return tree.match(op, [&](int) {
+    return apply(op, tree.getSlots());
+  });
+}
@@ -16,6 +16,8 @@ struct Atom : Expr {
   static bool classof(T *t) { return t->id == 1; }
 
   std::string_view value;
+  // The binding slot of this variable, filled in on compilation. -1 if not a variable.
+  int slot = -1;
   Atom(std::string_view value): Expr(1), value(value) {}
 };
 
@@ -27,23 +29,169 @@ struct List : Expr {
   List(): Expr(2) {}
 };
 
+// A pattern is compiled into a flat list of these.
+// `regs` hold the ops reached so far (regs[0] is the root), and `slots` the variables.
+// Registers and slots are numbered in pre-order of the pattern, so two patterns
+// with the same shape up to some point compile to the same instructions up to there.
+struct MatchInst {
+  enum Kind {
+    // regs[reg] has opid `arg`. Its first `count` operands go to regs[first...].
+    Opcode,
+    IsInt,
+    IsFloat,
+    // Literals. The value is in `arg` or `fvalue`.
+    IntValue,
+    FloatValue,
+    // Binds slots[arg] to regs[reg], or checks it's the same if already bound.
+    // BindInt and BindFloat compare by the constant's value instead.
+    Bind,
+    BindInt,
+    BindFloat,
+    // Binds slots[arg] to the IntAttr, TargetAttr or ElseAttr of regs[reg].
+    BindImm,
+    BindTarget,
+    BindElse,
+    // Rule number `arg` matches.
+    Accept,
+  } kind;
+  int reg = 0;
+  int arg = 0;
+  int first = 0;
+  int count = 0;
+  float fvalue = 0;
+
+  bool operator==(const MatchInst &other) const {
+    return kind == other.kind && reg == other.reg && arg == other.arg &&
+      first == other.first && count == other.count && fvalue == other.fvalue;
+  }
+};
+
+struct MatchSlot {
+  Op *op = nullptr;
+  BasicBlock *bb = nullptr;
+  int imm = 0;
+  bool bound = false;
+};
+
+// Compiled patterns merged into a discrimination tree.
+// A program is merged with the previously added one as far as they agree,
+// so the tree is traversed in the same order the rules are added.
+class MatchTree {
+  struct Node {
+    MatchInst inst;
+    std::vector<Node*> children;
+  };
+
+  std::vector<Node*> roots;
+  std::vector<Op*> regs;
+  std::vector<MatchSlot> slots;
+  // Slots bound during the traversal, to be unbound on backtracking.
+  std::vector<int> trail;
+
+  bool exec(const MatchInst &inst);
+  void release(Node *node);
+
+  template<class F>
+  bool walk(Node *node, F &accept) {
+    size_t mark = trail.size();
+    if (exec(node->inst)) {
+      if (node->inst.kind == MatchInst::Accept) {
+        if (accept(node->inst.arg))
+          return true;
+      } else {
+        for (auto child : node->children) {
+          if (walk(child, accept))
+            return true;
+        }
+      }
+    }
+    while (trail.size() > mark) {
+      slots[trail.back()].bound = false;
+      trail.pop_back();
+    }
+    return false;
+  }
+public:
+  MatchTree() = default;
+  MatchTree(const MatchTree &other) = delete;
+  MatchTree(MatchTree &&other) = default;
+  ~MatchTree();
+
+  // `program` must end with an Accept.
+  void add(const std::vector<MatchInst> &program);
+
+  // Unbinds all slots.
+  void reset();
+  // Binds a slot before matching.
+  void bind(int slot, Op *op);
+  const std::vector<MatchSlot> &getSlots() const { return slots; }
+
+  // Calls `accept(rule)` on every rule that matches `op`, in order, until it returns true.
+  // The slots are left as the accepted rule bound them.
+  template<class F>
+  bool match(Op *op, F accept) {
+    regs[0] = op;
+    trail.clear();
+    for (auto root : roots) {
+      if (walk(root, accept))
+        return true;
+    }
+    return false;
+  }
+};
+
+// Rules of the same kind sharing one MatchTree, which tests them all in one traversal.
+// `R` is Rule or ArmRule.
+template<class R>
+class RuleSet {
+  std::vector<R*> rules;
+  MatchTree tree;
+public:
+  RuleSet(const std::vector<R*> &rules): rules(rules) {
+    for (size_t i = 0; i < rules.size(); i++) {
+      auto program = rules[i]->program;
+      program.back().arg = i;
+      tree.add(program);
+    }
+  }
+
+  // Applies the first rule that matches and succeeds, just like
+  // calling rewrite() on each of them in order.
+  bool rewrite(Op *op) {
+    tree.reset();
+    return tree.match(op, [&](int i) {
+      return rules[i]->apply(op, tree.getSlots());
+    });
+  }
+};
 
 class Rule {
-  std::map<std::string_view, Op*> binding;
+  template<class R>
+  friend class RuleSet;
+
+  // Variable names to slots.
+  std::map<std::string_view, int> slotOf;
   std::string_view text;
-  std::vector<std::string> externalStrs;
   Expr *pattern;
+  std::vector<MatchInst> program;
+  MatchTree tree;
+  // The slots of the current match.
+  const std::vector<MatchSlot> *binding = nullptr;
   Builder builder;
   int loc = 0;
+  int regs = 0;
   bool failed = false;
 
   std::string_view nextToken();
   Expr *parse();
 
-  bool matchExpr(Expr *expr, Op *op);
+  void compile(Expr *expr, int reg);
+  void resolve(Expr *expr);
+  Op *bound(Atom *atom);
   int evalExpr(Expr *expr);
   float evalFExpr(Expr *expr);
   Op *buildExpr(Expr *expr);
+  bool apply(Op *op, const std::vector<MatchSlot> &slots);
 
   void dump(Expr *expr, std::ostream &os);
   void release(Expr *expr);
@@ -55,6 +203,9 @@ public:
   Rule(const char *text);
   ~Rule();
   bool rewrite(Op *op);
+  // The opid of the op the pattern's root can match, or -1 if it isn't fixed.
+  // For `(change ...)` rules this looks at the matcher side.
+  int rootOpid();
   bool match(Op *op, const Binding &external = {});
   Op *extract(const std::string &name);
 
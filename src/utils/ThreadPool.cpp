@@ -0,0 +1,59 @@
+#include "ThreadPool.h"
+
+using namespace sys;
+
+ThreadPool::ThreadPool(int size, std::function<void(int)> init) {
+  for (int i = 1; i < size; i++) {
+    threads.emplace_back([this, init, i]() {
+      if (init)
+        init(i);
+      loop(i);
+    });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  wake.notify_all();
+  for (auto &thread : threads)
+    thread.join();
+}
+
+void ThreadPool::loop(int id) {
+  int seen = 0;
+  for (;;) {
+    std::function<void(int)> fn;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      wake.wait(lock, [&]() { return stopping || generation != seen; });
+      if (stopping)
+        return;
+      seen = generation;
+      fn = job;
+    }
+
+    fn(id);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!--running)
+      done.notify_one();
+  }
+}
+
+void ThreadPool::run(std::function<void(int)> fn) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    job = fn;
+    running = threads.size();
+    generation++;
+  }
+  wake.notify_all();
+
+  fn(0);
+
+  std::unique_lock<std::mutex> lock(mutex);
+  done.wait(lock, [&]() { return running == 0; });
+}
@@ -0,0 +1,43 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace sys {
+
+// A fixed set of threads, started once and reused for every job.
+//
+// The calling thread takes part in each job as worker 0,
+// so a pool of size 1 never starts a thread at all.
+class ThreadPool {
+  std::vector<std::thread> threads;
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::condition_variable done;
+
+  std::function<void(int)> job;
+  // Bumped for each job, so that a worker never runs the same one twice.
+  int generation = 0;
+  int running = 0;
+  bool stopping = false;
+
+  void loop(int id);
+public:
+  // `init` is called once on each new thread with its worker id, before any job.
+  ThreadPool(int size, std::function<void(int)> init = {});
+  ThreadPool(const ThreadPool &other) = delete;
+  ~ThreadPool();
+
+  int size() const { return threads.size() + 1; }
+
+  // Calls `fn(id)` on every worker at once, and waits until all of them return.
+  void run(std::function<void(int)> fn);
+};
+
+}
+
+#endif
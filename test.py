@@ -299,7 +299,14 @@ def run_test_case(sy_path: Path, in_path: Path, out_path: Path):
       commands.append("--arm")
     if args.verify:
       commands.append("--verify")
-    
+    # Some cases need options of their own, e.g. to turn on an opt-in pass.
+    flags_path = sy_path.with_name(f"{sy_path.stem}.flags")
+    if flags_path.exists():
+      commands.extend(flags_path.read_text().split())
+    # Only --profile reads it, unless there's also --compare.
+    if in_path:
+      commands.extend(["-i", str(in_path)])
+
     try:
       proc.run(
         commands,